@@ -20,12 +20,16 @@ extern "C"
 
     // client connect
 #define IVC_CONNECT_IOCTL 10
+    // connect many clients at once.
+#define IVC_CONNECT_BATCH_IOCTL 11
     // client disconnect
 #define IVC_DISCONNECT_IOCTL 20
     // fire remote event.
 #define IVC_NOTIFY_REMOTE_IOCTL 30
     // accept client connection.
 #define IVC_SERVER_ACCEPT_IOCTL 40
+    // accept many client connections at once.
+#define IVC_SERVER_ACCEPT_BATCH_IOCTL 41
     // register server listener on port.
 #define IVC_REG_SVR_LSNR_IOCTL 50
     // unregister server listener on port.
@@ -39,6 +43,8 @@ extern "C"
 #define IVC_MUNMAP_IOCTL  71
     // client recconnect
 #define IVC_RECONNECT_IOCTL 80
+    // release the remote, keeping the client's buffer for a later reconnect.
+#define IVC_PARK_IOCTL 81
 
 #ifdef	__cplusplus
 }
@@ -109,6 +109,161 @@ struct libivc_client *lookup_ivc_client(uint16_t domid, uint16_t port, uint64_t
     libivc_connect_with_id(struct libivc_client **ivc, uint16_t remote_dom_id, uint16_t remote_port, 
             uint32_t numPages, uint64_t connection_id);
 
+    /**
+     * Client style connection to a remote domain, where the remote is only granted
+     * read access to the shared buffer. The buffer may be shared with an existing
+     * connection rather than newly allocated, so that data written once can be read
+     * by several remotes. Such connections carry no ring; see libivc_broadcast.h.
+     * Remotes that can't map the buffer read only refuse the connection, which
+     * then fails with NOT_IMPLEMENTED.
+     *
+     * @param ivc - pointer to receive created connection into
+     * @param remote_dom_id - remote domain to connect to.
+     * @param remote_port - remote port to connect to.
+     * @param numPages - number of pages to share. Ignored if source is given.
+     * @param connection_id A unique number identifying the originator of the connection.
+     * @param source - a connected client-side client whose buffer should be shared,
+     *        or NULL to allocate a new buffer. The buffer stays valid until every
+     *        connection sharing it has disconnected.
+     *
+     * @return SUCCESS or appropriate error number.
+     */
+#ifdef _WIN32
+	__declspec(dllexport)
+#endif
+    int
+    libivc_connect_shared(struct libivc_client **ivc, uint16_t remote_dom_id, uint16_t remote_port,
+            uint32_t numPages, uint64_t connection_id, struct libivc_client *source);
+
+    /**
+     * Allocates and grants a buffer to a remote domain, as for a client-style
+     * connection, but doesn't connect to anything yet. Connect the client later
+     * with libivc_reconnect, which then only has to notify the remote; this takes
+     * setting up the buffer off the connection path. See also libivc_pool.h.
+     *
+     * @param ivc - pointer to receive the parked client.
+     * @param remote_dom_id - the domain the buffer is granted to. The client may
+     *        only be reconnected to servers in this domain.
+     * @param remote_port - the port recorded for the client until it is reconnected.
+     * @param numPages - number of pages to share.
+     * @param connection_id A unique number identifying the originator of the connection.
+     *
+     * @return SUCCESS or appropriate error number.
+     */
+#ifdef _WIN32
+	__declspec(dllexport)
+#endif
+    int
+    libivc_connect_parked(struct libivc_client **ivc, uint16_t remote_dom_id, uint16_t remote_port,
+            uint32_t numPages, uint64_t connection_id);
+
+    /**
+     * Client style connection to a remote domain with several lanes in each
+     * direction. Each lane has its own channel in the ring, so urgent messages
+     * on one lane aren't stuck behind bulk data on another. Lane 0 is the one
+     * libivc_send and libivc_recv use; the buffer is divided evenly between
+     * the lanes. The remote must also understand lanes; if it doesn't, the
+     * connection is refused and this fails with NOT_IMPLEMENTED.
+     *
+     * @param ivc - pointer to receive created connection into
+     * @param remote_dom_id - remote domain to connect to.
+     * @param remote_port - remote port to connect to.
+     * @param numPages - number of pages to share.
+     * @param connection_id A unique number identifying the originator of the connection.
+     * @param num_lanes - lanes in each direction, from 1 to LIBIVC_MAX_LANES.
+     *
+     * @return SUCCESS or appropriate error number.
+     */
+#ifdef _WIN32
+	__declspec(dllexport)
+#endif
+    int
+    libivc_connect_lanes(struct libivc_client **ivc, uint16_t remote_dom_id, uint16_t remote_port,
+            uint32_t numPages, uint64_t connection_id, uint8_t num_lanes);
+
+    /**
+     * Client style connections to many remotes at once. Every buffer is
+     * allocated and granted first, then the CONNECT requests are all sent
+     * before any ACK is waited for, so opening many connections costs about
+     * one handshake round trip rather than one each. Each connection succeeds
+     * or fails on its own.
+     *
+     * @param reqs - the connections to open.
+     * @param count - the number of connections.
+     * @param results - count entries, receiving each connection's client, or
+     *        NULL, and its status.
+     *
+     * @return SUCCESS once every result has been filled in, even if some of
+     *         the connections failed, or appropriate error number.
+     */
+#ifdef _WIN32
+	__declspec(dllexport)
+#endif
+    int
+    libivc_connect_many(const struct libivc_connect_req *reqs, uint32_t count,
+            struct libivc_connect_result *results);
+
+    /**
+     * Grows or shrinks the part of a connection's buffer its ring spans,
+     * without disconnecting. The ring can span any number of pages up to the
+     * size of the buffer granted when connecting, so connecting with a larger
+     * buffer than is needed at first leaves room to grow into. The remote is
+     * asked to stop using the ring, the data waiting in it is moved across to
+     * the new layout, and the remote then picks the new layout up on its next
+     * event. Only the client side of a connection can resize it, and only once
+     * both sides have called libivc_enable_resize. While the resize waits for
+     * the remote, sends and receives on this side return ERROR_AGAIN rather
+     * than blocking.
+     *
+     * Rings being accessed in place, with libivc_reserve or libivc_peek, on
+     * either side, must not be resized.
+     *
+     * @param client - the client side of a connection.
+     * @param numPages - the pages the ring should span, from 1 to the number granted.
+     *
+     * @return SUCCESS, NO_SPACE if the data in flight wouldn't fit, TIMED_OUT
+     *         if the remote didn't stop using the ring in time, ERROR_AGAIN
+     *         if the remote hasn't picked up the last resize yet or another
+     *         resize is under way, or appropriate error number. On failure the ring is left as it was.
+     */
+#ifdef _WIN32
+	__declspec(dllexport)
+#endif
+    int
+    libivc_resize(struct libivc_client *client, uint32_t numPages);
+
+    /**
+     * Lets a connection's ring be resized with libivc_resize. Both sides must
+     * call this, before the client side first resizes; until then, the server
+     * side ignores resize requests, as the ring's header may belong to some
+     * other layout. Connections whose buffer has been taken over by another
+     * layout, such as a heap or vring, can't be resized.
+     *
+     * @param client - either side of a connection.
+     *
+     * @return SUCCESS, INVALID_PARAM if the connection is read only or its buffer
+     *         has been taken over, or appropriate error number.
+     */
+#ifdef _WIN32
+	__declspec(dllexport)
+#endif
+    int
+    libivc_enable_resize(struct libivc_client *client);
+
+    /**
+     * Gets the number of pages a connection's ring spans; see libivc_resize.
+     *
+     * @param client - a connected client.
+     * @param numPages - receives the number of pages.
+     *
+     * @return SUCCESS or appropriate error number.
+     */
+#ifdef _WIN32
+	__declspec(dllexport)
+#endif
+    int
+    libivc_get_ring_pages(struct libivc_client *client, uint32_t *numPages);
+
 
     /**
      * Reconnects an existing client to a server. This is effectively the same logic and
@@ -125,6 +280,21 @@ struct libivc_client *lookup_ivc_client(uint16_t domid, uint16_t port, uint64_t
     int
     libivc_reconnect(struct libivc_client * client, uint16_t remote_dom_id, uint16_t remote_port);
 
+    /**
+     * Disconnects a client from its remote, but keeps its buffer granted so that
+     * it can be connected again with libivc_reconnect. Registered callbacks are
+     * dropped, as is any cork and partial large message state. This must not be
+     * called from the client's own callbacks.
+     *
+     * @param client - the client to park.
+     * @return SUCCESS or appropriate error number.
+     */
+#ifdef _WIN32
+	__declspec(dllexport)
+#endif
+    int
+    libivc_park(struct libivc_client *client);
+
 
     /**
      * Returns any connection identifier associated with the given display,
@@ -182,6 +352,31 @@ struct libivc_client *lookup_ivc_client(uint16_t domid, uint16_t port, uint64_t
         uint16_t listening_port, uint16_t listen_for_domid, uint64_t listen_for_client_id, 
         libivc_client_connected connectCallback, void *opaque);
 
+    /**
+     * As libivc_start_listening_server, but also sets how many connections may
+     * wait to be accepted. When a user space server falls behind, as when many
+     * guests reconnect at once, the driver refuses connections beyond this
+     * rather than queueing without bound. A refused remote's connect fails
+     * with CONNECTION_REFUSED, and it is up to the remote to try again.
+     *
+     * @param server - pointer to receive ivc server object.
+     * @param listening_port - port to listen for incoming connections on.
+     * @param listen_for_domid - the domain ID that the server should listen for, or LIBIVC_DOMID_ANY.
+     * @param listen_for_connection_id - the connection ID that the server should listen for, or LIBIVC_ID_ANY.
+     * @param accept_backlog - the most connections left waiting to be accepted, or 0 for
+     *    no limit.
+     * @param client_callback - callback to be notified of new client connections that have been fully established.
+     * @param opaque - A user-specified object that will be passed to any relevant callbacks.
+     * @return SUCCESS, or appropriate error number.
+     */
+#ifdef _WIN32
+	__declspec(dllexport)
+#endif
+    int
+    libivc_start_listening_server_backlog(struct libivc_server **server, 
+        uint16_t listening_port, uint16_t listen_for_domid, uint64_t listen_for_client_id, 
+        uint32_t accept_backlog, libivc_client_connected connectCallback, void *opaque);
+
 
     /**
      * Blocks until something is ready for the user to read.
@@ -263,6 +458,20 @@ struct libivc_client *lookup_ivc_client(uint16_t domid, uint16_t port, uint64_t
     int
     libivc_send(struct libivc_client *ivc, char *src, size_t srcSize);
 
+    /**
+     * As libivc_send, but writes to one of the client's lanes.
+     * @param ivc - A connected ivc struct.
+     * @param lane - the lane to write to.
+     * @param src - source buffer to write to the ivc connection.
+     * @param srcSize - size of the source buffer and exact amount to write.
+     * @return SUCCESS or appropriate error number.
+     */
+#ifdef _WIN32
+	__declspec(dllexport)
+#endif
+    int
+    libivc_send_lane(struct libivc_client *ivc, uint8_t lane, char *src, size_t srcSize);
+
     /**
      * Read as many bytes as possible up to destSize into buffer dest, returns how
      * many bytes were read.
@@ -292,6 +501,208 @@ struct libivc_client *lookup_ivc_client(uint16_t domid, uint16_t port, uint64_t
     int
     libivc_recv(struct libivc_client *ivc, char *dest, size_t destSize);
 
+    /**
+     * As libivc_recv, but reads from one of the client's lanes.
+     * @param ivc - connected ivc struct.
+     * @param lane - the lane to read from.
+     * @param dest - destination buffer to write to.
+     * @param destSize - size of dest, and the exact number of bytes required to read.
+     * @return SUCCESS, or appropriate error number.
+     */
+#ifdef _WIN32
+	__declspec(dllexport)
+#endif
+    int
+    libivc_recv_lane(struct libivc_client *ivc, uint8_t lane, char *dest, size_t destSize);
+
+    /**
+     * Picks the lane to read from next, among those with data waiting. Under
+     * LIBIVC_LANE_STRICT, the default, that's always the lowest numbered one;
+     * under LIBIVC_LANE_WEIGHTED, each is picked in proportion to its weight.
+     * @param client - connected ivc struct.
+     * @param lane - pointer to receive the lane.
+     * @return SUCCESS, NO_DATA_AVAIL if no lane has data waiting, or appropriate error number.
+     */
+#ifdef _WIN32
+	__declspec(dllexport)
+#endif
+    int
+    libivc_recv_next_lane(struct libivc_client *client, uint8_t *lane);
+
+    /**
+     * Sets how libivc_recv_next_lane picks among the client's lanes.
+     * @param client - connected ivc struct.
+     * @param policy - LIBIVC_LANE_STRICT or LIBIVC_LANE_WEIGHTED.
+     * @param weights - for LIBIVC_LANE_WEIGHTED, a non zero weight for each lane;
+     *    or NULL to weigh them all equally.
+     * @return SUCCESS or appropriate error number.
+     */
+#ifdef _WIN32
+	__declspec(dllexport)
+#endif
+    int
+    libivc_set_lane_policy(struct libivc_client *client, LANE_POLICY_T policy, const uint32_t *weights);
+
+    /**
+     * Gets the number of lanes the client has in each direction; 1 unless it
+     * was connected with libivc_connect_lanes.
+     * @param client - connected ivc struct.
+     * @param num_lanes - pointer to receive the number of lanes.
+     * @return SUCCESS or appropriate error number.
+     */
+#ifdef _WIN32
+	__declspec(dllexport)
+#endif
+    int
+    libivc_get_num_lanes(struct libivc_client *client, uint8_t *num_lanes);
+
+    /**
+     * Retrieves the amount of data available to read from one of the client's lanes.
+     * @param client - connected ivc struct.
+     * @param lane - the lane of interest.
+     * @param dataSize - pointer to receive the number of bytes.
+     * @return SUCCESS or appropriate error number.
+     */
+#ifdef _WIN32
+	__declspec(dllexport)
+#endif
+    int
+    libivc_lane_available_data(struct libivc_client *client, uint8_t lane, size_t *dataSize);
+
+    /**
+     * Streams a message of arbitrary size to the remote, which must receive it with
+     * libivc_recv_large. The message is written directly from src in as many pieces
+     * as the ring has space for, and the remote is notified as each piece is
+     * published, so the remote can consume while we produce.
+     *
+     * If the ring fills before the whole message is sent, ERROR_AGAIN is returned;
+     * call again with the same arguments (typically from the client's event callback,
+     * which fires as the remote drains the ring) to continue where it left off.
+     * src must remain valid until SUCCESS is returned.
+     * @param ivc - A connected ivc struct.
+     * @param src - the message to send.
+     * @param srcSize - size of the message.
+     * @return SUCCESS once the whole message has been sent, ERROR_AGAIN if more
+     *    remains to be sent, INVALID_PARAM if continuing a message with a
+     *    different size, or appropriate error number.
+     */
+#ifdef _WIN32
+	__declspec(dllexport)
+#endif
+    int
+    libivc_send_large(struct libivc_client *ivc, char *src, size_t srcSize);
+
+    /**
+     * Receives a message sent with libivc_send_large, reassembling it directly into
+     * the destination buffer as data arrives.
+     *
+     * If *dest is NULL, the library allocates a buffer of the right size once the
+     * message length is known; it is returned in *dest on SUCCESS and must be released
+     * with libivc_free_large. Otherwise, *dest must hold at least destSize bytes; if the
+     * message is larger, NO_SPACE is returned with the required size in *actualSize, and
+     * the call may be retried with a larger buffer.
+     *
+     * If the message has not fully arrived, ERROR_AGAIN is returned; call again with
+     * the same arguments to continue where it left off.
+     *
+     * The length comes from the remote, so messages longer than the client's limit
+     * (see libivc_set_max_large_message) are refused with INVALID_PARAM, and dropped
+     * by this and later calls as they arrive; the next message is received as usual.
+     * @param ivc - connected ivc struct.
+     * @param dest - pointer to the destination buffer, or to NULL to have one allocated.
+     * @param destSize - size of *dest, if provided.
+     * @param actualSize - pointer to receive the size of the message.
+     * @return SUCCESS once the whole message has been received, ERROR_AGAIN if more
+     *    remains to be received, INVALID_PARAM if the message is too long, or
+     *    appropriate error number.
+     */
+#ifdef _WIN32
+	__declspec(dllexport)
+#endif
+    int
+    libivc_recv_large(struct libivc_client *ivc, char **dest, size_t destSize, size_t *actualSize);
+
+    /**
+     * Releases a buffer allocated by libivc_recv_large.
+     * @param buffer - the buffer to release.
+     */
+#ifdef _WIN32
+	__declspec(dllexport)
+#endif
+    void
+    libivc_free_large(char *buffer);
+
+    /**
+     * Sets the longest message libivc_recv_large will accept on a client.
+     * @param ivc - an ivc struct.
+     * @param max_length - the limit, in bytes, or 0 for LIBIVC_DEFAULT_MAX_LARGE_MESSAGE.
+     * @return SUCCESS or appropriate error number.
+     */
+#ifdef _WIN32
+	__declspec(dllexport)
+#endif
+    int
+    libivc_set_max_large_message(struct libivc_client *ivc, uint64_t max_length);
+
+    /**
+     * Exposes the free space in the ring, so a message can be built or read
+     * into it in place rather than copied in by libivc_send. Nothing reaches
+     * the remote until libivc_commit is called, and no other send may be made
+     * on the client in between.
+     * @param ivc - a connected ivc struct.
+     * @param segments - receives up to two stretches of free space, in order;
+     *    the second has zero length unless the space wraps around the ring.
+     * @param available - pointer to receive the total free space.
+     * @return SUCCESS, NO_SPACE if the ring is full, or appropriate error number.
+     */
+#ifdef _WIN32
+	__declspec(dllexport)
+#endif
+    int
+    libivc_reserve(struct libivc_client *ivc, struct libivc_segment segments[2], size_t *available);
+
+    /**
+     * Publishes data written into space exposed by libivc_reserve, and
+     * notifies the remote as libivc_send would.
+     * @param ivc - a connected ivc struct.
+     * @param length - the number of bytes written, from the start of the first segment.
+     * @return SUCCESS or appropriate error number.
+     */
+#ifdef _WIN32
+	__declspec(dllexport)
+#endif
+    int
+    libivc_commit(struct libivc_client *ivc, size_t length);
+
+    /**
+     * Exposes the data waiting in the ring in place, so it can be used
+     * without being copied out by libivc_recv. Nothing is consumed until
+     * libivc_consume is called, and no other receive may be made on the
+     * client in between.
+     * @param ivc - a connected ivc struct.
+     * @param segments - receives up to two stretches of data, in order; the
+     *    second has zero length unless the data wraps around the ring.
+     * @param available - pointer to receive the total data waiting.
+     * @return SUCCESS, NO_DATA_AVAIL if the ring is empty, or appropriate error number.
+     */
+#ifdef _WIN32
+	__declspec(dllexport)
+#endif
+    int
+    libivc_peek(struct libivc_client *ivc, struct libivc_segment segments[2], size_t *available);
+
+    /**
+     * Marks data exposed by libivc_peek as read, freeing its space for the remote.
+     * @param ivc - a connected ivc struct.
+     * @param length - the number of bytes to consume, from the start of the first segment.
+     * @return SUCCESS or appropriate error number.
+     */
+#ifdef _WIN32
+	__declspec(dllexport)
+#endif
+    int
+    libivc_consume(struct libivc_client *ivc, size_t length);
+
 	/**
 	* Write as many bytes as possible up to srcLength from src to the ivc buffer
 	* and return how many bytes were successfully written in actualLength, without
@@ -465,6 +876,7 @@ struct libivc_client *lookup_ivc_client(uint16_t domid, uint16_t port, uint64_t
     /**
      * When the remote side sends or writes data to this client, tell it not to
      * fire remote events to us.  Usually you would do this when polling on data.
+     * This applies to every lane.
      * @param client Non null pointer to client.
      * @return SUCCESS or appropriate error number.
      */
@@ -476,7 +888,7 @@ struct libivc_client *lookup_ivc_client(uint16_t domid, uint16_t port, uint64_t
 
     /**
      * Let the remote domain know that you wish to receive events when it sends or
-     * writes data in the ring buffer.
+     * writes data in the ring buffer. This applies to every lane.
      * @param client Non null pointer to the client
      * @return SUCCESS or appropriate error number.
      */
@@ -486,9 +898,35 @@ struct libivc_client *lookup_ivc_client(uint16_t domid, uint16_t port, uint64_t
     int
     libivc_enable_events(struct libivc_client *client);
 
+    /**
+     * Tells the remote not to fire events at us for data sent on one lane; e.g.
+     * a bulk lane that is drained whenever an urgent lane's event arrives.
+     * @param client Non null pointer to client.
+     * @param lane - the lane of interest.
+     * @return SUCCESS or appropriate error number.
+     */
+#ifdef _WIN32
+	__declspec(dllexport)
+#endif
+    int
+    libivc_disable_lane_events(struct libivc_client *client, uint8_t lane);
+
+    /**
+     * Asks the remote to fire events at us for data sent on one lane.
+     * @param client Non null pointer to client.
+     * @param lane - the lane of interest.
+     * @return SUCCESS or appropriate error number.
+     */
+#ifdef _WIN32
+	__declspec(dllexport)
+#endif
+    int
+    libivc_enable_lane_events(struct libivc_client *client, uint8_t lane);
+
     /**
      * Checks to see if the remote side has enabled or disabled events.  If the client doesn't
      * have a remote buffer due to not being channeled, it will error.
+     * Events count as enabled if they are for any lane.
      * @param client - the client to check.
      * @param enabled - pointer to receive value into. non zero if enabled.
      * @return SUCCESS or appropriate error number.
@@ -510,6 +948,132 @@ struct libivc_client *lookup_ivc_client(uint16_t domid, uint16_t port, uint64_t
     int
     libivc_notify_remote(struct libivc_client *client);
 
+    /**
+     * Corks the client: data sent with libivc_send is still published to the ring
+     * immediately, but the remote is not notified until the client is flushed,
+     * uncorked, or one of the cork thresholds is crossed. Use this to batch a burst
+     * of small messages behind a single event. A send that finds the ring full
+     * notifies the remote straight away, so it can make room. Corks nest, so a
+     * library can cork around its own sends without ending its caller's cork.
+     * @param client Non null pointer to client.
+     * @return SUCCESS or appropriate error number.
+     */
+#ifdef _WIN32
+	__declspec(dllexport)
+#endif
+    int
+    libivc_cork(struct libivc_client *client);
+
+    /**
+     * Undoes one libivc_cork. Once the client is no longer corked at all, the
+     * remote is notified of any data published while it was.
+     * @param client Non null pointer to client.
+     * @return SUCCESS or appropriate error number.
+     */
+#ifdef _WIN32
+	__declspec(dllexport)
+#endif
+    int
+    libivc_uncork(struct libivc_client *client);
+
+    /**
+     * Notifies the remote of any data published since it was last notified, without
+     * changing whether the client is corked.
+     * @param client Non null pointer to client.
+     * @return SUCCESS or appropriate error number.
+     */
+#ifdef _WIN32
+	__declspec(dllexport)
+#endif
+    int
+    libivc_flush(struct libivc_client *client);
+
+    /**
+     * Sets the thresholds at which a corked client flushes automatically.
+     * The delay is checked on each send, and from the client's event thread,
+     * so it is honored within a few milliseconds even when the application
+     * stops sending. Only Linux userspace has such a thread, so elsewhere a
+     * delay can't be set.
+     * @param client Non null pointer to client.
+     * @param max_bytes - flush once this many bytes are pending, or 0 for no limit.
+     * @param max_delay_us - flush once data has been pending this many microseconds, or 0 for no limit.
+     * @return SUCCESS, NOT_IMPLEMENTED if a delay was given outside Linux
+     *    userspace, or appropriate error number.
+     */
+#ifdef _WIN32
+	__declspec(dllexport)
+#endif
+    int
+    libivc_set_cork_thresholds(struct libivc_client *client, uint32_t max_bytes, uint32_t max_delay_us);
+
+    /**
+     * Receives exactly destSize bytes, waiting up to timeout_ms for them to
+     * arrive. It first spins, with events disabled, for up to the limit set
+     * with libivc_set_recv_spin; then enables events and blocks until the
+     * remote fires one. How long it spins adapts to how far apart messages
+     * arrive. Intended for one receiving thread per client; callbacks are
+     * still called for events as usual. Like libivc_recv it reads the first
+     * lane, and leaves events for any other lanes as they were.
+     * @param ivc - connected ivc struct.
+     * @param dest - destination buffer to write to.
+     * @param destSize - size of dest, and the exact number of bytes required to read.
+     * @param timeout_ms - the longest to wait, in milliseconds.
+     * @return SUCCESS, TIMED_OUT, or appropriate error number.
+     */
+#ifdef _WIN32
+	__declspec(dllexport)
+#endif
+    int
+    libivc_recv_wait(struct libivc_client *ivc, char *dest, size_t destSize, uint32_t timeout_ms);
+
+    /**
+     * Sets the longest libivc_recv_wait may spin waiting for data before
+     * blocking. Spinning is off by default.
+     * @param ivc - connected ivc struct.
+     * @param max_spin_us - the longest to spin, in microseconds, or 0 to never spin.
+     * @return SUCCESS or appropriate error number.
+     */
+#ifdef _WIN32
+	__declspec(dllexport)
+#endif
+    int
+    libivc_set_recv_spin(struct libivc_client *ivc, uint32_t max_spin_us);
+
+    /**
+     * Sets a client's interrupt moderation policy. When events arrive faster
+     * than high_rate, the client disables events and polls the ring every
+     * interval_us instead, calling its event callbacks when new data has
+     * arrived; once data arrives on fewer than low_rate polls a second, it
+     * goes back to taking an event per message. Userspace only.
+     * @param client Non null pointer to client.
+     * @param high_rate - events per second above which to moderate, or 0 to never moderate.
+     * @param low_rate - arrivals per second below which to stop moderating. Must
+     *    be below high_rate, and below the number of polls a second interval_us allows.
+     * @param interval_us - while moderating, how often to poll the ring.
+     * @return SUCCESS or appropriate error number.
+     */
+#ifdef _WIN32
+	__declspec(dllexport)
+#endif
+    int
+    libivc_set_moderation(struct libivc_client *client, uint32_t high_rate, uint32_t low_rate,
+        uint32_t interval_us);
+
+    /**
+     * Gets a snapshot of a client's counters: traffic in each direction, sends
+     * and receives that found the ring full or empty, events in each direction,
+     * how long callbacks took to run, and how full each ring has been seen.
+     * The unsafe_ variants are not counted.
+     * @param client Non null pointer to client.
+     * @param stats Pointer to receive the counters.
+     * @return SUCCESS or appropriate error number.
+     */
+#ifdef _WIN32
+	__declspec(dllexport)
+#endif
+    int
+    libivc_get_stats(struct libivc_client *client, struct libivc_stats *stats);
+
 
 
   /**
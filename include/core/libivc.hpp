@@ -0,0 +1,774 @@
+//
+// IVC Driver
+//
+// Copyright (C) 2016 Assured Information Security, Inc. All rights reserved.
+//
+
+/*
+ * File:   libivc.hpp
+ * Header only C++17 interface to libivc. Connections and servers are move
+ * only handles that disconnect or shut down when they go out of scope, and an
+ * ivc::channel<T> carries fixed size messages of a trivially copyable type T,
+ * each sent and received with one reserve, copy and commit (or peek, copy and
+ * consume) on the ring, so there is no casting or size bookkeeping to get
+ * wrong. Spans over the ring's segments give zero copy access to the raw bytes.
+ *
+ * Errors from establishing a connection or server, and failures of the ring
+ * itself, are thrown as ivc::error, carrying the libivc error number. A full
+ * or empty ring is ordinary flow control, and is reported by return value.
+ * Userspace only.
+ */
+
+#ifndef LIBIVC_HPP
+#define	LIBIVC_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+#include <libivc.h>
+
+namespace ivc
+{
+
+/**
+ * A libivc call that failed, with its error number.
+ */
+class error : public std::runtime_error
+{
+public:
+    error(const char *what, int code)
+        : std::runtime_error(std::string(what) + " failed: " + std::to_string(code)), code_(code)
+    {
+    }
+
+    /**
+     * @return the libivc error number, such as INVALID_PARAM or ACCESS_DENIED.
+     */
+    int
+    code() const noexcept
+    {
+        return code_;
+    }
+
+private:
+    int code_;
+};
+
+namespace detail
+{
+
+inline void
+check(int rc, const char *what)
+{
+    if (rc != SUCCESS)
+        throw error(what, rc);
+}
+
+} // namespace detail
+
+/**
+ * A view of a contiguous run of objects, in the style of C++20's std::span.
+ */
+template <typename T>
+class span
+{
+public:
+    constexpr span() noexcept = default;
+
+    constexpr span(T *data, std::size_t size) noexcept : data_(data), size_(size)
+    {
+    }
+
+    template <std::size_t N>
+    constexpr span(T (&array)[N]) noexcept : data_(array), size_(N)
+    {
+    }
+
+    // Lets a span of T be passed where a span of const T is wanted.
+    template <typename U, typename = std::enable_if_t<std::is_convertible_v<U (*)[], T (*)[]>>>
+    constexpr span(const span<U> &other) noexcept : data_(other.data()), size_(other.size())
+    {
+    }
+
+    constexpr T *data() const noexcept { return data_; }
+    constexpr std::size_t size() const noexcept { return size_; }
+    constexpr std::size_t size_bytes() const noexcept { return size_ * sizeof(T); }
+    constexpr bool empty() const noexcept { return size_ == 0; }
+    constexpr T *begin() const noexcept { return data_; }
+    constexpr T *end() const noexcept { return data_ + size_; }
+    constexpr T &operator[](std::size_t index) const noexcept { return data_[index]; }
+
+    /**
+     * @return the view of count objects from offset, or of everything from
+     *    offset if count is larger than what's left.
+     */
+    constexpr span
+    subspan(std::size_t offset, std::size_t count = static_cast<std::size_t>(-1)) const noexcept
+    {
+        if (offset > size_)
+            offset = size_;
+        if (count > size_ - offset)
+            count = size_ - offset;
+        return span(data_ + offset, count);
+    }
+
+private:
+    T *data_ = nullptr;
+    std::size_t size_ = 0;
+};
+
+/**
+ * Free space or waiting data in a ring, in place, as exposed by reserve and
+ * peek. It takes two spans when it wraps around the end of the ring.
+ */
+struct segments
+{
+    span<char> first;                 // the stretch at the ring's current position.
+    span<char> second;                // the stretch wrapped to the start of the ring, often empty.
+
+    std::size_t
+    size() const noexcept
+    {
+        return first.size() + second.size();
+    }
+
+    /**
+     * Copies length bytes into the start of the segments, which must hold them.
+     */
+    void
+    copy_in(const void *src, std::size_t length) const noexcept
+    {
+        if (length <= first.size())
+        {
+            std::memcpy(first.data(), src, length);
+            return;
+        }
+
+        std::memcpy(first.data(), src, first.size());
+        std::memcpy(second.data(), static_cast<const char *>(src) + first.size(), length - first.size());
+    }
+
+    /**
+     * Copies length bytes out of the start of the segments, which must hold them.
+     */
+    void
+    copy_out(void *dest, std::size_t length) const noexcept
+    {
+        if (length <= first.size())
+        {
+            std::memcpy(dest, first.data(), length);
+            return;
+        }
+
+        std::memcpy(dest, first.data(), first.size());
+        std::memcpy(static_cast<char *>(dest) + first.size(), second.data(), length - first.size());
+    }
+};
+
+/**
+ * A non owning reference to a libivc client, as handed to event handlers.
+ * Copies refer to the same connection; it must outlive them.
+ */
+class client_ref
+{
+public:
+    client_ref() noexcept = default;
+
+    explicit client_ref(libivc_client *client) noexcept : client_(client)
+    {
+    }
+
+    /**
+     * @return the underlying client, for use with the C interface.
+     */
+    libivc_client *
+    get() const noexcept
+    {
+        return client_;
+    }
+
+    explicit operator bool() const noexcept
+    {
+        return client_ != nullptr;
+    }
+
+    uint16_t
+    remote_domid() const
+    {
+        uint16_t domid = 0;
+        detail::check(libivc_getRemoteDomId(client_, &domid), "libivc_getRemoteDomId");
+        return domid;
+    }
+
+    uint16_t
+    port() const
+    {
+        uint16_t port = 0;
+        detail::check(libivc_getport(client_, &port), "libivc_getport");
+        return port;
+    }
+
+    /**
+     * @return the number of bytes waiting to be received.
+     */
+    std::size_t
+    available_data() const
+    {
+        std::size_t size = 0;
+        detail::check(libivc_getAvailableData(client_, &size), "libivc_getAvailableData");
+        return size;
+    }
+
+    /**
+     * @return the number of bytes that can be sent right now.
+     */
+    std::size_t
+    available_space() const
+    {
+        std::size_t size = 0;
+        detail::check(libivc_getAvailableSpace(client_, &size), "libivc_getAvailableSpace");
+        return size;
+    }
+
+    /**
+     * Sends exactly length bytes, or nothing, as libivc_send.
+     * @return true if they were sent, false if the ring hasn't room for them.
+     */
+    bool
+    send_bytes(const void *src, std::size_t length) const
+    {
+        int rc = libivc_send(client_, static_cast<char *>(const_cast<void *>(src)), length);
+        if (rc == NO_SPACE)
+            return false;
+        detail::check(rc, "libivc_send");
+        return true;
+    }
+
+    /**
+     * Receives exactly length bytes, or nothing, as libivc_recv.
+     * @return true if they were received, false if fewer are waiting.
+     */
+    bool
+    recv_bytes(void *dest, std::size_t length) const
+    {
+        int rc = libivc_recv(client_, static_cast<char *>(dest), length);
+        if (rc == NO_DATA_AVAIL)
+            return false;
+        detail::check(rc, "libivc_recv");
+        return true;
+    }
+
+    /**
+     * Exposes the ring's free space in place. Nothing is sent until commit.
+     * @return the free space; empty if the ring is full.
+     */
+    segments
+    reserve() const
+    {
+        libivc_segment raw[2];
+        std::size_t available = 0;
+        int rc = libivc_reserve(client_, raw, &available);
+        if (rc == NO_SPACE)
+            return segments();
+        detail::check(rc, "libivc_reserve");
+        return segments{span<char>(raw[0].base, raw[0].length), span<char>(raw[1].base, raw[1].length)};
+    }
+
+    /**
+     * Publishes length bytes written at the start of the space from reserve.
+     */
+    void
+    commit(std::size_t length) const
+    {
+        detail::check(libivc_commit(client_, length), "libivc_commit");
+    }
+
+    /**
+     * Exposes the data waiting in the ring in place. Nothing is freed until consume.
+     * @return the data; empty if the ring is empty.
+     */
+    segments
+    peek() const
+    {
+        libivc_segment raw[2];
+        std::size_t available = 0;
+        int rc = libivc_peek(client_, raw, &available);
+        if (rc == NO_DATA_AVAIL)
+            return segments();
+        detail::check(rc, "libivc_peek");
+        return segments{span<char>(raw[0].base, raw[0].length), span<char>(raw[1].base, raw[1].length)};
+    }
+
+    /**
+     * Frees length bytes from the start of the data from peek.
+     */
+    void
+    consume(std::size_t length) const
+    {
+        detail::check(libivc_consume(client_, length), "libivc_consume");
+    }
+
+    /**
+     * Fires an event to the remote.
+     */
+    void
+    notify() const
+    {
+        detail::check(libivc_notify_remote(client_), "libivc_notify_remote");
+    }
+
+protected:
+    libivc_client *client_ = nullptr;
+};
+
+namespace detail
+{
+
+/**
+ * Runs a handler from one of libivc's threads. An exception can't unwind
+ * through libivc, so one that escapes the handler is dropped there.
+ */
+template <typename Handler, typename Arg>
+inline void
+run_handler(Handler &handler, Arg &&arg) noexcept
+{
+    if (!handler)
+        return;
+
+    try
+    {
+        handler(std::forward<Arg>(arg));
+    }
+    catch (...)
+    {
+        libivc_error("ivc: dropped an exception thrown by a handler.\n");
+    }
+}
+
+/**
+ * The handlers for a connection's events. Kept on the heap, since libivc
+ * holds a pointer to it while the connection object itself may move.
+ */
+struct client_state
+{
+    std::function<void(client_ref)> on_event;
+    std::function<void(client_ref)> on_disconnect;
+
+    static void
+    event_fired(void *opaque, libivc_client *client)
+    {
+        run_handler(static_cast<client_state *>(opaque)->on_event, client_ref(client));
+    }
+
+    static void
+    disconnected(void *opaque, libivc_client *client)
+    {
+        run_handler(static_cast<client_state *>(opaque)->on_disconnect, client_ref(client));
+    }
+};
+
+class server_state;
+
+} // namespace detail
+
+/**
+ * An owning handle to a connection, which is disconnected when the handle is
+ * destroyed. Move only.
+ */
+class connection : public client_ref
+{
+public:
+    connection() noexcept = default;
+
+    /**
+     * Takes ownership of a connected client.
+     */
+    explicit connection(libivc_client *client) noexcept : client_ref(client)
+    {
+    }
+
+    connection(const connection &) = delete;
+    connection &operator=(const connection &) = delete;
+
+    connection(connection &&other) noexcept
+        : client_ref(std::exchange(other.client_, nullptr)),
+          state_(std::move(other.state_)), server_(std::move(other.server_))
+    {
+    }
+
+    connection &
+    operator=(connection &&other) noexcept
+    {
+        if (this != &other)
+        {
+            close();
+            client_ = std::exchange(other.client_, nullptr);
+            state_ = std::move(other.state_);
+            server_ = std::move(other.server_);
+        }
+        return *this;
+    }
+
+    ~connection()
+    {
+        close();
+    }
+
+    /**
+     * Connects to a listening server, as libivc_connect_with_id.
+     * @param remote_domid - remote domain to connect to.
+     * @param port - remote port to connect to.
+     * @param num_pages - number of pages to share.
+     * @param connection_id - the connection's ID, or LIBIVC_ID_NONE.
+     * @return the connection; throws ivc::error if it couldn't be made.
+     */
+    static connection
+    connect(uint16_t remote_domid, uint16_t port, uint32_t num_pages,
+            uint64_t connection_id = LIBIVC_ID_NONE)
+    {
+        libivc_client *client = nullptr;
+        detail::check(libivc_connect_with_id(&client, remote_domid, port, num_pages, connection_id),
+                      "libivc_connect_with_id");
+        return connection(client);
+    }
+
+    /**
+     * Sets the handler run, on libivc's event thread, when the remote fires
+     * an event. Set handlers before the remote can fire any, and don't destroy
+     * the connection from inside one.
+     */
+    void
+    on_event(std::function<void(client_ref)> handler)
+    {
+        on_events(std::move(handler), state_ ? state_->on_disconnect : nullptr);
+    }
+
+    /**
+     * Sets the handler run, on libivc's event thread, when the remote disconnects.
+     */
+    void
+    on_disconnect(std::function<void(client_ref)> handler)
+    {
+        on_events(state_ ? state_->on_event : nullptr, std::move(handler));
+    }
+
+    /**
+     * Sets both handlers at once. The first time handlers are set they are in
+     * place before libivc can run them, so this is safe on a connection that
+     * may already be receiving events, as one just accepted.
+     */
+    void
+    on_events(std::function<void(client_ref)> event_handler,
+              std::function<void(client_ref)> disconnect_handler)
+    {
+        if (state_)
+        {
+            state_->on_event = std::move(event_handler);
+            state_->on_disconnect = std::move(disconnect_handler);
+            return;
+        }
+
+        auto state = std::make_unique<detail::client_state>();
+        state->on_event = std::move(event_handler);
+        state->on_disconnect = std::move(disconnect_handler);
+        detail::check(libivc_register_event_callbacks(client_, detail::client_state::event_fired,
+                          detail::client_state::disconnected, state.get()),
+                      "libivc_register_event_callbacks");
+        state_ = std::move(state);
+    }
+
+    /**
+     * Disconnects now, rather than when the handle is destroyed.
+     */
+    void
+    close() noexcept;
+
+private:
+    friend class detail::server_state;
+
+    std::unique_ptr<detail::client_state> state_;
+    std::shared_ptr<detail::server_state> server_; // set on connections a server accepted.
+};
+
+namespace detail
+{
+
+/**
+ * What a server shares with the connections it accepted. Shutting a server
+ * down disconnects them all, so each holds a reference on its client, and
+ * checks here before disconnecting it itself.
+ */
+class server_state
+{
+public:
+    std::function<void(connection)> on_connect;
+    std::mutex lock;
+    bool shut_down = false;
+
+    static void
+    connected(void *opaque, libivc_client *client)
+    {
+        auto *state = static_cast<server_state *>(opaque);
+        connection accepted(client);
+
+        libivc_get_client(client);
+        accepted.server_ = state->self.lock();
+        run_handler(state->on_connect, std::move(accepted));
+    }
+
+    std::weak_ptr<server_state> self;
+};
+
+} // namespace detail
+
+inline void
+connection::close() noexcept
+{
+    if (!client_)
+        return;
+
+    if (server_)
+    {
+        std::lock_guard<std::mutex> guard(server_->lock);
+        if (!server_->shut_down)
+            libivc_disconnect(client_);
+        libivc_put_client(client_);
+    }
+    else
+    {
+        libivc_disconnect(client_);
+    }
+
+    client_ = nullptr;
+    state_.reset();
+    server_.reset();
+}
+
+/**
+ * An owning handle to a listening server, which is shut down when the handle
+ * is destroyed. Move only. Connections it accepted may outlive it; they are
+ * disconnected when it shuts down, and their handles then only free them.
+ */
+class server
+{
+public:
+    server() noexcept = default;
+
+    /**
+     * Listens for connections, as libivc_start_listening_server_backlog.
+     * @param port - port to listen for connections on.
+     * @param on_connect - run, on libivc's server thread, with each new connection.
+     * @param remote_domid - the domain to accept connections from, or LIBIVC_DOMID_ANY.
+     * @param connection_id - the connection ID to accept, or LIBIVC_ID_ANY.
+     * @param backlog - the most connections left waiting to be accepted, or 0 for the default.
+     * Throws ivc::error if the server couldn't be started.
+     */
+    server(uint16_t port, std::function<void(connection)> on_connect,
+           uint16_t remote_domid = LIBIVC_DOMID_ANY, uint64_t connection_id = LIBIVC_ID_ANY,
+           uint32_t backlog = 0)
+        : state_(std::make_shared<detail::server_state>())
+    {
+        state_->on_connect = std::move(on_connect);
+        state_->self = state_;
+        detail::check(libivc_start_listening_server_backlog(&server_, port, remote_domid, connection_id,
+                          backlog, detail::server_state::connected, state_.get()),
+                      "libivc_start_listening_server_backlog");
+    }
+
+    server(const server &) = delete;
+    server &operator=(const server &) = delete;
+
+    server(server &&other) noexcept
+        : server_(std::exchange(other.server_, nullptr)), state_(std::move(other.state_))
+    {
+    }
+
+    server &
+    operator=(server &&other) noexcept
+    {
+        if (this != &other)
+        {
+            shutdown();
+            server_ = std::exchange(other.server_, nullptr);
+            state_ = std::move(other.state_);
+        }
+        return *this;
+    }
+
+    ~server()
+    {
+        shutdown();
+    }
+
+    /**
+     * @return the underlying server, for use with the C interface.
+     */
+    libivc_server *
+    get() const noexcept
+    {
+        return server_;
+    }
+
+    explicit operator bool() const noexcept
+    {
+        return server_ != nullptr;
+    }
+
+    /**
+     * Stops listening and disconnects every connection accepted, now rather
+     * than when the handle is destroyed.
+     */
+    void
+    shutdown() noexcept
+    {
+        if (!server_)
+            return;
+
+        {
+            std::lock_guard<std::mutex> guard(state_->lock);
+            state_->shut_down = true;
+        }
+
+        libivc_shutdownIvcServer(server_);
+        server_ = nullptr;
+        state_.reset();
+    }
+
+private:
+    libivc_server *server_ = nullptr;
+    std::shared_ptr<detail::server_state> state_;
+};
+
+/**
+ * A connection carrying fixed size messages of type T, which is copied to and
+ * from the ring byte for byte, and so must mean the same to both ends: a
+ * trivially copyable type with no pointers, laid out the same by both
+ * compilers. Move only.
+ */
+template <typename T>
+class channel
+{
+    static_assert(std::is_trivially_copyable_v<T>, "ivc::channel messages are copied as bytes");
+    static_assert(!std::is_pointer_v<T>, "ivc::channel messages can't carry pointers to another domain");
+    static_assert(sizeof(T) <= 0x7FFFFFFF, "ivc::channel messages must fit in a ring");
+
+public:
+    using value_type = T;
+
+    channel() noexcept = default;
+
+    explicit channel(connection conn) noexcept : conn_(std::move(conn))
+    {
+    }
+
+    /**
+     * Sends one message.
+     * @return true if it was sent, false if the ring hasn't room for it.
+     */
+    bool
+    send(const T &message)
+    {
+        segments space = conn_.reserve();
+        if (space.size() < sizeof(T))
+            return false;
+
+        space.copy_in(&message, sizeof(T));
+        conn_.commit(sizeof(T));
+        return true;
+    }
+
+    /**
+     * Sends as many of the messages as fit, in order, with a single notification.
+     * @return the number sent.
+     */
+    std::size_t
+    send(span<const T> messages)
+    {
+        segments space = conn_.reserve();
+        std::size_t count = space.size() / sizeof(T);
+
+        if (count > messages.size())
+            count = messages.size();
+        if (count == 0)
+            return 0;
+
+        space.copy_in(messages.data(), count * sizeof(T));
+        conn_.commit(count * sizeof(T));
+        return count;
+    }
+
+    /**
+     * Receives one message.
+     * @return true if one was received, false if none has fully arrived.
+     */
+    bool
+    try_recv(T &message)
+    {
+        segments data = conn_.peek();
+        if (data.size() < sizeof(T))
+            return false;
+
+        data.copy_out(&message, sizeof(T));
+        conn_.consume(sizeof(T));
+        return true;
+    }
+
+    /**
+     * Receives as many messages as have arrived, up to the size of messages.
+     * @return the number received.
+     */
+    std::size_t
+    try_recv(span<T> messages)
+    {
+        segments data = conn_.peek();
+        std::size_t count = data.size() / sizeof(T);
+
+        if (count > messages.size())
+            count = messages.size();
+        if (count == 0)
+            return 0;
+
+        data.copy_out(messages.data(), count * sizeof(T));
+        conn_.consume(count * sizeof(T));
+        return count;
+    }
+
+    /**
+     * @return the number of whole messages waiting to be received.
+     */
+    std::size_t
+    pending() const
+    {
+        return conn_.available_data() / sizeof(T);
+    }
+
+    /**
+     * @return the connection the messages travel over.
+     */
+    connection &
+    conn() noexcept
+    {
+        return conn_;
+    }
+
+    const connection &
+    conn() const noexcept
+    {
+        return conn_;
+    }
+
+private:
+    connection conn_;
+};
+
+} // namespace ivc
+
+#endif	/* LIBIVC_HPP */
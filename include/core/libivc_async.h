@@ -0,0 +1,93 @@
+//
+// IVC Driver
+//
+// Copyright (C) 2016 Assured Information Security, Inc. All rights reserved.
+//
+
+/*
+ * File:   libivc_async.h
+ * Non-blocking connects. libivc_connect_with_id blocks until the remote has
+ * answered, so applications that open many connections at once would
+ * otherwise wait for each handshake in turn. Asynchronous connects are carried
+ * out by a small set of worker threads, so that several can be in flight at
+ * once; each completes either through a callback, or through a file
+ * descriptor that can be polled alongside the application's own. Userspace only.
+ */
+
+#ifndef LIBIVC_ASYNC_H
+#define	LIBIVC_ASYNC_H
+
+#ifdef	__cplusplus
+extern "C"
+{
+#endif
+
+#include <libivc.h>
+
+/**
+ * The most worker threads that carry out connects at once.
+ */
+#define LIBIVC_ASYNC_CONNECT_WORKERS 8
+
+struct libivc_connect_op;
+
+/**
+ * Called, on a worker thread, when an asynchronous connect completes.
+ * @param opaque - the opaque pointer passed to libivc_connect_async.
+ * @param status - SUCCESS, or the error the connect failed with.
+ * @param client - the connected client, now owned by the callback; or NULL if
+ *    the connect failed.
+ */
+typedef void (*libivc_connect_completion)(void *opaque, int status, struct libivc_client *client);
+
+    /**
+     * Starts connecting to a remote server, and returns without waiting for the
+     * remote to answer. Exactly one of op and callback must be given.
+     * @param op - pointer to receive a handle for the connect, to be polled with
+     *    libivc_connect_async_fd and completed with libivc_connect_async_finish;
+     *    or NULL if callback is given.
+     * @param remote_dom_id - remote domain to connect to.
+     * @param remote_port - remote port to connect to.
+     * @param numPages - number of pages to share.
+     * @param connection_id - as for libivc_connect_with_id.
+     * @param callback - called when the connect completes; or NULL if op is given.
+     * @param opaque - A user-specified object that will be passed to callback.
+     * @return SUCCESS if the connect was started, or appropriate error number.
+     */
+    int
+    libivc_connect_async(struct libivc_connect_op **op, uint16_t remote_dom_id, uint16_t remote_port,
+        uint32_t numPages, uint64_t connection_id, libivc_connect_completion callback, void *opaque);
+
+    /**
+     * Gets a file descriptor that becomes readable once a connect completes. It
+     * remains valid until the connect is finished or cancelled.
+     * @param op - the connect of interest.
+     * @return the file descriptor, or -1 on error.
+     */
+    int
+    libivc_connect_async_fd(struct libivc_connect_op *op);
+
+    /**
+     * Collects the result of a connect. Once this has returned anything other
+     * than ERROR_AGAIN, the handle has been freed.
+     * @param op - the connect of interest.
+     * @param client - pointer to receive the connected client.
+     * @return SUCCESS, ERROR_AGAIN if the connect is still in progress, or the
+     *    error the connect failed with.
+     */
+    int
+    libivc_connect_async_finish(struct libivc_connect_op *op, struct libivc_client **client);
+
+    /**
+     * Abandons a connect. If it has completed, or completes later, successfully,
+     * the connection is closed. The handle is freed.
+     * @param op - the connect to abandon.
+     */
+    void
+    libivc_connect_async_cancel(struct libivc_connect_op *op);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* LIBIVC_ASYNC_H */
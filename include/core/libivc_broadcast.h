@@ -0,0 +1,198 @@
+//
+// IVC Driver
+//
+// Copyright (C) 2016 Assured Information Security, Inc. All rights reserved.
+//
+
+/*
+ * File:   libivc_broadcast.h
+ * One-to-many publishing over shared memory. The publisher writes each message
+ * once, into a single region that is granted read only to every subscriber, so
+ * the cost of publishing doesn't grow with the number of subscribers.
+ *
+ * Each subscriber also has a small private control connection, over which it
+ * reports how far it has read. The publisher won't overwrite anything the
+ * slowest subscriber hasn't read yet; and only wakes subscribers that have
+ * caught up and are waiting for more.
+ *
+ * As the publisher grants out its memory, it connects to each subscriber: the
+ * subscriber listens with libivc_broadcast_listen, and the publisher calls
+ * libivc_broadcast_add_subscriber. Subscribers only see messages published after
+ * they were added. Callbacks run on the connections' event threads. Userspace only.
+ */
+
+#ifndef LIBIVC_BROADCAST_H
+#define	LIBIVC_BROADCAST_H
+
+#ifdef	__cplusplus
+extern "C"
+{
+#endif
+
+#include <libivc.h>
+
+struct libivc_broadcast;
+struct libivc_broadcast_subscriber;
+struct libivc_broadcast_listener;
+struct libivc_subscription;
+
+/**
+ * Called on the publisher once a publish that failed with NO_SPACE may succeed,
+ * because the slowest subscriber has read further or gone away.
+ */
+typedef void (*libivc_broadcast_writable)(void *opaque, struct libivc_broadcast *broadcast);
+
+/**
+ * Called on a subscriber for each new subscription. The subscription is ready
+ * to be read from.
+ */
+typedef void (*libivc_broadcast_subscribed)(void *opaque, struct libivc_broadcast_listener *listener,
+    struct libivc_subscription *subscription);
+
+/**
+ * Called on a subscriber when new messages may be available.
+ */
+typedef void (*libivc_subscription_event)(void *opaque, struct libivc_subscription *subscription);
+
+/**
+ * Called on a subscriber when the publisher goes away. Messages already published
+ * may still be read; the subscription must then be closed.
+ */
+typedef void (*libivc_subscription_closed)(void *opaque, struct libivc_subscription *subscription);
+
+    /**
+     * Creates a publisher. Its shared region is allocated when the first
+     * subscriber is added.
+     * @param broadcast - pointer to receive the new publisher.
+     * @param numPages - the size of the shared region, in pages.
+     * @param writableCallback - called when a publish that failed with NO_SPACE
+     *    should be retried, or NULL.
+     * @param opaque - A user-specified object that will be passed to writableCallback.
+     * @return SUCCESS or appropriate error number.
+     */
+    int
+    libivc_broadcast_create(struct libivc_broadcast **broadcast, uint32_t numPages,
+        libivc_broadcast_writable writableCallback, void *opaque);
+
+    /**
+     * Disconnects every subscriber and destroys the publisher.
+     * @param broadcast - the publisher to destroy.
+     */
+    void
+    libivc_broadcast_destroy(struct libivc_broadcast *broadcast);
+
+    /**
+     * Connects to a subscriber listening with libivc_broadcast_listen, and
+     * shares the publisher's region with it.
+     * @param broadcast - the publisher.
+     * @param remote_dom_id - the subscriber's domain.
+     * @param remote_port - the port the subscriber is listening on.
+     * @param connection_id - identifies this publisher to the subscriber; must
+     *    be unique between the two domains and port.
+     * @param subscriber - pointer to receive the new subscriber, or NULL.
+     * @return SUCCESS or appropriate error number.
+     */
+    int
+    libivc_broadcast_add_subscriber(struct libivc_broadcast *broadcast, uint16_t remote_dom_id,
+        uint16_t remote_port, uint64_t connection_id, struct libivc_broadcast_subscriber **subscriber);
+
+    /**
+     * Disconnects a subscriber. Subscribers that disconnect themselves are removed
+     * automatically.
+     * @param broadcast - the publisher.
+     * @param subscriber - the subscriber to remove.
+     * @return SUCCESS or appropriate error number.
+     */
+    int
+    libivc_broadcast_remove_subscriber(struct libivc_broadcast *broadcast,
+        struct libivc_broadcast_subscriber *subscriber);
+
+    /**
+     * Gets the number of connected subscribers.
+     * @param broadcast - the publisher.
+     * @return the number of subscribers.
+     */
+    uint32_t
+    libivc_broadcast_subscriber_count(struct libivc_broadcast *broadcast);
+
+    /**
+     * Publishes a message to every subscriber. With no subscribers, the message
+     * is dropped.
+     * @param broadcast - the publisher.
+     * @param src - the message to publish.
+     * @param length - the length of the message; at most a little under half the region.
+     * @return SUCCESS, NO_SPACE if the slowest subscriber hasn't read enough to make
+     *    room for the message, or appropriate error number.
+     */
+    int
+    libivc_broadcast_publish(struct libivc_broadcast *broadcast, char *src, uint32_t length);
+
+    /**
+     * Listens for publishers to subscribe to.
+     * @param listener - pointer to receive the new listener.
+     * @param port - the port to listen on.
+     * @param subscribedCallback - called for each new subscription.
+     * @param opaque - A user-specified object that will be passed to subscribedCallback.
+     * @return SUCCESS or appropriate error number.
+     */
+    int
+    libivc_broadcast_listen(struct libivc_broadcast_listener **listener, uint16_t port,
+        libivc_broadcast_subscribed subscribedCallback, void *opaque);
+
+    /**
+     * Stops listening. Subscriptions already made are unaffected, and must be
+     * closed separately.
+     * @param listener - the listener to shut down.
+     */
+    void
+    libivc_broadcast_shutdown(struct libivc_broadcast_listener *listener);
+
+    /**
+     * Registers callbacks for a subscription.
+     * @param subscription - the subscription of interest.
+     * @param eventCallback - called when new messages may be available.
+     * @param closedCallback - called when the publisher goes away.
+     * @param opaque - A user-specified object that will be passed to the callbacks.
+     * @return SUCCESS or appropriate error number.
+     */
+    int
+    libivc_subscription_register_callbacks(struct libivc_subscription *subscription,
+        libivc_subscription_event eventCallback, libivc_subscription_closed closedCallback,
+        void *opaque);
+
+    /**
+     * Reads the next message from a subscription.
+     * @param subscription - the subscription to read from.
+     * @param dest - buffer to receive the message.
+     * @param destSize - size of the buffer.
+     * @param actualSize - pointer to receive the length of the message.
+     * @return SUCCESS, NO_DATA_AVAIL if there are no new messages, NO_SPACE if the
+     *    next message is larger than destSize (actualSize receives its length),
+     *    NOT_CONNECTED if the publisher has gone and every message has been read,
+     *    or appropriate error number.
+     */
+    int
+    libivc_subscription_recv(struct libivc_subscription *subscription, char *dest, size_t destSize,
+        size_t *actualSize);
+
+    /**
+     * Gets the domain of a subscription's publisher.
+     * @param subscription - the subscription of interest.
+     * @return the publisher's domain ID.
+     */
+    uint16_t
+    libivc_subscription_get_remote_domid(struct libivc_subscription *subscription);
+
+    /**
+     * Disconnects from the publisher and frees a subscription. This must not be
+     * called from the subscription's own callbacks.
+     * @param subscription - the subscription to close.
+     */
+    void
+    libivc_subscription_close(struct libivc_subscription *subscription);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* LIBIVC_BROADCAST_H */
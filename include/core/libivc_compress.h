@@ -0,0 +1,159 @@
+//
+// IVC Driver
+//
+// Copyright (C) 2016 Assured Information Security, Inc. All rights reserved.
+//
+
+/*
+ * File:   libivc_compress.h
+ * Payload compression on top of an established libivc client. Messages are
+ * compressed with a small LZ77 block codec before they're written to the ring,
+ * so compressible data (telemetry, frames with large flat areas) takes up less
+ * of the ring and of the granted pages.
+ *
+ * Each message is framed with an eight byte header giving the length of the
+ * frame's body and the message's original length, with the top bit of the
+ * latter set if the body is compressed. Messages smaller than the compressor's
+ * threshold, and messages that don't shrink, are sent raw. Every frame must
+ * fit in the ring. Both ends of the connection must use a compressor.
+ * Userspace only.
+ */
+
+#ifndef LIBIVC_COMPRESS_H
+#define	LIBIVC_COMPRESS_H
+
+#ifdef	__cplusplus
+extern "C"
+{
+#endif
+
+#include <libivc.h>
+
+/**
+ * Messages smaller than this are sent raw unless the caller chooses otherwise.
+ */
+#define LIBIVC_COMPRESS_DEFAULT_THRESHOLD 256
+
+/**
+ * The size of the header in front of every frame.
+ */
+#define LIBIVC_COMPRESS_HEADER_SIZE 8
+
+struct libivc_compressor;
+
+/**
+ * Counters for one compressor, as returned by libivc_compress_get_stats. The
+ * ratio of raw to wire bytes is the factor by which compression stretches the
+ * ring.
+ */
+struct libivc_compress_stats
+{
+    uint64_t messages_sent;           // messages sent, compressed or not.
+    uint64_t messages_compressed;     // of those, the ones sent compressed.
+    uint64_t raw_bytes_sent;          // the messages' own lengths.
+    uint64_t wire_bytes_sent;         // bytes written to the ring, headers included.
+    uint64_t messages_received;       // messages received.
+    uint64_t raw_bytes_received;      // the messages' own lengths.
+    uint64_t wire_bytes_received;     // bytes read from the ring, headers included.
+};
+
+    /**
+     * Gets the largest output libivc_lz_compress can produce for a given input.
+     * @param srcSize - the length of the input.
+     * @return the worst case length of the output.
+     */
+    size_t
+    libivc_lz_bound(size_t srcSize);
+
+    /**
+     * Compresses a block.
+     * @param src - the data to compress.
+     * @param srcSize - the length of the data.
+     * @param dst - buffer to receive the compressed data.
+     * @param dstCapacity - the size of dst. If the output would be larger,
+     *    compression stops and NO_SPACE is returned.
+     * @param written - pointer to receive the length of the compressed data.
+     * @return SUCCESS or appropriate error number.
+     */
+    int
+    libivc_lz_compress(const char *src, size_t srcSize, char *dst, size_t dstCapacity,
+        size_t *written);
+
+    /**
+     * Decompresses a block produced by libivc_lz_compress. Corrupt input is
+     * detected rather than overrunning either buffer.
+     * @param src - the compressed data.
+     * @param srcSize - the length of the compressed data.
+     * @param dst - buffer to receive the original data.
+     * @param dstCapacity - the size of dst.
+     * @param written - pointer to receive the length of the original data.
+     * @return SUCCESS, or INVALID_PARAM if the input is corrupt or doesn't fit dst.
+     */
+    int
+    libivc_lz_decompress(const char *src, size_t srcSize, char *dst, size_t dstCapacity,
+        size_t *written);
+
+    /**
+     * Creates a compressor on top of a connected client. Both ends of the
+     * connection should create one; the client should then only be used
+     * through it.
+     * @param cz - pointer to receive the new compressor.
+     * @param client - a connected ivc client.
+     * @param threshold - messages smaller than this are sent raw; 0 compresses
+     *    everything, LIBIVC_COMPRESS_DEFAULT_THRESHOLD is a reasonable choice.
+     * @return SUCCESS or appropriate error number.
+     */
+    int
+    libivc_compress_create(struct libivc_compressor **cz, struct libivc_client *client,
+        uint32_t threshold);
+
+    /**
+     * Destroys a compressor. The client is left connected.
+     * @param cz - the compressor to destroy.
+     */
+    void
+    libivc_compress_destroy(struct libivc_compressor *cz);
+
+    /**
+     * Sends a message, compressed if that's worthwhile. As with libivc_send,
+     * the message is written entirely or not at all.
+     * @param cz - the compressor.
+     * @param src - the message to send.
+     * @param srcSize - the length of the message.
+     * @return SUCCESS, NO_SPACE if the ring doesn't have room for the frame
+     *    right now, or appropriate error number.
+     */
+    int
+    libivc_compress_send(struct libivc_compressor *cz, char *src, size_t srcSize);
+
+    /**
+     * Receives a message, decompressing it if needed.
+     * @param cz - the compressor.
+     * @param dest - buffer to receive the message.
+     * @param destSize - the size of dest.
+     * @param actualSize - pointer to receive the length of the message. If
+     *    NO_SPACE is returned, this is the size dest needs to be.
+     * @return SUCCESS, NO_DATA_AVAIL if no message has arrived, NO_SPACE if
+     *    dest is too small (the message is kept for the next call),
+     *    INVALID_PARAM if the message was malformed or corrupt (it is dropped,
+     *    and the next call moves on to the following message), or appropriate
+     *    error number.
+     */
+    int
+    libivc_compress_recv(struct libivc_compressor *cz, char *dest, size_t destSize,
+        size_t *actualSize);
+
+    /**
+     * Gets a snapshot of a compressor's counters.
+     * @param cz - the compressor.
+     * @param stats - pointer to receive the counters.
+     * @return SUCCESS or appropriate error number.
+     */
+    int
+    libivc_compress_get_stats(struct libivc_compressor *cz, struct libivc_compress_stats *stats);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* LIBIVC_COMPRESS_H */
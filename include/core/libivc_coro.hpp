@@ -0,0 +1,729 @@
+//
+// IVC Driver
+//
+// Copyright (C) 2016 Assured Information Security, Inc. All rights reserved.
+//
+
+/*
+ * File:   libivc_coro.hpp
+ * Header only C++20 coroutine interface to libivc, on top of libivc.hpp.
+ * Receives, sends and accepts are awaited rather than driven from callbacks:
+ *
+ *     ivc::event_loop loop;
+ *     ivc::async_server server(port, loop);
+ *     ...
+ *     ivc::async_connection conn = co_await server.accept();
+ *     co_await conn.recv(request);
+ *     co_await conn.send(reply);
+ *
+ * An awaited operation that can complete straight away does so without
+ * suspending. Otherwise the coroutine is parked on the connection until
+ * libivc delivers an event for it, and is then resumed on the executor the
+ * connection was created with; no user code runs on libivc's event threads.
+ * Any executor with a post(std::function<void()>) member will do, such as the
+ * single threaded ivc::event_loop below or a work stealing pool, and a
+ * coroutine may resume on a different thread than it suspended on.
+ *
+ * Sends and receives move exactly the bytes given, like libivc_send and
+ * libivc_recv, so a message is never split; each must fit in the ring. A
+ * connection may have one receive and one send outstanding at a time, and a
+ * server one accept. Once either end disconnects, outstanding and later
+ * operations throw ivc::error with NOT_CONNECTED. Both ends should use this
+ * interface, or otherwise notify the remote after receiving, so that senders
+ * waiting for space are woken. Userspace only.
+ */
+
+#ifndef LIBIVC_CORO_HPP
+#define	LIBIVC_CORO_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <coroutine>
+#include <deque>
+#include <type_traits>
+
+#include <libivc.hpp>
+
+namespace ivc
+{
+
+/**
+ * An executor coroutines are resumed on.
+ */
+template <typename E>
+concept executor = requires(E &e, std::function<void()> work) { e.post(std::move(work)); };
+
+/**
+ * A single threaded executor: work posted to it runs, in order, on whichever
+ * thread calls run.
+ */
+class event_loop
+{
+public:
+    /**
+     * Queues work to run on the loop. Thread safe.
+     */
+    void
+    post(std::function<void()> work)
+    {
+        {
+            std::lock_guard<std::mutex> guard(lock_);
+            queue_.push_back(std::move(work));
+        }
+        ready_.notify_one();
+    }
+
+    /**
+     * Runs posted work until stop is called.
+     */
+    void
+    run()
+    {
+        std::unique_lock<std::mutex> guard(lock_);
+
+        while (!stopped_)
+        {
+            if (queue_.empty())
+            {
+                ready_.wait(guard);
+                continue;
+            }
+
+            std::function<void()> work = std::move(queue_.front());
+            queue_.pop_front();
+
+            guard.unlock();
+            work();
+            guard.lock();
+        }
+
+        stopped_ = false;
+    }
+
+    /**
+     * Runs whatever work has been posted, without waiting for more.
+     * @return the number of items run.
+     */
+    std::size_t
+    poll()
+    {
+        std::size_t count = 0;
+
+        for (;;)
+        {
+            std::function<void()> work;
+            {
+                std::lock_guard<std::mutex> guard(lock_);
+                if (queue_.empty())
+                    return count;
+                work = std::move(queue_.front());
+                queue_.pop_front();
+            }
+
+            work();
+            count++;
+        }
+    }
+
+    /**
+     * Makes run return once the work it's running is done. Thread safe.
+     */
+    void
+    stop()
+    {
+        {
+            std::lock_guard<std::mutex> guard(lock_);
+            stopped_ = true;
+        }
+        ready_.notify_all();
+    }
+
+private:
+    std::mutex lock_;
+    std::condition_variable ready_;
+    std::deque<std::function<void()>> queue_;
+    bool stopped_ = false;
+};
+
+/**
+ * The return type of a coroutine that runs on its own, with nothing awaiting
+ * it. It starts straight away; an exception that escapes it is logged and
+ * dropped.
+ */
+struct detached
+{
+    struct promise_type
+    {
+        detached get_return_object() noexcept { return {}; }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() noexcept {}
+
+        void
+        unhandled_exception() noexcept
+        {
+            libivc_error("ivc: dropped an exception that escaped a detached coroutine.\n");
+        }
+    };
+};
+
+namespace detail
+{
+
+/**
+ * Where a suspended operation waits to be resumed. An operation parks itself
+ * in a slot; whoever takes it out, the event that makes the operation
+ * possible or the operation itself on finding it already is, is the one to
+ * resume it, so it's resumed exactly once.
+ */
+class wait_slot
+{
+public:
+    /**
+     * Parks a coroutine, unless the operation it's waiting for turns out to
+     * be possible already.
+     * @param handle - the coroutine.
+     * @param ready - checks whether the operation is possible; it must not
+     *    refer to the coroutine's frame, which may already have been resumed
+     *    elsewhere by the time it's called.
+     * @return true if the coroutine is parked, false if it should carry on.
+     */
+    template <typename Ready>
+    bool
+    park(std::coroutine_handle<> handle, Ready &&ready)
+    {
+        handle_.store(handle.address(), std::memory_order_release);
+
+        // Anything that happened before we parked had no one to wake, so look again.
+        if (ready())
+            return handle_.exchange(nullptr, std::memory_order_acq_rel) == nullptr;
+
+        return true;
+    }
+
+    /**
+     * Takes out the coroutine parked here, if any.
+     * @return its handle, or a null handle.
+     */
+    std::coroutine_handle<>
+    take() noexcept
+    {
+        return std::coroutine_handle<>::from_address(handle_.exchange(nullptr, std::memory_order_acq_rel));
+    }
+
+private:
+    std::atomic<void *> handle_{nullptr};
+};
+
+/**
+ * What an async connection shares with libivc's event thread and with the
+ * work it posts. Held by shared pointer, so it outlives any work in flight.
+ * The client is only touched under the lock, and not at all once closed, as
+ * closing may race with work running on another of the executor's threads.
+ */
+struct async_state : std::enable_shared_from_this<async_state>
+{
+    libivc_client *client = nullptr;
+    std::function<void(std::function<void()>)> post;
+    std::mutex lock;
+    bool closed = false;
+    wait_slot recv_waiter;
+    std::size_t recv_wanted = 0;      // bytes the parked receive is waiting for.
+    wait_slot send_waiter;
+    std::size_t send_wanted = 0;      // space the parked send is waiting for.
+
+    // Both of these are called with the lock held.
+    bool
+    can_recv(std::size_t wanted) const noexcept
+    {
+        std::size_t available = 0;
+        return closed || (libivc_getAvailableData(client, &available) == SUCCESS && available >= wanted);
+    }
+
+    bool
+    can_send(std::size_t wanted) const noexcept
+    {
+        std::size_t space = 0;
+        return closed || (libivc_getAvailableSpace(client, &space) == SUCCESS && space >= wanted);
+    }
+
+    /**
+     * Parks a coroutine until the operation it's waiting for is possible.
+     * @return true if the coroutine is parked, false if it should carry on.
+     */
+    bool
+    park_recv(std::coroutine_handle<> handle, std::size_t wanted)
+    {
+        std::lock_guard<std::mutex> guard(lock);
+
+        if (can_recv(wanted))
+            return false;
+
+        // Make sure the remote tells us when it sends.
+        recv_wanted = wanted;
+        libivc_enable_events(client);
+        return recv_waiter.park(handle, [this, wanted] { return can_recv(wanted); });
+    }
+
+    bool
+    park_send(std::coroutine_handle<> handle, std::size_t wanted)
+    {
+        std::lock_guard<std::mutex> guard(lock);
+
+        if (can_send(wanted))
+            return false;
+
+        send_wanted = wanted;
+        libivc_enable_events(client);
+        return send_waiter.park(handle, [this, wanted] { return can_send(wanted); });
+    }
+
+    /**
+     * Hands the parked operations to the executor, to resume them if they can
+     * now go ahead or park them again if not. Called for each event, so
+     * doesn't touch the client.
+     */
+    void
+    wake() noexcept
+    {
+        auto self = shared_from_this();
+        std::coroutine_handle<> handle;
+
+        if ((handle = recv_waiter.take()))
+        {
+            run_handler(post, [self, handle] {
+                if (!self->park_recv(handle, self->recv_wanted))
+                    handle.resume();
+            });
+        }
+
+        if ((handle = send_waiter.take()))
+        {
+            run_handler(post, [self, handle] {
+                if (!self->park_send(handle, self->send_wanted))
+                    handle.resume();
+            });
+        }
+    }
+
+    void
+    close() noexcept
+    {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            closed = true;
+        }
+        wake();
+    }
+};
+
+/**
+ * What an async server shares with libivc's server thread: the connections
+ * accepted but not yet collected.
+ */
+struct async_server_state : std::enable_shared_from_this<async_server_state>
+{
+    std::function<void(std::function<void()>)> post;
+    std::mutex lock;
+    std::deque<connection> accepted;
+    bool closed = false;
+    wait_slot accept_waiter;
+
+    bool
+    can_accept()
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        return closed || !accepted.empty();
+    }
+
+    bool
+    park_accept(std::coroutine_handle<> handle)
+    {
+        return accept_waiter.park(handle, [this] { return can_accept(); });
+    }
+
+    void
+    wake() noexcept
+    {
+        auto self = shared_from_this();
+        std::coroutine_handle<> handle = accept_waiter.take();
+
+        if (handle)
+        {
+            run_handler(post, [self, handle] {
+                if (!self->park_accept(handle))
+                    handle.resume();
+            });
+        }
+    }
+};
+
+} // namespace detail
+
+/**
+ * A connection whose receives and sends are awaited. Move only; it
+ * disconnects when destroyed, and any operation still outstanding then throws.
+ */
+class async_connection
+{
+public:
+    async_connection() noexcept = default;
+
+    /**
+     * Takes over a connection; its event handlers are replaced.
+     * @param conn - the connection.
+     * @param exec - the executor to resume coroutines on. It must outlive the connection.
+     */
+    template <executor Executor>
+    async_connection(connection conn, Executor &exec)
+        : conn_(std::move(conn)), state_(std::make_shared<detail::async_state>())
+    {
+        Executor *target = &exec;
+
+        state_->client = conn_.get();
+        state_->post = [target](std::function<void()> work) { target->post(std::move(work)); };
+
+        std::weak_ptr<detail::async_state> weak = state_;
+        conn_.on_events(
+            [weak](client_ref) {
+                if (auto state = weak.lock())
+                    state->wake();
+            },
+            [weak](client_ref) {
+                if (auto state = weak.lock())
+                    state->close();
+            });
+    }
+
+    async_connection(async_connection &&) noexcept = default;
+
+    async_connection &
+    operator=(async_connection &&other) noexcept
+    {
+        if (this != &other)
+        {
+            close();
+            conn_ = std::move(other.conn_);
+            state_ = std::move(other.state_);
+        }
+        return *this;
+    }
+
+    ~async_connection()
+    {
+        close();
+    }
+
+    /**
+     * Connects to a listening server, as ivc::connection::connect. The connect
+     * itself blocks; see libivc_async.h for connects that don't.
+     */
+    template <executor Executor>
+    static async_connection
+    connect(Executor &exec, uint16_t remote_domid, uint16_t port, uint32_t num_pages,
+            uint64_t connection_id = LIBIVC_ID_NONE)
+    {
+        return async_connection(connection::connect(remote_domid, port, num_pages, connection_id), exec);
+    }
+
+    /**
+     * Receives exactly buffer.size() bytes.
+     * @return an awaitable that completes once they're received.
+     */
+    auto
+    recv(span<char> buffer)
+    {
+        struct awaiter
+        {
+            std::shared_ptr<detail::async_state> state;
+            span<char> buffer;
+
+            bool
+            await_ready()
+            {
+                std::lock_guard<std::mutex> guard(state->lock);
+                return state->can_recv(buffer.size());
+            }
+
+            bool
+            await_suspend(std::coroutine_handle<> handle)
+            {
+                return state->park_recv(handle, buffer.size());
+            }
+
+            void
+            await_resume()
+            {
+                std::lock_guard<std::mutex> guard(state->lock);
+                if (state->closed)
+                    throw error("ivc::async_connection::recv", NOT_CONNECTED);
+
+                uint8_t enabled = 0;
+
+                if (!client_ref(state->client).recv_bytes(buffer.data(), buffer.size()))
+                    throw error("ivc::async_connection::recv", INTERNAL_ERROR);
+
+                // Let a sender that is waiting on ring space know we've made some.
+                libivc_remote_events_enabled(state->client, &enabled);
+                if (enabled)
+                    libivc_notify_remote(state->client);
+            }
+        };
+
+        check_open("ivc::async_connection::recv");
+        return awaiter{state_, buffer};
+    }
+
+    /**
+     * Sends exactly buffer.size() bytes, as one message.
+     * @return an awaitable that completes once they're sent.
+     */
+    auto
+    send(span<const char> buffer)
+    {
+        struct awaiter
+        {
+            std::shared_ptr<detail::async_state> state;
+            span<const char> buffer;
+
+            bool
+            await_ready()
+            {
+                std::lock_guard<std::mutex> guard(state->lock);
+                return state->can_send(buffer.size());
+            }
+
+            bool
+            await_suspend(std::coroutine_handle<> handle)
+            {
+                return state->park_send(handle, buffer.size());
+            }
+
+            void
+            await_resume()
+            {
+                std::lock_guard<std::mutex> guard(state->lock);
+                if (state->closed)
+                    throw error("ivc::async_connection::send", NOT_CONNECTED);
+
+                if (!client_ref(state->client).send_bytes(buffer.data(), buffer.size()))
+                    throw error("ivc::async_connection::send", INTERNAL_ERROR);
+            }
+        };
+
+        check_open("ivc::async_connection::send");
+        return awaiter{state_, buffer};
+    }
+
+    /**
+     * Receives one message of a trivially copyable type, as ivc::channel.
+     */
+    template <typename T>
+    auto
+    recv(T &message)
+    {
+        static_assert(std::is_trivially_copyable_v<T>, "messages are copied as bytes");
+        return recv(span<char>(reinterpret_cast<char *>(&message), sizeof(T)));
+    }
+
+    /**
+     * Sends one message of a trivially copyable type, as ivc::channel.
+     */
+    template <typename T>
+    auto
+    send(const T &message)
+    {
+        static_assert(std::is_trivially_copyable_v<T>, "messages are copied as bytes");
+        return send(span<const char>(reinterpret_cast<const char *>(&message), sizeof(T)));
+    }
+
+    /**
+     * @return the underlying connection.
+     */
+    connection &
+    conn() noexcept
+    {
+        return conn_;
+    }
+
+    explicit operator bool() const noexcept
+    {
+        return static_cast<bool>(conn_);
+    }
+
+    /**
+     * Disconnects now, rather than when the handle is destroyed. Outstanding
+     * operations are resumed, on the executor, and throw.
+     */
+    void
+    close() noexcept
+    {
+        if (!state_)
+            return;
+
+        // Stop anything on the executor using the client before it goes.
+        {
+            std::lock_guard<std::mutex> guard(state_->lock);
+            state_->closed = true;
+        }
+        conn_.close();
+        state_->wake();
+        state_.reset();
+    }
+
+private:
+    void
+    check_open(const char *what)
+    {
+        if (!state_)
+            throw error(what, NOT_CONNECTED);
+
+        std::lock_guard<std::mutex> guard(state_->lock);
+        if (state_->closed)
+            throw error(what, NOT_CONNECTED);
+    }
+
+    connection conn_;
+    std::shared_ptr<detail::async_state> state_;
+};
+
+/**
+ * A listening server whose connections are awaited. Move only; it shuts down
+ * when destroyed, and an accept still outstanding then throws.
+ */
+class async_server
+{
+public:
+    async_server() noexcept = default;
+
+    /**
+     * Listens for connections, as ivc::server.
+     * @param port - port to listen for connections on.
+     * @param exec - the executor to resume coroutines on, and to hand to the
+     *    connections accepted. It must outlive them all.
+     * @param remote_domid - the domain to accept connections from, or LIBIVC_DOMID_ANY.
+     * @param connection_id - the connection ID to accept, or LIBIVC_ID_ANY.
+     * @param backlog - the most connections left waiting to be accepted, or 0 for the default.
+     */
+    template <executor Executor>
+    async_server(uint16_t port, Executor &exec, uint16_t remote_domid = LIBIVC_DOMID_ANY,
+                 uint64_t connection_id = LIBIVC_ID_ANY, uint32_t backlog = 0)
+        : state_(std::make_shared<detail::async_server_state>())
+    {
+        Executor *target = &exec;
+        std::weak_ptr<detail::async_server_state> weak = state_;
+
+        state_->post = [target](std::function<void()> work) { target->post(std::move(work)); };
+        wrap_ = [target](connection conn) { return async_connection(std::move(conn), *target); };
+
+        server_ = server(port,
+            [weak](connection conn) {
+                auto state = weak.lock();
+                if (!state)
+                    return;
+
+                {
+                    std::lock_guard<std::mutex> guard(state->lock);
+                    state->accepted.push_back(std::move(conn));
+                }
+                state->wake();
+            },
+            remote_domid, connection_id, backlog);
+    }
+
+    async_server(async_server &&) noexcept = default;
+
+    async_server &
+    operator=(async_server &&other) noexcept
+    {
+        if (this != &other)
+        {
+            shutdown();
+            server_ = std::move(other.server_);
+            state_ = std::move(other.state_);
+            wrap_ = std::move(other.wrap_);
+        }
+        return *this;
+    }
+
+    ~async_server()
+    {
+        shutdown();
+    }
+
+    /**
+     * Accepts the next connection.
+     * @return an awaitable that completes with an async_connection on the
+     *    server's executor.
+     */
+    auto
+    accept()
+    {
+        struct awaiter
+        {
+            std::shared_ptr<detail::async_server_state> state;
+            std::function<async_connection(connection)> wrap;
+
+            bool
+            await_ready()
+            {
+                return state->can_accept();
+            }
+
+            bool
+            await_suspend(std::coroutine_handle<> handle)
+            {
+                return state->park_accept(handle);
+            }
+
+            async_connection
+            await_resume()
+            {
+                connection conn;
+                {
+                    std::lock_guard<std::mutex> guard(state->lock);
+                    if (state->accepted.empty())
+                        throw error("ivc::async_server::accept", NOT_CONNECTED);
+                    conn = std::move(state->accepted.front());
+                    state->accepted.pop_front();
+                }
+
+                return wrap(std::move(conn));
+            }
+        };
+
+        if (!state_)
+            throw error("ivc::async_server::accept", NOT_CONNECTED);
+        return awaiter{state_, wrap_};
+    }
+
+    /**
+     * Stops listening, and disconnects every connection accepted, now rather
+     * than when the handle is destroyed. An outstanding accept is resumed, on
+     * the executor, and throws.
+     */
+    void
+    shutdown() noexcept
+    {
+        if (!state_)
+            return;
+
+        server_.shutdown();
+        {
+            std::lock_guard<std::mutex> guard(state_->lock);
+            state_->closed = true;
+            state_->accepted.clear();
+        }
+        state_->wake();
+        state_.reset();
+    }
+
+private:
+    server server_;
+    std::shared_ptr<detail::async_server_state> state_;
+    std::function<async_connection(connection)> wrap_;
+};
+
+} // namespace ivc
+
+#endif	/* LIBIVC_CORO_HPP */
@@ -24,6 +24,7 @@ extern "C"
 #ifndef KERNEL
 #include <errno.h>
 #include <stdio.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
@@ -52,6 +53,7 @@ extern "C"
 #else
 #ifdef KERNEL
 #include <ntddk.h>
+#include "wintypes.h"
 #ifndef true
 #define true TRUE
 #define false FALSE
@@ -73,6 +75,34 @@ extern "C"
 #define __PRETTY_FUNCTION__ __FUNCTION__
 #endif
 
+    ///
+    /// Log levels, most severe first.
+    ///
+#define LIBIVC_LOG_ERROR 0
+#define LIBIVC_LOG_WARN  1
+#define LIBIVC_LOG_INFO  2
+#define LIBIVC_LOG_DEBUG 3
+
+    ///
+    /// Define LIBIVC_LOG_LEVEL in your settings to compile out every message
+    /// less severe than it. The arguments of compiled out messages are still
+    /// type checked, but never evaluated.
+    ///
+#ifndef LIBIVC_LOG_LEVEL
+#define LIBIVC_LOG_LEVEL LIBIVC_LOG_DEBUG
+#endif
+
+    ///
+    /// Wraps a message at the given level, compiling it out if the level is
+    /// less severe than LIBIVC_LOG_LEVEL.
+    ///
+#define LIBIVC_LOG_AT(level, stmt) \
+    do { \
+        if ((level) <= LIBIVC_LOG_LEVEL) { \
+            stmt; \
+        } \
+    } while (0)
+
 
     ///
     /// Define TAG in your settings if you want a custom TAG provided in the debug
@@ -261,7 +291,7 @@ extern "C"
     /// syslog instead of using printf. Use these functions just like
     /// printf.
     ///
-#define libivc_info(...) LIBIVC_ERROR(TAG ": INFO: " __VA_ARGS__)
+#define libivc_info(...) LIBIVC_LOG_AT(LIBIVC_LOG_INFO, LIBIVC_ERROR(TAG ": INFO: " __VA_ARGS__))
 
     ///
     /// This function provide a wrapped printf (warn). You can also define SYSLOG
@@ -269,7 +299,7 @@ extern "C"
     /// syslog instead of using printf. Use these functions just like
     /// printf.
     ///
-#define libivc_warn(...) LIBIVC_ERROR(TAG ": WARNING: " __VA_ARGS__)
+#define libivc_warn(...) LIBIVC_LOG_AT(LIBIVC_LOG_WARN, LIBIVC_ERROR(TAG ": WARNING: " __VA_ARGS__))
 
     ///
     /// This function provide a wrapped printf (error). You can also define SYSLOG
@@ -277,7 +307,7 @@ extern "C"
     /// syslog instead of using printf. Use these functions just like
     /// printf.
     ///
-#define libivc_error(...) LIBIVC_ERROR(TAG ": ERROR: " __VA_ARGS__)
+#define libivc_error(...) LIBIVC_LOG_AT(LIBIVC_LOG_ERROR, LIBIVC_ERROR(TAG ": ERROR: " __VA_ARGS__))
 
     ///
     /// This function provide a wrapped printf (error). You can also define SYSLOG
@@ -286,9 +316,157 @@ extern "C"
     /// printf.
     ///
 #define libivc_debug(...) \
-    if (libivc_debug_is_enabled() == true) { \
-        LIBIVC_ERROR(TAG ": DEBUG: " __VA_ARGS__); \
-    }
+    LIBIVC_LOG_AT(LIBIVC_LOG_DEBUG, \
+        if (libivc_debug_is_enabled() == true) { \
+            LIBIVC_ERROR(TAG ": DEBUG: " __VA_ARGS__); \
+        })
+
+    ///
+    /// Per-callsite state for rate limited messages. Updated without locking,
+    /// so under contention the counts are approximate; that's all a rate limit
+    /// needs.
+    ///
+    struct libivc_ratelimit
+    {
+        uint64_t window_start;  // when the current window began, in milliseconds.
+        uint32_t printed;       // messages printed in the current window.
+        uint32_t suppressed;    // messages suppressed in the current window.
+    };
+
+    ///
+    /// At most this many messages are printed from one callsite per interval.
+    ///
+#define LIBIVC_RATELIMIT_BURST 10
+#define LIBIVC_RATELIMIT_INTERVAL_MS 5000
+
+    ///
+    /// Decides whether a rate limited message may be printed. You should not use
+    /// this directly, but instead use one of the _ratelimited macros.
+    ///
+    /// @param state the callsite's state
+    /// @param suppressed receives the number of messages suppressed since the
+    ///        last one printed, if any
+    /// @return true = the message may be printed
+    ///
+#ifdef _WIN32
+	__declspec(dllexport)
+#endif
+    bool libivc_ratelimit_check(struct libivc_ratelimit *state, uint32_t *suppressed);
+
+#define LIBIVC_RATELIMITED(print, ...) \
+    do { \
+        static struct libivc_ratelimit __libivc_rl; \
+        uint32_t __libivc_suppressed = 0; \
+        if (libivc_ratelimit_check(&__libivc_rl, &__libivc_suppressed)) { \
+            if (__libivc_suppressed) \
+                print("%u similar messages suppressed.\n", __libivc_suppressed); \
+            print(__VA_ARGS__); \
+        } \
+    } while (0)
+
+    ///
+    /// Rate limited versions of the above, for anything that can repeat at the
+    /// rate the application sends or receives. Each callsite is limited
+    /// separately.
+    ///
+#define libivc_info_ratelimited(...) \
+    LIBIVC_LOG_AT(LIBIVC_LOG_INFO, LIBIVC_RATELIMITED(libivc_info, __VA_ARGS__))
+#define libivc_warn_ratelimited(...) \
+    LIBIVC_LOG_AT(LIBIVC_LOG_WARN, LIBIVC_RATELIMITED(libivc_warn, __VA_ARGS__))
+#define libivc_error_ratelimited(...) \
+    LIBIVC_LOG_AT(LIBIVC_LOG_ERROR, LIBIVC_RATELIMITED(libivc_error, __VA_ARGS__))
+
+    ///
+    /// A message recorded in the binary log ring. Records are stored unformatted;
+    /// the format takes each of the four arguments as a long long, in order.
+    ///
+    struct libivc_log_record
+    {
+        uint64_t timestamp;     // when the message was recorded, in milliseconds.
+        const char *format;     // the message's format string, which must be a literal.
+        int64_t args[4];        // the message's arguments.
+        uint32_t level;         // one of the LIBIVC_LOG_ levels.
+    };
+
+    ///
+    /// The number of records the binary log ring holds. Must be a power of two.
+    /// Once it's full, further records are dropped until it's drained.
+    ///
+#define LIBIVC_LOG_RING_SIZE 256
+
+    ///
+    /// Receives records drained from the binary log ring.
+    ///
+    typedef void (*libivc_log_sink)(void *opaque, const struct libivc_log_record *record);
+
+    ///
+    /// Records a message in the binary log ring, without locking or formatting
+    /// it. You should not use this directly, but instead use one of the _hot
+    /// macros.
+    ///
+#ifdef _WIN32
+	__declspec(dllexport)
+#endif
+    void libivc_log_record(uint32_t level, const char *format, int64_t a0, int64_t a1,
+                           int64_t a2, int64_t a3);
+
+    ///
+    /// Hands every record in the binary log ring to sink, oldest first, and
+    /// removes it. Only one thread may drain at a time.
+    ///
+    /// @param sink receives each record
+    /// @param opaque passed to sink
+    /// @param dropped receives the number of records dropped since the last
+    ///        drain because the ring was full; may be NULL
+    /// @return the number of records drained
+    ///
+#ifdef _WIN32
+	__declspec(dllexport)
+#endif
+    uint32_t libivc_log_drain(libivc_log_sink sink, void *opaque, uint32_t *dropped);
+
+    ///
+    /// The following tells the _hot macros whether to record to the binary
+    /// log ring
+    ///
+    /// @return true = the binary log ring is enabled
+    ///
+#ifdef _WIN32
+	__declspec(dllexport)
+#endif
+    bool libivc_log_ring_is_enabled(void);
+
+    ///
+    /// The following enables / disables the binary log ring. It's disabled by
+    /// default; while disabled, _hot messages are printed, rate limited.
+    ///
+    /// @param enabled true = record _hot messages to the binary log ring
+    ///
+#ifdef _WIN32
+	__declspec(dllexport)
+#endif
+    void libivc_log_ring_set_enabled(bool enabled);
+
+    ///
+    /// Messages for the hot paths: recorded to the binary log ring if it's
+    /// enabled, to be formatted and printed by whoever drains it, or printed
+    /// rate limited otherwise. The format must be a literal taking exactly four
+    /// long long arguments (%lld, %llx, ...).
+    ///
+#define LIBIVC_HOT(level, print, format, a0, a1, a2, a3) \
+    LIBIVC_LOG_AT(level, \
+        if (libivc_log_ring_is_enabled()) { \
+            libivc_log_record(level, format, (int64_t)(a0), (int64_t)(a1), \
+                              (int64_t)(a2), (int64_t)(a3)); \
+        } else { \
+            LIBIVC_RATELIMITED(print, format, (long long)(a0), (long long)(a1), \
+                               (long long)(a2), (long long)(a3)); \
+        })
+
+#define libivc_warn_hot(format, a0, a1, a2, a3) \
+    LIBIVC_HOT(LIBIVC_LOG_WARN, libivc_warn, format, a0, a1, a2, a3)
+#define libivc_error_hot(format, a0, a1, a2, a3) \
+    LIBIVC_HOT(LIBIVC_LOG_ERROR, libivc_error, format, a0, a1, a2, a3)
 
     ///
     /// Helpful for debugging issues
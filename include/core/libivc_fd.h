@@ -0,0 +1,75 @@
+//
+// IVC Driver
+//
+// Copyright (C) 2016 Assured Information Security, Inc. All rights reserved.
+//
+
+/*
+ * File:   libivc_fd.h
+ * Streaming between file descriptors and a connection's ring. Data is read
+ * from the file straight into free space in the ring, and written to the file
+ * straight out of the data waiting in it, with one preadv or pwritev per
+ * chunk, so it never passes through a user buffer.
+ *
+ * A transfer moves a raw stream of bytes, with no framing; both ends must
+ * agree on its length, for instance through an earlier message. Each chunk is
+ * published (or freed) as soon as it's done, so the remote works on one chunk
+ * while the next is being read. Neither call blocks on the ring: when it
+ * fills or empties they return ERROR_AGAIN, and should be called again with
+ * the same arguments, typically from the client's event callback, to pick up
+ * where they left off. Userspace only.
+ */
+
+#ifndef LIBIVC_FD_H
+#define	LIBIVC_FD_H
+
+#ifdef	__cplusplus
+extern "C"
+{
+#endif
+
+#include <libivc.h>
+
+/**
+ * The most either call moves through the ring before publishing it.
+ */
+#define LIBIVC_FD_CHUNK (64 * 1024)
+
+    /**
+     * Streams data from a file descriptor to the remote.
+     * @param client - a connected ivc client.
+     * @param fd - the file descriptor to read from.
+     * @param offset - the offset in the file the transfer starts at, or -1 to
+     *    read from the descriptor's current position, as for pipes and sockets.
+     * @param length - the number of bytes to transfer.
+     * @param transferred - the number of bytes transferred so far. Set it to
+     *    zero to start a transfer; each call adds to it.
+     * @return SUCCESS once length bytes have been sent, ERROR_AGAIN if the
+     *    ring filled or the descriptor would block, NO_DATA_AVAIL if the file
+     *    ended first, or appropriate error number.
+     */
+    int
+    libivc_send_from_fd(struct libivc_client *client, int fd, int64_t offset, size_t length,
+        size_t *transferred);
+
+    /**
+     * Streams data from the remote to a file descriptor.
+     * @param client - a connected ivc client.
+     * @param fd - the file descriptor to write to.
+     * @param offset - the offset in the file the transfer starts at, or -1 to
+     *    write at the descriptor's current position, as for pipes and sockets.
+     * @param length - the number of bytes to transfer.
+     * @param transferred - the number of bytes transferred so far. Set it to
+     *    zero to start a transfer; each call adds to it.
+     * @return SUCCESS once length bytes have been written, ERROR_AGAIN if the
+     *    ring emptied or the descriptor would block, or appropriate error number.
+     */
+    int
+    libivc_recv_to_fd(struct libivc_client *client, int fd, int64_t offset, size_t length,
+        size_t *transferred);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* LIBIVC_FD_H */
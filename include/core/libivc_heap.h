@@ -0,0 +1,163 @@
+//
+// IVC Driver
+//
+// Copyright (C) 2016 Assured Information Security, Inc. All rights reserved.
+//
+
+/*
+ * File:   libivc_heap.h
+ * Zero-copy object exchange through a connection's shared buffer. Rather than
+ * copying messages through a byte ring, the producing side allocates objects
+ * directly in the shared buffer, fills them in, and passes the consumer a
+ * small handle; the consumer reads the object in place, and hands the handle
+ * back through a return queue once it's done with it.
+ *
+ * The buffer starts, past the few bytes libivc keeps for itself, with a header
+ * holding two queues of handles, one in each direction; the rest is the heap. The heap is a slab allocator: it's cut into
+ * equal slabs, each of which holds objects of one power of two size class. All
+ * of the allocator's bookkeeping lives in the producer's private memory, so
+ * nothing the consumer writes can corrupt it, and handles coming back from the
+ * consumer are checked before they're freed.
+ *
+ * A handle is the object's offset in the buffer in its top 32 bits, and the
+ * length the producer asked for in its bottom 32, so it means the same in both
+ * domains. The heap takes over the whole buffer, so the client must then only
+ * be used through it: no sends or receives, and enabling or disabling events
+ * no longer changes anything. Only the producer notifies the remote; the
+ * consumer registers its own event callbacks on the client, once the heap is
+ * created, and drains handles from them. Userspace only.
+ */
+
+#ifndef LIBIVC_HEAP_H
+#define	LIBIVC_HEAP_H
+
+#ifdef	__cplusplus
+extern "C"
+{
+#endif
+
+#include <libivc.h>
+
+/**
+ * The number of handles each of the two queues holds.
+ */
+#define LIBIVC_HEAP_QUEUE_SLOTS 128
+
+/**
+ * The smallest object size class.
+ */
+#define LIBIVC_HEAP_MIN_OBJECT 64
+
+/**
+ * Gets the offset of an object in the shared buffer from its handle.
+ */
+#define LIBIVC_HEAP_HANDLE_OFFSET(handle) ((uint32_t)((handle) >> 32))
+
+/**
+ * Gets the length of an object from its handle.
+ */
+#define LIBIVC_HEAP_HANDLE_LENGTH(handle) ((uint32_t)((handle) & 0xFFFFFFFF))
+
+struct libivc_heap;
+
+    /**
+     * Creates a heap over a connected client's buffer. One side of the
+     * connection must be the producer, and the other the consumer.
+     * @param heap - pointer to receive the new heap.
+     * @param client - a connected ivc client, whose buffer must be at least
+     *    two pages.
+     * @param producer - non zero on the side that allocates objects.
+     * @return SUCCESS or appropriate error number.
+     */
+    int
+    libivc_heap_create(struct libivc_heap **heap, struct libivc_client *client, uint8_t producer);
+
+    /**
+     * Destroys a heap. The client is left connected.
+     * @param heap - the heap to destroy.
+     */
+    void
+    libivc_heap_destroy(struct libivc_heap *heap);
+
+    /**
+     * Gets the largest object the heap can allocate.
+     * @param heap - the heap of interest.
+     * @return the size of the largest object, in bytes.
+     */
+    size_t
+    libivc_heap_max_object(struct libivc_heap *heap);
+
+    /**
+     * Allocates an object. Producer only. Handles the consumer has returned
+     * are freed first.
+     * @param heap - the heap to allocate from.
+     * @param size - the size of the object, at most libivc_heap_max_object.
+     * @param handle - pointer to receive the object's handle.
+     * @return SUCCESS, NO_SPACE if the heap is full, or appropriate error number.
+     */
+    int
+    libivc_heap_alloc(struct libivc_heap *heap, size_t size, uint64_t *handle);
+
+    /**
+     * Frees an object that was never submitted, or that the consumer has
+     * returned by some other means. Producer only.
+     * @param heap - the heap the object belongs to.
+     * @param handle - the object's handle.
+     * @return SUCCESS, or INVALID_PARAM if the handle isn't an allocated object.
+     */
+    int
+    libivc_heap_free(struct libivc_heap *heap, uint64_t handle);
+
+    /**
+     * Gets the address of an object in the local mapping of the buffer.
+     * @param heap - the heap the object belongs to.
+     * @param handle - the object's handle.
+     * @return the object's address, or NULL if the handle lies outside the heap.
+     */
+    void *
+    libivc_heap_ptr(struct libivc_heap *heap, uint64_t handle);
+
+    /**
+     * Passes a filled in object to the consumer, and notifies it. Producer only.
+     * @param heap - the heap the object belongs to.
+     * @param handle - the object's handle.
+     * @return SUCCESS, NO_SPACE if the consumer hasn't caught up yet, or
+     *    appropriate error number.
+     */
+    int
+    libivc_heap_submit(struct libivc_heap *heap, uint64_t handle);
+
+    /**
+     * Frees every object the consumer has returned so far. Producer only;
+     * libivc_heap_alloc does this itself.
+     * @param heap - the heap of interest.
+     * @return the number of objects freed, or appropriate error number.
+     */
+    int
+    libivc_heap_reclaim(struct libivc_heap *heap);
+
+    /**
+     * Takes the next object the producer has submitted. Consumer only.
+     * @param heap - the heap of interest.
+     * @param handle - pointer to receive the object's handle.
+     * @return SUCCESS, NO_DATA_AVAIL if there are none, or appropriate error number.
+     */
+    int
+    libivc_heap_receive(struct libivc_heap *heap, uint64_t *handle);
+
+    /**
+     * Hands an object back to the producer once the consumer is done with it.
+     * Consumer only.
+     * @param heap - the heap the object belongs to.
+     * @param handle - the object's handle.
+     * @return SUCCESS, NO_SPACE if the producer hasn't caught up yet, or
+     *    appropriate error number.
+     */
+    int
+    libivc_heap_release(struct libivc_heap *heap, uint64_t handle);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* LIBIVC_HEAP_H */
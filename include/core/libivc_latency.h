@@ -0,0 +1,223 @@
+//
+// IVC Driver
+//
+// Copyright (C) 2016 Assured Information Security, Inc. All rights reserved.
+//
+
+/*
+ * File:   libivc_latency.h
+ * One way latency tracing on top of an established libivc client. Each
+ * message is framed with a header carrying two of the sender's timestamps:
+ * when the message originated, and when it was published to the ring. The
+ * receiver compares them with its own clock to find how long the message sat
+ * in the ring before it was picked up (the queueing delay) and how long it
+ * took from origin to delivery (the end to end latency), and records both in
+ * histograms that can be read back at any time.
+ *
+ * Each domain has its own monotonic clock, so the ends first work out the
+ * offset between them: when a tracer is created it exchanges a few rounds of
+ * timestamped calibration frames with the remote, and keeps the estimate from
+ * the round with the shortest round trip. Calibration frames are answered as
+ * the tracer is used; both sends and receives pick up the ones waiting at the
+ * head of the ring. Messages that arrive before calibration finishes are
+ * delivered, but not timed. Both ends of the connection must use a tracer.
+ * Userspace only.
+ */
+
+#ifndef LIBIVC_LATENCY_H
+#define	LIBIVC_LATENCY_H
+
+#ifdef	__cplusplus
+extern "C"
+{
+#endif
+
+#include <libivc.h>
+
+/**
+ * The size of the header in front of every frame.
+ */
+#define LIBIVC_LATENCY_HEADER_SIZE 32
+
+/**
+ * The number of calibration rounds the clock offset is estimated from.
+ */
+#define LIBIVC_LATENCY_CALIBRATION_ROUNDS 8
+
+/**
+ * Histograms keep 2^LIBIVC_LATENCY_SUB_BUCKET_BITS buckets for each power of
+ * two, so a recorded value is off by at most 1 part in 32. Values below 32ns
+ * are exact, and values from 2^40ns (about 18 minutes) up share the last bucket.
+ */
+#define LIBIVC_LATENCY_SUB_BUCKET_BITS 5
+#define LIBIVC_LATENCY_MAX_BITS 40
+#define LIBIVC_LATENCY_BUCKETS \
+    ((LIBIVC_LATENCY_MAX_BITS - LIBIVC_LATENCY_SUB_BUCKET_BITS + 1) << LIBIVC_LATENCY_SUB_BUCKET_BITS)
+
+/**
+ * The histograms a tracer keeps.
+ */
+typedef enum LIBIVC_LATENCY_KIND
+{
+    LIBIVC_LATENCY_QUEUEING,          // from publish on the sender to pick up on the receiver.
+    LIBIVC_LATENCY_END_TO_END         // from origin on the sender to delivery on the receiver.
+} LIBIVC_LATENCY_KIND_T;
+
+struct libivc_latency;
+
+/**
+ * A log linear histogram of latencies, in nanoseconds, as returned by
+ * libivc_latency_get_histogram.
+ */
+struct libivc_latency_histogram
+{
+    uint64_t count;                   // values recorded.
+    uint64_t min_ns;                  // the smallest of them.
+    uint64_t max_ns;                  // the largest of them.
+    uint64_t total_ns;                // their sum.
+    uint64_t buckets[LIBIVC_LATENCY_BUCKETS]; // values recorded in each bucket; see libivc_latency_bucket_floor.
+};
+
+/**
+ * Counters for one tracer, as returned by libivc_latency_get_stats.
+ */
+struct libivc_latency_stats
+{
+    uint64_t messages_sent;           // messages sent.
+    uint64_t messages_received;       // messages received, timed or not.
+    uint64_t messages_untimed;        // of those, the ones received before calibration finished.
+    uint64_t messages_clamped;        // timed messages that appeared to arrive before they were sent,
+                                      // and were recorded as zero; a sign the offset has drifted.
+    uint8_t calibrated;               // non zero once the clock offset is known.
+    int64_t clock_offset_ns;          // the remote's clock less ours.
+    uint64_t calibration_rtt_ns;      // the round trip of the round the offset was taken from,
+                                      // which bounds the offset's error.
+};
+
+    /**
+     * Creates a tracer on top of a connected client, and starts calibrating
+     * its clock against the remote's. Both ends of the connection should
+     * create one; the client should then only be used through it.
+     * @param lt - pointer to receive the new tracer.
+     * @param client - a connected ivc client.
+     * @return SUCCESS or appropriate error number.
+     */
+    int
+    libivc_latency_create(struct libivc_latency **lt, struct libivc_client *client);
+
+    /**
+     * Destroys a tracer. The client is left connected.
+     * @param lt - the tracer to destroy.
+     */
+    void
+    libivc_latency_destroy(struct libivc_latency *lt);
+
+    /**
+     * Gets the clock messages are timed with, for libivc_latency_send_at.
+     * @return the current time, in nanoseconds.
+     */
+    uint64_t
+    libivc_latency_now(void);
+
+    /**
+     * Sends a message, originating now. As with libivc_send, the message is
+     * written entirely or not at all.
+     * @param lt - the tracer.
+     * @param src - the message to send.
+     * @param srcSize - the length of the message.
+     * @return SUCCESS, NO_SPACE if the ring doesn't have room for the frame
+     *    right now, or appropriate error number.
+     */
+    int
+    libivc_latency_send(struct libivc_latency *lt, char *src, size_t srcSize);
+
+    /**
+     * Sends a message that originated earlier, so its end to end latency
+     * includes the time it spent waiting to be sent, for instance while the
+     * ring was full.
+     * @param lt - the tracer.
+     * @param src - the message to send.
+     * @param srcSize - the length of the message.
+     * @param origin_ns - when the message originated, from libivc_latency_now.
+     * @return SUCCESS, NO_SPACE if the ring doesn't have room for the frame
+     *    right now, or appropriate error number.
+     */
+    int
+    libivc_latency_send_at(struct libivc_latency *lt, char *src, size_t srcSize, uint64_t origin_ns);
+
+    /**
+     * Receives a message, recording its latencies.
+     * @param lt - the tracer.
+     * @param dest - buffer to receive the message.
+     * @param destSize - the size of dest.
+     * @param actualSize - pointer to receive the length of the message. If
+     *    NO_SPACE is returned, this is the size dest needs to be.
+     * @return SUCCESS, NO_DATA_AVAIL if no message has arrived, NO_SPACE if
+     *    dest is too small (the message is kept for the next call),
+     *    INVALID_PARAM if the message was malformed (it is dropped, and the
+     *    next call moves on to the following message), or appropriate error
+     *    number.
+     */
+    int
+    libivc_latency_recv(struct libivc_latency *lt, char *dest, size_t destSize, size_t *actualSize);
+
+    /**
+     * Starts calibrating the clock offset again, for instance if it appears
+     * to have drifted. The current offset is kept until the new one is known.
+     * @param lt - the tracer.
+     * @return SUCCESS or appropriate error number.
+     */
+    int
+    libivc_latency_calibrate(struct libivc_latency *lt);
+
+    /**
+     * Gets a snapshot of a tracer's counters.
+     * @param lt - the tracer.
+     * @param stats - pointer to receive the counters.
+     * @return SUCCESS or appropriate error number.
+     */
+    int
+    libivc_latency_get_stats(struct libivc_latency *lt, struct libivc_latency_stats *stats);
+
+    /**
+     * Gets a snapshot of one of a tracer's histograms.
+     * @param lt - the tracer.
+     * @param kind - the histogram of interest.
+     * @param histogram - pointer to receive the histogram.
+     * @return SUCCESS or appropriate error number.
+     */
+    int
+    libivc_latency_get_histogram(struct libivc_latency *lt, LIBIVC_LATENCY_KIND_T kind,
+        struct libivc_latency_histogram *histogram);
+
+    /**
+     * Empties a tracer's histograms. Its counters and calibration are kept.
+     * @param lt - the tracer.
+     * @return SUCCESS or appropriate error number.
+     */
+    int
+    libivc_latency_reset(struct libivc_latency *lt);
+
+    /**
+     * Gets the smallest value recorded in a histogram bucket.
+     * @param bucket - the index of the bucket.
+     * @return the bucket's lower bound, in nanoseconds.
+     */
+    uint64_t
+    libivc_latency_bucket_floor(uint32_t bucket);
+
+    /**
+     * Estimates a percentile of the values in a histogram.
+     * @param histogram - the histogram of interest.
+     * @param percentile - the percentile to find, from 0 to 100.
+     * @return the largest value that falls in the bucket the percentile lies
+     *    in, capped at the histogram's maximum, or 0 if it's empty.
+     */
+    uint64_t
+    libivc_latency_percentile(const struct libivc_latency_histogram *histogram, double percentile);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* LIBIVC_LATENCY_H */
@@ -0,0 +1,161 @@
+//
+// IVC Driver
+//
+// Copyright (C) 2016 Assured Information Security, Inc. All rights reserved.
+//
+
+/*
+ * File:   libivc_mq.h
+ * Multi-queue connections. A single libivc connection is one ring pair with
+ * one event channel, so one flow over it is limited to one producing and one
+ * consuming core. A multi-queue connection is a set of connections to the same
+ * server, one per queue, with their event threads spread across CPUs; traffic
+ * is steered to a queue by a caller-supplied key, or round-robin.
+ *
+ * Queue i of a multi-queue connection uses connection ID base + i, where the
+ * base connection ID is a multiple of the number of queues. Servers gather the
+ * queues back together by passing each new client to libivc_mq_server_add.
+ * Order is only preserved within a queue. Userspace only.
+ */
+
+#ifndef LIBIVC_MQ_H
+#define	LIBIVC_MQ_H
+
+#ifdef	__cplusplus
+extern "C"
+{
+#endif
+
+#include <libivc.h>
+
+/**
+ * The most queues one multi-queue connection may have.
+ */
+#define LIBIVC_MQ_MAX_QUEUES 64
+
+/**
+ * How long a server waits for every queue of a connection to arrive before
+ * dropping the ones that have.
+ */
+#define LIBIVC_MQ_INCOMPLETE_TIMEOUT_MS 10000
+
+/**
+ * Pass as the key to libivc_mq_send to steer round-robin.
+ */
+#define LIBIVC_MQ_ROUND_ROBIN 0xFFFFFFFFFFFFFFFFULL
+
+struct libivc_mq;
+struct libivc_mq_server;
+
+/**
+ * Called when every queue of a multi-queue connection has arrived at a server.
+ * The connection is now owned by the callback, and must be destroyed with
+ * libivc_mq_destroy.
+ */
+typedef void (*libivc_mq_ready)(void *opaque, struct libivc_mq *mq);
+
+    /**
+     * Opens a multi-queue connection to a remote server. The queues are connected
+     * in parallel, and each queue's event thread is pinned to a CPU, round-robin.
+     * @param mq - pointer to receive the new connection.
+     * @param remote_dom_id - remote domain to connect to.
+     * @param remote_port - remote port to connect to.
+     * @param numPages - number of pages to share for each queue.
+     * @param num_queues - the number of queues, at most LIBIVC_MQ_MAX_QUEUES.
+     * @param base_connection_id - the connection ID of queue 0; must be a multiple
+     *    of num_queues.
+     * @return SUCCESS or appropriate error number.
+     */
+    int
+    libivc_mq_connect(struct libivc_mq **mq, uint16_t remote_dom_id, uint16_t remote_port,
+        uint32_t numPages, uint32_t num_queues, uint64_t base_connection_id);
+
+    /**
+     * Disconnects every queue of a multi-queue connection and destroys it. As
+     * with libivc_disconnect, this must not be called from a queue's callbacks.
+     * @param mq - the connection to destroy.
+     */
+    void
+    libivc_mq_destroy(struct libivc_mq *mq);
+
+    /**
+     * Gets the number of queues in a multi-queue connection.
+     * @param mq - the connection of interest.
+     * @return the number of queues.
+     */
+    uint32_t
+    libivc_mq_num_queues(struct libivc_mq *mq);
+
+    /**
+     * Gets the client behind one queue, to receive from it or register callbacks
+     * on it. The client belongs to the multi-queue connection.
+     * @param mq - the connection of interest.
+     * @param queue - the queue's index.
+     * @return the queue's client, or NULL if there is no such queue.
+     */
+    struct libivc_client *
+    libivc_mq_queue(struct libivc_mq *mq, uint32_t queue);
+
+    /**
+     * Picks the queue for a key. The same key always maps to the same queue, so
+     * messages with the same key stay in order.
+     * @param mq - the connection of interest.
+     * @param key - the key to steer by, or LIBIVC_MQ_ROUND_ROBIN for the next
+     *    queue in turn.
+     * @return the queue's index.
+     */
+    uint32_t
+    libivc_mq_select(struct libivc_mq *mq, uint64_t key);
+
+    /**
+     * Sends a message on the queue picked by libivc_mq_select, as libivc_send.
+     * @param mq - the connection to send on.
+     * @param key - the key to steer by, or LIBIVC_MQ_ROUND_ROBIN.
+     * @param src - source buffer to send.
+     * @param srcSize - size of the source buffer and exact amount to send.
+     * @return SUCCESS or appropriate error number.
+     */
+    int
+    libivc_mq_send(struct libivc_mq *mq, uint64_t key, char *src, size_t srcSize);
+
+    /**
+     * Creates the server side bookkeeping for multi-queue connections.
+     * @param server - pointer to receive the new object.
+     * @param num_queues - the number of queues clients connect with.
+     * @param readyCallback - called as each multi-queue connection completes.
+     * @param opaque - A user-specified object that will be passed to readyCallback.
+     * @return SUCCESS or appropriate error number.
+     */
+    int
+    libivc_mq_server_create(struct libivc_mq_server **server, uint32_t num_queues,
+        libivc_mq_ready readyCallback, void *opaque);
+
+    /**
+     * Disconnects the queues of any multi-queue connections that haven't yet
+     * completed, and destroys the object. Completed connections are unaffected.
+     * Call this before shutting down the libivc server, which disconnects the
+     * clients it has handed over.
+     * @param server - the object to destroy.
+     */
+    void
+    libivc_mq_server_destroy(struct libivc_mq_server *server);
+
+    /**
+     * Hands a newly connected client to the server side bookkeeping; intended
+     * to be called from the libivc server's connect callback. Once every queue
+     * of its connection has arrived, the ready callback is called. A connection
+     * whose queues haven't all arrived within LIBIVC_MQ_INCOMPLETE_TIMEOUT_MS,
+     * or that the remote starts over by connecting a queue again, is dropped,
+     * and the queues that did arrive are disconnected.
+     * @param server - the bookkeeping object.
+     * @param client - the new client, which now belongs to the bookkeeping.
+     * @return SUCCESS or appropriate error number.
+     */
+    int
+    libivc_mq_server_add(struct libivc_mq_server *server, struct libivc_client *client);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* LIBIVC_MQ_H */
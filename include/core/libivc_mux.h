@@ -0,0 +1,167 @@
+//
+// IVC Driver
+//
+// Copyright (C) 2016 Assured Information Security, Inc. All rights reserved.
+//
+
+/*
+ * File:   libivc_mux.h
+ * Carries many independent byte streams over a single libivc connection, so
+ * applications with many low-volume streams to one peer don't need a set of
+ * granted pages, an event channel and an event thread for each of them.
+ *
+ * Each stream has its own flow control: a sender may only have as many bytes
+ * in flight as the receiver has buffer space for, so one slow reader can't
+ * stall the others. Streams with data to send are serviced round-robin, a
+ * bounded quantum at a time, so a busy stream can't starve a quiet one.
+ *
+ * The mux takes over the client's event callbacks. Stream callbacks run on the
+ * client's event thread, and may call back into the mux. Userspace only.
+ */
+
+#ifndef LIBIVC_MUX_H
+#define	LIBIVC_MUX_H
+
+#ifdef	__cplusplus
+extern "C"
+{
+#endif
+
+#include <libivc.h>
+
+struct libivc_mux;
+struct libivc_mux_stream;
+
+/**
+ * The number of bytes each side of a stream can buffer; this is also the number
+ * of bytes a sender may have in flight before it must wait for the reader.
+ */
+#define LIBIVC_MUX_STREAM_WINDOW (64 * 1024)
+
+/**
+ * Called when the remote opens a new stream. The stream is ready for use; to
+ * refuse it, close it.
+ */
+typedef void (*libivc_mux_stream_opened)(void *opaque, struct libivc_mux *mux,
+    struct libivc_mux_stream *stream);
+
+/**
+ * Called when a stream becomes readable, or when space frees up to write to it.
+ */
+typedef void (*libivc_mux_stream_event)(void *opaque, struct libivc_mux_stream *stream);
+
+/**
+ * Called when the remote closes a stream, or the connection is lost. Any data
+ * already received may still be read; the stream must then be closed locally.
+ */
+typedef void (*libivc_mux_stream_closed)(void *opaque, struct libivc_mux_stream *stream);
+
+    /**
+     * Creates a multiplexer on top of a connected client. Both ends of the
+     * connection should create one.
+     * @param mux - pointer to receive the new multiplexer.
+     * @param client - a connected ivc client. Its event callbacks are taken over
+     *    by the multiplexer.
+     * @param openedCallback - called for each stream the remote opens, or NULL to
+     *    refuse remotely-opened streams.
+     * @param opaque - A user-specified object that will be passed to openedCallback.
+     * @return SUCCESS or appropriate error number.
+     */
+    int
+    libivc_mux_create(struct libivc_mux **mux, struct libivc_client *client,
+        libivc_mux_stream_opened openedCallback, void *opaque);
+
+    /**
+     * Destroys a multiplexer, and any streams that are still open. As the client's
+     * event callbacks refer to the multiplexer, this must only be called once the
+     * underlying client has been disconnected.
+     * @param mux - the multiplexer to destroy.
+     */
+    void
+    libivc_mux_destroy(struct libivc_mux *mux);
+
+    /**
+     * Opens a new stream to the remote. Data may be written to it immediately.
+     * @param mux - the multiplexer.
+     * @param stream - pointer to receive the new stream.
+     * @return SUCCESS, PROTOCOL_ERROR if the multiplexer has given up on the
+     *    connection, or appropriate error number.
+     */
+    int
+    libivc_mux_open(struct libivc_mux *mux, struct libivc_mux_stream **stream);
+
+    /**
+     * Closes a stream. Data already written is still delivered to the remote; the
+     * stream must not be used after this call.
+     * @param stream - the stream to close.
+     * @return SUCCESS or appropriate error number.
+     */
+    int
+    libivc_mux_close(struct libivc_mux_stream *stream);
+
+    /**
+     * Registers callbacks for a single stream.
+     * @param stream - the stream of interest.
+     * @param eventCallback - called when the stream becomes readable or writable.
+     * @param closedCallback - called when the remote closes the stream.
+     * @param opaque - A user-specified object that will be passed to the callbacks.
+     * @return SUCCESS or appropriate error number.
+     */
+    int
+    libivc_mux_register_stream_callbacks(struct libivc_mux_stream *stream,
+        libivc_mux_stream_event eventCallback, libivc_mux_stream_closed closedCallback,
+        void *opaque);
+
+    /**
+     * Gets the ID of a stream, which is the same on both ends of the connection.
+     * @param stream - the stream of interest.
+     * @return the stream's ID.
+     */
+    uint32_t
+    libivc_mux_stream_id(struct libivc_mux_stream *stream);
+
+    /**
+     * Writes as many bytes as possible, up to srcSize, to a stream. Bytes that
+     * don't fit are left for the caller to retry once the stream's event callback
+     * reports it writable.
+     * @param stream - the stream to write to.
+     * @param src - source buffer to write.
+     * @param srcSize - size of the source buffer.
+     * @param actualSize - pointer to receive the number of bytes written.
+     * @return SUCCESS, NOT_CONNECTED if the remote has closed the stream, or
+     *    appropriate error number.
+     */
+    int
+    libivc_mux_write(struct libivc_mux_stream *stream, char *src, size_t srcSize, size_t *actualSize);
+
+    /**
+     * Reads as many bytes as possible, up to destSize, from a stream.
+     * @param stream - the stream to read from.
+     * @param dest - destination buffer to read data into.
+     * @param destSize - maximum number of bytes to read.
+     * @param actualSize - pointer to receive the number of bytes read.
+     * @return SUCCESS, NOT_CONNECTED if the remote has closed the stream and all of
+     *    its data has been read, or appropriate error number.
+     */
+    int
+    libivc_mux_read(struct libivc_mux_stream *stream, char *dest, size_t destSize, size_t *actualSize);
+
+    /**
+     * Processes any frames waiting in the ring, and sends any data that is waiting
+     * to go out. This happens automatically whenever the remote notifies us; it is
+     * exposed for callers that want to poll.
+     *
+     * A DATA frame too large for the ring can only come from a broken or hostile
+     * remote. The multiplexer then gives up: every stream is closed as if by the
+     * remote, and polls and opens fail with PROTOCOL_ERROR.
+     * @param mux - the multiplexer.
+     * @return SUCCESS, PROTOCOL_ERROR, or appropriate error number.
+     */
+    int
+    libivc_mux_poll(struct libivc_mux *mux);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* LIBIVC_MUX_H */
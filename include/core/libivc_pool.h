@@ -0,0 +1,91 @@
+//
+// IVC Driver
+//
+// Copyright (C) 2016 Assured Information Security, Inc. All rights reserved.
+//
+
+/*
+ * File:   libivc_pool.h
+ * A pool of client connections to one remote domain, whose buffers are
+ * allocated, granted and mapped ahead of time. Connecting from the pool only
+ * notifies the remote, and releasing back to it keeps the buffer for the next
+ * connection, so applications making many short-lived connections don't pay
+ * for setting up a buffer on each of them.
+ *
+ * Every client in a pool has the same buffer size; use one pool per size. Each
+ * is given its own connection ID, counting up from the pool's base ID, so a
+ * server sees a pooled client's connection ID rather than one of the caller's
+ * choosing. Userspace only.
+ */
+
+#ifndef LIBIVC_POOL_H
+#define	LIBIVC_POOL_H
+
+#ifdef	__cplusplus
+extern "C"
+{
+#endif
+
+#include <libivc.h>
+
+struct libivc_pool;
+
+    /**
+     * Creates a pool, and warms it with idle clients.
+     * @param pool - pointer to receive the new pool.
+     * @param remote_dom_id - the domain the pool's clients connect to.
+     * @param numPages - the size of each client's buffer, in pages.
+     * @param count - the number of idle clients to create, and the most the pool
+     *    keeps idle at once.
+     * @param base_connection_id - the connection ID of the pool's first client;
+     *    each further client takes the next ID up.
+     * @return SUCCESS or appropriate error number.
+     */
+    int
+    libivc_pool_create(struct libivc_pool **pool, uint16_t remote_dom_id, uint32_t numPages,
+        uint32_t count, uint64_t base_connection_id);
+
+    /**
+     * Disconnects the pool's idle clients and destroys it. Clients still handed
+     * out are unaffected, and must be disconnected with libivc_disconnect.
+     * @param pool - the pool to destroy.
+     */
+    void
+    libivc_pool_destroy(struct libivc_pool *pool);
+
+    /**
+     * Connects to a server in the pool's domain, using an idle client if there
+     * is one, or making a new connection if not.
+     * @param pool - the pool.
+     * @param remote_port - the port to connect to.
+     * @param client - pointer to receive the connected client.
+     * @return SUCCESS or appropriate error number.
+     */
+    int
+    libivc_pool_connect(struct libivc_pool *pool, uint16_t remote_port, struct libivc_client **client);
+
+    /**
+     * Disconnects a client handed out by the pool, returning it to the pool for
+     * reuse, or closing it if the pool already has as many idle clients as it
+     * keeps. As with libivc_park, its callbacks are dropped; this must not be
+     * called from the client's own callbacks.
+     * @param pool - the pool.
+     * @param client - the client to release. It must not be used after this call.
+     * @return SUCCESS or appropriate error number.
+     */
+    int
+    libivc_pool_release(struct libivc_pool *pool, struct libivc_client *client);
+
+    /**
+     * Gets the number of idle clients in the pool.
+     * @param pool - the pool.
+     * @return the number of idle clients.
+     */
+    uint32_t
+    libivc_pool_idle_count(struct libivc_pool *pool);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* LIBIVC_POOL_H */
@@ -33,6 +33,7 @@ typedef pthread_mutex_t mutex_t;
 #define mutex_destroy(x) pthread_mutex_destroy((x))
 #define mutex_lock(x) pthread_mutex_lock((x))
 #define mutex_unlock(x) pthread_mutex_unlock((x))
+#define UNUSED(x) (void)(x)
 
 // Userland implementation of the kernel atomics;
 // should work with most linux compilers
@@ -52,6 +53,25 @@ static inline void atomic_inc(atomic_t * target)
        (void)__sync_fetch_and_add(&target->counter, 1);
 }
 
+typedef struct {
+    volatile int64_t counter;
+} atomic64_t;
+
+static inline void atomic64_inc(atomic64_t * target)
+{
+       (void)__sync_fetch_and_add(&target->counter, 1);
+}
+
+static inline int64_t atomic64_read(atomic64_t * target)
+{
+       return __sync_fetch_and_add(&target->counter, 0);
+}
+
+static inline void atomic64_set(atomic64_t * target, int64_t value)
+{
+       (void)__sync_lock_test_and_set(&target->counter, value);
+}
+
 typedef uint32_t grant_ref_t;
 typedef uint32_t evtchn_port_t;
 #else
@@ -93,6 +113,24 @@ static BOOLEAN atomic_dec_and_test(atomic_t * target)
 }
 
 
+static void atomic64_inc(atomic64_t * target)
+{
+	InterlockedIncrement64(target);
+}
+
+
+static LONG64 atomic64_read(atomic64_t * target)
+{
+	return InterlockedCompareExchange64(target, 0, 0);
+}
+
+
+static void atomic64_set(atomic64_t * target, LONG64 value)
+{
+	InterlockedExchange64(target, value);
+}
+
+
 #include <list.h>
 #ifndef KERNEL
 #include <Windows.h>
@@ -172,6 +210,225 @@ typedef PVOID mapped_grant_ref_t;
 #ifdef _WIN32
 typedef ULONG evtchn_port_t;
 #endif
+
+/**
+ * Returns a monotonic timestamp, in nanoseconds. Only the difference between
+ * two timestamps is meaningful.
+ */
+#ifdef KERNEL
+#ifdef __linux
+#include <linux/ktime.h>
+
+static inline uint64_t libivc_monotonic_ns(void)
+{
+    return ktime_get_ns();
+}
+#else
+static __inline uint64_t libivc_monotonic_ns(void)
+{
+    LARGE_INTEGER frequency;
+    LARGE_INTEGER now = KeQueryPerformanceCounter(&frequency);
+
+    return ((now.QuadPart / frequency.QuadPart) * 1000000000ULL) +
+        (((now.QuadPart % frequency.QuadPart) * 1000000000ULL) / frequency.QuadPart);
+}
+#endif
+#else
+#ifdef __linux
+#include <time.h>
+
+static inline uint64_t libivc_monotonic_ns(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return ((uint64_t)now.tv_sec * 1000000000ULL) + (uint64_t)now.tv_nsec;
+}
+#else
+static __inline uint64_t libivc_monotonic_ns(void)
+{
+    LARGE_INTEGER frequency;
+    LARGE_INTEGER now;
+
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&now);
+    return ((now.QuadPart / frequency.QuadPart) * 1000000000ULL) +
+        (((now.QuadPart % frequency.QuadPart) * 1000000000ULL) / frequency.QuadPart);
+}
+#endif
+#endif
+
+/**
+ * Lets a thread wait for the next event delivered to a client. Delivering an
+ * event bumps a generation counter and wakes any waiters; a waiter notes the
+ * generation before checking for data, and waits only while it's unchanged,
+ * so an event delivered in between isn't missed.
+ */
+#ifdef KERNEL
+#ifdef __linux
+#include <linux/wait.h>
+#include <linux/jiffies.h>
+
+typedef wait_queue_head_t libivc_event_wait_t;
+
+static inline void libivc_event_wait_init(libivc_event_wait_t *wait)
+{
+    init_waitqueue_head(wait);
+}
+
+static inline void libivc_event_wait_destroy(libivc_event_wait_t *wait)
+{
+}
+
+static inline void libivc_event_wait_wake(libivc_event_wait_t *wait, volatile uint32_t *generation)
+{
+    WRITE_ONCE(*generation, *generation + 1);
+    wake_up_all(wait);
+}
+
+static inline void libivc_event_wait(libivc_event_wait_t *wait, volatile uint32_t *generation,
+    uint32_t seen, uint32_t timeout_ms)
+{
+    wait_event_interruptible_timeout(*wait, READ_ONCE(*generation) != seen,
+        msecs_to_jiffies(timeout_ms));
+}
+#else
+typedef KEVENT libivc_event_wait_t;
+
+static __inline void libivc_event_wait_init(libivc_event_wait_t *wait)
+{
+    KeInitializeEvent(wait, SynchronizationEvent, FALSE);
+}
+
+static __inline void libivc_event_wait_destroy(libivc_event_wait_t *wait)
+{
+    UNREFERENCED_PARAMETER(wait);
+}
+
+static __inline void libivc_event_wait_wake(libivc_event_wait_t *wait, volatile uint32_t *generation)
+{
+    InterlockedIncrement((volatile LONG *)generation);
+    KeSetEvent(wait, 0, FALSE);
+}
+
+static __inline void libivc_event_wait(libivc_event_wait_t *wait, volatile uint32_t *generation,
+    uint32_t seen, uint32_t timeout_ms)
+{
+    LARGE_INTEGER timeout;
+
+    if (*generation != seen)
+        return;
+
+    timeout.QuadPart = -10000LL * timeout_ms; // relative, in 100ns units.
+    KeWaitForSingleObject(wait, Executive, KernelMode, FALSE, &timeout);
+}
+#endif
+#else
+#ifdef __linux
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+} libivc_event_wait_t;
+
+static inline void libivc_event_wait_init(libivc_event_wait_t *wait)
+{
+    pthread_condattr_t attribs;
+
+    pthread_condattr_init(&attribs);
+    pthread_condattr_setclock(&attribs, CLOCK_MONOTONIC);
+    pthread_cond_init(&wait->cond, &attribs);
+    pthread_condattr_destroy(&attribs);
+    pthread_mutex_init(&wait->lock, NULL);
+}
+
+static inline void libivc_event_wait_destroy(libivc_event_wait_t *wait)
+{
+    pthread_cond_destroy(&wait->cond);
+    pthread_mutex_destroy(&wait->lock);
+}
+
+static inline void libivc_event_wait_wake(libivc_event_wait_t *wait, volatile uint32_t *generation)
+{
+    pthread_mutex_lock(&wait->lock);
+    (*generation)++;
+    pthread_cond_broadcast(&wait->cond);
+    pthread_mutex_unlock(&wait->lock);
+}
+
+static inline void libivc_event_wait(libivc_event_wait_t *wait, volatile uint32_t *generation,
+    uint32_t seen, uint32_t timeout_ms)
+{
+    struct timespec deadline;
+
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec += timeout_ms / 1000;
+    deadline.tv_nsec += (long)(timeout_ms % 1000) * 1000000;
+    if (deadline.tv_nsec >= 1000000000) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000;
+    }
+
+    pthread_mutex_lock(&wait->lock);
+    while (*generation == seen) {
+        if (pthread_cond_timedwait(&wait->cond, &wait->lock, &deadline) != 0)
+            break;
+    }
+    pthread_mutex_unlock(&wait->lock);
+}
+#else
+typedef HANDLE libivc_event_wait_t;
+
+static __inline void libivc_event_wait_init(libivc_event_wait_t *wait)
+{
+    *wait = CreateEvent(NULL, FALSE, FALSE, NULL);
+}
+
+static __inline void libivc_event_wait_destroy(libivc_event_wait_t *wait)
+{
+    if (*wait)
+        CloseHandle(*wait);
+}
+
+static __inline void libivc_event_wait_wake(libivc_event_wait_t *wait, volatile uint32_t *generation)
+{
+    InterlockedIncrement((volatile LONG *)generation);
+    SetEvent(*wait);
+}
+
+static __inline void libivc_event_wait(libivc_event_wait_t *wait, volatile uint32_t *generation,
+    uint32_t seen, uint32_t timeout_ms)
+{
+    if (*generation != seen)
+        return;
+
+    WaitForSingleObject(*wait, timeout_ms);
+}
+#endif
+#endif
+
+/**
+ * Tells the processor we're in a spin loop.
+ */
+#ifdef KERNEL
+#ifdef __linux
+#define libivc_cpu_relax() cpu_relax()
+#else
+#define libivc_cpu_relax() YieldProcessor()
+#endif
+#else
+#ifdef __linux
+#if defined(__i386__) || defined(__x86_64__)
+#define libivc_cpu_relax() __asm__ __volatile__("pause" ::: "memory")
+#elif defined(__aarch64__) || defined(__arm__)
+#define libivc_cpu_relax() __asm__ __volatile__("yield" ::: "memory")
+#else
+#define libivc_cpu_relax() __asm__ __volatile__("" ::: "memory")
+#endif
+#else
+#define libivc_cpu_relax() YieldProcessor()
+#endif
+#endif
+
 extern list_head_t ivcServerList;
 extern list_head_t ivcClients;
 extern mutex_t ivc_server_list_lock;
@@ -193,9 +450,50 @@ typedef struct grant_share_descriptor {
 #define SERVER_SIDE_TX_EVENT_FLAG 0x80
 #define CLIENT_SIDE_TX_EVENT_FLAG 0x01
 
+// set in a CONNECT request's connect_flags if the buffer was granted read only.
+#define CONNECT_FLAG_READ_ONLY 0x0001
+
+// the bits of a CONNECT request's connect_flags holding the connection's number
+// of lanes; zero, as sent by older peers, means the usual single lane.
+#define CONNECT_FLAG_LANES_SHIFT 8
+#define CONNECT_FLAG_LANES_MASK 0x0F00
+#define CONNECT_FLAGS_MASK (CONNECT_FLAG_READ_ONLY | CONNECT_FLAG_LANES_MASK)
+
+// set in the status of a successful ACK by peers that honored the CONNECT
+// request's connect_flags, with the flags they applied in the bits of
+// CONNECT_FLAGS_MASK. Older peers ignore connect_flags and ACK with a status
+// of SUCCESS, so a request with flags set must see them confirmed this way.
+// Failure statuses are either negative or below 0x100, so never look like this.
+#define ACK_STATUS_FLAGS_APPLIED 0x4000
+#define ack_status_applied_flags(s) \
+    (((s) > 0 && ((s) & ACK_STATUS_FLAGS_APPLIED)) ? ((s) & CONNECT_FLAGS_MASK) : -1)
+
 #define CLIENT_TO_SERVER_CHANNEL 0
 #define SERVER_TO_CLIENT_CHANNEL 1
 
+// the ring's control words used to resize it in place; see libivc_resize. The
+// client side, which starts a resize, writes the first two, and the server
+// side answers in the third. States are tagged with the resize's sequence
+// number, in the bits above RESIZE_STATE_MASK.
+#define RESIZE_CONTROL_PAGES 0
+#define RESIZE_CONTROL_REQUEST 1
+#define RESIZE_CONTROL_REPLY 2
+#define RESIZE_STATE_MASK 0xFF
+#define RESIZE_SEQ_SHIFT 8
+#define RESIZE_REQUESTED 1 // client: pages holds the new size; stop using the ring.
+#define RESIZE_DONE 2      // client: the ring has been laid out again at the new size.
+#define RESIZE_ABORTED 3   // client: the resize was abandoned; carry on as before.
+#define RESIZE_QUIESCED 1  // server: no longer using the ring.
+#define RESIZE_ADOPTED 2   // server: using the ring again, at whatever size it now is.
+
+// how long libivc_resize waits for the server side to stop using the ring.
+#define LIBIVC_RESIZE_TIMEOUT_MS 1000
+
+// the bytes at the start of a buffer left to the first channel's header, whose
+// reserved words hold event flags and resize state. Layers that take a buffer
+// over from the ring (broadcast, heap, vring) start their own structures here.
+#define LIBIVC_RING_HEADER_RESERVED 32
+
 #pragma pack(push,1)
 
 typedef struct grant_mem_header {
@@ -245,6 +543,7 @@ typedef struct libivc_message {
     union {
         int16_t status;         // if an ACK to a message, the remote status of sending it.
         uint16_t target_domain; // notification parmater, if this is related to a domain-death notification
+        uint16_t connect_flags; // if a CONNECT request, CONNECT_FLAG_* values describing the shared buffer.
     };
 
     uint16_t msg_end;           // validation field for message format end               2
@@ -278,6 +577,59 @@ struct libivc_client_ioctl_info {
     // the reconnect IOCTLs.
     uint16_t new_domid;
     uint16_t new_port;
+
+    // Non zero if the buffer is (or is to be) shared read only. Used by the
+    // connect and accept IOCTLs.
+    uint8_t read_only;
+
+    // If has_source is set, the client whose buffer a new connection should
+    // share rather than allocating its own. Used only by the connect IOCTL.
+    uint8_t has_source;
+    uint16_t source_domid;
+    uint16_t source_port;
+    uint64_t source_connection_id;
+
+    // Non zero if the client holds its buffer without being connected to a
+    // remote; see libivc_connect_parked. Used by the connect IOCTL.
+    uint8_t parked;
+
+    // The number of lanes in each direction; see libivc_connect_lanes. Used by
+    // the connect and accept IOCTLs.
+    uint8_t num_lanes;
+};
+
+/**
+ * The most clients a single IVC_SERVER_ACCEPT_BATCH ioctl may accept.
+ */
+#define LIBIVC_ACCEPT_BATCH_MAX 64
+
+/**
+ * The payload of the IVC_SERVER_ACCEPT_BATCH ioctl, which accepts as many of a
+ * server's waiting connections as it has room for in one call.
+ */
+struct libivc_accept_batch_ioctl_info {
+    struct libivc_client_ioctl_info listener; // the server's port, domid and connection ID, as for IVC_SERVER_ACCEPT.
+    uint32_t max_clients;             // the length of clients, at most LIBIVC_ACCEPT_BATCH_MAX.
+    uint32_t num_clients;             // receives the number of clients accepted.
+    struct libivc_client_ioctl_info *clients; // one entry per client, each carrying the event handles
+                                      // the client should use; the accepted ones are filled in.
+};
+
+/**
+ * The most clients a single IVC_CONNECT_BATCH ioctl, or a single pass of
+ * libivc_connect_many, may connect.
+ */
+#define LIBIVC_CONNECT_BATCH_MAX 64
+
+/**
+ * The payload of the IVC_CONNECT_BATCH ioctl, which connects many clients in one
+ * call, with their CONNECT requests all in flight at once.
+ */
+struct libivc_connect_batch_ioctl_info {
+    uint32_t num_clients;             // the length of clients and statuses, at most LIBIVC_CONNECT_BATCH_MAX.
+    struct libivc_client_ioctl_info *clients; // one entry per client, as for IVC_CONNECT; the connected
+                                      // ones are filled in.
+    int32_t *statuses;                // receives SUCCESS or an error number for each client.
 };
 
 /**
@@ -303,6 +655,61 @@ struct libivc_client {
 
     atomic_t ref_count;               // holds the current reference count for this object
 
+    uint32_t corked;                  // libivc_cork calls not yet undone; remote notifications for
+                                      // sends are deferred while non zero.
+    uint32_t cork_pending;            // bytes published to the remote since it was last notified.
+    uint64_t cork_since;              // libivc_monotonic_ns() of the oldest unnotified send.
+    uint32_t cork_max_bytes;          // flush automatically once this many bytes are pending; 0 for never.
+    uint32_t cork_max_delay_us;       // flush automatically once a send has been pending this long; 0 for never.
+
+    char *large_tx_src;               // the message libivc_send_large is currently streaming, or NULL.
+    uint64_t large_tx_size;           // the size of that message.
+    uint64_t large_tx_offset;         // bytes of the current large message's frame (header included) already sent.
+    char *large_rx_dest;              // the buffer libivc_recv_large is currently reassembling into, or NULL.
+    uint8_t large_rx_owned;           // non zero if large_rx_dest was allocated by the library.
+    uint64_t large_rx_length;         // payload length of the large message being received, once known.
+    uint64_t large_rx_offset;         // bytes of the current large message's frame (header included) already received.
+    uint8_t large_rx_header[8];       // the large message length header, as it is received.
+    uint8_t large_rx_discarding;      // non zero if the large message being received is too long, and is being dropped.
+    uint64_t large_rx_max;            // the longest large message accepted; 0 for LIBIVC_DEFAULT_MAX_LARGE_MESSAGE.
+
+    uint8_t read_only;                // non zero if the remote was only granted (or we were only granted) read access.
+    uint8_t shares_buffer;            // non zero if the buffer belongs to another client, see libivc_connect_shared.
+    struct libivc_client *buffer_source; // while connecting, the client whose buffer is to be shared.
+    uint8_t parked;                   // non zero while the buffer is held for a later reconnect, with no remote.
+    uint8_t taken_over;               // non zero once a layer owns the buffer, see __libivc_take_over_buffer.
+
+    struct libivc_stats stats;        // counters for libivc_get_stats; guarded by mutex.
+    atomic64_t notifications_sent;    // stats.notifications_sent, kept apart so notifying needn't take the mutex.
+
+    uint32_t spin_max_us;             // the longest libivc_recv_wait may spin before blocking; 0 never spins.
+    uint64_t spin_budget_ns;          // how long libivc_recv_wait spins at the moment, adapted to arrivals.
+    uint64_t last_arrival;            // libivc_monotonic_ns() of the last message libivc_recv_wait returned.
+    uint64_t arrival_gap_ns;          // moving average of the time between those messages.
+    volatile uint32_t event_generation; // bumped each time an event is delivered to the client.
+    libivc_event_wait_t event_wait;   // woken each time an event is delivered to the client.
+
+    uint32_t moderation_high_rate;    // events per second above which events are moderated; 0 never moderates.
+    uint32_t moderation_low_rate;     // arrivals per second below which moderation ends.
+    uint32_t moderation_interval_us;  // while moderating, how often the ring is polled.
+    uint8_t moderating;               // non zero while events are disabled and the ring is polled instead.
+    uint8_t moderation_events_were_enabled; // whether events were enabled before moderation began.
+    uint32_t moderation_arrivals;     // events delivered, or polls that found data, in the current window.
+    uint64_t moderation_window_start; // libivc_monotonic_ns() at the start of the current window.
+
+    uint8_t num_lanes;                // lanes in each direction, see libivc_connect_lanes; 0 for the usual one.
+    uint8_t lane_policy;              // LANE_POLICY_T used by libivc_recv_next_lane.
+    uint32_t lane_weights[LIBIVC_MAX_LANES]; // each lane's weight under LIBIVC_LANE_WEIGHTED.
+    int64_t lane_credit[LIBIVC_MAX_LANES];   // each lane's running credit under LIBIVC_LANE_WEIGHTED.
+
+    uint32_t ring_pages;              // the pages the ring spans, see libivc_resize; 0 for all of them.
+    uint8_t resizable;                // non zero once libivc_enable_resize has been called.
+    uint32_t resize_seq;              // the last resize this side started, or took part in.
+    uint8_t resizing;                 // non zero while libivc_resize waits for the remote to stop;
+                                      // I/O on the ring returns ERROR_AGAIN meanwhile.
+    struct ringbuffer_header_t *resize_shadow; // while the remote resizes the ring, the headers
+                                      // our channels are detached onto.
+
 #ifdef __linux
     int client_disconnect_event;    // event fd for client disconnecting.
     int client_notify_event;        // event fd for general event notification.
@@ -322,6 +729,7 @@ struct libivc_server_ioctl_info {
   uint16_t limit_to_domid;
   uint64_t limit_to_connection_id;
     void *opaque;
+    uint32_t accept_backlog; // the most connections left waiting to be accepted; 0 for no limit.
 #ifdef __linux
     int client_connect_event; // event fd for connection available.
 #else
@@ -347,6 +755,8 @@ struct libivc_server {
     void *context;                          // if owned by a user space process, not null in KERNEL.
     void *opaque;
     atomic_t ref_count;                     // holds the current reference count for this object
+    uint32_t accept_backlog;                // the most connections left waiting for a user space server to
+                                            // accept, or 0 for no limit; beyond it, new ones are refused.
 
 #ifdef __linux
     int client_connect_event; // event fd for connection available.
@@ -364,16 +774,20 @@ typedef int (*platform_register_server_listener)(struct libivc_server *);
 typedef int (*platform_unregister_server_listener)(struct libivc_server *);
 typedef int (*platform_notify_remote)(struct libivc_client *);
 typedef int (*platform_connect)(struct libivc_client *);
+typedef int (*platform_connect_many)(struct libivc_client **, int *statuses, uint32_t count);
 typedef int (*platform_reconnect)(struct libivc_client *, uint16_t new_domid, uint16_t new_port);
 typedef int (*platform_disconnect)(struct libivc_client *);
+typedef int (*platform_park)(struct libivc_client *);
 
 typedef struct platform_functions {
     platform_register_server_listener registerServerListener;
     platform_unregister_server_listener unregisterServerListener;
     platform_notify_remote notifyRemote;
     platform_connect connect;
+    platform_connect_many connectMany; // optional; connects are made one at a time without it.
     platform_disconnect disconnect;
     platform_reconnect reconnect;
+    platform_park park;
 } platform_functions_t, *pplatform_functions_t;
 
 /**
@@ -434,6 +848,88 @@ void
 __libivc_shutdown_server(struct libivc_server * server);
 
 
+/**
+ * Notifies the remote of any corked data whose cork thresholds have been
+ * crossed. Intended to be called periodically by platforms that have a
+ * natural place to do so (e.g. an event-polling thread), so the delay
+ * threshold is honored even when the application stops sending.
+ *
+ * @param client The client whose deferred notification should be checked.
+ * @return SUCCESS or appropriate error number.
+ */
+int
+__libivc_flush_if_due(struct libivc_client *client);
+
+
+/**
+ * Applies the client's interrupt moderation policy. Intended to be called by
+ * platforms with an event-polling thread each time around its loop. While
+ * moderating, events are disabled, and the platform should poll the ring at
+ * the returned interval and dispatch the client's event callbacks itself when
+ * new data has arrived. Takes the client's mutex, so must be called without it.
+ *
+ * @param client The client to moderate.
+ * @param polled_data Non zero if the last poll found new data.
+ * @return the interval to poll at, in microseconds, or 0 if not moderating.
+ */
+uint32_t
+__libivc_moderate(struct libivc_client *client, uint8_t polled_data);
+
+
+/**
+ * Records events received from the remote and the dispatch of the client's
+ * callbacks for them, for libivc_get_stats. Intended to be called by the
+ * platforms wherever they deliver events to a client.
+ *
+ * @param client The client the events were delivered to.
+ * @param events The number of events picked up at once.
+ * @param picked_up libivc_monotonic_ns() when the events were picked up.
+ * @param dispatched Non zero if callbacks were run for them.
+ */
+void
+__libivc_record_events(struct libivc_client *client, uint64_t events, uint64_t picked_up,
+    uint8_t dispatched);
+
+
+/**
+ * Lays the client's ring buffer out over its buffer, with a channel in each
+ * direction for each of its lanes. Both sides of a connection must call this
+ * once the buffer is mapped and num_lanes is known; the ring buffer is
+ * allocated if the client doesn't have one yet.
+ *
+ * @param client The client whose ring buffer should be set up.
+ * @return SUCCESS or appropriate error number.
+ */
+int
+__libivc_create_ringbuffer(struct libivc_client *client);
+
+
+/**
+ * Hands the client's buffer over to a layer that lays its own structures out
+ * in it, past LIBIVC_RING_HEADER_RESERVED, rather than using it as a ring.
+ * From then on libivc leaves the ring's headers alone: enabling and disabling
+ * events changes no flags, and the ring can't be resized. Both
+ * sides should call this before registering any event callbacks.
+ *
+ * @param client The client whose buffer is being taken over.
+ */
+void
+__libivc_take_over_buffer(struct libivc_client *client);
+
+
+/**
+ * Takes part in a resize of the client's ring started by the remote, if
+ * libivc_enable_resize has been called on it; see libivc_resize. Intended to be called by the platforms wherever they deliver
+ * events to a client, before its callbacks run. Never blocks waiting for the
+ * remote: while the remote moves the ring, the client's channels look empty
+ * and full.
+ *
+ * @param client The client whose ring may be being resized.
+ */
+void
+__libivc_service_resize(struct libivc_client *client);
+
+
 typedef struct callback_node {
     list_head_t node;
     libivc_client_event_fired eventCallback;
@@ -0,0 +1,47 @@
+//
+// IVC Driver
+//
+// Copyright (C) 2016 Assured Information Security, Inc. All rights reserved.
+//
+
+/*
+ * File:   libivc_probes.h
+ * Static tracepoints in libivc.so, for bpftrace, perf and systemtap. Each
+ * probe is a single nop in the instruction stream plus a note in the
+ * library's .note.stapsdt section; nothing is evaluated or called until a
+ * tracer attaches to it. All of them belong to the "libivc" provider:
+ *
+ *   send_entry(domid, port, lane, size)       send_return(domid, port, lane, size, rc)
+ *   recv_entry(domid, port, lane, size)       recv_return(domid, port, lane, size, rc)
+ *   ring_full(domid, port, size)              ring_empty(domid, port, size)
+ *   notify(domid, port)
+ *   event_dispatch(domid, port, events)       event_return(domid, port, events)
+ *   connect_entry(domid, port, pages)         connect_return(domid, port, rc)
+ *   connect_many_entry(count)                 connect_many_return(count, rc)
+ *   accept_entry(port, count)                 accept_return(domid, port, rc)
+ *
+ * The probes are only built into Linux userspace libraries, and only where
+ * <sys/sdt.h> was found at configure time; elsewhere they compile away.
+ * See src/test/us/bpftrace for scripts that use them. Private to the library.
+ */
+
+#ifndef LIBIVC_PROBES_H
+#define	LIBIVC_PROBES_H
+
+#if defined(__linux) && !defined(KERNEL) && defined(HAVE_SYS_SDT_H)
+#include <sys/sdt.h>
+
+#define libivc_probe1(name, a) DTRACE_PROBE1(libivc, name, a)
+#define libivc_probe2(name, a, b) DTRACE_PROBE2(libivc, name, a, b)
+#define libivc_probe3(name, a, b, c) DTRACE_PROBE3(libivc, name, a, b, c)
+#define libivc_probe4(name, a, b, c, d) DTRACE_PROBE4(libivc, name, a, b, c, d)
+#define libivc_probe5(name, a, b, c, d, e) DTRACE_PROBE5(libivc, name, a, b, c, d, e)
+#else
+#define libivc_probe1(name, a) do { } while (0)
+#define libivc_probe2(name, a, b) do { } while (0)
+#define libivc_probe3(name, a, b, c) do { } while (0)
+#define libivc_probe4(name, a, b, c, d) do { } while (0)
+#define libivc_probe5(name, a, b, c, d, e) do { } while (0)
+#endif
+
+#endif	/* LIBIVC_PROBES_H */
@@ -0,0 +1,165 @@
+//
+// IVC Driver
+//
+// Copyright (C) 2016 Assured Information Security, Inc. All rights reserved.
+//
+
+/*
+ * File:   libivc_rpc.h
+ * A small request/response layer on top of an established libivc client.
+ *
+ * Each request carries a correlation ID, so any number of requests may be
+ * outstanding on a connection at once; responses are matched back to their
+ * requests as they arrive, in whatever order the remote produces them.
+ * Requests and responses must each fit in the connection's ring.
+ *
+ * The RPC layer takes over the client's event callbacks, so it can process
+ * incoming frames as soon as the remote notifies us. Requests are handled, and
+ * responses completed, on the client's event thread; don't make blocking calls
+ * from a request handler or completion. Userspace only.
+ */
+
+#ifndef LIBIVC_RPC_H
+#define	LIBIVC_RPC_H
+
+#ifdef	__cplusplus
+extern "C"
+{
+#endif
+
+#include <libivc.h>
+
+struct libivc_rpc;
+
+/**
+ * Called when a request arrives from the remote. The request should be answered,
+ * now or later, by calling libivc_rpc_reply with the provided request ID.
+ * The payload is only valid for the duration of the callback.
+ */
+typedef void (*libivc_rpc_request_handler)(void *opaque, struct libivc_rpc *rpc,
+    uint64_t request_id, uint32_t method, char *payload, uint32_t length);
+
+/**
+ * Called when a response arrives for a request sent with libivc_rpc_call_async,
+ * or with NOT_CONNECTED if the connection is torn down first. The payload is only
+ * valid for the duration of the callback.
+ */
+typedef void (*libivc_rpc_completion)(void *opaque, struct libivc_rpc *rpc,
+    int status, char *payload, uint32_t length);
+
+    /**
+     * Creates an RPC endpoint on top of a connected client. Both ends of the
+     * connection should create one.
+     * @param rpc - pointer to receive the new RPC endpoint.
+     * @param client - a connected ivc client. Its event callbacks are taken over
+     *    by the RPC layer.
+     * @param handler - called for each request received from the remote, or NULL
+     *    if this end only makes requests.
+     * @param opaque - A user-specified object that will be passed to the handler.
+     * @return SUCCESS or appropriate error number.
+     */
+    int
+    libivc_rpc_create(struct libivc_rpc **rpc, struct libivc_client *client,
+        libivc_rpc_request_handler handler, void *opaque);
+
+    /**
+     * Destroys an RPC endpoint. Any requests still outstanding are completed with
+     * NOT_CONNECTED. As the client's event callbacks refer to the endpoint, this
+     * must only be called once the underlying client has been disconnected.
+     * @param rpc - the RPC endpoint to destroy.
+     */
+    void
+    libivc_rpc_destroy(struct libivc_rpc *rpc);
+
+    /**
+     * Sends a request without waiting for its response.
+     * @param rpc - the RPC endpoint.
+     * @param method - an application-defined method number.
+     * @param payload - the request body, or NULL if length is 0.
+     * @param length - the length of the request body.
+     * @param completion - called when the response arrives.
+     * @param opaque - A user-specified object that will be passed to the completion.
+     * @return SUCCESS, NO_SPACE if the ring cannot currently hold the request, or
+     *    appropriate error number.
+     */
+    int
+    libivc_rpc_call_async(struct libivc_rpc *rpc, uint32_t method, char *payload, uint32_t length,
+        libivc_rpc_completion completion, void *opaque);
+
+    /**
+     * Sends a request and waits for its response.
+     * @param rpc - the RPC endpoint.
+     * @param method - an application-defined method number.
+     * @param payload - the request body, or NULL if length is 0.
+     * @param length - the length of the request body.
+     * @param response - buffer to receive the response body.
+     * @param responseSize - size of the response buffer.
+     * @param actualSize - pointer to receive the length of the response body; if it is
+     *    larger than responseSize, the response was truncated.
+     * @param timeout_ms - how long to wait for the response, or 0 to wait forever.
+     * @return the status passed to libivc_rpc_reply by the remote, TIMED_OUT, or
+     *    appropriate error number.
+     */
+    int
+    libivc_rpc_call(struct libivc_rpc *rpc, uint32_t method, char *payload, uint32_t length,
+        char *response, size_t responseSize, size_t *actualSize, uint32_t timeout_ms);
+
+    /**
+     * Answers a request received by the request handler.
+     * @param rpc - the RPC endpoint.
+     * @param request_id - the ID passed to the request handler.
+     * @param status - an application-defined status, passed back to the caller.
+     * @param payload - the response body, or NULL if length is 0.
+     * @param length - the length of the response body.
+     * @return SUCCESS, NO_SPACE if the ring cannot currently hold the response, or
+     *    appropriate error number.
+     */
+    int
+    libivc_rpc_reply(struct libivc_rpc *rpc, uint64_t request_id, int32_t status,
+        char *payload, uint32_t length);
+
+    /**
+     * Starts a batch: requests and replies sent until libivc_rpc_end_batch are
+     * published to the ring as usual, but the remote is only notified once, when
+     * the batch ends.
+     * @param rpc - the RPC endpoint.
+     * @return SUCCESS or appropriate error number.
+     */
+    int
+    libivc_rpc_begin_batch(struct libivc_rpc *rpc);
+
+    /**
+     * Ends a batch started with libivc_rpc_begin_batch, notifying the remote.
+     * @param rpc - the RPC endpoint.
+     * @return SUCCESS or appropriate error number.
+     */
+    int
+    libivc_rpc_end_batch(struct libivc_rpc *rpc);
+
+    /**
+     * Processes any frames waiting in the ring, dispatching requests to the handler
+     * and responses to their completions. This happens automatically whenever the
+     * remote notifies us; it is exposed for callers that want to poll.
+     *
+     * A frame too large for the ring can only come from a broken or hostile
+     * remote. The endpoint then gives up on the connection: outstanding requests
+     * fail with NOT_CONNECTED, and polls, calls and replies fail with PROTOCOL_ERROR.
+     * @param rpc - the RPC endpoint.
+     * @return SUCCESS, PROTOCOL_ERROR, or appropriate error number.
+     */
+    int
+    libivc_rpc_poll(struct libivc_rpc *rpc);
+
+    /**
+     * Gets the number of requests that are still waiting for a response.
+     * @param rpc - the RPC endpoint.
+     * @return the number of outstanding requests.
+     */
+    uint32_t
+    libivc_rpc_outstanding(struct libivc_rpc *rpc);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* LIBIVC_RPC_H */
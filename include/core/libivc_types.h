@@ -48,6 +48,71 @@ extern "C"
     typedef void (*libivc_client_disconnected)(void *, struct libivc_client *);
     typedef void (*libivc_client_connected)(void *, struct libivc_client *);
 
+    // Per-connection counters, as returned by libivc_get_stats. Counters
+    // only ever increase while the client is connected; they are reset when
+    // it's parked.
+    struct libivc_stats
+    {
+        uint64_t bytes_sent;              // bytes published to the remote.
+        uint64_t messages_sent;           // times data was published, by a send, a write, or a chunk of a large message.
+        uint64_t bytes_received;          // bytes consumed from the remote.
+        uint64_t messages_received;       // times data was consumed, by a receive, a read, or a chunk of a large message.
+        uint64_t send_no_space;           // sends and writes that found no room in the ring.
+        uint64_t recv_no_data;            // receives and reads that found nothing in the ring.
+        uint64_t notifications_sent;      // events fired to the remote.
+        uint64_t notifications_received;  // events received from the remote.
+        uint64_t callbacks_dispatched;    // times the event callbacks were run for received events.
+        uint64_t callback_latency_total_ns; // total time from picking up an event to its callbacks returning.
+        uint64_t callback_latency_max_ns; // the longest of those.
+        uint32_t peak_tx_occupancy;       // the most bytes seen waiting in the outgoing ring.
+        uint32_t peak_rx_occupancy;       // the most bytes seen waiting in the incoming ring.
+    };
+
+    // The most priority lanes a connection may have; see libivc_connect_lanes.
+#define LIBIVC_MAX_LANES 8
+
+    // The largest message libivc_recv_large accepts, unless the client asks
+    // for otherwise; see libivc_set_max_large_message.
+#define LIBIVC_DEFAULT_MAX_LARGE_MESSAGE (64 * 1024 * 1024)
+
+    // How many connections the driver holds for a user space server before
+    // refusing new ones, unless the server asks for otherwise; see
+    // libivc_start_listening_server_backlog. 0 is no limit.
+#define LIBIVC_DEFAULT_ACCEPT_BACKLOG 0
+
+    // How libivc_recv_next_lane picks among lanes with data waiting: always the
+    // lowest numbered (most urgent) one, or each in proportion to its weight.
+    typedef enum LANE_POLICY
+    {
+        LIBIVC_LANE_STRICT, LIBIVC_LANE_WEIGHTED
+    } LANE_POLICY_T;
+
+    // A stretch of a ring, as exposed in place by libivc_reserve and
+    // libivc_peek. Space or data that wraps around the end of the ring takes
+    // two of them.
+    struct libivc_segment
+    {
+        char *base;                       // the start of the stretch.
+        size_t length;                    // its length.
+    };
+
+    // One connection for libivc_connect_many to open.
+    struct libivc_connect_req
+    {
+        uint16_t remote_domid;            // remote domain to connect to.
+        uint16_t port;                    // remote port to connect to.
+        uint32_t num_pages;               // number of pages to share.
+        uint64_t connection_id;           // the connection's ID, or LIBIVC_ID_NONE.
+        uint8_t num_lanes;                // lanes in each direction; zero for one.
+    };
+
+    // The outcome of one of libivc_connect_many's connections.
+    struct libivc_connect_result
+    {
+        struct libivc_client *client;     // the connected client, or NULL.
+        int status;                       // SUCCESS or appropriate error number.
+    };
+
 #ifdef _WIN32
     // these will need to be converted to NTSTATUS codes
     // for return through the driver to the userspace layer.
@@ -69,6 +134,7 @@ extern "C"
 #define IVC_UNAVAILABLE -EUNATCH
 #define TIMED_OUT -ETIMEDOUT
 #define NOT_IMPLEMENTED -ENOSYS
+#define PROTOCOL_ERROR -EPROTO
 
 #ifdef	__cplusplus
 }
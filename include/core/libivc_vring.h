@@ -0,0 +1,176 @@
+//
+// IVC Driver
+//
+// Copyright (C) 2016 Assured Information Security, Inc. All rights reserved.
+//
+
+/*
+ * File:   libivc_vring.h
+ * A split descriptor ring, in the style of virtio, over a connection's shared
+ * buffer. The start of the buffer, past the few bytes libivc keeps for itself,
+ * holds a small ring of descriptors, each pointing at a data buffer in the
+ * bulk area that makes up the rest of it, and a ring of completions going the
+ * other way. Large payloads never pass through a ring: the producer hands the
+ * consumer ownership of a data buffer by posting its descriptor, and the
+ * consumer hands it back by completing it.
+ *
+ * Data buffers are whole, contiguous pages of the bulk area, managed by the
+ * producer. Each buffer in flight has an ID, and completions carry only the ID
+ * and the number of bytes the consumer wrote, so nothing the consumer writes
+ * can change which pages the producer gets back. Buffers posted with
+ * LIBIVC_VRING_F_WRITE are for the consumer to fill in, as with receive
+ * buffers; the others carry data to it.
+ *
+ * Neither posting nor completing notifies the remote: call libivc_vring_kick
+ * once a batch is published. The ring takes over the whole buffer, so the
+ * client must then only be used through it. Userspace only.
+ */
+
+#ifndef LIBIVC_VRING_H
+#define	LIBIVC_VRING_H
+
+#ifdef	__cplusplus
+extern "C"
+{
+#endif
+
+#include <libivc.h>
+
+/**
+ * The number of entries in each ring, and so the most buffers in flight.
+ */
+#define LIBIVC_VRING_SIZE 256
+
+/**
+ * Set on a buffer the consumer is to write, rather than read.
+ */
+#define LIBIVC_VRING_F_WRITE 0x1
+
+/**
+ * A descriptor, as posted and as completed.
+ */
+struct libivc_vring_desc
+{
+    uint32_t offset;                  // the buffer's offset in the shared buffer.
+    uint32_t length;                  // the length of the data; once completed, the
+                                      // number of bytes the consumer wrote.
+    uint32_t flags;                   // LIBIVC_VRING_F_ flags.
+    uint32_t id;                      // identifies the buffer while it's in flight.
+};
+
+struct libivc_vring;
+
+    /**
+     * Creates a descriptor ring over a connected client's buffer. One side of
+     * the connection must be the producer, and the other the consumer.
+     * @param vring - pointer to receive the new ring.
+     * @param client - a connected ivc client, whose buffer must be at least
+     *    three pages.
+     * @param producer - non zero on the side that owns the data buffers.
+     * @return SUCCESS or appropriate error number.
+     */
+    int
+    libivc_vring_create(struct libivc_vring **vring, struct libivc_client *client, uint8_t producer);
+
+    /**
+     * Destroys a descriptor ring. The client is left connected.
+     * @param vring - the ring to destroy.
+     */
+    void
+    libivc_vring_destroy(struct libivc_vring *vring);
+
+    /**
+     * Gets the size of the bulk area, which bounds the size of a data buffer.
+     * @param vring - the ring of interest.
+     * @return the size of the bulk area, in bytes.
+     */
+    size_t
+    libivc_vring_bulk_size(struct libivc_vring *vring);
+
+    /**
+     * Takes a data buffer from the bulk area. Producer only.
+     * @param vring - the ring of interest.
+     * @param size - the size of the buffer.
+     * @param flags - LIBIVC_VRING_F_ flags to post it with.
+     * @param desc - the descriptor to fill in.
+     * @return SUCCESS, NO_SPACE if there's no room, or appropriate error number.
+     */
+    int
+    libivc_vring_get_buffer(struct libivc_vring *vring, size_t size, uint32_t flags,
+        struct libivc_vring_desc *desc);
+
+    /**
+     * Returns a data buffer to the bulk area. Producer only; the buffer must not
+     * be posted.
+     * @param vring - the ring of interest.
+     * @param desc - the buffer's descriptor.
+     * @return SUCCESS, or INVALID_PARAM if the buffer isn't ours to return.
+     */
+    int
+    libivc_vring_put_buffer(struct libivc_vring *vring, struct libivc_vring_desc *desc);
+
+    /**
+     * Gets the address of a data buffer in the local mapping of the buffer.
+     * @param vring - the ring of interest.
+     * @param desc - the buffer's descriptor.
+     * @return the data's address, or NULL if the descriptor lies outside the bulk area.
+     */
+    void *
+    libivc_vring_ptr(struct libivc_vring *vring, struct libivc_vring_desc *desc);
+
+    /**
+     * Passes ownership of a data buffer to the consumer. Producer only. The
+     * descriptor's length may be shortened first, to the amount of data in it.
+     * @param vring - the ring of interest.
+     * @param desc - the buffer's descriptor.
+     * @return SUCCESS, NO_SPACE if the ring is full, or appropriate error number.
+     */
+    int
+    libivc_vring_post(struct libivc_vring *vring, struct libivc_vring_desc *desc);
+
+    /**
+     * Takes back the next data buffer the consumer has completed. Producer
+     * only. The buffer may be posted again, or returned to the bulk area.
+     * @param vring - the ring of interest.
+     * @param desc - receives the buffer's descriptor, with its length set to
+     *    the number of bytes the consumer wrote.
+     * @return SUCCESS, NO_DATA_AVAIL if there are none, or appropriate error number.
+     */
+    int
+    libivc_vring_reap(struct libivc_vring *vring, struct libivc_vring_desc *desc);
+
+    /**
+     * Takes the next data buffer the producer has posted. Consumer only.
+     * @param vring - the ring of interest.
+     * @param desc - receives the buffer's descriptor.
+     * @return SUCCESS, NO_DATA_AVAIL if there are none, or appropriate error number.
+     */
+    int
+    libivc_vring_pop(struct libivc_vring *vring, struct libivc_vring_desc *desc);
+
+    /**
+     * Hands a data buffer back to the producer. Consumer only.
+     * @param vring - the ring of interest.
+     * @param desc - the buffer's descriptor, as popped.
+     * @param written - the number of bytes written into a LIBIVC_VRING_F_WRITE
+     *    buffer; ignored for the others.
+     * @return SUCCESS or appropriate error number.
+     */
+    int
+    libivc_vring_complete(struct libivc_vring *vring, struct libivc_vring_desc *desc,
+        uint32_t written);
+
+    /**
+     * Notifies the remote, if anything has been posted or completed since the
+     * last kick.
+     * @param vring - the ring of interest.
+     * @return SUCCESS or appropriate error number.
+     */
+    int
+    libivc_vring_kick(struct libivc_vring *vring);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* LIBIVC_VRING_H */
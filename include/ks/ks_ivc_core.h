@@ -51,12 +51,26 @@ struct libivc_client *ks_ivc_core_get_client(uint32_t clientNo);
 int
 ks_ivc_core_connect(struct libivc_client *client);
 
+/**
+ * Connects many clients at once, with their CONNECT requests all in flight
+ * together.
+ * @param clients The clients to connect.
+ * @param statuses Receives SUCCESS or an error number for each client.
+ * @param count The number of clients.
+ * @return SUCCESS or appropriate error number.
+ */
+int
+ks_ivc_core_connect_many(struct libivc_client **clients, int *statuses, uint32_t count);
+
 int
 ks_ivc_core_reconnect(struct libivc_client *client, uint16_t new_domid, uint16_t new_port);
 
 int
 ks_ivc_core_disconnect(struct libivc_client *client);
 
+int
+ks_ivc_core_park(struct libivc_client *client);
+
 int
 ks_ivc_core_notify_remote(struct libivc_client *client);
 
@@ -112,6 +126,30 @@ ks_ivc_core_handle_domain_death_notification(libivc_message_t *msg);
 int
 ks_ivc_core_client_ioctl(uint8_t ioctlNum, struct libivc_client_ioctl_info *client, file_context_t *context);
 
+/**
+ * Connects many user space clients at once, servicing the IVC_CONNECT_BATCH IOCTL.
+ * @param batch - non null pointer to the user space batch payload.
+ * @param clients - kernel copy of the batch's client entries.
+ * @param statuses - receives SUCCESS or an error number for each client.
+ * @param context - non null pointer to user space file context.
+ * @return SUCCESS or appropriate error number.
+ */
+int
+ks_ivc_core_connect_batch(struct libivc_connect_batch_ioctl_info *batch, struct libivc_client_ioctl_info *clients,
+                          int32_t *statuses, file_context_t *context);
+
+/**
+ * Accepts as many of a user space server's waiting clients as the caller has
+ * room for, servicing the IVC_SERVER_ACCEPT_BATCH IOCTL.
+ * @param batch - non null pointer to the user space batch payload.
+ * @param clients - kernel copy of the batch's client entries.
+ * @param context - non null pointer to user space file context.
+ * @return SUCCESS or appropriate error number.
+ */
+int
+ks_ivc_core_accept_batch(struct libivc_accept_batch_ioctl_info *batch, struct libivc_client_ioctl_info *clients,
+                         file_context_t *context);
+
 /**
  * Services IOCTLs coming from user space for ivc server related operations.
  * @param ioctlNum - The IOCTL number as defined in ivc_ioctl_defs.h
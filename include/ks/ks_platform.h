@@ -131,18 +131,44 @@ ks_platform_free(void *mem);
  * @return SUCCESS or appropriate error message.
  */
 int
-ks_platform_alloc_shared_mem(uint32_t numPages, uint16_t remoteDomId,
+ks_platform_alloc_shared_mem(uint32_t numPages, uint16_t remoteDomId, uint8_t readOnly,
                              char **mem, mapped_grant_ref_t **grantRefs);
 
 
 /**
  * Free the shared memory previously created by ks_platform_alloc_shared_mem.
+ * If the memory has been shared on with ks_platform_share_mem, the pages are
+ * only released once each of those shares has been undone as well.
  * @param mem - Non NULL pointer returned in ks_platform_alloc_shared_mem
  * @return SUCCESS or appropriate error number.
  */
 int
 ks_platform_free_shared_mem(char *mem);
 
+/**
+ * Shares memory previously allocated by ks_platform_alloc_shared_mem to an
+ * additional domain, without copying it. Every domain it is shared to sees the
+ * same pages.
+ * @param mem - Non NULL pointer returned in ks_platform_alloc_shared_mem
+ * @param remoteDomId The remote domain id being shared to.
+ * @param readOnly Non zero for read only memory to the remote dom.
+ * @param grantRefs pointer to receive list of grant refs into.  Should not be
+ * modified outside of platform itself.
+ * @return SUCCESS or appropriate error number.
+ */
+int
+ks_platform_share_mem(char *mem, uint16_t remoteDomId, uint8_t readOnly,
+                      mapped_grant_ref_t **grantRefs);
+
+/**
+ * Undoes a share created by ks_platform_share_mem.
+ * @param mem - Non NULL pointer passed to ks_platform_share_mem
+ * @param grantRefs - the grant refs returned by ks_platform_share_mem.
+ * @return SUCCESS or appropriate error number.
+ */
+int
+ks_platform_unshare_mem(char *mem, mapped_grant_ref_t *grantRefs);
+
 /**
  * given a xen event channel port number, bind it to a local irq number
  * and a callback that will be called when the event is fired in the platform driver.
@@ -63,9 +63,20 @@ typedef struct shareable_mem_alloc {
     grant_ref_t *grantHandles; // matching grant refs to each page.
     void *kAddress; //the virtually contiguous address to the pages.
     uint16_t remoteDomId;
+    uint8_t readOnly; // non zero if remoteDomId was only granted read access.
+    uint32_t refCount; // the allocation itself, plus one for each additional share.
+    list_head_t shares; // additional shares of these pages, see ks_platform_share_mem.
+    uint8_t freed; // non zero once the allocation itself has been freed, while shares remain.
     void *context;
 } shareable_mem_alloc_t;
 
+typedef struct shared_mem_grant {
+    list_head_t listHead; // used in the owning allocation's list of shares.
+    uint16_t remoteDomId; // the domain the pages were shared to.
+    uint8_t readOnly; // non zero if the domain was only granted read access.
+    grant_ref_t *grantHandles; // matching grant refs to each page, or NULL if shared locally.
+} shared_mem_grant_t;
+
 typedef struct mapped_mem_descriptor {
     unsigned long id;
     list_head_t listHead; // used in list of mapped memory
@@ -26,6 +26,7 @@
 #define ssize_t   LONG
 #define domid_t   uint16_t
 #define atomic_t  LONG
+#define atomic64_t LONG64
 
 #ifndef ENXIO
 #define ENXIO  6
@@ -48,6 +49,10 @@
 #define EUNATCH 49
 #endif
 
+#ifndef EPROTO
+#define EPROTO 71
+#endif
+
 //FIXME: these warnings shouldn't occur in the first place
 #pragma warning( disable : 4127 4267 )
 
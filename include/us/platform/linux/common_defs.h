@@ -38,10 +38,13 @@ extern "C"
 #define IVC_DRIVER_IOC_MAGIC 'K'
 
 #define IVC_CONNECT _IOWR(IVC_DRIVER_IOC_MAGIC,IVC_CONNECT_IOCTL,struct libivc_client)
+#define IVC_CONNECT_BATCH _IOWR(IVC_DRIVER_IOC_MAGIC, IVC_CONNECT_BATCH_IOCTL, struct libivc_connect_batch_ioctl_info)
 #define IVC_RECONNECT _IOWR(IVC_DRIVER_IOC_MAGIC,IVC_RECONNECT_IOCTL,struct libivc_client)
+#define IVC_PARK _IOWR(IVC_DRIVER_IOC_MAGIC,IVC_PARK_IOCTL,struct libivc_client)
 #define IVC_DISCONNECT _IOWR(IVC_DRIVER_IOC_MAGIC, IVC_DISCONNECT_IOCTL, struct libivc_client)
 #define IVC_NOTIFY_REMOTE _IOWR(IVC_DRIVER_IOC_MAGIC, IVC_NOTIFY_REMOTE_IOCTL, struct libivc_client)
 #define IVC_SERVER_ACCEPT _IOWR(IVC_DRIVER_IOC_MAGIC, IVC_SERVER_ACCEPT_IOCTL, struct libivc_client)
+#define IVC_SERVER_ACCEPT_BATCH _IOWR(IVC_DRIVER_IOC_MAGIC, IVC_SERVER_ACCEPT_BATCH_IOCTL, struct libivc_accept_batch_ioctl_info)
 
 #define IVC_REG_SVR_LSTNR _IOWR(IVC_DRIVER_IOC_MAGIC, IVC_REG_SVR_LSNR_IOCTL, struct libivc_server)
 #define IVC_UNREG_SVR_LSTNR _IOWR(IVC_DRIVER_IOC_MAGIC, IVC_UNREG_SVR_LSNR_IOCTL, struct libivc_server)
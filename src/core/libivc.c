@@ -22,6 +22,7 @@
 #include <libivc_private.h>
 #include <ringbuffer.h>
 #include <libivc_debug.h>
+#include <libivc_probes.h>
 
 LIST_HEAD(ivcServerList);
 LIST_HEAD(ivcClients);
@@ -162,6 +163,33 @@ int
 libivc_start_listening_server(struct libivc_server **server, 
     uint16_t listening_port, uint16_t listen_for_domid, uint64_t listen_for_connection_id, 
     libivc_client_connected connectCallback, void *opaque)
+{
+    return libivc_start_listening_server_backlog(server, listening_port, listen_for_domid,
+        listen_for_connection_id, LIBIVC_DEFAULT_ACCEPT_BACKLOG, connectCallback, opaque);
+}
+#ifdef KERNEL
+#ifdef __linux
+EXPORT_SYMBOL(libivc_start_listening_server);
+#endif
+#endif
+
+/**
+ * Sets up a listener for incoming connections from remote domains, with a
+ * limit on how many connections may wait to be accepted.
+ *
+ * @param server - pointer to receive ivc server object.
+ * @param listening_port - port to listen for incoming connections on.
+ * @param listen_for_domid - the domain ID that the server should listen for, or LIBIVC_DOMID_ANY.
+ * @param listen_for_connection_id - the connection ID that the server should listen for, or LIBIVC_ID_ANY.
+ * @param accept_backlog - the most connections left waiting to be accepted, or 0 for no limit.
+ * @param client_callback - callback to be notified of new client connections that have been fully established.
+ * @param opaque - A user-specified object that will be passed to any relevant callbacks.
+ * @return SUCCESS, or appropriate error number.
+ */
+int
+libivc_start_listening_server_backlog(struct libivc_server **server, 
+    uint16_t listening_port, uint16_t listen_for_domid, uint64_t listen_for_connection_id, 
+    uint32_t accept_backlog, libivc_client_connected connectCallback, void *opaque)
 {
     int rc;
     struct libivc_server * iserver = NULL;
@@ -209,6 +237,7 @@ libivc_start_listening_server(struct libivc_server **server,
     iserver->port = listening_port;
     iserver->limit_to_domid = listen_for_domid;
     iserver->limit_to_connection_id = listen_for_connection_id;
+    iserver->accept_backlog = accept_backlog;
 
     libivc_assert_goto((rc = platformAPI->registerServerListener(iserver)) == SUCCESS, ERR);
 
@@ -231,7 +260,7 @@ END:
 }
 #ifdef KERNEL
 #ifdef __linux
-EXPORT_SYMBOL(libivc_start_listening_server);
+EXPORT_SYMBOL(libivc_start_listening_server_backlog);
 #endif
 #endif
 #ifdef _WIN32
@@ -373,6 +402,12 @@ libivc_put_client(struct libivc_client *client)
             free(client->ringbuffer);
         }
 
+        if(client->large_rx_owned && client->large_rx_dest)
+            free(client->large_rx_dest);
+
+        if(client->resize_shadow)
+            free(client->resize_shadow);
+
         memset(client, 0, sizeof (struct libivc_client));
         free(client);
     }
@@ -404,6 +439,239 @@ static void * incoming_channel_for(struct libivc_client *client)
 }
 
 
+/**
+ * Returns the number of lanes the given IVC client has in each direction.
+ */
+static uint8_t lanes_of(struct libivc_client *client)
+{
+    return client->num_lanes > 1 ? client->num_lanes : 1;
+}
+
+
+/**
+ * Returns the outgoing (write) channel of one of the given IVC client's lanes.
+ * Lane L uses channels 2L and 2L + 1, so lane 0 is the usual pair.
+ */
+static struct ringbuffer_channel_t * outgoing_lane_channel_for(struct libivc_client *client, uint8_t lane)
+{
+    size_t channel_number = client->server_side ? SERVER_TO_CLIENT_CHANNEL : CLIENT_TO_SERVER_CHANNEL;
+    return &client->ringbuffer->channels[2 * lane + channel_number];
+}
+
+
+/**
+ * Returns the incoming (read) channel of one of the given IVC client's lanes.
+ */
+static struct ringbuffer_channel_t * incoming_lane_channel_for(struct libivc_client *client, uint8_t lane)
+{
+    size_t channel_number = client->server_side ? CLIENT_TO_SERVER_CHANNEL : SERVER_TO_CLIENT_CHANNEL;
+    return &client->ringbuffer->channels[2 * lane + channel_number];
+}
+
+
+/**
+ * Determines whether the remote wants events for data sent on one of the
+ * given IVC client's lanes.
+ */
+static bool remote_lane_events_enabled(struct libivc_client *client, uint8_t lane)
+{
+    int32_t target_flag = client->server_side ? SERVER_SIDE_TX_EVENT_FLAG : CLIENT_SIDE_TX_EVENT_FLAG;
+    return (ringbuffer_get_flags(outgoing_lane_channel_for(client, lane)) & target_flag) != 0;
+}
+
+
+/**
+ * Returns the number of pages the given IVC client's ring spans.
+ */
+static uint32_t pages_of(struct libivc_client *client)
+{
+    return client->ring_pages ? client->ring_pages : client->num_pages;
+}
+
+
+/**
+ * Lays the client's channels out over the first pages of its buffer, leaving
+ * whatever is in them alone.
+ * @return SUCCESS or appropriate error number.
+ */
+static int
+libivc_layout_ring(struct libivc_client *client, uint32_t pages)
+{
+    int32_t channel_length, i;
+
+    channel_length = (int32_t)((pages * PAGE_SIZE) / client->ringbuffer->num_channels);
+    client->ringbuffer->length = pages * PAGE_SIZE;
+
+    for (i = 0; i < client->ringbuffer->num_channels; i++)
+        libivc_assert(ringbuffer_channel_create(&client->ringbuffer->channels[i], channel_length) == 0, INVALID_PARAM);
+
+    libivc_assert(ringbuffer_use(client->ringbuffer) == 0, INVALID_PARAM);
+    client->ring_pages = (pages == client->num_pages) ? 0 : pages;
+    return SUCCESS;
+}
+
+
+/**
+ * Lays the client's ring buffer out over its buffer. Every channel is the same
+ * size, so with a single lane this is the usual pair of halves.
+ * @return SUCCESS or appropriate error number.
+ */
+int
+__libivc_create_ringbuffer(struct libivc_client *client)
+{
+    int32_t num_channels;
+
+    libivc_checkp(client, INVALID_PARAM);
+    libivc_checkp(client->buffer, INVALID_PARAM);
+
+    num_channels = 2 * lanes_of(client);
+
+    if (client->ringbuffer == NULL) {
+        client->ringbuffer = malloc(sizeof(client->ringbuffer[0]));
+        libivc_checkp(client->ringbuffer, OUT_OF_MEM);
+        memset(client->ringbuffer, 0, sizeof(client->ringbuffer[0]));
+    }
+
+    // A reconnected client keeps its lanes, and so its channels.
+    if (client->ringbuffer->channels == NULL) {
+        client->ringbuffer->channels = malloc(num_channels * sizeof(client->ringbuffer->channels[0]));
+        libivc_checkp(client->ringbuffer->channels, OUT_OF_MEM);
+        memset(client->ringbuffer->channels, 0, num_channels * sizeof(client->ringbuffer->channels[0]));
+    }
+
+    client->ringbuffer->buffer = client->buffer;
+    client->ringbuffer->num_channels = num_channels;
+
+    // A new connection always starts out with the ring spanning the whole buffer.
+    if (client->resize_shadow) {
+        free(client->resize_shadow);
+        client->resize_shadow = NULL;
+    }
+
+    return libivc_layout_ring(client, client->num_pages);
+}
+
+
+/**
+ * Hands the client's buffer over to a layer that lays its own structures out
+ * in it; from then on, libivc leaves the ring's headers alone.
+ */
+void
+__libivc_take_over_buffer(struct libivc_client *client)
+{
+    libivc_checkp(client);
+
+    mutex_lock(&client->mutex);
+    client->taken_over = 1;
+    client->resizable = 0;
+    mutex_unlock(&client->mutex);
+}
+
+
+/**
+ * Determines whether a corked client has crossed one of its cork thresholds.
+ * Assumes the client's mutex is held.
+ */
+static bool
+libivc_cork_threshold_reached(struct libivc_client *client, uint64_t now)
+{
+    if (client->cork_max_bytes && client->cork_pending >= client->cork_max_bytes)
+        return true;
+
+    if (client->cork_max_delay_us &&
+        (now - client->cork_since) >= ((uint64_t)client->cork_max_delay_us * 1000))
+        return true;
+
+    return false;
+}
+
+
+/**
+ * Accounts for data that has just been published to the remote, and decides
+ * whether the remote should be notified of it now.
+ *
+ * @param client The client that published the data.
+ * @param published The number of bytes published.
+ * @return true if the notification should be deferred, as the client is corked
+ *    and has not yet crossed any of its cork thresholds.
+ */
+static bool
+libivc_defer_notification(struct libivc_client *client, size_t published)
+{
+    bool defer = false;
+    uint64_t now;
+
+    mutex_lock(&client->mutex);
+    if (client->corked)
+    {
+        now = libivc_monotonic_ns();
+        if (client->cork_pending == 0)
+            client->cork_since = now;
+
+        client->cork_pending += (uint32_t)published;
+        defer = !libivc_cork_threshold_reached(client, now);
+        if (!defer)
+            client->cork_pending = 0;
+    }
+    mutex_unlock(&client->mutex);
+
+    return defer;
+}
+
+
+/**
+ * Accounts for data that has just been published to the remote.
+ * Assumes the client's mutex is held.
+ */
+static void
+libivc_stats_sent(struct libivc_client *client, struct ringbuffer_channel_t *channel, size_t published)
+{
+    uint32_t occupancy = (uint32_t)(channel->body_length - ringbuffer_bytes_available_write(channel));
+
+    client->stats.bytes_sent += published;
+    client->stats.messages_sent++;
+    if (occupancy > client->stats.peak_tx_occupancy)
+        client->stats.peak_tx_occupancy = occupancy;
+}
+
+
+static int
+libivc_notify_pending(struct libivc_client *client, uint32_t pending);
+
+/**
+ * Accounts for a send that found the ring full. A corked client's deferred
+ * notifications are taken back, to be sent at once: the remote won't make
+ * room in the ring until it's told about the data filling it.
+ * Assumes the client's mutex is held.
+ * @return the number of bytes the remote should now be notified of.
+ */
+static uint32_t
+libivc_stats_ring_full(struct libivc_client *client)
+{
+    uint32_t pending = client->cork_pending;
+
+    client->cork_pending = 0;
+    client->stats.send_no_space++;
+    return pending;
+}
+
+
+/**
+ * Accounts for data that is about to be consumed from the remote.
+ * Assumes the client's mutex is held.
+ *
+ * @param available The number of bytes waiting in the ring before consuming.
+ */
+static void
+libivc_stats_received(struct libivc_client *client, int32_t available, size_t consumed)
+{
+    client->stats.bytes_received += consumed;
+    client->stats.messages_received++;
+    if (available > 0 && (uint32_t)available > client->stats.peak_rx_occupancy)
+        client->stats.peak_rx_occupancy = (uint32_t)available;
+}
+
+
 /**
  * Client style connection to a remote domain listening for connections.
  * @param ivc - pointer to receive created connection into
@@ -440,6 +708,96 @@ EXPORT_SYMBOL(libivc_connect_with_id);
 
 
 
+/**
+ * Creates a client-side client, ready to hand to the platform to connect, and
+ * adds it to the client list.
+ * @return the new client, or NULL if it couldn't be allocated.
+ */
+static struct libivc_client *
+libivc_new_client(uint16_t remote_dom_id, uint16_t remote_port, uint32_t numPages,
+        uint64_t connection_id, uint8_t read_only, struct libivc_client *source,
+        uint8_t parked, uint8_t num_lanes)
+{
+    struct libivc_client * client = NULL;
+
+    client = (struct libivc_client *) malloc(sizeof (struct libivc_client));
+    libivc_checkp(client, NULL);
+    memset(client, 0, sizeof (struct libivc_client));
+
+    client->remote_domid = remote_dom_id;
+    client->port = remote_port;
+    client->num_pages = numPages;
+    client->connection_id = connection_id;
+    client->read_only = read_only;
+    client->shares_buffer = (source != NULL);
+    client->buffer_source = source;
+    client->parked = parked;
+    client->num_lanes = num_lanes;
+
+    // Increment our client's reference count.
+    libivc_get_client(client);
+
+    INIT_LIST_HEAD(&client->callback_list);
+
+    mutex_init(&client->mutex);
+    libivc_event_wait_init(&client->event_wait);
+    INIT_LIST_HEAD(&client->node);
+
+    mutex_lock(&ivc_client_list_lock);
+    list_add(&client->node, &ivcClients);
+    mutex_unlock(&ivc_client_list_lock);
+
+    return client;
+}
+
+/**
+ * Releases a client made by libivc_new_client whose connection failed.
+ * @param client The client to release.
+ */
+static void
+libivc_release_new_client(struct libivc_client *client)
+{
+    if(client->ringbuffer)
+    {
+        if(client->ringbuffer->channels)
+        {
+            free(client->ringbuffer->channels);
+        }
+
+        free(client->ringbuffer);
+        client->ringbuffer = NULL;
+    }
+
+    mutex_lock(&ivc_client_list_lock);
+    list_del(&client->node);
+    mutex_unlock(&ivc_client_list_lock);
+    mutex_destroy(&client->mutex);
+    libivc_event_wait_destroy(&client->event_wait);
+    libivc_put_client(client);
+}
+
+/**
+ * Finishes setting up a client the platform has connected.
+ * @param client The client.
+ * @param rc What the platform's connect returned.
+ * @return SUCCESS or appropriate error number; on failure the client is released.
+ */
+static int
+libivc_finish_new_client(struct libivc_client *client, int rc)
+{
+    client->buffer_source = NULL;
+    libivc_assert_goto(rc == SUCCESS, ERR);
+    rc = INVALID_PARAM;
+    libivc_checkp_goto(client->buffer, ERR);
+
+    libivc_assert_goto((rc = __libivc_create_ringbuffer(client)) == SUCCESS, ERR);
+    return SUCCESS;
+
+ERR:
+    libivc_release_new_client(client);
+    return rc;
+}
+
 /**
  * Client style connection to a remote domain listening for connections.
  * @param ivc - pointer to receive created connection into
@@ -457,9 +815,10 @@ EXPORT_SYMBOL(libivc_connect_with_id);
 __pragma(warning(push))
 __pragma(warning(disable : 4127))
 #endif
-int
-libivc_connect_with_id(struct libivc_client **ivc, uint16_t remote_dom_id, uint16_t remote_port, 
-        uint32_t numPages, uint64_t connection_id)
+static int
+libivc_connect_internal(struct libivc_client **ivc, uint16_t remote_dom_id, uint16_t remote_port, 
+        uint32_t numPages, uint64_t connection_id, uint8_t read_only, struct libivc_client *source,
+        uint8_t parked, uint8_t num_lanes)
 {
     int rc = INVALID_PARAM;
     struct libivc_client * client = NULL;
@@ -467,7 +826,7 @@ libivc_connect_with_id(struct libivc_client **ivc, uint16_t remote_dom_id, uint1
 #ifdef _WIN32
     if (list_empty(&ivcClients))
     {
-        libivc_assert_goto((rc = ks_platform_load()) == STATUS_SUCCESS, ERR);
+        libivc_assert((rc = ks_platform_load()) == STATUS_SUCCESS, rc);
     }
 #endif
 #endif
@@ -487,71 +846,31 @@ libivc_connect_with_id(struct libivc_client **ivc, uint16_t remote_dom_id, uint1
 
     libivc_checkp(ivc, INVALID_PARAM);
     libivc_assert(numPages > 0, INVALID_PARAM);
+    libivc_probe3(connect_entry, remote_dom_id, remote_port, numPages);
 
-    client = (struct libivc_client *) malloc(sizeof (struct libivc_client));
-    libivc_checkp(client, OUT_OF_MEM);
-    memset(client, 0, sizeof (struct libivc_client));
-
-    client->remote_domid = remote_dom_id;
-    client->port = remote_port;
-    client->num_pages = numPages;
-    client->connection_id = connection_id;
-
-    // Increment our client's reference count.
-    libivc_get_client(client);
-
-    INIT_LIST_HEAD(&client->callback_list);
-
-    mutex_init(&client->mutex);
-    INIT_LIST_HEAD(&client->node);
-
-    mutex_lock(&ivc_client_list_lock);
-    list_add(&client->node, &ivcClients);
-    mutex_unlock(&ivc_client_list_lock);
-
-    libivc_assert_goto((rc = platformAPI->connect(client)) == SUCCESS, ERR);
-    libivc_checkp_goto(client->buffer, ERR);
-
-    client->ringbuffer = malloc(sizeof(client->ringbuffer[0]));
-    libivc_assert_goto(client->ringbuffer != NULL, ERR);
-
-    client->ringbuffer->buffer = client->buffer;
-    client->ringbuffer->length = client->num_pages*PAGE_SIZE;
-    client->ringbuffer->num_channels = 2;
-    client->ringbuffer->channels = malloc(2*sizeof(client->ringbuffer->channels[0]));
-    libivc_assert_goto(client->ringbuffer->channels != NULL, ERR);
-
-    ringbuffer_channel_create(&client->ringbuffer->channels[0], (client->num_pages * PAGE_SIZE)/2);
-    ringbuffer_channel_create(&client->ringbuffer->channels[1], (client->num_pages * PAGE_SIZE)/2);
-    ringbuffer_use(client->ringbuffer);
-
-
-    rc = SUCCESS;
-    goto END;
-ERR:
+    client = libivc_new_client(remote_dom_id, remote_port, numPages, connection_id, read_only,
+                               source, parked, num_lanes);
     if (client)
-    {
-        if(client->ringbuffer)
-        {
-            if(client->ringbuffer->channels)
-            {
-                free(client->ringbuffer->channels);
-            }
-
-            free(client->ringbuffer);
-        }
+        rc = libivc_finish_new_client(client, platformAPI->connect(client));
+    else
+        rc = OUT_OF_MEM;
 
-        list_del(&client->node);
-        mutex_destroy(&client->mutex);
-        libivc_put_client(client);
+    if (rc != SUCCESS)
         client = NULL;
-    }
-END:
+
     *ivc = client;
+    libivc_probe3(connect_return, remote_dom_id, remote_port, rc);
 
     libivc_info("%d <====\n", rc);
     return rc;
 }
+
+int
+libivc_connect_with_id(struct libivc_client **ivc, uint16_t remote_dom_id, uint16_t remote_port, 
+        uint32_t numPages, uint64_t connection_id)
+{
+    return libivc_connect_internal(ivc, remote_dom_id, remote_port, numPages, connection_id, 0, NULL, 0, 1);
+}
 #ifdef KERNEL
 #ifdef __linux
 EXPORT_SYMBOL(libivc_connect);
@@ -564,13 +883,255 @@ __pragma(warning(pop))
 
 
 /**
- * Returns any connection identifier associated with the given display,
- * or LIBIVC_ID_NONE if no connection information could be queried.
- *
- * @param client The client for which the connection identifier is desired.
- * @return The relevant connection ID, or LIBIVC_ID_NONE if none
- *    could be accessed. Should be the same on both sides of an IVC
- *    connection.
+ * Client style connection to a remote domain, where the remote is only granted
+ * read access to the shared buffer. The buffer may be shared with an existing
+ * connection rather than newly allocated, so that data written once can be
+ * read by several remotes.
+ * @param ivc - pointer to receive created connection into
+ * @param remote_dom_id - remote domain to connect to.
+ * @param remote_port - remote port to connect to.
+ * @param numPages - number of pages to share. Ignored if source is given.
+ * @param connection_id A unique number identifying the originator of the connection.
+ * @param source - a connected client-side client whose buffer should be shared,
+ *        or NULL to allocate a new buffer. The buffer stays valid until every
+ *        connection sharing it has disconnected.
+ * @return SUCCESS or appropriate error number.
+ */
+#ifdef _WIN32
+
+__pragma(warning(push))
+__pragma(warning(disable : 4127))
+#endif
+int
+libivc_connect_shared(struct libivc_client **ivc, uint16_t remote_dom_id, uint16_t remote_port,
+        uint32_t numPages, uint64_t connection_id, struct libivc_client *source)
+{
+    if (source)
+    {
+        libivc_assert(libivc_isOpen(source), NOT_CONNECTED);
+        libivc_assert(!source->server_side, INVALID_PARAM);
+        numPages = source->num_pages;
+    }
+
+    return libivc_connect_internal(ivc, remote_dom_id, remote_port, numPages, connection_id, 1, source, 0, 1);
+}
+#ifdef KERNEL
+#ifdef __linux
+EXPORT_SYMBOL(libivc_connect_shared);
+#endif
+#endif
+#ifdef _WIN32
+
+__pragma(warning(pop))
+#endif
+
+
+/**
+ * Allocates and grants a buffer to a remote domain, as for a client-style
+ * connection, but doesn't connect to anything yet. The client can later be
+ * connected with libivc_reconnect, which then only has to notify the remote;
+ * this moves the cost of setting up the buffer off the connection path.
+ * @param ivc - pointer to receive the parked client.
+ * @param remote_dom_id - the domain the buffer is granted to. The client may only
+ *        be reconnected to servers in this domain.
+ * @param remote_port - the port recorded for the client until it is reconnected.
+ * @param numPages - number of pages to share.
+ * @param connection_id A unique number identifying the originator of the connection.
+ * @return SUCCESS or appropriate error number.
+ */
+#ifdef _WIN32
+
+__pragma(warning(push))
+__pragma(warning(disable : 4127))
+#endif
+int
+libivc_connect_parked(struct libivc_client **ivc, uint16_t remote_dom_id, uint16_t remote_port,
+        uint32_t numPages, uint64_t connection_id)
+{
+    return libivc_connect_internal(ivc, remote_dom_id, remote_port, numPages, connection_id, 0, NULL, 1, 1);
+}
+#ifdef KERNEL
+#ifdef __linux
+EXPORT_SYMBOL(libivc_connect_parked);
+#endif
+#endif
+#ifdef _WIN32
+
+__pragma(warning(pop))
+#endif
+
+
+/**
+ * Client style connection to a remote domain with several lanes in each
+ * direction, each with its own channel in the ring, so that urgent messages
+ * aren't stuck behind bulk data. Lane 0 is the one libivc_send and libivc_recv
+ * use; the buffer is divided evenly between the lanes.
+ * @param ivc - pointer to receive created connection into
+ * @param remote_dom_id - remote domain to connect to.
+ * @param remote_port - remote port to connect to.
+ * @param numPages - number of pages to share.
+ * @param connection_id A unique number identifying the originator of the connection.
+ * @param num_lanes - lanes in each direction, from 1 to LIBIVC_MAX_LANES.
+ * @return SUCCESS or appropriate error number.
+ */
+#ifdef _WIN32
+
+__pragma(warning(push))
+__pragma(warning(disable : 4127))
+#endif
+int
+libivc_connect_lanes(struct libivc_client **ivc, uint16_t remote_dom_id, uint16_t remote_port,
+        uint32_t numPages, uint64_t connection_id, uint8_t num_lanes)
+{
+    libivc_assert(num_lanes > 0 && num_lanes <= LIBIVC_MAX_LANES, INVALID_PARAM);
+
+    return libivc_connect_internal(ivc, remote_dom_id, remote_port, numPages, connection_id, 0, NULL, 0, num_lanes);
+}
+#ifdef KERNEL
+#ifdef __linux
+EXPORT_SYMBOL(libivc_connect_lanes);
+#endif
+#endif
+#ifdef _WIN32
+
+__pragma(warning(pop))
+#endif
+
+
+/**
+ * Client style connections to many remotes at once. Every buffer is allocated
+ * and granted before any CONNECT request is sent, the requests are sent back
+ * to back, and the ACKs are collected together, so the cost of the round trips
+ * is paid about once rather than once per connection. Where the platform can't
+ * batch connections, they're made one after another.
+ * @param reqs - the connections to open.
+ * @param count - the number of connections.
+ * @param results - count entries, receiving each connection's client and status.
+ * @return SUCCESS once every result has been filled in, even if some of the
+ *    connections failed, or appropriate error number.
+ */
+#ifdef _WIN32
+
+__pragma(warning(push))
+__pragma(warning(disable : 4127))
+#endif
+int
+libivc_connect_many(const struct libivc_connect_req *reqs, uint32_t count,
+        struct libivc_connect_result *results)
+{
+    int rc = INVALID_PARAM;
+    struct libivc_client **clients = NULL;
+    int *statuses = NULL;
+    uint32_t *index = NULL;
+    uint32_t first, last, pending, i, j;
+    const struct libivc_connect_req *req = NULL;
+
+    libivc_checkp(reqs, INVALID_PARAM);
+    libivc_checkp(results, INVALID_PARAM);
+    libivc_assert(count > 0, INVALID_PARAM);
+
+    if (!initialized)
+    {
+        libivc_assert((rc = libivc_init()) == SUCCESS, rc);
+    }
+
+    libivc_probe1(connect_many_entry, count);
+
+    rc = OUT_OF_MEM;
+    clients = (struct libivc_client **) malloc(LIBIVC_CONNECT_BATCH_MAX * sizeof(struct libivc_client *));
+    statuses = (int *) malloc(LIBIVC_CONNECT_BATCH_MAX * sizeof(int));
+    index = (uint32_t *) malloc(LIBIVC_CONNECT_BATCH_MAX * sizeof(uint32_t));
+    libivc_checkp_goto(clients, END);
+    libivc_checkp_goto(statuses, END);
+    libivc_checkp_goto(index, END);
+
+    for (first = 0; first < count; first = last)
+    {
+        last = (count - first > LIBIVC_CONNECT_BATCH_MAX) ? first + LIBIVC_CONNECT_BATCH_MAX : count;
+        pending = 0;
+
+        for (i = first; i < last; i++)
+        {
+            req = &reqs[i];
+            results[i].client = NULL;
+            results[i].status = INVALID_PARAM;
+
+            if ((req->remote_domid == IVC_DOM_ID && req->port == IVC_PORT) ||
+                req->num_pages == 0 || req->num_lanes > LIBIVC_MAX_LANES)
+            {
+                libivc_error("Invalid connection request to dom%u:%u.\n", req->remote_domid, req->port);
+                continue;
+            }
+
+            clients[pending] = libivc_new_client(req->remote_domid, req->port, req->num_pages,
+                    req->connection_id, 0, NULL, 0, req->num_lanes ? req->num_lanes : 1);
+            if (!clients[pending])
+            {
+                results[i].status = OUT_OF_MEM;
+                continue;
+            }
+
+            index[pending++] = i;
+        }
+
+        if (pending == 0)
+            continue;
+
+        // Fall back to connecting one at a time if the platform can't batch,
+        // for instance with an older driver. Any other failure leaves nothing
+        // connected, and connecting again would only fail the same way.
+        rc = platformAPI->connectMany ? platformAPI->connectMany(clients, statuses, pending) : NOT_IMPLEMENTED;
+        if (rc == NOT_IMPLEMENTED)
+        {
+            for (j = 0; j < pending; j++)
+                statuses[j] = platformAPI->connect(clients[j]);
+        }
+        else if (rc != SUCCESS)
+        {
+            for (j = 0; j < pending; j++)
+                statuses[j] = rc;
+        }
+
+        for (j = 0; j < pending; j++)
+        {
+            results[index[j]].status = libivc_finish_new_client(clients[j], statuses[j]);
+            if (results[index[j]].status == SUCCESS)
+                results[index[j]].client = clients[j];
+        }
+    }
+
+    rc = SUCCESS;
+
+END:
+    if (index)
+        free(index);
+    if (statuses)
+        free(statuses);
+    if (clients)
+        free(clients);
+
+    libivc_probe2(connect_many_return, count, rc);
+    return rc;
+}
+#ifdef KERNEL
+#ifdef __linux
+EXPORT_SYMBOL(libivc_connect_many);
+#endif
+#endif
+#ifdef _WIN32
+
+__pragma(warning(pop))
+#endif
+
+
+/**
+ * Returns any connection identifier associated with the given display,
+ * or LIBIVC_ID_NONE if no connection information could be queried.
+ *
+ * @param client The client for which the connection identifier is desired.
+ * @return The relevant connection ID, or LIBIVC_ID_NONE if none
+ *    could be accessed. Should be the same on both sides of an IVC
+ *    connection.
  */
 #ifdef _WIN32
 
@@ -635,24 +1196,8 @@ libivc_reconnect(struct libivc_client * client, uint16_t remote_dom_id, uint16_t
     libivc_assert_goto((rc = platformAPI->reconnect(client, remote_dom_id, remote_port)) == SUCCESS, ERR);
     libivc_checkp_goto(client->buffer, ERR);
 
-    if(client->ringbuffer == NULL) {
-        client->ringbuffer = malloc(sizeof(*(client->ringbuffer)));    
-    }
-    
-    libivc_assert_goto(client->ringbuffer != NULL, ERR);
-
-    client->ringbuffer->buffer = client->buffer;
-    client->ringbuffer->length = client->num_pages*PAGE_SIZE;
-    client->ringbuffer->num_channels = 2;
-    
-    if(client->ringbuffer->channels == NULL) {
-        client->ringbuffer->channels = malloc(2*sizeof(*(client->ringbuffer->channels)));    
-    }
-    libivc_assert_goto(client->ringbuffer->channels != NULL, ERR);
-
-    ringbuffer_channel_create(&client->ringbuffer->channels[0], (client->num_pages * PAGE_SIZE)/2);
-    ringbuffer_channel_create(&client->ringbuffer->channels[1], (client->num_pages * PAGE_SIZE)/2);
-    ringbuffer_use(client->ringbuffer);
+    libivc_assert_goto((rc = __libivc_create_ringbuffer(client)) == SUCCESS, ERR);
+    client->parked = 0;
     
     rc = SUCCESS;
     libivc_assert(client->ringbuffer != NULL, INTERNAL_ERROR);
@@ -673,54 +1218,43 @@ __pragma(warning(pop))
 
 
 /**
- * Disconnects the ivc struct and notifies the remote of it if possible.
- * This version assumes the IVC client and server list locks are held.
+ * Disconnects a client from its remote, but keeps its buffer granted so that it
+ * can be connected again with libivc_reconnect. Registered callbacks are dropped,
+ * as is any cork and partial large message state. This must not be called from
+ * the client's own callbacks.
  *
- * @param ivc - the connected ivc struct.
+ * @param client - the client to park.
+ * @return SUCCESS or appropriate error number.
  */
-void
-__libivc_disconnect(struct libivc_client *client, bool from_public_api)
+#ifdef _WIN32
+
+__pragma(warning(push))
+__pragma(warning(disable : 4127))
+#endif
+int
+libivc_park(struct libivc_client *client)
 {
     list_head_t *pos = NULL, *temp = NULL;
     callback_node_t *callback = NULL;
-    struct libivc_server *server = NULL;
-
-
-    libivc_assert(initialized);
+    int rc = INVALID_PARAM;
 
-#ifndef KERNEL
-    if(client->remote_domid == IVC_DOM_ID && client->port == IVC_PORT)
+    if(!platformAPI->park)
     {
-        libivc_error("Userspace trying to shutdown driver.\n");
-        return;
+        libivc_error("Platform API does not (yet) support parking.\n");
+        return NOT_IMPLEMENTED;
     }
-#endif
 
-    libivc_checkp(client);
-    mutex_lock(&client->mutex);
+    libivc_checkp(client, INVALID_PARAM);
+    libivc_assert(initialized, INVALID_PARAM);
+    libivc_assert(!client->server_side, INVALID_PARAM);
+    libivc_assert(!client->shares_buffer, INVALID_PARAM);
 
-    // If this is a server-side client, ensure that we hold the servers' client
-    // list mutex before deleting this client.
-    if(client->server_side && from_public_api)
-    {
-        // Find the server that this client belongs to.
-        server = __libivc_find_listening_server(client->remote_domid, client->port, client->connection_id);
+    mutex_lock(&client->mutex);
 
-        // If we found a server, lock its client-list mutex.
-        if(server)
-        {
-            mutex_lock(&server->client_mutex);
-            list_del(&client->node);
-        }
-        else
-        {
-            libivc_warn("Trying to shut down a server-side client, but couldn't find its server!\n");
-            libivc_warn("This may indicate a bookkeeping issue.\n");
-        }
-    }
-    else
+    if(!client->parked)
     {
-        list_del(&client->node);
+        libivc_assert_goto((rc = platformAPI->park(client)) == SUCCESS, END);
+        client->parked = 1;
     }
 
     list_for_each_safe(pos, temp, &client->callback_list)
@@ -731,814 +1265,2588 @@ __libivc_disconnect(struct libivc_client *client, bool from_public_api)
         free(callback);
         callback = NULL;
     }
+    client->opaque = NULL;
+
+    client->corked = 0;
+    client->cork_pending = 0;
+    client->cork_since = 0;
+    client->cork_max_bytes = 0;
+    client->cork_max_delay_us = 0;
+
+    if(client->large_rx_owned && client->large_rx_dest)
+        free(client->large_rx_dest);
+
+    client->large_tx_src = NULL;
+    client->large_tx_size = 0;
+    client->large_tx_offset = 0;
+    client->large_rx_dest = NULL;
+    client->large_rx_owned = 0;
+    client->large_rx_length = 0;
+    client->large_rx_offset = 0;
+    client->large_rx_discarding = 0;
+    client->large_rx_max = 0;
+
+    memset(&client->stats, 0, sizeof(struct libivc_stats));
+    atomic64_set(&client->notifications_sent, 0);
+
+    client->spin_max_us = 0;
+    client->spin_budget_ns = 0;
+    client->last_arrival = 0;
+    client->arrival_gap_ns = 0;
+
+    client->moderation_high_rate = 0;
+    client->moderating = 0;
 
-    // If we obtained a server, release its client list mutex,
-    // and relinquish our reference to the server.
-    if(server)
-    {
-        mutex_unlock(&server->client_mutex);
-        libivc_put_server(server);
-    }
+    rc = SUCCESS;
+END:
     mutex_unlock(&client->mutex);
-    mutex_destroy(&client->mutex);
-    platformAPI->disconnect(client);
-
-    libivc_put_client(client);
-    client = NULL;
-
-#ifdef KERNEL
-#ifdef _WIN32
-    if (list_empty(&ivcClients))
-    {
-        ks_platform_unload();
-    }
-#endif
-#endif
+    return rc;
 }
 #ifdef KERNEL
 #ifdef __linux
-EXPORT_SYMBOL(__libivc_disconnect);
+EXPORT_SYMBOL(libivc_park);
 #endif
 #endif
+#ifdef _WIN32
+__pragma(warning(pop))
+#endif
 
 
 /**
- * Disconnects the ivc struct and notifies the remote of it if possible.
- * @param ivc - the connected ivc struct.
+ * Builds the value of a resize control word.
  */
-void
-libivc_disconnect(struct libivc_client *client)
+static int32_t
+resize_state(uint32_t seq, uint32_t state)
 {
-    mutex_lock(&ivc_client_list_lock);
-    mutex_lock(&ivc_server_list_lock);
-    __libivc_disconnect(client, true);
-    mutex_unlock(&ivc_server_list_lock);
-    mutex_unlock(&ivc_client_list_lock);
+    return (int32_t)((seq << RESIZE_SEQ_SHIFT) | state);
 }
-#ifdef KERNEL
-#ifdef __linux
-EXPORT_SYMBOL(libivc_disconnect);
-#endif
-#endif
-
 
 /**
- * Determines if ivc is connected based on parameters at time of connect.
- * @param ivc - ivc struct describing connection.
- * @return 1 if connect, 0 otherwise.
+ * Takes a client's mutex for I/O on its ring.
+ * @param client The client whose ring is about to be used.
+ * @return SUCCESS with the mutex held, or ERROR_AGAIN without it while
+ *    libivc_resize is waiting to move the ring.
  */
-uint8_t
-libivc_isOpen(struct libivc_client *ivc)
+static int
+libivc_lock_ring(struct libivc_client *client)
 {
-    libivc_checkp(ivc, 0);
+    mutex_lock(&client->mutex);
+    if (client->resizing)
+    {
+        mutex_unlock(&client->mutex);
+        return ERROR_AGAIN;
+    }
 
-    return ivc->buffer != NULL;
+    return SUCCESS;
 }
-#ifdef KERNEL
-#ifdef __linux
-EXPORT_SYMBOL(libivc_isOpen);
-#endif
-#endif
 
 /**
- * Write as many bytes as possible up to srcLength from src to the ivc buffer 
- * and return how many bytes were successfully written in actualLength.
- * @param ivc - a connected ivc struct.
+ * Lays the client's ring out again over its first pages, carrying the data
+ * waiting in each channel, and its flags, across. The remote must not be
+ * using the ring.
+ * @param client The client whose ring should be moved; its mutex must be held.
+ * @param pages The pages the ring should span.
+ * @return SUCCESS, NO_SPACE if a channel holds more than it would have room
+ *    for, or appropriate error number; on failure the ring is untouched.
+ */
+static int
+libivc_move_ring(struct libivc_client *client, uint32_t pages)
+{
+    struct ringbuffer_t *ring = client->ringbuffer;
+    struct ringbuffer_channel_t *channel = NULL;
+    int32_t *pending = NULL, *flags = NULL;
+    int32_t body_length, i;
+    char *saved = NULL;
+    size_t total = 0, offset = 0;
+    int rc = OUT_OF_MEM;
+
+    body_length = (int32_t)((pages * PAGE_SIZE) / ring->num_channels) - (int32_t)sizeof(struct ringbuffer_header_t);
+
+    pending = (int32_t *) malloc(ring->num_channels * sizeof(int32_t));
+    flags = (int32_t *) malloc(ring->num_channels * sizeof(int32_t));
+    libivc_checkp_goto(pending, END);
+    libivc_checkp_goto(flags, END);
+
+    for (i = 0; i < ring->num_channels; i++)
+    {
+        pending[i] = ringbuffer_bytes_available_read(&ring->channels[i]);
+        flags[i] = ringbuffer_get_flags(&ring->channels[i]);
+
+        // A channel always keeps a byte free.
+        if (pending[i] > body_length - 1)
+        {
+            rc = NO_SPACE;
+            goto END;
+        }
+
+        total += (size_t)pending[i];
+    }
+
+    if (total)
+    {
+        saved = (char *) malloc(total);
+        libivc_checkp_goto(saved, END);
+    }
+
+    for (i = 0; i < ring->num_channels; i++)
+    {
+        if (pending[i])
+            ringbuffer_read(&ring->channels[i], saved + offset, pending[i]);
+        offset += (size_t)pending[i];
+    }
+
+    libivc_assert_goto((rc = libivc_layout_ring(client, pages)) == SUCCESS, END);
+    ringbuffer_create(ring);
+
+    offset = 0;
+    for (i = 0; i < ring->num_channels; i++)
+    {
+        channel = &ring->channels[i];
+        if (pending[i])
+            ringbuffer_write(channel, saved + offset, pending[i]);
+        ringbuffer_set_flags(channel, (uint32_t)flags[i]);
+        offset += (size_t)pending[i];
+    }
+
+    rc = SUCCESS;
+
+END:
+    if (saved)
+        free(saved);
+    if (flags)
+        free(flags);
+    if (pending)
+        free(pending);
+
+    return rc;
+}
+
+/**
+ * Grows or shrinks the part of a connection's buffer its ring spans, without
+ * disconnecting. The ring can span any number of pages up to the size of the
+ * buffer that was granted when connecting; a smaller ring keeps the data in
+ * flight, and so the working set of both ends, small, while connecting with
+ * a larger buffer leaves room to grow into when a flow's rate picks up.
+ *
+ * The remote is asked to stop using the ring, and once it has, the data
+ * waiting in each channel is moved across to the new layout. Until then, I/O
+ * on this side returns ERROR_AGAIN; on the remote, until it has taken up the
+ * new layout, its channels look empty and full. Only the client side of a
+ * connection can resize it, and only once both sides have called
+ * libivc_enable_resize.
+ *
+ * @param client - the client side of a connection.
+ * @param numPages - the pages the ring should span, from 1 to the number granted.
+ * @return SUCCESS, NO_SPACE if a channel holds more data than it would have
+ *    room for, TIMED_OUT if the remote didn't stop using the ring in time,
+ *    ERROR_AGAIN if the remote hasn't yet taken up the last resize, or another
+ *    resize is under way, or appropriate error number. On failure the ring is
+ *    left as it was.
+ */
+int
+libivc_resize(struct libivc_client *client, uint32_t numPages)
+{
+    struct ringbuffer_t *ring = NULL;
+    uint64_t now, deadline;
+    uint32_t seq, seen;
+    int32_t request;
+    int rc = SUCCESS;
+
+    libivc_checkp(client, INVALID_PARAM);
+    libivc_checkp(client->ringbuffer, INVALID_PARAM);
+    libivc_assert(!client->server_side, INVALID_PARAM);
+    libivc_assert(client->resizable, INVALID_PARAM);
+    libivc_assert(numPages > 0 && numPages <= client->num_pages, INVALID_PARAM);
+
+    ring = client->ringbuffer;
+
+    mutex_lock(&client->mutex);
+
+    if (numPages == pages_of(client))
+        goto END;
+
+    if (client->resizing)
+    {
+        rc = ERROR_AGAIN;
+        goto END;
+    }
+
+    // Until the remote has taken up the last layout, it can't stop for another.
+    seq = client->resize_seq;
+    request = ringbuffer_get_control(ring, RESIZE_CONTROL_REQUEST);
+    if (seq && request == resize_state(seq, RESIZE_DONE) &&
+        ringbuffer_get_control(ring, RESIZE_CONTROL_REPLY) != resize_state(seq, RESIZE_ADOPTED))
+    {
+        rc = ERROR_AGAIN;
+        goto END;
+    }
+
+    seq = (seq + 1) & ((uint32_t)~0 >> RESIZE_SEQ_SHIFT);
+    if (seq == 0)
+        seq = 1;
+    client->resize_seq = seq;
+    client->resizing = 1;
+
+    ringbuffer_set_control(ring, RESIZE_CONTROL_PAGES, (int32_t)numPages);
+    ringbuffer_set_control(ring, RESIZE_CONTROL_REQUEST, resize_state(seq, RESIZE_REQUESTED));
+    mutex_unlock(&client->mutex);
+    libivc_notify_remote(client);
+
+    // Wait for the remote to let go of the ring, without holding up callers
+    // that only want to find the ring busy. Our own event thread may be
+    // what's calling us, so this can't rely on events being delivered.
+    deadline = libivc_monotonic_ns() + (uint64_t)LIBIVC_RESIZE_TIMEOUT_MS * 1000000;
+    for (;;)
+    {
+        seen = client->event_generation;
+        if (ringbuffer_get_control(ring, RESIZE_CONTROL_REPLY) == resize_state(seq, RESIZE_QUIESCED))
+            break;
+
+        now = libivc_monotonic_ns();
+        if (now >= deadline)
+        {
+            libivc_warn("dom%u:%u didn't stop for a resize.\n", client->remote_domid, client->port);
+            rc = TIMED_OUT;
+            mutex_lock(&client->mutex);
+            goto ABORT;
+        }
+
+        libivc_event_wait(&client->event_wait, &client->event_generation, seen, 1);
+    }
+
+    mutex_lock(&client->mutex);
+    rc = libivc_move_ring(client, numPages);
+    if (rc != SUCCESS)
+        goto ABORT;
+
+    // Moving the ring cleared the control words along with everything else.
+    ringbuffer_set_control(ring, RESIZE_CONTROL_PAGES, (int32_t)numPages);
+    ringbuffer_set_control(ring, RESIZE_CONTROL_REPLY, resize_state(seq, RESIZE_QUIESCED));
+    ringbuffer_set_control(ring, RESIZE_CONTROL_REQUEST, resize_state(seq, RESIZE_DONE));
+    libivc_info("Resized the ring to dom%u:%u to %u pages.\n", client->remote_domid, client->port, numPages);
+    goto NOTIFY;
+
+ABORT:
+    ringbuffer_set_control(ring, RESIZE_CONTROL_REQUEST, resize_state(seq, RESIZE_ABORTED));
+
+NOTIFY:
+    client->resizing = 0;
+    mutex_unlock(&client->mutex);
+    libivc_notify_remote(client);
+    return rc;
+
+END:
+    mutex_unlock(&client->mutex);
+    return rc;
+}
+#ifdef KERNEL
+#ifdef __linux
+EXPORT_SYMBOL(libivc_resize);
+#endif
+#endif
+
+/**
+ * Lets a connection's ring be resized; see libivc_resize. The ring's header
+ * only holds resize state on connections where both sides have asked for it,
+ * since elsewhere it may belong to something else.
+ * @param client - either side of a connection used through the send and
+ *    receive calls.
+ * @return SUCCESS or appropriate error number.
+ */
+int
+libivc_enable_resize(struct libivc_client *client)
+{
+    int rc = SUCCESS;
+
+    libivc_checkp(client, INVALID_PARAM);
+    libivc_checkp(client->ringbuffer, INVALID_PARAM);
+
+    mutex_lock(&client->mutex);
+    if (client->read_only || client->taken_over)
+        rc = INVALID_PARAM;
+    else
+        client->resizable = 1;
+    mutex_unlock(&client->mutex);
+
+    return rc;
+}
+#ifdef KERNEL
+#ifdef __linux
+EXPORT_SYMBOL(libivc_enable_resize);
+#endif
+#endif
+
+/**
+ * Gets the number of pages a connection's ring spans; see libivc_resize.
+ * @param client - a connected client.
+ * @param numPages - receives the number of pages.
+ * @return SUCCESS or appropriate error number.
+ */
+int
+libivc_get_ring_pages(struct libivc_client *client, uint32_t *numPages)
+{
+    libivc_checkp(client, INVALID_PARAM);
+    libivc_checkp(numPages, INVALID_PARAM);
+    libivc_checkp(client->ringbuffer, NOT_CONNECTED);
+
+    mutex_lock(&client->mutex);
+    *numPages = pages_of(client);
+    mutex_unlock(&client->mutex);
+
+    return SUCCESS;
+}
+#ifdef KERNEL
+#ifdef __linux
+EXPORT_SYMBOL(libivc_get_ring_pages);
+#endif
+#endif
+
+/**
+ * Takes the server side's channels back out of the shadow headers they were
+ * detached onto during a resize, and lays them out over the ring at its size.
+ * The event flags we set while detached are carried across; the rest are the
+ * remote's.
+ */
+static void
+libivc_resume_ring(struct libivc_client *client, uint32_t pages)
+{
+    struct ringbuffer_t *ring = client->ringbuffer;
+    struct ringbuffer_header_t *shadow = client->resize_shadow;
+    int32_t our_flag, flags, i;
+
+    our_flag = client->server_side ? CLIENT_SIDE_TX_EVENT_FLAG : SERVER_SIDE_TX_EVENT_FLAG;
+
+    // A remote asking for a size the buffer can't hold is ignored.
+    if (pages == 0 || pages > client->num_pages)
+        pages = pages_of(client);
+
+    libivc_layout_ring(client, pages);
+
+    for (i = 0; i < ring->num_channels; i++)
+    {
+        flags = ringbuffer_get_flags(&ring->channels[i]);
+        flags = (flags & ~our_flag) | (shadow[i].reserved1 & our_flag);
+        ringbuffer_set_flags(&ring->channels[i], (uint32_t)flags);
+    }
+
+    client->resize_shadow = NULL;
+    free(shadow);
+}
+
+void
+__libivc_service_resize(struct libivc_client *client)
+{
+    struct ringbuffer_t *ring = NULL;
+    struct ringbuffer_header_t *shadow = NULL;
+    uint32_t request, seq, state, pages;
+    int32_t i, reply = 0;
+
+    if (!client || !client->ringbuffer || !client->server_side || !client->resizable)
+        return;
+
+    ring = client->ringbuffer;
+    request = (uint32_t)ringbuffer_get_control(ring, RESIZE_CONTROL_REQUEST);
+    seq = request >> RESIZE_SEQ_SHIFT;
+    state = request & RESIZE_STATE_MASK;
+
+    // Most events have nothing to do with resizing.
+    if (seq == 0 || (seq == client->resize_seq && !client->resize_shadow))
+        return;
+
+    mutex_lock(&client->mutex);
+
+    if (!client->resize_shadow && seq != client->resize_seq)
+    {
+        if (state == RESIZE_REQUESTED)
+        {
+            // Let go of the ring. If we can't, the client will time out and
+            // give up.
+            shadow = (struct ringbuffer_header_t *) malloc(ring->num_channels * sizeof(struct ringbuffer_header_t));
+            libivc_checkp_goto(shadow, END);
+            memset(shadow, 0, ring->num_channels * sizeof(struct ringbuffer_header_t));
+
+            for (i = 0; i < ring->num_channels; i++)
+                ringbuffer_channel_detach(&ring->channels[i], &shadow[i]);
+
+            client->resize_shadow = shadow;
+            reply = resize_state(seq, RESIZE_QUIESCED);
+        }
+        else
+        {
+            // A resize that was given up on before we saw it.
+            reply = resize_state(seq, RESIZE_ADOPTED);
+        }
+
+        client->resize_seq = seq;
+    }
+    else if (client->resize_shadow && seq != client->resize_seq && state == RESIZE_REQUESTED)
+    {
+        // The resize we stopped for was given up on, and another asked for;
+        // the ring is as it was, so there's no need to pick it up in between.
+        client->resize_seq = seq;
+        reply = resize_state(seq, RESIZE_QUIESCED);
+    }
+    else if (client->resize_shadow && (state == RESIZE_DONE || state == RESIZE_ABORTED))
+    {
+        pages = (state == RESIZE_DONE) ? (uint32_t)ringbuffer_get_control(ring, RESIZE_CONTROL_PAGES) : pages_of(client);
+        libivc_resume_ring(client, pages);
+
+        client->resize_seq = seq;
+        reply = resize_state(seq, RESIZE_ADOPTED);
+    }
+
+    if (reply)
+        ringbuffer_set_control(ring, RESIZE_CONTROL_REPLY, reply);
+
+END:
+    mutex_unlock(&client->mutex);
+
+    if (reply)
+        libivc_notify_remote(client);
+}
+
+
+/**
+ * Disconnects the ivc struct and notifies the remote of it if possible.
+ * This version assumes the IVC client and server list locks are held.
+ *
+ * @param ivc - the connected ivc struct.
+ */
+void
+__libivc_disconnect(struct libivc_client *client, bool from_public_api)
+{
+    list_head_t *pos = NULL, *temp = NULL;
+    callback_node_t *callback = NULL;
+    struct libivc_server *server = NULL;
+
+
+    libivc_assert(initialized);
+
+#ifndef KERNEL
+    if(client->remote_domid == IVC_DOM_ID && client->port == IVC_PORT)
+    {
+        libivc_error("Userspace trying to shutdown driver.\n");
+        return;
+    }
+#endif
+
+    libivc_checkp(client);
+    mutex_lock(&client->mutex);
+
+    // If this is a server-side client, ensure that we hold the servers' client
+    // list mutex before deleting this client.
+    if(client->server_side && from_public_api)
+    {
+        // Find the server that this client belongs to.
+        server = __libivc_find_listening_server(client->remote_domid, client->port, client->connection_id);
+
+        // If we found a server, lock its client-list mutex.
+        if(server)
+        {
+            mutex_lock(&server->client_mutex);
+            list_del(&client->node);
+        }
+        else
+        {
+            libivc_warn("Trying to shut down a server-side client, but couldn't find its server!\n");
+            libivc_warn("This may indicate a bookkeeping issue.\n");
+        }
+    }
+    else
+    {
+        list_del(&client->node);
+    }
+
+    list_for_each_safe(pos, temp, &client->callback_list)
+    {
+        callback = container_of(pos, callback_node_t, node);
+        list_del(pos);
+        memset(callback, 0, sizeof (callback_node_t));
+        free(callback);
+        callback = NULL;
+    }
+
+    // If we obtained a server, release its client list mutex,
+    // and relinquish our reference to the server.
+    if(server)
+    {
+        mutex_unlock(&server->client_mutex);
+        libivc_put_server(server);
+    }
+    mutex_unlock(&client->mutex);
+    platformAPI->disconnect(client);
+
+    // Only once the platform has stopped delivering events to the client.
+    mutex_destroy(&client->mutex);
+    libivc_event_wait_destroy(&client->event_wait);
+
+    libivc_put_client(client);
+    client = NULL;
+
+#ifdef KERNEL
+#ifdef _WIN32
+    if (list_empty(&ivcClients))
+    {
+        ks_platform_unload();
+    }
+#endif
+#endif
+}
+#ifdef KERNEL
+#ifdef __linux
+EXPORT_SYMBOL(__libivc_disconnect);
+#endif
+#endif
+
+
+/**
+ * Disconnects the ivc struct and notifies the remote of it if possible.
+ * @param ivc - the connected ivc struct.
+ */
+void
+libivc_disconnect(struct libivc_client *client)
+{
+    mutex_lock(&ivc_client_list_lock);
+    mutex_lock(&ivc_server_list_lock);
+    __libivc_disconnect(client, true);
+    mutex_unlock(&ivc_server_list_lock);
+    mutex_unlock(&ivc_client_list_lock);
+}
+#ifdef KERNEL
+#ifdef __linux
+EXPORT_SYMBOL(libivc_disconnect);
+#endif
+#endif
+
+
+/**
+ * Determines if ivc is connected based on parameters at time of connect.
+ * @param ivc - ivc struct describing connection.
+ * @return 1 if connect, 0 otherwise.
+ */
+uint8_t
+libivc_isOpen(struct libivc_client *ivc)
+{
+    libivc_checkp(ivc, 0);
+
+    return ivc->buffer != NULL;
+}
+#ifdef KERNEL
+#ifdef __linux
+EXPORT_SYMBOL(libivc_isOpen);
+#endif
+#endif
+
+/**
+ * Write as many bytes as possible up to srcLength from src to the ivc buffer 
+ * and return how many bytes were successfully written in actualLength.
+ * @param ivc - a connected ivc struct.
  * @param src - non null character buffer to copy from.
  * @param srcLength - size of the src buffer.
  * @param actualLength - number of bytes that were actually written.
  * @return SUCCESS or appropriate error number.
  */
 int
-libivc_write(struct libivc_client *ivc, char *src, size_t srcSize, size_t * actualLength)
+libivc_write(struct libivc_client *ivc, char *src, size_t srcSize, size_t * actualLength)
+{
+    uint32_t pending = 0;
+    ssize_t n;
+
+    libivc_checkp(ivc, INVALID_PARAM);
+    libivc_checkp(src, INVALID_PARAM);
+    libivc_checkp(actualLength, INVALID_PARAM);
+
+    libivc_assert(srcSize > 0, INVALID_PARAM);
+    libivc_checkp(ivc->buffer, ACCESS_DENIED);
+    libivc_checkp(ivc->ringbuffer, ACCESS_DENIED);
+
+    if (libivc_lock_ring(ivc) != SUCCESS) {
+        *actualLength = 0;
+        return ERROR_AGAIN;
+    }
+    n = ringbuffer_write(outgoing_channel_for(ivc), src, srcSize);
+    if (n > 0)
+        libivc_stats_sent(ivc, outgoing_channel_for(ivc), (size_t)n);
+    else if (n == 0) {
+        pending = libivc_stats_ring_full(ivc);
+        libivc_probe3(ring_full, ivc->remote_domid, ivc->port, srcSize);
+    }
+    mutex_unlock(&ivc->mutex);
+    libivc_notify_pending(ivc, pending);
+
+    if (n < 0) {
+        libivc_error_hot("libivc_write: Failed to write %lldB to dom%lld:%lld ring (%lld).\n",
+                srcSize, ivc->remote_domid, ivc->port, n);
+        *actualLength = 0;
+        return n;
+    }
+
+    *actualLength = (size_t)n;
+    return SUCCESS;
+}
+#ifdef KERNEL
+#ifdef __linux
+EXPORT_SYMBOL(libivc_write);
+#endif
+#endif
+
+/**
+ * Try to write EXACTLY srcSize bytes to the ivc channel.  If they can't be written
+ * because the buffer is full, NO_SPACE is returned.
+ * @param ivc - A connected ivc struct.
+ * @param src - source buffer to write to the ivc connection.
+ * @param srcSize - size of the source buffer and exact amount to write.
+ * @return SUCCESS or appropriate error number.
+ */
+int
+libivc_send(struct libivc_client *ivc, char *src, size_t srcSize)
+{
+    return libivc_send_lane(ivc, 0, src, srcSize);
+}
+#ifdef KERNEL
+#ifdef __linux
+EXPORT_SYMBOL(libivc_send);
+#endif
+#endif
+
+/**
+ * Try to write EXACTLY srcSize bytes to one of the client's lanes. If they can't
+ * be written because the lane is full, NO_SPACE is returned.
+ * @param ivc - A connected ivc struct.
+ * @param lane - the lane to write to.
+ * @param src - source buffer to write to the ivc connection.
+ * @param srcSize - size of the source buffer and exact amount to write.
+ * @return SUCCESS or appropriate error number.
+ */
+int
+libivc_send_lane(struct libivc_client *ivc, uint8_t lane, char *src, size_t srcSize)
+{
+    size_t actual = 0;
+    uint32_t pending;
+    struct ringbuffer_channel_t *channel = NULL;
+    libivc_checkp(ivc, INVALID_PARAM);
+    libivc_checkp(src, INVALID_PARAM);
+    libivc_assert(srcSize > 0, INVALID_PARAM);
+    libivc_checkp(ivc->ringbuffer, INVALID_PARAM);
+    libivc_assert(lane < lanes_of(ivc), INVALID_PARAM);
+
+    channel = outgoing_lane_channel_for(ivc, lane);
+    libivc_probe4(send_entry, ivc->remote_domid, ivc->port, lane, srcSize);
+
+    if (libivc_lock_ring(ivc) != SUCCESS) {
+        libivc_probe5(send_return, ivc->remote_domid, ivc->port, lane, srcSize, ERROR_AGAIN);
+        return ERROR_AGAIN;
+    }
+    if (ringbuffer_bytes_available_write(channel) < (ssize_t)srcSize) {
+        // A full ring is ordinary flow control, not an error; it's counted
+        // rather than logged.
+        pending = libivc_stats_ring_full(ivc);
+        mutex_unlock(&ivc->mutex);
+        libivc_notify_pending(ivc, pending);
+        libivc_probe3(ring_full, ivc->remote_domid, ivc->port, srcSize);
+        libivc_probe5(send_return, ivc->remote_domid, ivc->port, lane, srcSize, NO_SPACE);
+        return NO_SPACE;
+    }
+    actual = ringbuffer_write(channel, src, srcSize);
+    libivc_stats_sent(ivc, channel, actual);
+    mutex_unlock(&ivc->mutex);
+
+    // The mutex prevents threaded applications to clobber the ring.
+    // From here the write had to be successful. If for some reason it was not,
+    // the ring itself is lost and unrecoverable.
+    if (actual != srcSize)
+        libivc_error_hot("libivc_send: Wrote %lldB of %lldB, dom%lld:%lld ring corrupted.\n",
+                actual, srcSize, ivc->remote_domid, ivc->port);
+
+    // If the client is corked, the remote will be told about this data
+    // when it is flushed instead. Otherwise, each lane has its own event flag,
+    // so a receiver can take events for urgent lanes while polling bulk ones.
+    if (!libivc_defer_notification(ivc, srcSize) && remote_lane_events_enabled(ivc, lane))
+        libivc_notify_remote(ivc);
+
+    libivc_probe5(send_return, ivc->remote_domid, ivc->port, lane, srcSize, SUCCESS);
+    return SUCCESS;
+}
+#ifdef KERNEL
+#ifdef __linux
+EXPORT_SYMBOL(libivc_send_lane);
+#endif
+#endif
+
+/**
+ * Read as many bytes as possible up to destSize into buffer dest, returns how
+ * many bytes were read.
+ * @param ivc - connected libivc struct.
+ * @param dest - destination buffer to read data into
+ * @param destSize - maximum number of bytes to read.
+ * @param actualSize - pointer to receive actual bytes read.
+ * @return SUCCESS or appropriate error number.
+ */
+int
+libivc_read(struct libivc_client *ivc, char *dest, size_t destSize, size_t * actualSize)
+{
+    struct ringbuffer_channel_t *channel = NULL;
+    int32_t available;
+    ssize_t n;
+
+    libivc_checkp(ivc, INVALID_PARAM);
+    libivc_checkp(ivc->ringbuffer, INVALID_PARAM);
+    libivc_checkp(dest, INVALID_PARAM);
+    libivc_checkp(actualSize, INVALID_PARAM);
+    libivc_assert(destSize > 0, INVALID_PARAM);
+
+    channel = incoming_channel_for(ivc);
+
+    if (libivc_lock_ring(ivc) != SUCCESS) {
+        *actualSize = 0;
+        return ERROR_AGAIN;
+    }
+    available = ringbuffer_bytes_available_read(channel);
+    n = ringbuffer_read(channel, dest, destSize);
+    if (n > 0)
+        libivc_stats_received(ivc, available, (size_t)n);
+    else if (n == 0) {
+        ivc->stats.recv_no_data++;
+        libivc_probe3(ring_empty, ivc->remote_domid, ivc->port, destSize);
+    }
+    mutex_unlock(&ivc->mutex);
+
+    if (n < 0) {
+        libivc_error_hot("libivc_read: Failed to read %lldB from dom%lld:%lld ring (%lld).\n",
+                destSize, ivc->remote_domid, ivc->port, n);
+        *actualSize = 0;
+        return n;
+    }
+
+    *actualSize = (size_t)n;
+    return SUCCESS;
+}
+#ifdef KERNEL
+#ifdef __linux
+EXPORT_SYMBOL(libivc_read);
+#endif
+#endif
+
+/**
+ * Read exactly destSize bytes from ivc, failing if there are less than the specified
+ * amount available. (Packet style receive)
+ * @param ivc - connected ivc struct.
+ * @param dest - destination buffer to write to.
+ * @param destSize - size of dest, and the exact number of bytes required to read.
+ * @return SUCCESS, or appropriate error number.
+ */
+int
+libivc_recv(struct libivc_client *ivc, char *dest, size_t destSize)
+{
+    return libivc_recv_lane(ivc, 0, dest, destSize);
+}
+#ifdef KERNEL
+#ifdef __linux
+EXPORT_SYMBOL(libivc_recv);
+#endif
+#endif
+
+/**
+ * Read exactly destSize bytes from one of the client's lanes, failing if there
+ * are less than the specified amount available.
+ * @param ivc - connected ivc struct.
+ * @param lane - the lane to read from.
+ * @param dest - destination buffer to write to.
+ * @param destSize - size of dest, and the exact number of bytes required to read.
+ * @return SUCCESS, or appropriate error number.
+ */
+int
+libivc_recv_lane(struct libivc_client *ivc, uint8_t lane, char *dest, size_t destSize)
+{
+    struct ringbuffer_channel_t *channel = NULL;
+    int32_t available;
+    ssize_t read;
+
+    libivc_checkp(ivc, INVALID_PARAM);
+    libivc_checkp(ivc->ringbuffer, INVALID_PARAM);
+    libivc_checkp(dest, INVALID_PARAM);
+    libivc_assert(destSize > 0, INVALID_PARAM);
+    libivc_assert(lane < lanes_of(ivc), INVALID_PARAM);
+
+    channel = incoming_lane_channel_for(ivc, lane);
+    libivc_probe4(recv_entry, ivc->remote_domid, ivc->port, lane, destSize);
+
+    if (libivc_lock_ring(ivc) != SUCCESS) {
+        libivc_probe5(recv_return, ivc->remote_domid, ivc->port, lane, destSize, ERROR_AGAIN);
+        return ERROR_AGAIN;
+    }
+    available = ringbuffer_bytes_available_read(channel);
+    if (available < (ssize_t)destSize) {
+        // As with a full ring on send, this is counted rather than logged.
+        ivc->stats.recv_no_data++;
+        mutex_unlock(&ivc->mutex);
+        libivc_probe3(ring_empty, ivc->remote_domid, ivc->port, destSize);
+        libivc_probe5(recv_return, ivc->remote_domid, ivc->port, lane, destSize, NO_DATA_AVAIL);
+        return NO_DATA_AVAIL;
+    }
+
+    read = ringbuffer_read(channel, dest, destSize);
+    libivc_stats_received(ivc, available, destSize);
+    mutex_unlock(&ivc->mutex);
+
+    // The mutex prevents threaded applications to clobber the ring.
+    // From here the read had to be successful. If for some reason it was not,
+    // the ring itself is lost and unrecoverable.
+    if (read != destSize)
+        libivc_error_hot("libivc_recv: Read %lldB of %lldB, dom%lld:%lld ring corrupted.\n",
+                read, destSize, ivc->remote_domid, ivc->port);
+
+    libivc_probe5(recv_return, ivc->remote_domid, ivc->port, lane, destSize, SUCCESS);
+    return SUCCESS;
+}
+#ifdef KERNEL
+#ifdef __linux
+EXPORT_SYMBOL(libivc_recv_lane);
+#endif
+#endif
+
+static void
+libivc_set_lane_events(struct libivc_client *client, uint8_t lane, uint8_t enabled);
+
+/**
+ * Determines whether the remote has been asked to send us events for the
+ * first lane, the one libivc_recv reads.
+ */
+static bool
+libivc_local_events_enabled(struct libivc_client *client)
+{
+    int32_t target_flag = client->server_side ? CLIENT_SIDE_TX_EVENT_FLAG : SERVER_SIDE_TX_EVENT_FLAG;
+
+    return (ringbuffer_get_flags(incoming_channel_for(client)) & target_flag) != 0;
+}
+
+/**
+ * Learns from the arrival of a message how long libivc_recv_wait should spin.
+ * Spinning for about twice the usual gap between messages catches most of them
+ * without blocking; when messages are further apart than the client allows
+ * spinning for, they'd mostly be missed anyway, so it doesn't spin at all.
+ */
+static void
+libivc_adapt_spin(struct libivc_client *ivc, uint64_t now)
+{
+    uint64_t gap, max_ns;
+
+    mutex_lock(&ivc->mutex);
+    max_ns = (uint64_t)ivc->spin_max_us * 1000;
+    if (ivc->last_arrival)
+    {
+        // A moving average, weighting each new gap by 1/8.
+        gap = now - ivc->last_arrival;
+        if (ivc->arrival_gap_ns)
+            ivc->arrival_gap_ns = ivc->arrival_gap_ns - (ivc->arrival_gap_ns >> 3) + (gap >> 3);
+        else
+            ivc->arrival_gap_ns = gap;
+
+        ivc->spin_budget_ns = (ivc->arrival_gap_ns * 2 <= max_ns) ? ivc->arrival_gap_ns * 2 : 0;
+    }
+    ivc->last_arrival = now;
+    mutex_unlock(&ivc->mutex);
+}
+
+/**
+ * Spins between checks of the clock while waiting for data.
+ */
+#define LIBIVC_SPIN_BATCH 64
+
+/**
+ * Receives exactly destSize bytes, waiting up to timeout_ms for them to arrive.
+ * It first spins for the client's spin budget with events disabled, then
+ * enables events and blocks. Like libivc_recv, it reads the first lane, and
+ * only that lane's events are touched.
+ * @param ivc - connected ivc struct.
+ * @param dest - destination buffer to write to.
+ * @param destSize - size of dest, and the exact number of bytes required to read.
+ * @param timeout_ms - the longest to wait, in milliseconds.
+ * @return SUCCESS, TIMED_OUT, or appropriate error number.
+ */
+int
+libivc_recv_wait(struct libivc_client *ivc, char *dest, size_t destSize, uint32_t timeout_ms)
+{
+    struct ringbuffer_channel_t *channel = NULL;
+    uint64_t start, now, deadline, budget, remaining;
+    uint32_t seen;
+    bool events_enabled;
+    int i;
+
+    libivc_checkp(ivc, INVALID_PARAM);
+    libivc_checkp(ivc->ringbuffer, INVALID_PARAM);
+    libivc_checkp(dest, INVALID_PARAM);
+    libivc_assert(destSize > 0, INVALID_PARAM);
+
+    channel = incoming_channel_for(ivc);
+    now = start = libivc_monotonic_ns();
+    deadline = start + (uint64_t)timeout_ms * 1000000;
+
+    if (ringbuffer_bytes_available_read(channel) < (ssize_t)destSize)
+    {
+        events_enabled = libivc_local_events_enabled(ivc);
+
+        // While we're watching the ring ourselves, there's no need for the
+        // remote to tell us about it.
+        budget = ivc->spin_budget_ns;
+        if (budget)
+        {
+            libivc_set_lane_events(ivc, 0, 0);
+            while (ringbuffer_bytes_available_read(channel) < (ssize_t)destSize)
+            {
+                now = libivc_monotonic_ns();
+                if (now - start >= budget || now >= deadline)
+                    break;
+
+                for (i = 0; i < LIBIVC_SPIN_BATCH; i++)
+                    libivc_cpu_relax();
+            }
+        }
+
+        // Then block for the rest. Enabling events before checking again
+        // ensures that anything sent after the check is followed by an event.
+        libivc_set_lane_events(ivc, 0, 1);
+        for (;;)
+        {
+            seen = ivc->event_generation;
+            if (ringbuffer_bytes_available_read(channel) >= (ssize_t)destSize)
+                break;
+
+            now = libivc_monotonic_ns();
+            if (now >= deadline)
+                break;
+
+            remaining = (deadline - now + 999999) / 1000000;
+            libivc_event_wait(&ivc->event_wait, &ivc->event_generation, seen, (uint32_t)remaining);
+        }
+
+        if (!events_enabled)
+            libivc_set_lane_events(ivc, 0, 0);
+
+        if (ringbuffer_bytes_available_read(channel) < (ssize_t)destSize)
+            return TIMED_OUT;
+
+        now = libivc_monotonic_ns();
+    }
+
+    libivc_adapt_spin(ivc, now);
+    return libivc_recv(ivc, dest, destSize);
+}
+#ifdef KERNEL
+#ifdef __linux
+EXPORT_SYMBOL(libivc_recv_wait);
+#endif
+#endif
+
+/**
+ * Sets the longest libivc_recv_wait may spin waiting for data before blocking.
+ * @param ivc - connected ivc struct.
+ * @param max_spin_us - the longest to spin, in microseconds, or 0 to never spin.
+ * @return SUCCESS or appropriate error number.
+ */
+int
+libivc_set_recv_spin(struct libivc_client *ivc, uint32_t max_spin_us)
+{
+    libivc_checkp(ivc, INVALID_PARAM);
+
+    mutex_lock(&ivc->mutex);
+    ivc->spin_max_us = max_spin_us;
+
+    // Start out spinning for as long as allowed, until arrivals say otherwise.
+    ivc->spin_budget_ns = (uint64_t)max_spin_us * 1000;
+    ivc->last_arrival = 0;
+    ivc->arrival_gap_ns = 0;
+    mutex_unlock(&ivc->mutex);
+
+    return SUCCESS;
+}
+#ifdef KERNEL
+#ifdef __linux
+EXPORT_SYMBOL(libivc_set_recv_spin);
+#endif
+#endif
+
+/**
+ * Size of the length header that precedes each message sent by libivc_send_large.
+ */
+#define LIBIVC_LARGE_HEADER_SIZE 8
+
+/**
+ * Notifies the remote that data has been published, unless the client
+ * is corked, and the remote has asked for events.
+ */
+static void
+libivc_notify_published(struct libivc_client *ivc, size_t published)
+{
+    uint8_t event_enabled = 0;
+
+    if (libivc_defer_notification(ivc, published))
+        return;
+
+    libivc_remote_events_enabled(ivc, &event_enabled);
+    if (event_enabled)
+        libivc_notify_remote(ivc);
+}
+
+/**
+ * Streams a message of arbitrary size to the remote, which must receive it with
+ * libivc_recv_large. Returns ERROR_AGAIN if the ring filled before the message was
+ * fully sent; the caller should call again with the same arguments to continue.
+ * @param ivc - A connected ivc struct.
+ * @param src - the message to send.
+ * @param srcSize - size of the message.
+ * @return SUCCESS, ERROR_AGAIN, or appropriate error number.
+ */
+int
+libivc_send_large(struct libivc_client *ivc, char *src, size_t srcSize)
+{
+    struct ringbuffer_channel_t *channel = NULL;
+    uint8_t header[LIBIVC_LARGE_HEADER_SIZE];
+    uint64_t total = (uint64_t)srcSize + LIBIVC_LARGE_HEADER_SIZE;
+    uint64_t remaining;
+    uint32_t pending;
+    int32_t space, chunk, written;
+    int i, rc = ERROR_AGAIN;
+
+    libivc_checkp(ivc, INVALID_PARAM);
+    libivc_checkp(src, INVALID_PARAM);
+    libivc_checkp(ivc->ringbuffer, INVALID_PARAM);
+
+    channel = outgoing_channel_for(ivc);
+
+    // The length is always sent little endian, so both ends agree on it
+    // regardless of their native byte order.
+    for (i = 0; i < LIBIVC_LARGE_HEADER_SIZE; i++)
+        header[i] = (uint8_t)((uint64_t)srcSize >> (8 * i));
+
+    while (rc == ERROR_AGAIN)
+    {
+        if (libivc_lock_ring(ivc) != SUCCESS)
+            return ERROR_AGAIN;
+
+        if (ivc->large_tx_src && ivc->large_tx_src != src) {
+            mutex_unlock(&ivc->mutex);
+            libivc_error("%s: dom%u:%u is still sending another large message.\n",
+                    __func__, ivc->remote_domid, ivc->port);
+            return ADDRESS_IN_USE;
+        }
+
+        // The frame's header has been sent with the size it started with;
+        // continuing with another would desynchronise the remote.
+        if (ivc->large_tx_src && ivc->large_tx_size != (uint64_t)srcSize) {
+            mutex_unlock(&ivc->mutex);
+            libivc_error("%s: dom%u:%u resumed a large message with a different size.\n",
+                    __func__, ivc->remote_domid, ivc->port);
+            return INVALID_PARAM;
+        }
+        ivc->large_tx_src = src;
+        ivc->large_tx_size = (uint64_t)srcSize;
+
+        // Publish at most half the ring at a time, so the remote can drain one
+        // half while we fill the other.
+        space = ringbuffer_bytes_available_write(channel);
+        if (space > channel->body_length / 2)
+            space = channel->body_length / 2;
+        if (space <= 0) {
+            pending = libivc_stats_ring_full(ivc);
+            mutex_unlock(&ivc->mutex);
+            libivc_notify_pending(ivc, pending);
+            libivc_probe3(ring_full, ivc->remote_domid, ivc->port, srcSize);
+            break;
+        }
+
+        if (ivc->large_tx_offset < LIBIVC_LARGE_HEADER_SIZE) {
+            remaining = LIBIVC_LARGE_HEADER_SIZE - ivc->large_tx_offset;
+            chunk = (remaining < (uint64_t)space) ? (int32_t)remaining : space;
+            written = ringbuffer_write(channel, (char *)header + ivc->large_tx_offset, chunk);
+        } else {
+            remaining = total - ivc->large_tx_offset;
+            chunk = (remaining < (uint64_t)space) ? (int32_t)remaining : space;
+            written = ringbuffer_write(channel,
+                    src + (ivc->large_tx_offset - LIBIVC_LARGE_HEADER_SIZE), chunk);
+        }
+
+        if (written < 0) {
+            ivc->large_tx_src = NULL;
+            ivc->large_tx_size = 0;
+            ivc->large_tx_offset = 0;
+            mutex_unlock(&ivc->mutex);
+            libivc_error_hot("libivc_send_large: Failed to write %lldB to dom%lld:%lld ring (%lld).\n",
+                    chunk, ivc->remote_domid, ivc->port, written);
+            return written;
+        }
+
+        libivc_stats_sent(ivc, channel, (size_t)written);
+        ivc->large_tx_offset += (uint64_t)written;
+        if (ivc->large_tx_offset == total) {
+            ivc->large_tx_src = NULL;
+            ivc->large_tx_size = 0;
+            ivc->large_tx_offset = 0;
+            rc = SUCCESS;
+        }
+        mutex_unlock(&ivc->mutex);
+
+        libivc_notify_published(ivc, (size_t)written);
+    }
+
+    return rc;
+}
+#ifdef KERNEL
+#ifdef __linux
+EXPORT_SYMBOL(libivc_send_large);
+#endif
+#endif
+
+/**
+ * Receives a message sent with libivc_send_large directly into *dest, allocating
+ * it if *dest is NULL. Returns ERROR_AGAIN if the message has not fully arrived;
+ * the caller should call again with the same arguments to continue. A message
+ * longer than the client's limit is dropped as it arrives.
+ * @param ivc - connected ivc struct.
+ * @param dest - pointer to the destination buffer, or to NULL to have one allocated.
+ * @param destSize - size of *dest, if provided.
+ * @param actualSize - pointer to receive the size of the message.
+ * @return SUCCESS, ERROR_AGAIN, INVALID_PARAM if the message is too long, or
+ *    appropriate error number.
+ */
+int
+libivc_recv_large(struct libivc_client *ivc, char **dest, size_t destSize, size_t *actualSize)
+{
+    struct ringbuffer_channel_t *channel = NULL;
+    uint64_t remaining, limit;
+    int32_t available, chunk, read;
+    size_t consumed = 0;
+    uint8_t event_enabled = 0;
+    int i, rc = ERROR_AGAIN;
+
+    libivc_checkp(ivc, INVALID_PARAM);
+    libivc_checkp(ivc->ringbuffer, INVALID_PARAM);
+    libivc_checkp(dest, INVALID_PARAM);
+    libivc_checkp(actualSize, INVALID_PARAM);
+
+    channel = incoming_channel_for(ivc);
+
+    if (libivc_lock_ring(ivc) != SUCCESS)
+        return ERROR_AGAIN;
+    while (rc == ERROR_AGAIN)
+    {
+        // Once a message being dropped has all gone, start on the next one.
+        if (ivc->large_rx_discarding &&
+            ivc->large_rx_offset == ivc->large_rx_length + LIBIVC_LARGE_HEADER_SIZE)
+        {
+            ivc->large_rx_discarding = 0;
+            ivc->large_rx_offset = 0;
+            ivc->large_rx_length = 0;
+        }
+
+        // Once the header is in, find somewhere to put the message before
+        // consuming any of it, so it is read straight into its final home.
+        if (ivc->large_rx_offset == LIBIVC_LARGE_HEADER_SIZE && !ivc->large_rx_dest &&
+            !ivc->large_rx_discarding)
+        {
+            ivc->large_rx_length = 0;
+            for (i = 0; i < LIBIVC_LARGE_HEADER_SIZE; i++)
+                ivc->large_rx_length |= (uint64_t)ivc->large_rx_header[i] << (8 * i);
+
+            // The length comes from the remote, so don't let it size an
+            // allocation, or a buffer, without bound.
+            limit = ivc->large_rx_max ? ivc->large_rx_max : LIBIVC_DEFAULT_MAX_LARGE_MESSAGE;
+            if (ivc->large_rx_length > limit ||
+                (uint64_t)(size_t)ivc->large_rx_length != ivc->large_rx_length) {
+                libivc_error_hot("libivc_recv_large: Dropping a %lldB message from dom%lld:%lld, over the %lldB limit.\n",
+                        ivc->large_rx_length, ivc->remote_domid, ivc->port, limit);
+                ivc->large_rx_discarding = 1;
+                rc = INVALID_PARAM;
+                break;
+            }
+
+            if (*dest) {
+                if (destSize < ivc->large_rx_length) {
+                    *actualSize = (size_t)ivc->large_rx_length;
+                    rc = NO_SPACE;
+                    break;
+                }
+                ivc->large_rx_dest = *dest;
+                ivc->large_rx_owned = 0;
+            } else {
+                ivc->large_rx_dest = (char *)malloc(ivc->large_rx_length ? (size_t)ivc->large_rx_length : 1);
+                if (!ivc->large_rx_dest) {
+                    rc = OUT_OF_MEM;
+                    break;
+                }
+                ivc->large_rx_owned = 1;
+            }
+        }
+
+        if (ivc->large_rx_dest &&
+            ivc->large_rx_offset == ivc->large_rx_length + LIBIVC_LARGE_HEADER_SIZE)
+        {
+            *dest = ivc->large_rx_dest;
+            *actualSize = (size_t)ivc->large_rx_length;
+            ivc->large_rx_dest = NULL;
+            ivc->large_rx_owned = 0;
+            ivc->large_rx_offset = 0;
+            ivc->large_rx_length = 0;
+            rc = SUCCESS;
+            break;
+        }
+
+        available = ringbuffer_bytes_available_read(channel);
+        if (available <= 0) {
+            if (!consumed) {
+                ivc->stats.recv_no_data++;
+                libivc_probe3(ring_empty, ivc->remote_domid, ivc->port, 0);
+            }
+            break;
+        }
+
+        if (ivc->large_rx_offset < LIBIVC_LARGE_HEADER_SIZE) {
+            remaining = LIBIVC_LARGE_HEADER_SIZE - ivc->large_rx_offset;
+            chunk = (remaining < (uint64_t)available) ? (int32_t)remaining : available;
+            read = ringbuffer_read(channel, (char *)ivc->large_rx_header + ivc->large_rx_offset, chunk);
+        } else {
+            remaining = ivc->large_rx_length + LIBIVC_LARGE_HEADER_SIZE - ivc->large_rx_offset;
+            chunk = (remaining < (uint64_t)available) ? (int32_t)remaining : available;
+            if (ivc->large_rx_discarding)
+                read = ringbuffer_consume(channel, chunk);
+            else
+                read = ringbuffer_read(channel,
+                        ivc->large_rx_dest + (ivc->large_rx_offset - LIBIVC_LARGE_HEADER_SIZE), chunk);
+        }
+
+        if (read < 0) {
+            rc = read;
+            break;
+        }
+
+        libivc_stats_received(ivc, available, (size_t)read);
+        ivc->large_rx_offset += (uint64_t)read;
+        consumed += (size_t)read;
+    }
+    mutex_unlock(&ivc->mutex);
+
+    if (rc != SUCCESS && rc != ERROR_AGAIN && rc != NO_SPACE && rc != INVALID_PARAM)
+        libivc_error_hot("libivc_recv_large: Failed to receive from dom%lld:%lld (%lld) after %lldB.\n",
+                ivc->remote_domid, ivc->port, rc, consumed);
+
+    // Let a sender that is waiting on ring space know we've made some.
+    if (consumed) {
+        libivc_remote_events_enabled(ivc, &event_enabled);
+        if (event_enabled)
+            libivc_notify_remote(ivc);
+    }
+
+    return rc;
+}
+#ifdef KERNEL
+#ifdef __linux
+EXPORT_SYMBOL(libivc_recv_large);
+#endif
+#endif
+
+/**
+ * Releases a buffer allocated by libivc_recv_large.
+ * @param buffer - the buffer to release.
+ */
+void
+libivc_free_large(char *buffer)
+{
+    if (buffer)
+        free(buffer);
+}
+#ifdef KERNEL
+#ifdef __linux
+EXPORT_SYMBOL(libivc_free_large);
+#endif
+#endif
+
+/**
+ * Sets the longest message libivc_recv_large will accept on a client.
+ * @param ivc - an ivc struct.
+ * @param max_length - the limit, in bytes, or 0 for LIBIVC_DEFAULT_MAX_LARGE_MESSAGE.
+ * @return SUCCESS or appropriate error number.
+ */
+int
+libivc_set_max_large_message(struct libivc_client *ivc, uint64_t max_length)
+{
+    libivc_checkp(ivc, INVALID_PARAM);
+
+    mutex_lock(&ivc->mutex);
+    ivc->large_rx_max = max_length;
+    mutex_unlock(&ivc->mutex);
+
+    return SUCCESS;
+}
+#ifdef KERNEL
+#ifdef __linux
+EXPORT_SYMBOL(libivc_set_max_large_message);
+#endif
+#endif
+
+/**
+ * Exposes the free space in the ring for filling in place.
+ * @param ivc - a connected ivc struct.
+ * @param segments - receives up to two stretches of free space, in order.
+ * @param available - pointer to receive the total free space.
+ * @return SUCCESS, NO_SPACE if the ring is full, or appropriate error number.
+ */
+int
+libivc_reserve(struct libivc_client *ivc, struct libivc_segment segments[2], size_t *available)
+{
+    char *seg1 = NULL, *seg2 = NULL;
+    int32_t len1 = 0, len2 = 0, n;
+    uint32_t pending = 0;
+
+    libivc_checkp(ivc, INVALID_PARAM);
+    libivc_checkp(ivc->ringbuffer, INVALID_PARAM);
+    libivc_checkp(segments, INVALID_PARAM);
+    libivc_checkp(available, INVALID_PARAM);
+
+    if (libivc_lock_ring(ivc) != SUCCESS)
+        return ERROR_AGAIN;
+    n = ringbuffer_write_segments(outgoing_channel_for(ivc), &seg1, &len1, &seg2, &len2);
+    if (n == 0) {
+        pending = libivc_stats_ring_full(ivc);
+        libivc_probe3(ring_full, ivc->remote_domid, ivc->port, 0);
+    }
+    mutex_unlock(&ivc->mutex);
+    libivc_notify_pending(ivc, pending);
+
+    if (n < 0)
+        return n;
+
+    segments[0].base = seg1;
+    segments[0].length = (size_t)len1;
+    segments[1].base = seg2;
+    segments[1].length = (size_t)len2;
+    *available = (size_t)n;
+
+    return n ? SUCCESS : NO_SPACE;
+}
+#ifdef KERNEL
+#ifdef __linux
+EXPORT_SYMBOL(libivc_reserve);
+#endif
+#endif
+
+/**
+ * Publishes data written into space exposed by libivc_reserve.
+ * @param ivc - a connected ivc struct.
+ * @param length - the number of bytes written.
+ * @return SUCCESS or appropriate error number.
+ */
+int
+libivc_commit(struct libivc_client *ivc, size_t length)
+{
+    struct ringbuffer_channel_t *channel = NULL;
+    int32_t n;
+
+    libivc_checkp(ivc, INVALID_PARAM);
+    libivc_checkp(ivc->ringbuffer, INVALID_PARAM);
+    libivc_assert(length <= 0x7FFFFFFF, INVALID_PARAM);
+
+    if (length == 0)
+        return SUCCESS;
+
+    channel = outgoing_channel_for(ivc);
+
+    if (libivc_lock_ring(ivc) != SUCCESS)
+        return ERROR_AGAIN;
+    n = ringbuffer_commit(channel, (int32_t)length);
+    if (n > 0)
+        libivc_stats_sent(ivc, channel, (size_t)n);
+    mutex_unlock(&ivc->mutex);
+
+    if (n < 0)
+    {
+        libivc_error_hot("libivc_commit: Failed to commit %lldB to dom%lld:%lld ring (%lld).\n",
+                length, ivc->remote_domid, ivc->port, n);
+        return INVALID_PARAM;
+    }
+
+    libivc_notify_published(ivc, length);
+    return SUCCESS;
+}
+#ifdef KERNEL
+#ifdef __linux
+EXPORT_SYMBOL(libivc_commit);
+#endif
+#endif
+
+/**
+ * Exposes the data waiting in the ring in place.
+ * @param ivc - a connected ivc struct.
+ * @param segments - receives up to two stretches of data, in order.
+ * @param available - pointer to receive the total data waiting.
+ * @return SUCCESS, NO_DATA_AVAIL if the ring is empty, or appropriate error number.
+ */
+int
+libivc_peek(struct libivc_client *ivc, struct libivc_segment segments[2], size_t *available)
+{
+    char *seg1 = NULL, *seg2 = NULL;
+    int32_t len1 = 0, len2 = 0, n;
+
+    libivc_checkp(ivc, INVALID_PARAM);
+    libivc_checkp(ivc->ringbuffer, INVALID_PARAM);
+    libivc_checkp(segments, INVALID_PARAM);
+    libivc_checkp(available, INVALID_PARAM);
+
+    if (libivc_lock_ring(ivc) != SUCCESS)
+        return ERROR_AGAIN;
+    n = ringbuffer_read_segments(incoming_channel_for(ivc), &seg1, &len1, &seg2, &len2);
+    if (n == 0) {
+        ivc->stats.recv_no_data++;
+        libivc_probe3(ring_empty, ivc->remote_domid, ivc->port, 0);
+    }
+    mutex_unlock(&ivc->mutex);
+
+    if (n < 0)
+        return n;
+
+    segments[0].base = seg1;
+    segments[0].length = (size_t)len1;
+    segments[1].base = seg2;
+    segments[1].length = (size_t)len2;
+    *available = (size_t)n;
+
+    return n ? SUCCESS : NO_DATA_AVAIL;
+}
+#ifdef KERNEL
+#ifdef __linux
+EXPORT_SYMBOL(libivc_peek);
+#endif
+#endif
+
+/**
+ * Marks data exposed by libivc_peek as read.
+ * @param ivc - a connected ivc struct.
+ * @param length - the number of bytes to consume.
+ * @return SUCCESS or appropriate error number.
+ */
+int
+libivc_consume(struct libivc_client *ivc, size_t length)
+{
+    struct ringbuffer_channel_t *channel = NULL;
+    int32_t available, n;
+
+    libivc_checkp(ivc, INVALID_PARAM);
+    libivc_checkp(ivc->ringbuffer, INVALID_PARAM);
+    libivc_assert(length <= 0x7FFFFFFF, INVALID_PARAM);
+
+    if (length == 0)
+        return SUCCESS;
+
+    channel = incoming_channel_for(ivc);
+
+    if (libivc_lock_ring(ivc) != SUCCESS)
+        return ERROR_AGAIN;
+    available = ringbuffer_bytes_available_read(channel);
+    n = ringbuffer_consume(channel, (int32_t)length);
+    if (n > 0)
+        libivc_stats_received(ivc, available, (size_t)n);
+    mutex_unlock(&ivc->mutex);
+
+    if (n < 0)
+    {
+        libivc_error_hot("libivc_consume: Failed to consume %lldB from dom%lld:%lld ring (%lld).\n",
+                length, ivc->remote_domid, ivc->port, n);
+        return INVALID_PARAM;
+    }
+
+    return SUCCESS;
+}
+#ifdef KERNEL
+#ifdef __linux
+EXPORT_SYMBOL(libivc_consume);
+#endif
+#endif
+
+/**
+* Write as many bytes as possible up to srcLength from src to the ivc buffer
+* and return how many bytes were successfully written in actualLength, without
+* locking the client. Intended for use in Windows at IRQL levels higher than
+* APC_LEVEL, in which the client's FastMutex may not be used. It's up to the
+* user to enforce mutual exclusion in these cases.
+* @param ivc - a connected ivc struct.
+* @param src - non null character buffer to copy from.
+* @param srcLength - size of the src buffer.
+* @param actualLength - number of bytes that were actually written.
+* @return SUCCESS or appropriate error number.
+*/
+int
+libivc_unsafe_write(struct libivc_client *ivc, char *src, size_t srcSize, size_t * actualLength)
+{
+	libivc_checkp(ivc, INVALID_PARAM);
+	libivc_checkp(src, INVALID_PARAM);
+	libivc_checkp(actualLength, INVALID_PARAM);
+
+	libivc_assert(srcSize > 0, INVALID_PARAM);
+	libivc_checkp(ivc->buffer, ACCESS_DENIED);
+	libivc_checkp(ivc->ringbuffer, ACCESS_DENIED);
+
+	*actualLength = ringbuffer_write(outgoing_channel_for(ivc), src, srcSize);
+	return SUCCESS;
+}
+#ifdef KERNEL
+#ifdef __linux
+EXPORT_SYMBOL(libivc_unsafe_write);
+#endif
+#endif
+
+/**
+* Try to write EXACTLY srcSize bytes to the ivc channel, without locking the
+* client. If they can't be written because the buffer is full, 0 is returned.
+* Intended for use in Windows at IRQL levels higher than APC_LEVEL, in which
+* the client's FastMutex may not be used. It's up to the user to enforce mutual
+* exclusion in these cases.
+* FIXME: remote not notified (since that's not safe to do at DISPATCH_LEVEL).
+* @param ivc - A connected ivc struct.
+* @param src - source buffer to write to the ivc connection.
+* @param srcSize - size of the source buffer and exact amount to write.
+* @return SUCCESS or appropriate error number.
+*/
+int
+libivc_unsafe_send(struct libivc_client *ivc, char *src, size_t srcSize)
+{
+	size_t actual = 0;
+	// uint8_t event_enabled = 0;
+	int rc;
+	struct ringbuffer_channel_t *channel = NULL;
+	libivc_checkp(ivc, INVALID_PARAM);
+	libivc_checkp(src, INVALID_PARAM);
+	libivc_assert(srcSize > 0, INVALID_PARAM);
+	libivc_checkp(ivc->ringbuffer, INVALID_PARAM);
+
+	channel = outgoing_channel_for(ivc);
+
+	libivc_assert(ringbuffer_bytes_available_write(channel) >= (ssize_t)srcSize, NO_SPACE);
+	actual = ringbuffer_write(channel, src, srcSize);
+
+	rc = srcSize == actual ? SUCCESS : NO_SPACE;
+
+	/*libivc_remote_events_enabled(ivc, &event_enabled);
+
+	if (event_enabled)
+	{
+		libivc_notify_remote(ivc);
+	}*/
+
+	return rc;
+}
+#ifdef KERNEL
+#ifdef __linux
+EXPORT_SYMBOL(libivc_unsafe_send);
+#endif
+#endif
+
+/**
+* Read as many bytes as possible up to destSize into buffer dest, without
+* locking the client. Returns how many bytes were read. Intended for use in
+* Windows at IRQL levels higher than APC_LEVEL, in which the client's FastMutex
+* may not be used. It's up to the user to enforce mutual exclusion in these
+* cases.
+* @param ivc - connected libivc struct.
+* @param dest - destination buffer to read data into
+* @param destSize - maximum number of bytes to read.
+* @param actualSize - pointer to receive actual bytes read.
+* @return SUCCESS or appropriate error number.
+*/
+int
+libivc_unsafe_read(struct libivc_client *ivc, char *dest, size_t destSize, size_t * actualSize)
+{
+	struct ringbuffer_channel_t *channel = NULL;
+	libivc_checkp(ivc, INVALID_PARAM);
+	libivc_checkp(ivc->ringbuffer, INVALID_PARAM);
+	libivc_checkp(dest, INVALID_PARAM);
+	libivc_checkp(actualSize, INVALID_PARAM);
+	libivc_assert(destSize > 0, INVALID_PARAM);
+
+	channel = incoming_channel_for(ivc);
+
+	*actualSize = ringbuffer_read(channel, dest, destSize);
+	return SUCCESS;
+}
+#ifdef KERNEL
+#ifdef __linux
+EXPORT_SYMBOL(libivc_unsafe_read);
+#endif
+#endif
+
+/**
+* Read exactly destSize bytes from ivc, without locking the client. Fails if
+* there are less than the specified amount available. Intended for use in
+* Windows at IRQL levels higher than APC_LEVEL, in which the client's FastMutex
+* may not be used. It's up to the user to enforce mutual exclusion in these
+* cases.
+* @param ivc - connected ivc struct.
+* @param dest - destination buffer to write to.
+* @param destSize - size of dest, and the exact number of bytes required to read.
+* @return SUCCESS, or appropriate error number.
+*/
+int
+libivc_unsafe_recv(struct libivc_client *ivc, char *dest, size_t destSize)
+{
+	struct ringbuffer_channel_t *channel = NULL;
+	size_t read;
+
+	libivc_checkp(ivc, INVALID_PARAM);
+	libivc_checkp(ivc->ringbuffer, INVALID_PARAM);
+	libivc_checkp(dest, INVALID_PARAM);
+
+	libivc_assert(destSize > 0, INVALID_PARAM);
+
+	channel = incoming_channel_for(ivc);
+
+	libivc_assert(ringbuffer_bytes_available_read(channel) >= (ssize_t)destSize, NO_DATA_AVAIL);
+
+	read = ringbuffer_read(channel, dest, destSize);
+	return read == destSize ? SUCCESS : NO_DATA_AVAIL;
+}
+#ifdef KERNEL
+#ifdef __linux
+EXPORT_SYMBOL(libivc_unsafe_recv);
+#endif
+#endif
+
+/**
+ * Returns the remote domain id associated with the connection.
+ * @param ivc - connected ivc struct.
+ * @param dom - pointer to receive domain id value into.
+ * @return SUCCESS or appropriate error number.
+ */
+int
+libivc_getRemoteDomId(struct libivc_client *ivc, uint16_t * dom)
+{
+    libivc_checkp(ivc, INVALID_PARAM);
+    libivc_checkp(dom, INVALID_PARAM);
+    *dom = ivc->remote_domid;
+    return SUCCESS;
+}
+#ifdef KERNEL
+#ifdef __linux
+EXPORT_SYMBOL(libivc_getRemoteDomId);
+#endif
+#endif
+
+/**
+ * return the port number for a connection.
+ * @param ivc - connected ivc struct.
+ * @param port - pointer to receive value into.
+ * @return SUCCESS or appropriate error number.
+ */
+int
+libivc_getport(struct libivc_client *ivc, uint16_t * port)
+{
+    libivc_checkp(ivc, INVALID_PARAM);
+    libivc_checkp(port, INVALID_PARAM);
+
+    *port = ivc->port;
+    return SUCCESS;
+}
+#ifdef KERNEL
+#ifdef __linux
+EXPORT_SYMBOL(libivc_getport);
+#endif
+#endif
+
+/**
+ * returns the local buffer that can be read and written to.  The buffer will be 
+ * offset by the number of bytes required to store the ring buffer header.
+ * @param ivc - connected ivc struct.
+ * @param buffer - pointer to receive buffer pointer
+ * @return SUCCESS or appropriate error number.
+ */
+int
+libivc_getbuffer(struct libivc_client *ivc, char ** buffer)
 {
-    ssize_t n;
-
     libivc_checkp(ivc, INVALID_PARAM);
-    libivc_checkp(src, INVALID_PARAM);
-    libivc_checkp(actualLength, INVALID_PARAM);
+    libivc_checkp(buffer, INVALID_PARAM);
+    *buffer = NULL;
 
-    libivc_assert(srcSize > 0, INVALID_PARAM);
     libivc_checkp(ivc->buffer, ACCESS_DENIED);
-    libivc_checkp(ivc->ringbuffer, ACCESS_DENIED);
-
-    mutex_lock(&ivc->mutex);
-    n = ringbuffer_write(outgoing_channel_for(ivc), src, srcSize);
-    mutex_unlock(&ivc->mutex);
-
-    if (n < 0) {
-        libivc_error("%s: Failed to write to dom%u:%u ring (%ld).\n", __func__,
-                ivc->remote_domid, ivc->port, n);
-        *actualLength = 0;
-        return n;
-    }
-
-    *actualLength = (size_t)n;
+    *buffer = ivc->buffer; // offset for ring header, otherwise it can be clobbered.
     return SUCCESS;
 }
 #ifdef KERNEL
 #ifdef __linux
-EXPORT_SYMBOL(libivc_write);
+EXPORT_SYMBOL(libivc_getbuffer);
 #endif
 #endif
 
 /**
- * Try to write EXACTLY srcSize bytes to the ivc channel.  If they can't be written
- * because the buffer is full, NO_SPACE is returned.
- * @param ivc - A connected ivc struct.
- * @param src - source buffer to write to the ivc connection.
- * @param srcSize - size of the source buffer and exact amount to write.
+ * Returns the size of the local buffer minus any space required for ring buffer
+ * headers.
+ * @param ivc - connected ivc struct.
+ * @param buffSize - parameter to receive buffer size into.
  * @return SUCCESS or appropriate error number.
  */
 int
-libivc_send(struct libivc_client *ivc, char *src, size_t srcSize)
+libivc_getbufferSize(struct libivc_client *ivc, size_t * buffSize)
 {
-    size_t actual = 0;
-    uint8_t event_enabled = 0;
-    int rc;
-    struct ringbuffer_channel_t *channel = NULL;
     libivc_checkp(ivc, INVALID_PARAM);
-    libivc_checkp(src, INVALID_PARAM);
-    libivc_assert(srcSize > 0, INVALID_PARAM);
-    libivc_checkp(ivc->ringbuffer, INVALID_PARAM);
-
-    channel = outgoing_channel_for(ivc);
-
-    mutex_lock(&ivc->mutex);
-    if (ringbuffer_bytes_available_write(channel) < (ssize_t)srcSize) {
-        mutex_unlock(&ivc->mutex);
-        libivc_error("%s: Cannot write %zuB, dom%u:%u ring is full.\n",
-                __func__, ivc->remote_domid, ivc->port, srcSize);
-        return NO_SPACE;
-    }
-    actual = ringbuffer_write(channel, src, srcSize);
-    mutex_unlock(&ivc->mutex);
-
-    // The mutex prevents threaded applications to clobber the ring.
-    // From here the write had to be successful. If for some reason it was not,
-    // the ring itself is lost and unrecoverable.
-    if (actual != srcSize)
-        libivc_error("%s: dom%u:%u ring corrupted.\n", __func__,
-                ivc->remote_domid, ivc->port);
-
-    libivc_remote_events_enabled(ivc, &event_enabled);
-    if (event_enabled)
-        libivc_notify_remote(ivc);
+    libivc_checkp(buffSize, INVALID_PARAM);
+    *buffSize = 0;
 
+    libivc_checkp(ivc->buffer, ACCESS_DENIED);
+    *buffSize = (ivc->num_pages * PAGE_SIZE);
     return SUCCESS;
 }
 #ifdef KERNEL
 #ifdef __linux
-EXPORT_SYMBOL(libivc_send);
+EXPORT_SYMBOL(libivc_getbufferSize);
 #endif
 #endif
 
 /**
- * Read as many bytes as possible up to destSize into buffer dest, returns how
- * many bytes were read.
- * @param ivc - connected libivc struct.
- * @param dest - destination buffer to read data into
- * @param destSize - maximum number of bytes to read.
- * @param actualSize - pointer to receive actual bytes read.
+ * Returns the READ ONLY remote buffer, offset by any ringbuffer headers, or NULL if not connected.
+ * @param ivc - connected ivc struct.
+ * @param remoteBuffer - pointer to receive address of buffer into.
  * @return SUCCESS or appropriate error number.
  */
 int
-libivc_read(struct libivc_client *ivc, char *dest, size_t destSize, size_t * actualSize)
+libivc_getRemoteBuffer(struct libivc_client *ivc, char ** remoteBuffer)
 {
-    struct ringbuffer_channel_t *channel = NULL;
-    ssize_t n;
-
     libivc_checkp(ivc, INVALID_PARAM);
-    libivc_checkp(ivc->ringbuffer, INVALID_PARAM);
-    libivc_checkp(dest, INVALID_PARAM);
-    libivc_checkp(actualSize, INVALID_PARAM);
-    libivc_assert(destSize > 0, INVALID_PARAM);
-
-    channel = incoming_channel_for(ivc);
-
-    mutex_lock(&ivc->mutex);
-    n = ringbuffer_read(channel, dest, destSize);
-    mutex_unlock(&ivc->mutex);
-
-    if (n < 0) {
-        libivc_error("%s: Failed to read from dom%u:%u ring (%d).\n", __func__,
-                ivc->remote_domid, ivc->port, n);
-        *actualSize = 0;
-        return n;
-    }
+    libivc_checkp(remoteBuffer, INVALID_PARAM);
+    *remoteBuffer = NULL;
 
-    *actualSize = (size_t)n;
+    libivc_checkp(ivc->buffer, ACCESS_DENIED);
+    *remoteBuffer = ivc->buffer;
     return SUCCESS;
 }
 #ifdef KERNEL
 #ifdef __linux
-EXPORT_SYMBOL(libivc_read);
+EXPORT_SYMBOL(libivc_getRemoteBuffer);
 #endif
 #endif
 
 /**
- * Read exactly destSize bytes from ivc, failing if there are less than the specified
- * amount available. (Packet style receive)
+ * Returns the READ ONLY remote buffer, offset by any ringbuffer headers, or NULL if not connected.
  * @param ivc - connected ivc struct.
- * @param dest - destination buffer to write to.
- * @param destSize - size of dest, and the exact number of bytes required to read.
- * @return SUCCESS, or appropriate error number.
+ * @param remoteBuffer - pointer to receive address of buffer into.
+ * @return SUCCESS or appropriate error number.
  */
 int
-libivc_recv(struct libivc_client *ivc, char *dest, size_t destSize)
+libivc_getLocalBuffer(struct libivc_client *ivc, char ** remoteBuffer)
 {
-    struct ringbuffer_channel_t *channel = NULL;
-    ssize_t read;
-
     libivc_checkp(ivc, INVALID_PARAM);
-    libivc_checkp(ivc->ringbuffer, INVALID_PARAM);
-    libivc_checkp(dest, INVALID_PARAM);
-    libivc_assert(destSize > 0, INVALID_PARAM);
-
-    channel = incoming_channel_for(ivc);
-
-    mutex_lock(&ivc->mutex);
-    if (ringbuffer_bytes_available_read(channel) < (ssize_t)destSize) {
-        mutex_unlock(&ivc->mutex);
-        libivc_error("%s: Cannot read %zuB, dom%u:%u ring is empty.\n",
-                __func__, destSize, ivc->remote_domid, ivc->port);
-        return NO_DATA_AVAIL;
-    }
-
-    read = ringbuffer_read(channel, dest, destSize);
-    mutex_unlock(&ivc->mutex);
-
-    // The mutex prevents threaded applications to clobber the ring.
-    // From here the read had to be successful. If for some reason it was not,
-    // the ring itself is lost and unrecoverable.
-    if (read != destSize)
-        libivc_error("%s: dom%u:%u ring corrupted.\n", __func__,
-                ivc->remote_domid, ivc->port);
+    libivc_checkp(remoteBuffer, INVALID_PARAM);
+    *remoteBuffer = NULL;
 
+    libivc_checkp(ivc->buffer, ACCESS_DENIED);
+    *remoteBuffer = ivc->buffer;
     return SUCCESS;
 }
 #ifdef KERNEL
 #ifdef __linux
-EXPORT_SYMBOL(libivc_recv);
+EXPORT_SYMBOL(libivc_getLocalBuffer);
 #endif
 #endif
 
 /**
-* Write as many bytes as possible up to srcLength from src to the ivc buffer
-* and return how many bytes were successfully written in actualLength, without
-* locking the client. Intended for use in Windows at IRQL levels higher than
-* APC_LEVEL, in which the client's FastMutex may not be used. It's up to the
-* user to enforce mutual exclusion in these cases.
-* @param ivc - a connected ivc struct.
-* @param src - non null character buffer to copy from.
-* @param srcLength - size of the src buffer.
-* @param actualLength - number of bytes that were actually written.
-* @return SUCCESS or appropriate error number.
-*/
+ * Returns the size of the remote buffer minus the ring buffer headers, or null if not connected.
+ * @param ivc - connected ivc struct.
+ * @param buffSize - pointer to receive size into.
+ * @return SUCCESS or appropriate error number.
+ */
 int
-libivc_unsafe_write(struct libivc_client *ivc, char *src, size_t srcSize, size_t * actualLength)
+libivc_getRemoteBufferSize(struct libivc_client *ivc, size_t * buffSize)
 {
-	libivc_checkp(ivc, INVALID_PARAM);
-	libivc_checkp(src, INVALID_PARAM);
-	libivc_checkp(actualLength, INVALID_PARAM);
-
-	libivc_assert(srcSize > 0, INVALID_PARAM);
-	libivc_checkp(ivc->buffer, ACCESS_DENIED);
-	libivc_checkp(ivc->ringbuffer, ACCESS_DENIED);
+    libivc_checkp(ivc, INVALID_PARAM);
+    libivc_checkp(buffSize, INVALID_PARAM);
+    *buffSize = 0;
 
-	*actualLength = ringbuffer_write(outgoing_channel_for(ivc), src, srcSize);
-	return SUCCESS;
+    libivc_checkp(ivc->buffer, NOT_CONNECTED);
+    *buffSize = (ivc->num_pages * PAGE_SIZE);
+    return SUCCESS;
 }
 #ifdef KERNEL
 #ifdef __linux
-EXPORT_SYMBOL(libivc_unsafe_write);
+EXPORT_SYMBOL(libivc_getRemoteBufferSize);
 #endif
 #endif
 
 /**
-* Try to write EXACTLY srcSize bytes to the ivc channel, without locking the
-* client. If they can't be written because the buffer is full, 0 is returned.
-* Intended for use in Windows at IRQL levels higher than APC_LEVEL, in which
-* the client's FastMutex may not be used. It's up to the user to enforce mutual
-* exclusion in these cases.
-* FIXME: remote not notified (since that's not safe to do at DISPATCH_LEVEL).
-* @param ivc - A connected ivc struct.
-* @param src - source buffer to write to the ivc connection.
-* @param srcSize - size of the source buffer and exact amount to write.
-* @return SUCCESS or appropriate error number.
-*/
+ * Returns the size of the remote buffer minus the ring buffer headers, or null if not connected.
+ * @param ivc - connected ivc struct.
+ * @param buffSize - pointer to receive size into.
+ * @return SUCCESS or appropriate error number.
+ */
 int
-libivc_unsafe_send(struct libivc_client *ivc, char *src, size_t srcSize)
+libivc_getLocalBufferSize(struct libivc_client *ivc, size_t * buffSize)
 {
-	size_t actual = 0;
-	// uint8_t event_enabled = 0;
-	int rc;
-	struct ringbuffer_channel_t *channel = NULL;
-	libivc_checkp(ivc, INVALID_PARAM);
-	libivc_checkp(src, INVALID_PARAM);
-	libivc_assert(srcSize > 0, INVALID_PARAM);
-	libivc_checkp(ivc->ringbuffer, INVALID_PARAM);
-
-	channel = outgoing_channel_for(ivc);
-
-	libivc_assert(ringbuffer_bytes_available_write(channel) >= (ssize_t)srcSize, NO_SPACE);
-	actual = ringbuffer_write(channel, src, srcSize);
+    return libivc_getRemoteBufferSize(ivc, buffSize);
+}
+#ifdef KERNEL
+#ifdef __linux
+EXPORT_SYMBOL(libivc_getLocalBufferSize);
+#endif
+#endif
 
-	rc = srcSize == actual ? SUCCESS : NO_SPACE;
+/**
+ * Register function pointers to be notified of events callback style. NULLs may
+ * be passed if you are not interested in a particular type of event.
+ * @param client The ivc client of interest.
+ * @param eventCallback when a remote event has been fired to this clients port
+ * @param disconnectCallback when the remote domain wants to disconnect this client.
+ * @return SUCCESS, or appropriate error message.
+ */
+#ifdef _WIN32
 
-	/*libivc_remote_events_enabled(ivc, &event_enabled);
+__pragma(warning(push))
+__pragma(warning(disable : 4127))
+#endif
+int
+libivc_register_event_callbacks(struct libivc_client *client,
+                libivc_client_event_fired eventCallback,
+                libivc_client_disconnected disconnectCallback,
+                void *opaque)
+{
+    callback_node_t * callbacks = NULL;
 
-	if (event_enabled)
-	{
-		libivc_notify_remote(ivc);
-	}*/
+    libivc_checkp(client, INVALID_PARAM);
+    libivc_assert(eventCallback != NULL || disconnectCallback != NULL, INVALID_PARAM);
+    
+    callbacks = (callback_node_t *) malloc(sizeof (callback_node_t));
+    libivc_checkp(callbacks, OUT_OF_MEM);
+    memset(callbacks, 0, sizeof (callback_node_t));
+    
+    callbacks->disconnectCallback = disconnectCallback;
+    callbacks->eventCallback = eventCallback;
+    
+    client->opaque = opaque;
 
-	return rc;
+    INIT_LIST_HEAD(&callbacks->node);
+    
+    list_add(&callbacks->node, &client->callback_list);
+    if(libivc_isOpen(client))
+    {
+        libivc_enable_events(client);
+    }
+    else
+    {
+        libivc_info("Tried to enable events on client that wasn't open\n");
+    }
+    
+    return SUCCESS;
 }
+
 #ifdef KERNEL
 #ifdef __linux
-EXPORT_SYMBOL(libivc_unsafe_send);
+EXPORT_SYMBOL(libivc_register_event_callbacks);
+#endif
 #endif
+#ifdef _WIN32
+
+__pragma(warning(pop))
 #endif
 
 /**
-* Read as many bytes as possible up to destSize into buffer dest, without
-* locking the client. Returns how many bytes were read. Intended for use in
-* Windows at IRQL levels higher than APC_LEVEL, in which the client's FastMutex
-* may not be used. It's up to the user to enforce mutual exclusion in these
-* cases.
-* @param ivc - connected libivc struct.
-* @param dest - destination buffer to read data into
-* @param destSize - maximum number of bytes to read.
-* @param actualSize - pointer to receive actual bytes read.
-* @return SUCCESS or appropriate error number.
-*/
+ * Retrieves how much space is available to write into the buffer.
+ * @param client Non null pointer to client being used to write to.
+ * @param space Non null pointer to receive space.
+ * @return SUCCESS or appropriate error number.
+ */
 int
-libivc_unsafe_read(struct libivc_client *ivc, char *dest, size_t destSize, size_t * actualSize)
+libivc_getAvailableSpace(struct libivc_client *client, size_t * space)
 {
-	struct ringbuffer_channel_t *channel = NULL;
-	libivc_checkp(ivc, INVALID_PARAM);
-	libivc_checkp(ivc->ringbuffer, INVALID_PARAM);
-	libivc_checkp(dest, INVALID_PARAM);
-	libivc_checkp(actualSize, INVALID_PARAM);
-	libivc_assert(destSize > 0, INVALID_PARAM);
-
-	channel = incoming_channel_for(ivc);
+    libivc_checkp(client, INVALID_PARAM);
+    libivc_checkp(space, INVALID_PARAM);
+    libivc_checkp(client->ringbuffer, INVALID_PARAM); // shouldn't ever happen.
 
-	*actualSize = ringbuffer_read(channel, dest, destSize);
-	return SUCCESS;
+    *space = ringbuffer_bytes_available_write(outgoing_channel_for(client));
+    return SUCCESS;
 }
 #ifdef KERNEL
 #ifdef __linux
-EXPORT_SYMBOL(libivc_unsafe_read);
+EXPORT_SYMBOL(libivc_getAvailableSpace);
 #endif
 #endif
 
+
 /**
-* Read exactly destSize bytes from ivc, without locking the client. Fails if
-* there are less than the specified amount available. Intended for use in
-* Windows at IRQL levels higher than APC_LEVEL, in which the client's FastMutex
-* may not be used. It's up to the user to enforce mutual exclusion in these
-* cases.
-* @param ivc - connected ivc struct.
-* @param dest - destination buffer to write to.
-* @param destSize - size of dest, and the exact number of bytes required to read.
-* @return SUCCESS, or appropriate error number.
-*/
+ * Retrieves the amount of data available to read from the client connection.
+ * @param client - non null pointer to client.
+ * @param dataSize - non null pointer to receive data.
+ * @return SUCCESS or appropriate error.
+ */
 int
-libivc_unsafe_recv(struct libivc_client *ivc, char *dest, size_t destSize)
+libivc_getAvailableData(struct libivc_client *client, size_t *dataSize)
 {
-	struct ringbuffer_channel_t *channel = NULL;
-	size_t read;
-
-	libivc_checkp(ivc, INVALID_PARAM);
-	libivc_checkp(ivc->ringbuffer, INVALID_PARAM);
-	libivc_checkp(dest, INVALID_PARAM);
-
-	libivc_assert(destSize > 0, INVALID_PARAM);
-
-	channel = incoming_channel_for(ivc);
+    libivc_checkp(client, INVALID_PARAM);
+    libivc_checkp(dataSize, INVALID_PARAM);
+    libivc_checkp(client->ringbuffer, INVALID_PARAM); // shouldn't ever happen.
 
-	libivc_assert(ringbuffer_bytes_available_read(channel) >= (ssize_t)destSize, NO_DATA_AVAIL);
+    *dataSize = ringbuffer_bytes_available_read(incoming_channel_for(client));
 
-	read = ringbuffer_read(channel, dest, destSize);
-	return read == destSize ? SUCCESS : NO_DATA_AVAIL;
+    return SUCCESS;
 }
 #ifdef KERNEL
 #ifdef __linux
-EXPORT_SYMBOL(libivc_unsafe_recv);
+EXPORT_SYMBOL(libivc_getAvailableData);
 #endif
 #endif
 
 /**
- * Returns the remote domain id associated with the connection.
- * @param ivc - connected ivc struct.
- * @param dom - pointer to receive domain id value into.
- * @return SUCCESS or appropriate error number.
+ * Gets the number of lanes the client has in each direction.
+ * @param client - non null pointer to client.
+ * @param num_lanes - non null pointer to receive the number of lanes.
+ * @return SUCCESS or appropriate error.
  */
 int
-libivc_getRemoteDomId(struct libivc_client *ivc, uint16_t * dom)
+libivc_get_num_lanes(struct libivc_client *client, uint8_t *num_lanes)
 {
-    libivc_checkp(ivc, INVALID_PARAM);
-    libivc_checkp(dom, INVALID_PARAM);
-    *dom = ivc->remote_domid;
+    libivc_checkp(client, INVALID_PARAM);
+    libivc_checkp(num_lanes, INVALID_PARAM);
+
+    *num_lanes = lanes_of(client);
     return SUCCESS;
 }
 #ifdef KERNEL
 #ifdef __linux
-EXPORT_SYMBOL(libivc_getRemoteDomId);
+EXPORT_SYMBOL(libivc_get_num_lanes);
 #endif
 #endif
 
 /**
- * return the port number for a connection.
- * @param ivc - connected ivc struct.
- * @param port - pointer to receive value into.
- * @return SUCCESS or appropriate error number.
+ * Retrieves the amount of data available to read from one of the client's lanes.
+ * @param client - non null pointer to client.
+ * @param lane - the lane of interest.
+ * @param dataSize - non null pointer to receive data.
+ * @return SUCCESS or appropriate error.
  */
 int
-libivc_getport(struct libivc_client *ivc, uint16_t * port)
+libivc_lane_available_data(struct libivc_client *client, uint8_t lane, size_t *dataSize)
 {
-    libivc_checkp(ivc, INVALID_PARAM);
-    libivc_checkp(port, INVALID_PARAM);
+    libivc_checkp(client, INVALID_PARAM);
+    libivc_checkp(dataSize, INVALID_PARAM);
+    libivc_checkp(client->ringbuffer, INVALID_PARAM); // shouldn't ever happen.
+    libivc_assert(lane < lanes_of(client), INVALID_PARAM);
+
+    *dataSize = ringbuffer_bytes_available_read(incoming_lane_channel_for(client, lane));
 
-    *port = ivc->port;
     return SUCCESS;
 }
 #ifdef KERNEL
 #ifdef __linux
-EXPORT_SYMBOL(libivc_getport);
+EXPORT_SYMBOL(libivc_lane_available_data);
 #endif
 #endif
 
 /**
- * returns the local buffer that can be read and written to.  The buffer will be 
- * offset by the number of bytes required to store the ring buffer header.
- * @param ivc - connected ivc struct.
- * @param buffer - pointer to receive buffer pointer
- * @return SUCCESS or appropriate error number.
+ * Sets how libivc_recv_next_lane picks among the client's lanes.
+ * @param client - non null pointer to client.
+ * @param policy - the policy to use.
+ * @param weights - for LIBIVC_LANE_WEIGHTED, a weight for each lane; or NULL to
+ *    weigh them all equally.
+ * @return SUCCESS or appropriate error.
  */
 int
-libivc_getbuffer(struct libivc_client *ivc, char ** buffer)
+libivc_set_lane_policy(struct libivc_client *client, LANE_POLICY_T policy, const uint32_t *weights)
 {
-    libivc_checkp(ivc, INVALID_PARAM);
-    libivc_checkp(buffer, INVALID_PARAM);
-    *buffer = NULL;
+    uint8_t lane;
+
+    libivc_checkp(client, INVALID_PARAM);
+    libivc_assert(policy == LIBIVC_LANE_STRICT || policy == LIBIVC_LANE_WEIGHTED, INVALID_PARAM);
+
+    if (weights)
+    {
+        for (lane = 0; lane < lanes_of(client); lane++)
+            libivc_assert(weights[lane] > 0, INVALID_PARAM);
+    }
+
+    mutex_lock(&client->mutex);
+    client->lane_policy = (uint8_t)policy;
+    for (lane = 0; lane < LIBIVC_MAX_LANES; lane++)
+    {
+        client->lane_weights[lane] = (weights && lane < lanes_of(client)) ? weights[lane] : 1;
+        client->lane_credit[lane] = 0;
+    }
+    mutex_unlock(&client->mutex);
 
-    libivc_checkp(ivc->buffer, ACCESS_DENIED);
-    *buffer = ivc->buffer; // offset for ring header, otherwise it can be clobbered.
     return SUCCESS;
 }
 #ifdef KERNEL
 #ifdef __linux
-EXPORT_SYMBOL(libivc_getbuffer);
+EXPORT_SYMBOL(libivc_set_lane_policy);
 #endif
 #endif
 
 /**
- * Returns the size of the local buffer minus any space required for ring buffer
- * headers.
- * @param ivc - connected ivc struct.
- * @param buffSize - parameter to receive buffer size into.
- * @return SUCCESS or appropriate error number.
+ * Picks the lane to read from next, among those with data waiting, according
+ * to the client's lane policy.
+ * @param client - non null pointer to client.
+ * @param lane - non null pointer to receive the lane.
+ * @return SUCCESS, NO_DATA_AVAIL if no lane has data waiting, or appropriate error.
  */
 int
-libivc_getbufferSize(struct libivc_client *ivc, size_t * buffSize)
+libivc_recv_next_lane(struct libivc_client *client, uint8_t *lane)
 {
-    libivc_checkp(ivc, INVALID_PARAM);
-    libivc_checkp(buffSize, INVALID_PARAM);
-    *buffSize = 0;
+    uint8_t i, best = LIBIVC_MAX_LANES;
+    int64_t weight, total = 0;
 
-    libivc_checkp(ivc->buffer, ACCESS_DENIED);
-    *buffSize = (ivc->num_pages * PAGE_SIZE);
+    libivc_checkp(client, INVALID_PARAM);
+    libivc_checkp(lane, INVALID_PARAM);
+    libivc_checkp(client->ringbuffer, INVALID_PARAM); // shouldn't ever happen.
+
+    mutex_lock(&client->mutex);
+    for (i = 0; i < lanes_of(client); i++)
+    {
+        if (ringbuffer_bytes_available_read(incoming_lane_channel_for(client, i)) <= 0)
+            continue;
+
+        if (client->lane_policy == LIBIVC_LANE_STRICT)
+        {
+            best = i;
+            break;
+        }
+
+        // Smooth weighted round robin: each waiting lane earns its weight, and
+        // the one with the most credit is picked and pays for everyone's; so
+        // lanes are picked in proportion to their weights, interleaved rather
+        // than in bursts, and idle lanes don't bank credit.
+        weight = client->lane_weights[i] ? client->lane_weights[i] : 1;
+        client->lane_credit[i] += weight;
+        total += weight;
+        if (best == LIBIVC_MAX_LANES || client->lane_credit[i] > client->lane_credit[best])
+            best = i;
+    }
+
+    if (best == LIBIVC_MAX_LANES)
+    {
+        client->stats.recv_no_data++;
+        mutex_unlock(&client->mutex);
+        return NO_DATA_AVAIL;
+    }
+
+    if (client->lane_policy == LIBIVC_LANE_WEIGHTED)
+        client->lane_credit[best] -= total;
+    mutex_unlock(&client->mutex);
+
+    *lane = best;
     return SUCCESS;
 }
 #ifdef KERNEL
 #ifdef __linux
-EXPORT_SYMBOL(libivc_getbufferSize);
+EXPORT_SYMBOL(libivc_recv_next_lane);
+#endif
+#endif
+
+int
+libivc_clear_ringbuffer(struct libivc_client *client)
+{
+    libivc_checkp(client, INVALID_PARAM);
+    libivc_checkp(client->ringbuffer, INVALID_PARAM); // shouldn't ever happen.
+    mutex_lock(&client->mutex);
+    ringbuffer_clear_buffer(incoming_channel_for(client));
+    mutex_unlock(&client->mutex);
+    return SUCCESS;
+}
+#ifdef KERNEL
+#ifdef __linux
+EXPORT_SYMBOL(libivc_clear_ringbuffer);
 #endif
 #endif
 
+
+
 /**
- * Returns the READ ONLY remote buffer, offset by any ringbuffer headers, or NULL if not connected.
- * @param ivc - connected ivc struct.
- * @param remoteBuffer - pointer to receive address of buffer into.
+ * Sets or clears the flag asking the remote to fire events at us for data sent
+ * on one of the client's lanes.
+ */
+static void
+libivc_set_lane_events(struct libivc_client *client, uint8_t lane, uint8_t enabled)
+{
+    int32_t flags = 0;
+    int32_t target_flag;
+    struct ringbuffer_channel_t *channel;
+
+    // A buffer that's been taken over has no flags; the layer that owns it
+    // notifies the remote unconditionally.
+    if (client->taken_over)
+        return;
+
+    // We want to control events fired _at_ us-- so we're going to
+    // adjust the flags on the channel we receive on.
+    target_flag = client->server_side ? CLIENT_SIDE_TX_EVENT_FLAG : SERVER_SIDE_TX_EVENT_FLAG;
+    channel = incoming_lane_channel_for(client, lane);
+
+    // Adjust the event flag on the relevant channel.
+    flags = ringbuffer_get_flags(channel);
+    if (enabled)
+        flags |= target_flag;
+    else
+        flags &= ~target_flag;
+    ringbuffer_set_flags(channel, flags);
+}
+
+/**
+ * When the remote side sends or writes data to this client, tell it not to
+ * fire remote events to us.  Usually you would do this when polling on data.
+ * This applies to every lane.
+ * @param client Non null pointer to client.
  * @return SUCCESS or appropriate error number.
  */
 int
-libivc_getRemoteBuffer(struct libivc_client *ivc, char ** remoteBuffer)
+libivc_disable_events(struct libivc_client *client)
 {
-    libivc_checkp(ivc, INVALID_PARAM);
-    libivc_checkp(remoteBuffer, INVALID_PARAM);
-    *remoteBuffer = NULL;
+    uint8_t lane;
+
+    libivc_checkp(client, INVALID_PARAM);
+    libivc_checkp(client->ringbuffer, INVALID_PARAM);
+
+    for (lane = 0; lane < lanes_of(client); lane++)
+        libivc_set_lane_events(client, lane, 0);
 
-    libivc_checkp(ivc->buffer, ACCESS_DENIED);
-    *remoteBuffer = ivc->buffer;
     return SUCCESS;
 }
 #ifdef KERNEL
 #ifdef __linux
-EXPORT_SYMBOL(libivc_getRemoteBuffer);
+EXPORT_SYMBOL(libivc_disable_events);
 #endif
 #endif
 
 /**
- * Returns the READ ONLY remote buffer, offset by any ringbuffer headers, or NULL if not connected.
- * @param ivc - connected ivc struct.
- * @param remoteBuffer - pointer to receive address of buffer into.
+ * Let the remote domain know that you wish to receive events when it sends or
+ * writes data in the ring buffer. This applies to every lane.
+ * @param client Non null pointer to the client
  * @return SUCCESS or appropriate error number.
  */
 int
-libivc_getLocalBuffer(struct libivc_client *ivc, char ** remoteBuffer)
+libivc_enable_events(struct libivc_client *client)
 {
-    libivc_checkp(ivc, INVALID_PARAM);
-    libivc_checkp(remoteBuffer, INVALID_PARAM);
-    *remoteBuffer = NULL;
+    uint8_t lane;
+
+    libivc_checkp(client, INVALID_PARAM);
+    libivc_checkp(client->ringbuffer, INVALID_PARAM);
+
+    for (lane = 0; lane < lanes_of(client); lane++)
+        libivc_set_lane_events(client, lane, 1);
 
-    libivc_checkp(ivc->buffer, ACCESS_DENIED);
-    *remoteBuffer = ivc->buffer;
     return SUCCESS;
 }
 #ifdef KERNEL
 #ifdef __linux
-EXPORT_SYMBOL(libivc_getLocalBuffer);
+EXPORT_SYMBOL(libivc_enable_events);
 #endif
 #endif
 
 /**
- * Returns the size of the remote buffer minus the ring buffer headers, or null if not connected.
- * @param ivc - connected ivc struct.
- * @param buffSize - pointer to receive size into.
+ * Tells the remote not to fire events at us for data sent on one lane, e.g. a
+ * bulk lane that's drained whenever an urgent lane's event arrives.
+ * @param client Non null pointer to client.
+ * @param lane - the lane of interest.
  * @return SUCCESS or appropriate error number.
  */
 int
-libivc_getRemoteBufferSize(struct libivc_client *ivc, size_t * buffSize)
+libivc_disable_lane_events(struct libivc_client *client, uint8_t lane)
 {
-    libivc_checkp(ivc, INVALID_PARAM);
-    libivc_checkp(buffSize, INVALID_PARAM);
-    *buffSize = 0;
+    libivc_checkp(client, INVALID_PARAM);
+    libivc_checkp(client->ringbuffer, INVALID_PARAM);
+    libivc_assert(lane < lanes_of(client), INVALID_PARAM);
 
-    libivc_checkp(ivc->buffer, NOT_CONNECTED);
-    *buffSize = (ivc->num_pages * PAGE_SIZE);
+    libivc_set_lane_events(client, lane, 0);
     return SUCCESS;
 }
 #ifdef KERNEL
 #ifdef __linux
-EXPORT_SYMBOL(libivc_getRemoteBufferSize);
+EXPORT_SYMBOL(libivc_disable_lane_events);
 #endif
 #endif
 
 /**
- * Returns the size of the remote buffer minus the ring buffer headers, or null if not connected.
- * @param ivc - connected ivc struct.
- * @param buffSize - pointer to receive size into.
+ * Asks the remote to fire events at us for data sent on one lane.
+ * @param client Non null pointer to client.
+ * @param lane - the lane of interest.
  * @return SUCCESS or appropriate error number.
  */
 int
-libivc_getLocalBufferSize(struct libivc_client *ivc, size_t * buffSize)
+libivc_enable_lane_events(struct libivc_client *client, uint8_t lane)
 {
-    return libivc_getRemoteBufferSize(ivc, buffSize);
+    libivc_checkp(client, INVALID_PARAM);
+    libivc_checkp(client->ringbuffer, INVALID_PARAM);
+    libivc_assert(lane < lanes_of(client), INVALID_PARAM);
+
+    libivc_set_lane_events(client, lane, 1);
+    return SUCCESS;
 }
 #ifdef KERNEL
 #ifdef __linux
-EXPORT_SYMBOL(libivc_getLocalBufferSize);
+EXPORT_SYMBOL(libivc_enable_lane_events);
 #endif
 #endif
 
-/**
- * Register function pointers to be notified of events callback style. NULLs may
- * be passed if you are not interested in a particular type of event.
- * @param client The ivc client of interest.
- * @param eventCallback when a remote event has been fired to this clients port
- * @param disconnectCallback when the remote domain wants to disconnect this client.
- * @return SUCCESS, or appropriate error message.
- */
-#ifdef _WIN32
-
-__pragma(warning(push))
-__pragma(warning(disable : 4127))
-#endif
 int
-libivc_register_event_callbacks(struct libivc_client *client,
-                libivc_client_event_fired eventCallback,
-                libivc_client_disconnected disconnectCallback,
-                void *opaque)
+libivc_remote_events_enabled(struct libivc_client *client, uint8_t *enabled)
 {
-    callback_node_t * callbacks = NULL;
+    uint8_t lane;
 
     libivc_checkp(client, INVALID_PARAM);
-    libivc_assert(eventCallback != NULL || disconnectCallback != NULL, INVALID_PARAM);
-    
-    callbacks = (callback_node_t *) malloc(sizeof (callback_node_t));
-    libivc_checkp(callbacks, OUT_OF_MEM);
-    memset(callbacks, 0, sizeof (callback_node_t));
-    
-    callbacks->disconnectCallback = disconnectCallback;
-    callbacks->eventCallback = eventCallback;
-    
-    client->opaque = opaque;
+    libivc_checkp(enabled, INVALID_PARAM);
+    libivc_checkp(client->ringbuffer, INVALID_PARAM);
 
-    INIT_LIST_HEAD(&callbacks->node);
-    
-    list_add(&callbacks->node, &client->callback_list);
-    if(libivc_isOpen(client))
-    {
-        libivc_enable_events(client);
-    }
-    else
+    // We're interested in whether we should send event at
+    // the _remote_ channel-- so we're going to check the
+    // channels we write in. The remote wants events if it
+    // wants them for any lane.
+    *enabled = 0;
+    for (lane = 0; lane < lanes_of(client) && !*enabled; lane++)
+        *enabled = remote_lane_events_enabled(client, lane);
+
+    return SUCCESS;
+}
+
+/**
+ * Fires a XEN event to the remote domain.
+ * @param client Non null pointer to client connected to remote.
+ * @return SUCCESS or appropriate error message.
+ */
+int
+libivc_notify_remote(struct libivc_client *client)
+{
+    libivc_checkp(client, INVALID_PARAM);
+    if (!initialized)
     {
-        libivc_info("Tried to enable events on client that wasn't open\n");
+        libivc_init();
     }
-    
-    return SUCCESS;
+
+    atomic64_inc(&client->notifications_sent);
+
+    libivc_probe2(notify, client->remote_domid, client->port);
+    return platformAPI->notifyRemote(client);
 }
 
 #ifdef KERNEL
 #ifdef __linux
-EXPORT_SYMBOL(libivc_register_event_callbacks);
+EXPORT_SYMBOL(libivc_notify_remote);
 #endif
 #endif
-#ifdef _WIN32
 
-__pragma(warning(pop))
-#endif
+/**
+ * Notifies the remote of any deferred data if the remote wants events.
+ * @param client Non null pointer to client connected to remote.
+ * @param pending The number of bytes the remote has not yet been told about.
+ * @return SUCCESS or appropriate error message.
+ */
+static int
+libivc_notify_pending(struct libivc_client *client, uint32_t pending)
+{
+    uint8_t event_enabled = 0;
+
+    if (!pending)
+        return SUCCESS;
+
+    libivc_remote_events_enabled(client, &event_enabled);
+    if (!event_enabled)
+        return SUCCESS;
+
+    return libivc_notify_remote(client);
+}
 
 /**
- * Retrieves how much space is available to write into the buffer.
- * @param client Non null pointer to client being used to write to.
- * @param space Non null pointer to receive space.
+ * Corks the client, deferring remote notifications for sends until flushed.
+ * Corks nest: the client stays corked until uncorked as many times.
+ * @param client Non null pointer to client.
  * @return SUCCESS or appropriate error number.
  */
 int
-libivc_getAvailableSpace(struct libivc_client *client, size_t * space)
+libivc_cork(struct libivc_client *client)
 {
     libivc_checkp(client, INVALID_PARAM);
-    libivc_checkp(space, INVALID_PARAM);
-    libivc_checkp(client->ringbuffer, INVALID_PARAM); // shouldn't ever happen.
 
-    *space = ringbuffer_bytes_available_write(outgoing_channel_for(client));
+    mutex_lock(&client->mutex);
+    client->corked++;
+    mutex_unlock(&client->mutex);
+
     return SUCCESS;
 }
+
 #ifdef KERNEL
 #ifdef __linux
-EXPORT_SYMBOL(libivc_getAvailableSpace);
+EXPORT_SYMBOL(libivc_cork);
 #endif
 #endif
 
-
 /**
- * Retrieves the amount of data available to read from the client connection.
- * @param client - non null pointer to client.
- * @param dataSize - non null pointer to receive data.
- * @return SUCCESS or appropriate error.
+ * Undoes one libivc_cork, notifying the remote of any deferred data once the
+ * outermost cork is removed.
+ * @param client Non null pointer to client.
+ * @return SUCCESS or appropriate error number.
  */
 int
-libivc_getAvailableData(struct libivc_client *client, size_t *dataSize)
+libivc_uncork(struct libivc_client *client)
 {
+    uint32_t pending = 0;
+
     libivc_checkp(client, INVALID_PARAM);
-    libivc_checkp(dataSize, INVALID_PARAM);
-    libivc_checkp(client->ringbuffer, INVALID_PARAM); // shouldn't ever happen.
 
-    *dataSize = ringbuffer_bytes_available_read(incoming_channel_for(client));
+    mutex_lock(&client->mutex);
+    if (client->corked)
+        client->corked--;
+    if (!client->corked)
+    {
+        pending = client->cork_pending;
+        client->cork_pending = 0;
+    }
+    mutex_unlock(&client->mutex);
 
-    return SUCCESS;
+    return libivc_notify_pending(client, pending);
 }
+
 #ifdef KERNEL
 #ifdef __linux
-EXPORT_SYMBOL(libivc_getAvailableData);
+EXPORT_SYMBOL(libivc_uncork);
 #endif
 #endif
 
+/**
+ * Notifies the remote of any deferred data, leaving the client corked.
+ * @param client Non null pointer to client.
+ * @return SUCCESS or appropriate error number.
+ */
 int
-libivc_clear_ringbuffer(struct libivc_client *client)
+libivc_flush(struct libivc_client *client)
 {
+    uint32_t pending;
+
     libivc_checkp(client, INVALID_PARAM);
-    libivc_checkp(client->ringbuffer, INVALID_PARAM); // shouldn't ever happen.
+
     mutex_lock(&client->mutex);
-    ringbuffer_clear_buffer(incoming_channel_for(client));
+    pending = client->cork_pending;
+    client->cork_pending = 0;
     mutex_unlock(&client->mutex);
-    return SUCCESS;
+
+    return libivc_notify_pending(client, pending);
 }
+
 #ifdef KERNEL
 #ifdef __linux
-EXPORT_SYMBOL(libivc_clear_ringbuffer);
+EXPORT_SYMBOL(libivc_flush);
 #endif
 #endif
 
-
-
 /**
- * When the remote side sends or writes data to this client, tell it not to
- * fire remote events to us.  Usually you would do this when polling on data.
+ * Sets the thresholds at which a corked client flushes automatically.
  * @param client Non null pointer to client.
+ * @param max_bytes - flush once this many bytes are pending, or 0 for no limit.
+ * @param max_delay_us - flush once data has been pending this long, or 0 for no limit.
  * @return SUCCESS or appropriate error number.
  */
 int
-libivc_disable_events(struct libivc_client *client)
+libivc_set_cork_thresholds(struct libivc_client *client, uint32_t max_bytes, uint32_t max_delay_us)
 {
-    int32_t flags = 0;
-    int64_t target_flag;
-    void * channel;
-
     libivc_checkp(client, INVALID_PARAM);
-    libivc_checkp(client->ringbuffer, INVALID_PARAM);
 
-    // We want to control events fired _at_ us-- so we're going to
-    // adjust the flags on the channel we receive on.
-    target_flag = client->server_side ? CLIENT_SIDE_TX_EVENT_FLAG : SERVER_SIDE_TX_EVENT_FLAG;
-    channel = incoming_channel_for(client);
+#if !defined(__linux) || defined(KERNEL)
+    // Only the Linux userspace event thread checks the delay when no one is
+    // sending; elsewhere corked data could sit unflushed indefinitely.
+    libivc_assert(max_delay_us == 0, NOT_IMPLEMENTED);
+#endif
 
-    // Adjust the event flag on the relevant channel.
-    flags = ringbuffer_get_flags(channel);
-    flags &= ~target_flag;
-    ringbuffer_set_flags(channel, flags);
+    mutex_lock(&client->mutex);
+    client->cork_max_bytes = max_bytes;
+    client->cork_max_delay_us = max_delay_us;
+    mutex_unlock(&client->mutex);
 
     return SUCCESS;
 }
+
 #ifdef KERNEL
 #ifdef __linux
-EXPORT_SYMBOL(libivc_disable_events);
+EXPORT_SYMBOL(libivc_set_cork_thresholds);
 #endif
 #endif
 
 /**
- * Let the remote domain know that you wish to receive events when it sends or
- * writes data in the ring buffer.
- * @param client Non null pointer to the client
+ * Notifies the remote of any corked data whose cork thresholds have been crossed.
+ * @param client The client whose deferred notification should be checked.
  * @return SUCCESS or appropriate error number.
  */
 int
-libivc_enable_events(struct libivc_client *client)
+__libivc_flush_if_due(struct libivc_client *client)
 {
-    int32_t flags = 0;
-    int32_t target_flag;
-    void * channel;
+    uint32_t pending = 0;
 
     libivc_checkp(client, INVALID_PARAM);
-    libivc_checkp(client->ringbuffer, INVALID_PARAM);
 
-    // We want to control events fired _at_ us-- so we're going to
-    // adjust the flags on the channel we receive on.
-    target_flag = client->server_side ? CLIENT_SIDE_TX_EVENT_FLAG : SERVER_SIDE_TX_EVENT_FLAG;
-    channel = incoming_channel_for(client);
+    mutex_lock(&client->mutex);
+    if (client->corked && client->cork_pending &&
+        libivc_cork_threshold_reached(client, libivc_monotonic_ns()))
+    {
+        pending = client->cork_pending;
+        client->cork_pending = 0;
+    }
+    mutex_unlock(&client->mutex);
 
-    // Adjust the event flag on the relevant channel.
-    flags = ringbuffer_get_flags(channel);
-    flags |= target_flag;
-    ringbuffer_set_flags(channel, flags);
+    return libivc_notify_pending(client, pending);
+}
+
+/**
+ * Records events received from the remote and the dispatch of the client's
+ * callbacks for them.
+ * @param client The client the events were delivered to.
+ * @param events The number of events picked up at once.
+ * @param picked_up libivc_monotonic_ns() when the events were picked up.
+ * @param dispatched Non zero if callbacks were run for them.
+ */
+void
+__libivc_record_events(struct libivc_client *client, uint64_t events, uint64_t picked_up,
+    uint8_t dispatched)
+{
+    uint64_t latency = 0;
+
+    libivc_checkp(client);
+
+    if (dispatched)
+        latency = libivc_monotonic_ns() - picked_up;
+
+    mutex_lock(&client->mutex);
+    client->stats.notifications_received += events;
+    client->moderation_arrivals += (uint32_t)events;
+    if (dispatched)
+    {
+        client->stats.callbacks_dispatched++;
+        client->stats.callback_latency_total_ns += latency;
+        if (latency > client->stats.callback_latency_max_ns)
+            client->stats.callback_latency_max_ns = latency;
+    }
+    mutex_unlock(&client->mutex);
+
+    // Wake anyone blocked in libivc_recv_wait.
+    libivc_event_wait_wake(&client->event_wait, &client->event_generation);
+}
+
+/**
+ * Gets a snapshot of a client's counters.
+ * @param client Non null pointer to client.
+ * @param stats Pointer to receive the counters.
+ * @return SUCCESS or appropriate error number.
+ */
+int
+libivc_get_stats(struct libivc_client *client, struct libivc_stats *stats)
+{
+    libivc_checkp(client, INVALID_PARAM);
+    libivc_checkp(stats, INVALID_PARAM);
+
+    mutex_lock(&client->mutex);
+    memcpy(stats, &client->stats, sizeof(struct libivc_stats));
+    mutex_unlock(&client->mutex);
+    stats->notifications_sent = (uint64_t)atomic64_read(&client->notifications_sent);
 
     return SUCCESS;
 }
+
 #ifdef KERNEL
 #ifdef __linux
-EXPORT_SYMBOL(libivc_enable_events);
+EXPORT_SYMBOL(libivc_get_stats);
 #endif
 #endif
 
+/**
+ * How often the moderation policy re-measures a client's event rate.
+ */
+#define LIBIVC_MODERATION_WINDOW_MS 100
+
+/**
+ * Sets a client's interrupt moderation policy.
+ * @param client Non null pointer to client.
+ * @param high_rate - events per second above which to moderate, or 0 to never moderate.
+ * @param low_rate - arrivals per second below which to stop moderating.
+ * @param interval_us - while moderating, how often to poll the ring.
+ * @return SUCCESS or appropriate error number.
+ */
 int
-libivc_remote_events_enabled(struct libivc_client *client, uint8_t *enabled)
+libivc_set_moderation(struct libivc_client *client, uint32_t high_rate, uint32_t low_rate,
+    uint32_t interval_us)
 {
-    int64_t flags;
-    int64_t target_flag;
-
     libivc_checkp(client, INVALID_PARAM);
-    libivc_checkp(enabled, INVALID_PARAM);
-    libivc_checkp(client->ringbuffer, INVALID_PARAM);
 
-    // We're interested in whether we should send event at
-    // the _remote_ channel-- so we're going to check the
-    // channel we write in.
-    target_flag = client->server_side ? SERVER_SIDE_TX_EVENT_FLAG : CLIENT_SIDE_TX_EVENT_FLAG;
+#ifdef KERNEL
+    // Kernel clients have no thread to poll the ring from.
+    return NOT_IMPLEMENTED;
+#else
+    libivc_assert(!high_rate || (low_rate < high_rate && interval_us > 0), INVALID_PARAM);
 
-    // Read whether events are currently enabled for the relevant channel.
-    flags = ringbuffer_get_flags(outgoing_channel_for(client)) & target_flag;
-    *enabled = (flags != 0);
+    mutex_lock(&client->mutex);
+    client->moderation_high_rate = high_rate;
+    client->moderation_low_rate = low_rate;
+    client->moderation_interval_us = interval_us;
+    client->moderation_arrivals = 0;
+    client->moderation_window_start = 0;
+    mutex_unlock(&client->mutex);
 
     return SUCCESS;
+#endif
 }
 
 /**
- * Fires a XEN event to the remote domain.
- * @param client Non null pointer to client connected to remote.
- * @return SUCCESS or appropriate error message.
+ * Applies the client's interrupt moderation policy.
+ * @param client The client to moderate.
+ * @param polled_data Non zero if the last poll found new data.
+ * @return the interval to poll at, in microseconds, or 0 if not moderating.
  */
-int
-libivc_notify_remote(struct libivc_client *client)
+uint32_t
+__libivc_moderate(struct libivc_client *client, uint8_t polled_data)
 {
-    libivc_checkp(client, INVALID_PARAM);
-    if (!initialized)
+    uint64_t now, elapsed_ms, rate;
+    uint8_t start = 0, stop = 0;
+    uint32_t interval = 0;
+
+    libivc_checkp(client, 0);
+
+    mutex_lock(&client->mutex);
+    if (!client->moderation_high_rate && !client->moderating)
     {
-        libivc_init();
+        mutex_unlock(&client->mutex);
+        return 0;
     }
 
-    return platformAPI->notifyRemote(client);
-}
+    now = libivc_monotonic_ns();
+    if (polled_data)
+        client->moderation_arrivals++;
 
-#ifdef KERNEL
-#ifdef __linux
-EXPORT_SYMBOL(libivc_notify_remote);
-#endif
-#endif
+    if (!client->moderation_window_start)
+        client->moderation_window_start = now;
+
+    elapsed_ms = (now - client->moderation_window_start) / 1000000;
+    if (elapsed_ms >= LIBIVC_MODERATION_WINDOW_MS)
+    {
+        rate = ((uint64_t)client->moderation_arrivals * 1000) / elapsed_ms;
+
+        // Like a NIC's adaptive moderation: busy clients stop taking an event
+        // per message, and go back to it once things quieten down.
+        if (!client->moderating && client->moderation_high_rate &&
+            rate > client->moderation_high_rate)
+            start = 1;
+        else if (client->moderating &&
+            (!client->moderation_high_rate || rate < client->moderation_low_rate))
+            stop = 1;
+
+        client->moderation_arrivals = 0;
+        client->moderation_window_start = now;
+    }
+
+    if (start)
+    {
+        client->moderation_events_were_enabled = libivc_local_events_enabled(client);
+        client->moderating = 1;
+        libivc_disable_events(client);
+    }
+    else if (stop)
+    {
+        client->moderating = 0;
+        if (client->moderation_events_were_enabled)
+            libivc_enable_events(client);
+    }
+
+    if (client->moderating)
+        interval = client->moderation_interval_us;
+    mutex_unlock(&client->mutex);
+
+    // Anything that arrived while events were still off has to be picked up
+    // by one last poll.
+    return stop ? 1 : interval;
+}
 
 /**
  * Locates a server on within this IVC instance that will accept connections with
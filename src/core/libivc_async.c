@@ -0,0 +1,296 @@
+//
+// IVC Driver
+//
+// Copyright (C) 2016 Assured Information Security, Inc. All rights reserved.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
+#include <list.h>
+
+#include <libivc.h>
+#include <libivc_types.h>
+#include <libivc_private.h>
+#include <libivc_async.h>
+#include <libivc_debug.h>
+
+struct libivc_connect_op {
+    list_head_t node;                 // for tracking in the queue of connects waiting for a worker.
+    uint16_t remote_domid;
+    uint16_t port;
+    uint32_t num_pages;
+    uint64_t connection_id;
+    libivc_connect_completion callback; // called on completion, if the caller didn't take a handle.
+    void *opaque;                     // passed to callback.
+    int event_fd;                     // signalled on completion, if the caller took a handle; otherwise -1.
+    uint8_t started;                  // non zero once a worker has taken the connect off the queue.
+    uint8_t done;                     // non zero once status and client are set.
+    uint8_t cancelled;                // non zero if the caller has abandoned the connect.
+    int status;                       // the result of the connect.
+    struct libivc_client *client;     // the connected client, if status is SUCCESS.
+};
+
+// Guards everything below, and the started, done and cancelled flags of every connect.
+static pthread_mutex_t asyncLock = PTHREAD_MUTEX_INITIALIZER;
+static LIST_HEAD(asyncQueue);
+static uint32_t asyncQueued = 0;
+static uint32_t asyncWorkers = 0;
+
+// Until the first connect has been made, libivc may not be initialized, and
+// initializing it isn't safe to do from several threads at once; so until then,
+// only one worker runs.
+static uint8_t asyncPrimed = 0;
+
+/**
+ * Frees a connect's handle.
+ */
+static void
+libivc_connect_op_free(struct libivc_connect_op *op)
+{
+    if (op->event_fd >= 0)
+        close(op->event_fd);
+
+    memset(op, 0, sizeof(struct libivc_connect_op));
+    free(op);
+}
+
+static void *
+libivc_connect_async_worker(void *arg);
+
+/**
+ * Starts workers for queued connects, up to the limit. Expects asyncLock to be held.
+ * @return SUCCESS, or appropriate error number if there are no workers at all.
+ */
+static int
+libivc_connect_async_spawn(void)
+{
+    pthread_t worker;
+    pthread_attr_t attribs;
+    uint32_t limit = asyncPrimed ? LIBIVC_ASYNC_CONNECT_WORKERS : 1;
+    uint32_t spawned = 0;
+    int rc = 0;
+
+    // Busy workers will also pick up queued connects when they finish; so this
+    // may start more than needed, but they exit again as soon as the queue is empty.
+    pthread_attr_init(&attribs);
+    pthread_attr_setdetachstate(&attribs, PTHREAD_CREATE_DETACHED);
+    while (spawned < asyncQueued && asyncWorkers < limit)
+    {
+        rc = pthread_create(&worker, &attribs, libivc_connect_async_worker, NULL);
+        if (rc != 0)
+        {
+            libivc_error("Failed to start a worker for connects (%d).\n", rc);
+            break;
+        }
+
+        asyncWorkers++;
+        spawned++;
+    }
+    pthread_attr_destroy(&attribs);
+
+    return asyncWorkers > 0 ? SUCCESS : OUT_OF_MEM;
+}
+
+/**
+ * Carries out queued connects until there are none left.
+ */
+static void *
+libivc_connect_async_worker(void *arg)
+{
+    struct libivc_connect_op *op = NULL;
+    struct libivc_client *client = NULL;
+    uint64_t one = 1;
+    int rc;
+
+    UNUSED(arg);
+
+    pthread_mutex_lock(&asyncLock);
+    while (!list_empty(&asyncQueue))
+    {
+        op = list_entry(asyncQueue.next, struct libivc_connect_op, node);
+        list_del(&op->node);
+        asyncQueued--;
+        op->started = 1;
+        pthread_mutex_unlock(&asyncLock);
+
+        client = NULL;
+        rc = libivc_connect_with_id(&client, op->remote_domid, op->port, op->num_pages, op->connection_id);
+        if (rc != SUCCESS)
+            client = NULL;
+
+        if (op->callback)
+        {
+            op->callback(op->opaque, rc, client);
+            libivc_connect_op_free(op);
+            pthread_mutex_lock(&asyncLock);
+        }
+        else
+        {
+            pthread_mutex_lock(&asyncLock);
+            if (op->cancelled)
+            {
+                pthread_mutex_unlock(&asyncLock);
+                if (client)
+                    libivc_disconnect(client);
+                libivc_connect_op_free(op);
+                pthread_mutex_lock(&asyncLock);
+            }
+            else
+            {
+                op->status = rc;
+                op->client = client;
+                op->done = 1;
+                if (write(op->event_fd, &one, sizeof(one)) != sizeof(one))
+                    libivc_error("Failed to signal completion of a connect to dom%u:%u.\n",
+                        op->remote_domid, op->port);
+            }
+        }
+
+        // Now that libivc is initialized, let the rest of the queue run in parallel.
+        if (!asyncPrimed)
+        {
+            asyncPrimed = 1;
+            libivc_connect_async_spawn();
+        }
+    }
+
+    asyncWorkers--;
+    pthread_mutex_unlock(&asyncLock);
+
+    return NULL;
+}
+
+/**
+ * Starts connecting to a remote server.
+ * @return SUCCESS if the connect was started, or appropriate error number.
+ */
+int
+libivc_connect_async(struct libivc_connect_op **op, uint16_t remote_dom_id, uint16_t remote_port,
+    uint32_t numPages, uint64_t connection_id, libivc_connect_completion callback, void *opaque)
+{
+    struct libivc_connect_op *iop = NULL;
+    int rc;
+
+    libivc_assert((op == NULL) != (callback == NULL), INVALID_PARAM);
+    libivc_assert(numPages > 0, INVALID_PARAM);
+
+    iop = (struct libivc_connect_op *) malloc(sizeof(struct libivc_connect_op));
+    libivc_checkp(iop, OUT_OF_MEM);
+    memset(iop, 0, sizeof(struct libivc_connect_op));
+
+    iop->remote_domid = remote_dom_id;
+    iop->port = remote_port;
+    iop->num_pages = numPages;
+    iop->connection_id = connection_id;
+    iop->callback = callback;
+    iop->opaque = opaque;
+    iop->event_fd = -1;
+    INIT_LIST_HEAD(&iop->node);
+
+    if (op)
+    {
+        iop->event_fd = eventfd(0, EFD_CLOEXEC);
+        if (iop->event_fd < 0)
+        {
+            libivc_connect_op_free(iop);
+            return ACCESS_DENIED;
+        }
+    }
+
+    pthread_mutex_lock(&asyncLock);
+    list_add_tail(&iop->node, &asyncQueue);
+    asyncQueued++;
+
+    // Workers exit once the queue is empty; start another if there's room.
+    rc = libivc_connect_async_spawn();
+    if (rc != SUCCESS)
+    {
+        // Nobody would ever pick it up.
+        list_del(&iop->node);
+        asyncQueued--;
+        pthread_mutex_unlock(&asyncLock);
+        libivc_connect_op_free(iop);
+        return rc;
+    }
+    pthread_mutex_unlock(&asyncLock);
+
+    if (op)
+        *op = iop;
+
+    return SUCCESS;
+}
+
+/**
+ * Gets a file descriptor that becomes readable once a connect completes.
+ * @return the file descriptor, or -1 on error.
+ */
+int
+libivc_connect_async_fd(struct libivc_connect_op *op)
+{
+    libivc_checkp(op, -1);
+    return op->event_fd;
+}
+
+/**
+ * Collects the result of a connect.
+ * @return SUCCESS, ERROR_AGAIN if the connect is still in progress, or the
+ *    error the connect failed with.
+ */
+int
+libivc_connect_async_finish(struct libivc_connect_op *op, struct libivc_client **client)
+{
+    int rc;
+
+    libivc_checkp(op, INVALID_PARAM);
+    libivc_checkp(client, INVALID_PARAM);
+    libivc_assert(op->callback == NULL, INVALID_PARAM);
+
+    pthread_mutex_lock(&asyncLock);
+    if (!op->done)
+    {
+        pthread_mutex_unlock(&asyncLock);
+        return ERROR_AGAIN;
+    }
+    pthread_mutex_unlock(&asyncLock);
+
+    rc = op->status;
+    *client = op->client;
+    libivc_connect_op_free(op);
+
+    return rc;
+}
+
+/**
+ * Abandons a connect.
+ */
+void
+libivc_connect_async_cancel(struct libivc_connect_op *op)
+{
+    libivc_checkp(op);
+    libivc_assert(op->callback == NULL);
+
+    pthread_mutex_lock(&asyncLock);
+    if (!op->started)
+    {
+        list_del(&op->node);
+        asyncQueued--;
+    }
+    else if (!op->done)
+    {
+        // The worker will clean up when it's done.
+        op->cancelled = 1;
+        pthread_mutex_unlock(&asyncLock);
+        return;
+    }
+    pthread_mutex_unlock(&asyncLock);
+
+    if (op->client)
+        libivc_disconnect(op->client);
+
+    libivc_connect_op_free(op);
+}
@@ -0,0 +1,952 @@
+//
+// IVC Driver
+//
+// Copyright (C) 2016 Assured Information Security, Inc. All rights reserved.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+#include <list.h>
+
+#include <libivc.h>
+#include <libivc_types.h>
+#include <libivc_private.h>
+#include <libivc_broadcast.h>
+#include <libivc_debug.h>
+
+#define LIBIVC_BROADCAST_MAGIC 0x54534342
+
+/**
+ * The region connection to a subscriber uses the control connection's ID with
+ * this bit flipped, so the two can be told apart and paired back up.
+ */
+#define LIBIVC_BROADCAST_REGION_ID_BIT 0x8000000000000000ULL
+
+/**
+ * Space at the start of the region reserved for its header, which itself
+ * starts past the ring header libivc keeps at the start of every buffer.
+ */
+#define LIBIVC_BROADCAST_HEADER_SIZE 64
+
+/**
+ * Finds the headers in their connections' buffers.
+ */
+#define LIBIVC_BROADCAST_REGION_OF(client) \
+    ((struct libivc_broadcast_region *) ((client)->buffer + LIBIVC_RING_HEADER_RESERVED))
+#define LIBIVC_BROADCAST_CONTROL_OF(client) \
+    ((struct libivc_broadcast_control *) ((client)->buffer + LIBIVC_RING_HEADER_RESERVED))
+
+/**
+ * Set on a record that only pads out the end of the region.
+ */
+#define LIBIVC_BROADCAST_RECORD_PAD 0x1
+
+#define LIBIVC_BROADCAST_ALIGN(x) (((x) + 7) & ~((uint64_t)7))
+
+#pragma pack(push, 1)
+
+/**
+ * The header at the start of the shared region. Only the publisher writes it.
+ */
+struct libivc_broadcast_region {
+    uint32_t magic;                   // LIBIVC_BROADCAST_MAGIC.
+    uint32_t data_size;               // the number of bytes of records that follow the header.
+    volatile uint64_t producer;       // the total number of bytes ever published, pads included.
+};
+
+/**
+ * The header that precedes each record in the region. Records are 8-byte aligned.
+ */
+struct libivc_broadcast_record {
+    uint32_t length;                  // the length of the message that follows.
+    uint32_t flags;                   // LIBIVC_BROADCAST_RECORD_ flags.
+};
+
+/**
+ * The layout of a subscriber's control page.
+ */
+struct libivc_broadcast_control {
+    uint32_t magic;                   // LIBIVC_BROADCAST_MAGIC, once the publisher has set the page up.
+    uint32_t data_size;               // the size of the region's record space.
+    uint64_t start;                   // the subscriber's first cursor: it sees messages published after this.
+    volatile uint64_t cursor;         // written by the subscriber: how far into the region it has read.
+    volatile uint32_t subscriber_waiting; // set by a subscriber that has read everything; the publisher
+                                      // clears it and notifies the subscriber when it publishes.
+    volatile uint32_t publisher_waiting;  // set by a publisher that has run out of room; the subscriber
+                                      // clears it and notifies the publisher when it reads further.
+};
+
+#pragma pack(pop)
+
+struct libivc_broadcast_subscriber {
+    list_head_t node;                 // for tracking in the publisher's subscriber list.
+    struct libivc_broadcast *broadcast; // the publisher this subscriber belongs to.
+    struct libivc_client *control;    // the subscriber's private control connection.
+    struct libivc_client *region;     // the connection sharing the region with the subscriber.
+    struct libivc_broadcast_control *page; // the header in the control connection's buffer.
+    uint8_t dead;                     // non zero once the subscriber has disconnected.
+    uint8_t removed;                  // non zero once removed from the subscriber list.
+};
+
+struct libivc_broadcast {
+    pthread_mutex_t lock;
+    uint32_t num_pages;               // the size of the region.
+    uint32_t data_size;               // the size of the region's record space.
+    struct libivc_broadcast_subscriber *anchor; // the subscriber whose mapping of the region we write through.
+    struct libivc_broadcast_region *header; // the region's header, or NULL if there are no subscribers.
+    char *records;                    // the region's record space.
+    uint64_t producer;                // the total number of bytes ever published into the region.
+    uint64_t min_cursor;              // the slowest subscriber's cursor, when last checked.
+    list_head_t subscribers;
+    uint32_t num_subscribers;
+    uint8_t blocked;                  // non zero if a publish has failed for lack of space.
+    libivc_broadcast_writable writable_cb;
+    void *opaque;                     // passed to writable_cb.
+};
+
+struct libivc_subscription {
+    list_head_t node;                 // for tracking in the listener's list of half-made subscriptions.
+    struct libivc_broadcast_listener *listener;
+    pthread_mutex_t lock;
+    struct libivc_client *control;    // our private control connection.
+    struct libivc_client *region;     // the read only connection to the region.
+    uint16_t remote_domid;
+    uint64_t connection_id;           // the control connection's ID.
+    struct libivc_broadcast_control *page; // the header in the control connection's buffer.
+    struct libivc_broadcast_region *header;
+    char *records;
+    uint32_t data_size;
+    uint64_t cursor;                  // how far into the region we have read.
+    uint8_t ready;                    // non zero once handed to the user.
+    uint8_t closed;                   // non zero once the publisher has gone.
+    uint8_t closed_delivered;         // non zero once closed_cb has been called.
+    libivc_subscription_event event_cb;
+    libivc_subscription_closed closed_cb;
+    void *opaque;                     // passed to the callbacks.
+};
+
+struct libivc_broadcast_listener {
+    pthread_mutex_t lock;
+    struct libivc_server *server;
+    list_head_t pending;              // subscriptions still waiting for one of their connections.
+    libivc_broadcast_subscribed subscribed_cb;
+    void *opaque;                     // passed to subscribed_cb.
+};
+
+/**
+ * Finds the cursor of the slowest live subscriber. Expects the lock to be held.
+ */
+static uint64_t
+libivc_broadcast_slowest(struct libivc_broadcast *broadcast)
+{
+    list_head_t *pos = NULL;
+    struct libivc_broadcast_subscriber *subscriber = NULL;
+    uint64_t slowest = broadcast->producer, cursor;
+
+    list_for_each(pos, &broadcast->subscribers)
+    {
+        subscriber = list_entry(pos, struct libivc_broadcast_subscriber, node);
+        if (subscriber->dead)
+            continue;
+
+        // A misbehaving subscriber may only hurt itself: clamp what it reports.
+        cursor = subscriber->page->cursor;
+        if (cursor > broadcast->producer || broadcast->producer - cursor > broadcast->data_size)
+            cursor = broadcast->producer - broadcast->data_size;
+
+        if (cursor < slowest)
+            slowest = cursor;
+    }
+
+    return slowest;
+}
+
+/**
+ * Sets or clears publisher_waiting on every live subscriber. Expects the lock to be held.
+ */
+static void
+libivc_broadcast_set_waiting(struct libivc_broadcast *broadcast, uint32_t waiting)
+{
+    list_head_t *pos = NULL;
+    struct libivc_broadcast_subscriber *subscriber = NULL;
+
+    list_for_each(pos, &broadcast->subscribers)
+    {
+        subscriber = list_entry(pos, struct libivc_broadcast_subscriber, node);
+        if (!subscriber->dead)
+            subscriber->page->publisher_waiting = waiting;
+    }
+}
+
+/**
+ * Called when a subscriber has read further while the publisher was waiting.
+ */
+static void
+libivc_broadcast_control_event(void *opaque, struct libivc_client *client)
+{
+    struct libivc_broadcast_subscriber *subscriber = (struct libivc_broadcast_subscriber *) opaque;
+    struct libivc_broadcast *broadcast = subscriber->broadcast;
+    uint8_t writable;
+
+    UNUSED(client);
+
+    pthread_mutex_lock(&broadcast->lock);
+    writable = broadcast->blocked && !subscriber->removed;
+    broadcast->blocked = 0;
+    pthread_mutex_unlock(&broadcast->lock);
+
+    if (writable && broadcast->writable_cb)
+        broadcast->writable_cb(broadcast->opaque, broadcast);
+}
+
+/**
+ * Called when a subscriber goes away. It no longer holds the publisher back; it
+ * is cleaned up the next time the publisher is used.
+ */
+static void
+libivc_broadcast_control_disconnect(void *opaque, struct libivc_client *client)
+{
+    struct libivc_broadcast_subscriber *subscriber = (struct libivc_broadcast_subscriber *) opaque;
+    struct libivc_broadcast *broadcast = subscriber->broadcast;
+    uint8_t writable;
+
+    UNUSED(client);
+
+    pthread_mutex_lock(&broadcast->lock);
+    subscriber->dead = 1;
+    writable = broadcast->blocked && !subscriber->removed;
+    broadcast->blocked = 0;
+    pthread_mutex_unlock(&broadcast->lock);
+
+    if (writable && broadcast->writable_cb)
+        broadcast->writable_cb(broadcast->opaque, broadcast);
+}
+
+/**
+ * Takes a subscriber out of the list, moving the publisher's view of the region
+ * to another subscriber's mapping if needed. Expects the lock to be held.
+ */
+static void
+libivc_broadcast_unlink(struct libivc_broadcast *broadcast, struct libivc_broadcast_subscriber *subscriber)
+{
+    struct libivc_broadcast_subscriber *next = NULL;
+
+    list_del(&subscriber->node);
+    subscriber->removed = 1;
+    broadcast->num_subscribers--;
+
+    if (broadcast->anchor != subscriber)
+        return;
+
+    // Every subscriber's connection maps the same pages, so any of them will do.
+    broadcast->anchor = NULL;
+    broadcast->header = NULL;
+    broadcast->records = NULL;
+
+    if (!list_empty(&broadcast->subscribers))
+    {
+        next = list_entry(broadcast->subscribers.next, struct libivc_broadcast_subscriber, node);
+        broadcast->anchor = next;
+        broadcast->header = LIBIVC_BROADCAST_REGION_OF(next->region);
+        broadcast->records = next->region->buffer + LIBIVC_BROADCAST_HEADER_SIZE;
+    }
+}
+
+/**
+ * Disconnects and frees a subscriber that is no longer in the list. Must be
+ * called without the lock, as its connections' event threads may be waiting on it.
+ */
+static void
+libivc_broadcast_free_subscriber(struct libivc_broadcast_subscriber *subscriber)
+{
+    if (subscriber->control)
+        libivc_disconnect(subscriber->control);
+    if (subscriber->region)
+        libivc_disconnect(subscriber->region);
+
+    free(subscriber);
+}
+
+/**
+ * Cleans up subscribers that have disconnected.
+ */
+static void
+libivc_broadcast_reap(struct libivc_broadcast *broadcast)
+{
+    list_head_t *pos = NULL, *temp = NULL;
+    list_head_t dead;
+    struct libivc_broadcast_subscriber *subscriber = NULL;
+
+    INIT_LIST_HEAD(&dead);
+
+    pthread_mutex_lock(&broadcast->lock);
+    list_for_each_safe(pos, temp, &broadcast->subscribers)
+    {
+        subscriber = list_entry(pos, struct libivc_broadcast_subscriber, node);
+        if (subscriber->dead)
+        {
+            libivc_broadcast_unlink(broadcast, subscriber);
+            list_add(&subscriber->node, &dead);
+        }
+    }
+    pthread_mutex_unlock(&broadcast->lock);
+
+    list_for_each_safe(pos, temp, &dead)
+    {
+        subscriber = list_entry(pos, struct libivc_broadcast_subscriber, node);
+        list_del(pos);
+        libivc_broadcast_free_subscriber(subscriber);
+    }
+}
+
+/**
+ * Creates a publisher.
+ * @return SUCCESS or appropriate error number.
+ */
+int
+libivc_broadcast_create(struct libivc_broadcast **broadcast, uint32_t numPages,
+    libivc_broadcast_writable writableCallback, void *opaque)
+{
+    struct libivc_broadcast *ibroadcast = NULL;
+
+    libivc_checkp(broadcast, INVALID_PARAM);
+    libivc_assert(numPages > 0, INVALID_PARAM);
+
+    ibroadcast = (struct libivc_broadcast *) malloc(sizeof(struct libivc_broadcast));
+    libivc_checkp(ibroadcast, OUT_OF_MEM);
+    memset(ibroadcast, 0, sizeof(struct libivc_broadcast));
+
+    ibroadcast->num_pages = numPages;
+    ibroadcast->data_size = (numPages * PAGE_SIZE) - LIBIVC_BROADCAST_HEADER_SIZE;
+    ibroadcast->writable_cb = writableCallback;
+    ibroadcast->opaque = opaque;
+    INIT_LIST_HEAD(&ibroadcast->subscribers);
+    pthread_mutex_init(&ibroadcast->lock, NULL);
+
+    *broadcast = ibroadcast;
+    return SUCCESS;
+}
+
+/**
+ * Disconnects every subscriber and destroys the publisher.
+ */
+void
+libivc_broadcast_destroy(struct libivc_broadcast *broadcast)
+{
+    libivc_checkp(broadcast);
+
+    pthread_mutex_lock(&broadcast->lock);
+    while (!list_empty(&broadcast->subscribers))
+    {
+        list_entry(broadcast->subscribers.next, struct libivc_broadcast_subscriber, node)->dead = 1;
+        pthread_mutex_unlock(&broadcast->lock);
+        libivc_broadcast_reap(broadcast);
+        pthread_mutex_lock(&broadcast->lock);
+    }
+    pthread_mutex_unlock(&broadcast->lock);
+
+    pthread_mutex_destroy(&broadcast->lock);
+    memset(broadcast, 0, sizeof(struct libivc_broadcast));
+    free(broadcast);
+}
+
+/**
+ * Connects to a subscriber and shares the region with it.
+ * @return SUCCESS or appropriate error number.
+ */
+int
+libivc_broadcast_add_subscriber(struct libivc_broadcast *broadcast, uint16_t remote_dom_id,
+    uint16_t remote_port, uint64_t connection_id, struct libivc_broadcast_subscriber **subscriber)
+{
+    struct libivc_broadcast_subscriber *isubscriber = NULL;
+    int rc;
+
+    libivc_checkp(broadcast, INVALID_PARAM);
+
+    libivc_broadcast_reap(broadcast);
+
+    isubscriber = (struct libivc_broadcast_subscriber *) malloc(sizeof(struct libivc_broadcast_subscriber));
+    libivc_checkp(isubscriber, OUT_OF_MEM);
+    memset(isubscriber, 0, sizeof(struct libivc_broadcast_subscriber));
+    isubscriber->broadcast = broadcast;
+
+    // Hold the lock throughout, so nothing is published between handing the
+    // subscriber its starting point and adding it to the list.
+    pthread_mutex_lock(&broadcast->lock);
+
+    rc = libivc_connect_with_id(&isubscriber->control, remote_dom_id, remote_port, 1, connection_id);
+    libivc_assert_goto(rc == SUCCESS, ERROR);
+    __libivc_take_over_buffer(isubscriber->control);
+
+    // If this is the first subscriber, the region is about to be allocated,
+    // zeroed, afresh; start counting from scratch.
+    if (!broadcast->anchor)
+        broadcast->producer = broadcast->min_cursor = 0;
+
+    // Set the control page up before the region connection arrives, which is
+    // when the subscriber will look at it.
+    isubscriber->page = LIBIVC_BROADCAST_CONTROL_OF(isubscriber->control);
+    isubscriber->page->data_size = broadcast->data_size;
+    isubscriber->page->start = broadcast->producer;
+    isubscriber->page->cursor = broadcast->producer;
+    isubscriber->page->magic = LIBIVC_BROADCAST_MAGIC;
+    __sync_synchronize();
+
+    rc = libivc_connect_shared(&isubscriber->region, remote_dom_id, remote_port, broadcast->num_pages,
+        connection_id ^ LIBIVC_BROADCAST_REGION_ID_BIT, broadcast->anchor ? broadcast->anchor->region : NULL);
+    libivc_assert_goto(rc == SUCCESS, ERROR);
+    __libivc_take_over_buffer(isubscriber->region);
+
+    if (!broadcast->anchor)
+    {
+        broadcast->anchor = isubscriber;
+        broadcast->header = LIBIVC_BROADCAST_REGION_OF(isubscriber->region);
+        broadcast->records = isubscriber->region->buffer + LIBIVC_BROADCAST_HEADER_SIZE;
+        broadcast->header->data_size = broadcast->data_size;
+        broadcast->header->magic = LIBIVC_BROADCAST_MAGIC;
+    }
+
+    rc = libivc_register_event_callbacks(isubscriber->control, libivc_broadcast_control_event,
+        libivc_broadcast_control_disconnect, isubscriber);
+    libivc_assert_goto(rc == SUCCESS, ERROR);
+
+    list_add_tail(&isubscriber->node, &broadcast->subscribers);
+    broadcast->num_subscribers++;
+    pthread_mutex_unlock(&broadcast->lock);
+
+    if (subscriber)
+        *subscriber = isubscriber;
+
+    return SUCCESS;
+
+ERROR:
+    if (broadcast->anchor == isubscriber)
+    {
+        broadcast->anchor = NULL;
+        broadcast->header = NULL;
+        broadcast->records = NULL;
+    }
+    pthread_mutex_unlock(&broadcast->lock);
+
+    libivc_broadcast_free_subscriber(isubscriber);
+    return rc;
+}
+
+/**
+ * Disconnects a subscriber.
+ * @return SUCCESS or appropriate error number.
+ */
+int
+libivc_broadcast_remove_subscriber(struct libivc_broadcast *broadcast,
+    struct libivc_broadcast_subscriber *subscriber)
+{
+    libivc_checkp(broadcast, INVALID_PARAM);
+    libivc_checkp(subscriber, INVALID_PARAM);
+
+    pthread_mutex_lock(&broadcast->lock);
+    libivc_assert_goto(subscriber->broadcast == broadcast && !subscriber->removed, ERROR);
+    subscriber->dead = 1;
+    pthread_mutex_unlock(&broadcast->lock);
+
+    libivc_broadcast_reap(broadcast);
+    return SUCCESS;
+
+ERROR:
+    pthread_mutex_unlock(&broadcast->lock);
+    return INVALID_PARAM;
+}
+
+/**
+ * Gets the number of connected subscribers.
+ * @return the number of subscribers.
+ */
+uint32_t
+libivc_broadcast_subscriber_count(struct libivc_broadcast *broadcast)
+{
+    list_head_t *pos = NULL;
+    uint32_t count = 0;
+
+    libivc_checkp(broadcast, 0);
+
+    pthread_mutex_lock(&broadcast->lock);
+    list_for_each(pos, &broadcast->subscribers)
+    {
+        if (!list_entry(pos, struct libivc_broadcast_subscriber, node)->dead)
+            count++;
+    }
+    pthread_mutex_unlock(&broadcast->lock);
+
+    return count;
+}
+
+/**
+ * Publishes a message to every subscriber.
+ * @return SUCCESS, NO_SPACE, or appropriate error number.
+ */
+int
+libivc_broadcast_publish(struct libivc_broadcast *broadcast, char *src, uint32_t length)
+{
+    list_head_t *pos = NULL;
+    struct libivc_broadcast_subscriber *subscriber = NULL;
+    struct libivc_broadcast_record *record = NULL;
+    uint64_t needed, offset, pad;
+    int rc = SUCCESS;
+
+    libivc_checkp(broadcast, INVALID_PARAM);
+    libivc_assert(src != NULL || length == 0, INVALID_PARAM);
+
+    libivc_broadcast_reap(broadcast);
+
+    pthread_mutex_lock(&broadcast->lock);
+
+    // With nobody listening, there's nowhere to put it.
+    if (!broadcast->header)
+        goto END;
+
+    // Capping records at half the region guarantees one always fits once
+    // every subscriber has caught up, however the padding falls.
+    needed = sizeof(struct libivc_broadcast_record) + LIBIVC_BROADCAST_ALIGN(length);
+    rc = INVALID_PARAM;
+    libivc_assert_goto(needed <= broadcast->data_size / 2, END);
+
+    // If a record doesn't fit before the end of the region, pad out to the end
+    // and start it at the beginning.
+    offset = broadcast->producer % broadcast->data_size;
+    pad = (broadcast->data_size - offset < needed) ? broadcast->data_size - offset : 0;
+
+    // Only look at the subscribers if what we knew of them isn't enough.
+    if ((broadcast->producer + pad + needed) - broadcast->min_cursor > broadcast->data_size)
+    {
+        broadcast->min_cursor = libivc_broadcast_slowest(broadcast);
+
+        if ((broadcast->producer + pad + needed) - broadcast->min_cursor > broadcast->data_size)
+        {
+            // Ask to be told when the subscribers read further, then look once
+            // more, in case they did so before they could see the request.
+            libivc_broadcast_set_waiting(broadcast, 1);
+            __sync_synchronize();
+            broadcast->min_cursor = libivc_broadcast_slowest(broadcast);
+
+            if ((broadcast->producer + pad + needed) - broadcast->min_cursor > broadcast->data_size)
+            {
+                broadcast->blocked = 1;
+                rc = NO_SPACE;
+                goto END;
+            }
+
+            libivc_broadcast_set_waiting(broadcast, 0);
+        }
+    }
+
+    if (pad)
+    {
+        record = (struct libivc_broadcast_record *)(broadcast->records + offset);
+        record->length = 0;
+        record->flags = LIBIVC_BROADCAST_RECORD_PAD;
+        offset = 0;
+    }
+
+    record = (struct libivc_broadcast_record *)(broadcast->records + offset);
+    record->length = length;
+    record->flags = 0;
+    if (length)
+        memcpy(record + 1, src, length);
+
+    // Make the record visible before the producer index that covers it, and
+    // the producer index before we look at who is waiting for it.
+    __sync_synchronize();
+    broadcast->producer += pad + needed;
+    broadcast->header->producer = broadcast->producer;
+    __sync_synchronize();
+
+    // Only subscribers that have caught up need waking; the rest will find the
+    // new record when they get to it.
+    list_for_each(pos, &broadcast->subscribers)
+    {
+        subscriber = list_entry(pos, struct libivc_broadcast_subscriber, node);
+        if (!subscriber->dead && subscriber->page->subscriber_waiting)
+        {
+            subscriber->page->subscriber_waiting = 0;
+            libivc_notify_remote(subscriber->control);
+        }
+    }
+
+    rc = SUCCESS;
+END:
+    pthread_mutex_unlock(&broadcast->lock);
+    return rc;
+}
+
+/**
+ * Called when the publisher has published while we were waiting.
+ */
+static void
+libivc_subscription_control_event(void *opaque, struct libivc_client *client)
+{
+    struct libivc_subscription *subscription = (struct libivc_subscription *) opaque;
+    libivc_subscription_event event_cb = NULL;
+    void *cb_opaque = NULL;
+
+    UNUSED(client);
+
+    pthread_mutex_lock(&subscription->lock);
+    if (subscription->ready)
+    {
+        event_cb = subscription->event_cb;
+        cb_opaque = subscription->opaque;
+    }
+    pthread_mutex_unlock(&subscription->lock);
+
+    if (event_cb)
+        event_cb(cb_opaque, subscription);
+}
+
+/**
+ * Called when either of the publisher's connections goes away.
+ */
+static void
+libivc_subscription_disconnect(void *opaque, struct libivc_client *client)
+{
+    struct libivc_subscription *subscription = (struct libivc_subscription *) opaque;
+    libivc_subscription_closed closed_cb = NULL;
+    void *cb_opaque = NULL;
+
+    UNUSED(client);
+
+    pthread_mutex_lock(&subscription->lock);
+    subscription->closed = 1;
+    if (subscription->ready && !subscription->closed_delivered)
+    {
+        subscription->closed_delivered = 1;
+        closed_cb = subscription->closed_cb;
+        cb_opaque = subscription->opaque;
+    }
+    pthread_mutex_unlock(&subscription->lock);
+
+    if (closed_cb)
+        closed_cb(cb_opaque, subscription);
+}
+
+/**
+ * Frees a subscription, disconnecting whatever it has. Must be called without
+ * any lock the connections' event threads might be waiting on.
+ */
+static void
+libivc_subscription_free(struct libivc_subscription *subscription)
+{
+    if (subscription->control)
+        libivc_disconnect(subscription->control);
+    if (subscription->region)
+        libivc_disconnect(subscription->region);
+
+    pthread_mutex_destroy(&subscription->lock);
+    free(subscription);
+}
+
+/**
+ * Called for each connection from a publisher. Each subscription takes two:
+ * a read write control connection, and the read only region connection.
+ */
+static void
+libivc_broadcast_client_connected(void *opaque, struct libivc_client *client)
+{
+    struct libivc_broadcast_listener *listener = (struct libivc_broadcast_listener *) opaque;
+    struct libivc_subscription *subscription = NULL;
+    list_head_t *pos = NULL;
+    uint64_t connection_id;
+    uint8_t is_region = client->read_only;
+    uint8_t complete = 0;
+
+    connection_id = is_region ? client->connection_id ^ LIBIVC_BROADCAST_REGION_ID_BIT : client->connection_id;
+
+    pthread_mutex_lock(&listener->lock);
+
+    list_for_each(pos, &listener->pending)
+    {
+        subscription = list_entry(pos, struct libivc_subscription, node);
+        if (subscription->remote_domid == client->remote_domid && subscription->connection_id == connection_id &&
+            (is_region ? subscription->region == NULL : subscription->control == NULL))
+            break;
+
+        subscription = NULL;
+    }
+
+    if (!subscription)
+    {
+        subscription = (struct libivc_subscription *) malloc(sizeof(struct libivc_subscription));
+        if (!subscription)
+        {
+            pthread_mutex_unlock(&listener->lock);
+            libivc_error("Out of memory for a new subscription; refusing it.\n");
+            libivc_disconnect(client);
+            return;
+        }
+
+        memset(subscription, 0, sizeof(struct libivc_subscription));
+        subscription->listener = listener;
+        subscription->remote_domid = client->remote_domid;
+        subscription->connection_id = connection_id;
+        pthread_mutex_init(&subscription->lock, NULL);
+        list_add_tail(&subscription->node, &listener->pending);
+    }
+
+    // Neither buffer is a ring; keep libivc's event flags out of them.
+    __libivc_take_over_buffer(client);
+
+    if (is_region)
+    {
+        subscription->region = client;
+        libivc_register_event_callbacks(client, NULL, libivc_subscription_disconnect, subscription);
+    }
+    else
+    {
+        subscription->control = client;
+        libivc_register_event_callbacks(client, libivc_subscription_control_event,
+            libivc_subscription_disconnect, subscription);
+    }
+
+    if (subscription->control && subscription->region)
+    {
+        list_del(&subscription->node);
+        complete = 1;
+    }
+
+    pthread_mutex_unlock(&listener->lock);
+
+    if (!complete)
+        return;
+
+    // The publisher sets the control page up before it shares the region.
+    subscription->page = LIBIVC_BROADCAST_CONTROL_OF(subscription->control);
+    __sync_synchronize();
+
+    if (subscription->closed || subscription->page->magic != LIBIVC_BROADCAST_MAGIC ||
+        (size_t) subscription->page->data_size + LIBIVC_BROADCAST_HEADER_SIZE >
+        (size_t) subscription->region->num_pages * PAGE_SIZE)
+    {
+        libivc_error("Refusing a malformed subscription from dom%u.\n", subscription->remote_domid);
+        libivc_subscription_free(subscription);
+        return;
+    }
+
+    pthread_mutex_lock(&subscription->lock);
+    subscription->header = LIBIVC_BROADCAST_REGION_OF(subscription->region);
+    subscription->records = subscription->region->buffer + LIBIVC_BROADCAST_HEADER_SIZE;
+    subscription->data_size = subscription->page->data_size;
+    subscription->cursor = subscription->page->start;
+    subscription->ready = 1;
+    pthread_mutex_unlock(&subscription->lock);
+
+    listener->subscribed_cb(listener->opaque, listener, subscription);
+}
+
+/**
+ * Listens for publishers to subscribe to.
+ * @return SUCCESS or appropriate error number.
+ */
+int
+libivc_broadcast_listen(struct libivc_broadcast_listener **listener, uint16_t port,
+    libivc_broadcast_subscribed subscribedCallback, void *opaque)
+{
+    struct libivc_broadcast_listener *ilistener = NULL;
+    int rc;
+
+    libivc_checkp(listener, INVALID_PARAM);
+    libivc_checkp(subscribedCallback, INVALID_PARAM);
+
+    ilistener = (struct libivc_broadcast_listener *) malloc(sizeof(struct libivc_broadcast_listener));
+    libivc_checkp(ilistener, OUT_OF_MEM);
+    memset(ilistener, 0, sizeof(struct libivc_broadcast_listener));
+
+    ilistener->subscribed_cb = subscribedCallback;
+    ilistener->opaque = opaque;
+    INIT_LIST_HEAD(&ilistener->pending);
+    pthread_mutex_init(&ilistener->lock, NULL);
+
+    rc = libivc_startIvcServer(&ilistener->server, port, libivc_broadcast_client_connected, ilistener);
+    if (rc != SUCCESS)
+    {
+        pthread_mutex_destroy(&ilistener->lock);
+        free(ilistener);
+        return rc;
+    }
+
+    *listener = ilistener;
+    return SUCCESS;
+}
+
+/**
+ * Stops listening, dropping any half-made subscriptions.
+ */
+void
+libivc_broadcast_shutdown(struct libivc_broadcast_listener *listener)
+{
+    list_head_t *pos = NULL, *temp = NULL;
+
+    libivc_checkp(listener);
+
+    libivc_shutdownIvcServer(listener->server);
+
+    list_for_each_safe(pos, temp, &listener->pending)
+    {
+        list_del(pos);
+        libivc_subscription_free(list_entry(pos, struct libivc_subscription, node));
+    }
+
+    pthread_mutex_destroy(&listener->lock);
+    memset(listener, 0, sizeof(struct libivc_broadcast_listener));
+    free(listener);
+}
+
+/**
+ * Registers callbacks for a subscription.
+ * @return SUCCESS or appropriate error number.
+ */
+int
+libivc_subscription_register_callbacks(struct libivc_subscription *subscription,
+    libivc_subscription_event eventCallback, libivc_subscription_closed closedCallback,
+    void *opaque)
+{
+    libivc_subscription_closed closed_cb = NULL;
+
+    libivc_checkp(subscription, INVALID_PARAM);
+
+    pthread_mutex_lock(&subscription->lock);
+    subscription->event_cb = eventCallback;
+    subscription->closed_cb = closedCallback;
+    subscription->opaque = opaque;
+
+    // If the publisher went away before anyone was listening, say so now.
+    if (subscription->closed && !subscription->closed_delivered)
+    {
+        subscription->closed_delivered = 1;
+        closed_cb = closedCallback;
+    }
+    pthread_mutex_unlock(&subscription->lock);
+
+    if (closed_cb)
+        closed_cb(opaque, subscription);
+
+    return SUCCESS;
+}
+
+/**
+ * Publishes how far we have read, waking the publisher if it was waiting for us.
+ * Expects the subscription's lock to be held.
+ */
+static void
+libivc_subscription_advance(struct libivc_subscription *subscription, uint64_t cursor)
+{
+    subscription->cursor = cursor;
+    subscription->page->cursor = cursor;
+    __sync_synchronize();
+
+    if (subscription->page->publisher_waiting)
+    {
+        subscription->page->publisher_waiting = 0;
+        libivc_notify_remote(subscription->control);
+    }
+}
+
+/**
+ * Reads the next message from a subscription.
+ * @return SUCCESS, NO_DATA_AVAIL, NO_SPACE, NOT_CONNECTED, or appropriate error number.
+ */
+int
+libivc_subscription_recv(struct libivc_subscription *subscription, char *dest, size_t destSize,
+    size_t *actualSize)
+{
+    struct libivc_broadcast_record *record = NULL;
+    uint64_t producer, cursor, offset;
+    int rc = INTERNAL_ERROR;
+
+    libivc_checkp(subscription, INVALID_PARAM);
+    libivc_checkp(actualSize, INVALID_PARAM);
+    libivc_assert(dest != NULL || destSize == 0, INVALID_PARAM);
+
+    pthread_mutex_lock(&subscription->lock);
+    libivc_assert_goto(subscription->ready, END);
+
+    cursor = subscription->cursor;
+
+    for (;;)
+    {
+        producer = subscription->header->producer;
+        __sync_synchronize();
+
+        if (producer <= cursor)
+        {
+            if (subscription->closed)
+            {
+                rc = NOT_CONNECTED;
+                break;
+            }
+
+            // Ask to be woken for the next record, then look once more, in
+            // case it was published before the publisher could see the request.
+            subscription->page->subscriber_waiting = 1;
+            __sync_synchronize();
+            if (subscription->header->producer > cursor)
+                continue;
+
+            rc = NO_DATA_AVAIL;
+            break;
+        }
+
+        offset = cursor % subscription->data_size;
+        record = (struct libivc_broadcast_record *)(subscription->records + offset);
+        libivc_assert_goto(subscription->data_size - offset >= sizeof(struct libivc_broadcast_record), END);
+
+        if (record->flags & LIBIVC_BROADCAST_RECORD_PAD)
+        {
+            cursor += subscription->data_size - offset;
+            continue;
+        }
+
+        libivc_assert_goto(sizeof(struct libivc_broadcast_record) + LIBIVC_BROADCAST_ALIGN(record->length) <=
+            subscription->data_size - offset, END);
+
+        *actualSize = record->length;
+        if (record->length > destSize)
+        {
+            rc = NO_SPACE;
+            break;
+        }
+
+        memcpy(dest, record + 1, record->length);
+        cursor += sizeof(struct libivc_broadcast_record) + LIBIVC_BROADCAST_ALIGN(record->length);
+        rc = SUCCESS;
+        break;
+    }
+
+    if (cursor != subscription->cursor)
+        libivc_subscription_advance(subscription, cursor);
+
+END:
+    pthread_mutex_unlock(&subscription->lock);
+    return rc;
+}
+
+/**
+ * Gets the domain of a subscription's publisher.
+ * @return the publisher's domain ID.
+ */
+uint16_t
+libivc_subscription_get_remote_domid(struct libivc_subscription *subscription)
+{
+    libivc_checkp(subscription, LIBIVC_DOMID_ANY);
+    return subscription->remote_domid;
+}
+
+/**
+ * Disconnects from the publisher and frees a subscription.
+ */
+void
+libivc_subscription_close(struct libivc_subscription *subscription)
+{
+    libivc_checkp(subscription);
+    libivc_subscription_free(subscription);
+}
@@ -0,0 +1,585 @@
+//
+// IVC Driver
+//
+// Copyright (C) 2016 Assured Information Security, Inc. All rights reserved.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+#include <list.h>
+
+#include <libivc.h>
+#include <libivc_types.h>
+#include <libivc_private.h>
+#include <libivc_compress.h>
+#include <libivc_debug.h>
+
+// Set in a frame's raw_length if its body is compressed.
+#define LIBIVC_COMPRESS_FLAG 0x80000000u
+
+// The codec. Each sequence is a token byte, holding the number of literals in
+// its top four bits and the match length less LZ_MIN_MATCH in its bottom four,
+// either of which is extended by further bytes when it reads 15; then the
+// literals; then the match's two byte little endian offset back into the
+// output. The last sequence has literals only.
+#define LZ_MIN_MATCH 4
+#define LZ_MAX_OFFSET 65535
+#define LZ_HASH_BITS 12
+#define LZ_RUN_MASK 15
+
+#pragma pack(push, 1)
+
+/**
+ * The header that precedes every message on the wire.
+ */
+struct libivc_compress_header {
+    uint32_t length;                  // length of the body that follows the header.
+    uint32_t raw_length;              // the message's own length, with LIBIVC_COMPRESS_FLAG if the body is compressed.
+};
+
+#pragma pack(pop)
+
+struct libivc_compressor {
+    struct libivc_client *client;     // the connection messages are sent over.
+    uint32_t threshold;               // messages smaller than this are sent raw.
+
+    pthread_mutex_t tx_lock;          // serializes frames written to the ring, and guards the fields below.
+    char *tx_body;                    // buffer messages are compressed into.
+    size_t tx_body_size;              // allocated size of tx_body.
+
+    pthread_mutex_t rx_lock;          // serializes frames read from the ring, and guards the fields below.
+    uint8_t rx_have_header;           // non zero once rx_header holds the current frame's header.
+    struct libivc_compress_header rx_header; // the header of the frame currently being received.
+    size_t rx_discard;                // bytes of a malformed frame still to be skipped.
+    char *rx_body;                    // buffer compressed bodies are received into.
+    size_t rx_body_size;              // allocated size of rx_body.
+
+    pthread_mutex_t stats_lock;       // guards stats.
+    struct libivc_compress_stats stats; // counters for libivc_compress_get_stats.
+};
+
+static inline uint32_t
+lz_read32(const uint8_t *p)
+{
+    uint32_t value;
+
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static inline uint32_t
+lz_hash(uint32_t sequence)
+{
+    return (sequence * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+/**
+ * Writes a literal or match length's extension bytes.
+ * @return the new output position, or NULL if out of room.
+ */
+static uint8_t *
+lz_put_length(uint8_t *op, uint8_t *oend, size_t length)
+{
+    for (; length >= 255; length -= 255)
+    {
+        if (op >= oend)
+            return NULL;
+        *op++ = 255;
+    }
+
+    if (op >= oend)
+        return NULL;
+    *op++ = (uint8_t)length;
+
+    return op;
+}
+
+/**
+ * Writes one sequence: literals, then a match unless match_length is 0.
+ * @return the new output position, or NULL if out of room.
+ */
+static uint8_t *
+lz_put_sequence(uint8_t *op, uint8_t *oend, const uint8_t *literals, size_t literal_length,
+    size_t offset, size_t match_length)
+{
+    uint8_t *token;
+    size_t match_code = match_length ? match_length - LZ_MIN_MATCH : 0;
+
+    if (op >= oend)
+        return NULL;
+    token = op++;
+    *token = (uint8_t)(((literal_length < LZ_RUN_MASK ? literal_length : LZ_RUN_MASK) << 4) |
+                       (match_code < LZ_RUN_MASK ? match_code : LZ_RUN_MASK));
+
+    if (literal_length >= LZ_RUN_MASK && !(op = lz_put_length(op, oend, literal_length - LZ_RUN_MASK)))
+        return NULL;
+
+    if ((size_t)(oend - op) < literal_length)
+        return NULL;
+    memcpy(op, literals, literal_length);
+    op += literal_length;
+
+    if (!match_length)
+        return op;
+
+    if (oend - op < 2)
+        return NULL;
+    *op++ = (uint8_t)(offset & 0xFF);
+    *op++ = (uint8_t)(offset >> 8);
+
+    if (match_code >= LZ_RUN_MASK && !(op = lz_put_length(op, oend, match_code - LZ_RUN_MASK)))
+        return NULL;
+
+    return op;
+}
+
+/**
+ * Gets the largest output libivc_lz_compress can produce for a given input.
+ * @return the worst case length of the output.
+ */
+size_t
+libivc_lz_bound(size_t srcSize)
+{
+    return srcSize + (srcSize / 255) + 16;
+}
+
+/**
+ * Compresses a block.
+ * @return SUCCESS or appropriate error number.
+ */
+int
+libivc_lz_compress(const char *src, size_t srcSize, char *dst, size_t dstCapacity, size_t *written)
+{
+    const uint8_t *base = (const uint8_t *)src;
+    const uint8_t *ip = base, *anchor = base, *ref;
+    const uint8_t *iend = base + srcSize;
+    uint8_t *op = (uint8_t *)dst, *oend = (uint8_t *)dst + dstCapacity;
+    uint32_t table[1 << LZ_HASH_BITS];
+    uint32_t h;
+    size_t match_length;
+
+    libivc_checkp(src, INVALID_PARAM);
+    libivc_checkp(dst, INVALID_PARAM);
+    libivc_checkp(written, INVALID_PARAM);
+
+    memset(table, 0, sizeof(table));
+
+    while (srcSize >= LZ_MIN_MATCH && ip <= iend - LZ_MIN_MATCH)
+    {
+        h = lz_hash(lz_read32(ip));
+        ref = base + table[h];
+        table[h] = (uint32_t)(ip - base);
+
+        if (ref >= ip || ip - ref > LZ_MAX_OFFSET || lz_read32(ref) != lz_read32(ip))
+        {
+            // Step over incompressible data faster the longer it goes on.
+            ip += 1 + ((ip - anchor) >> 6);
+            continue;
+        }
+
+        match_length = LZ_MIN_MATCH;
+        while (ip + match_length < iend && ref[match_length] == ip[match_length])
+            match_length++;
+
+        op = lz_put_sequence(op, oend, anchor, (size_t)(ip - anchor), (size_t)(ip - ref), match_length);
+        if (!op)
+            return NO_SPACE;
+
+        ip += match_length;
+        anchor = ip;
+    }
+
+    op = lz_put_sequence(op, oend, anchor, (size_t)(iend - anchor), 0, 0);
+    if (!op)
+        return NO_SPACE;
+
+    *written = (size_t)(op - (uint8_t *)dst);
+    return SUCCESS;
+}
+
+/**
+ * Reads a literal or match length's extension bytes.
+ * @return SUCCESS, or INVALID_PARAM if the input ends first.
+ */
+static int
+lz_get_length(const uint8_t **ip, const uint8_t *iend, size_t *length)
+{
+    uint8_t byte;
+
+    do
+    {
+        if (*ip >= iend)
+            return INVALID_PARAM;
+        byte = *(*ip)++;
+        *length += byte;
+    } while (byte == 255);
+
+    return SUCCESS;
+}
+
+/**
+ * Decompresses a block produced by libivc_lz_compress.
+ * @return SUCCESS, or INVALID_PARAM if the input is corrupt or doesn't fit dst.
+ */
+int
+libivc_lz_decompress(const char *src, size_t srcSize, char *dst, size_t dstCapacity, size_t *written)
+{
+    const uint8_t *ip = (const uint8_t *)src, *iend = (const uint8_t *)src + srcSize;
+    uint8_t *op = (uint8_t *)dst, *oend = (uint8_t *)dst + dstCapacity;
+    size_t literal_length, match_length, offset, i;
+    uint8_t token;
+
+    libivc_checkp(src, INVALID_PARAM);
+    libivc_checkp(dst, INVALID_PARAM);
+    libivc_checkp(written, INVALID_PARAM);
+
+    while (ip < iend)
+    {
+        token = *ip++;
+
+        literal_length = token >> 4;
+        if (literal_length == LZ_RUN_MASK && lz_get_length(&ip, iend, &literal_length) != SUCCESS)
+            return INVALID_PARAM;
+
+        if ((size_t)(iend - ip) < literal_length || (size_t)(oend - op) < literal_length)
+            return INVALID_PARAM;
+        memcpy(op, ip, literal_length);
+        ip += literal_length;
+        op += literal_length;
+
+        // The last sequence has no match.
+        if (ip == iend)
+            break;
+
+        if (iend - ip < 2)
+            return INVALID_PARAM;
+        offset = (size_t)ip[0] | ((size_t)ip[1] << 8);
+        ip += 2;
+        if (offset == 0 || offset > (size_t)(op - (uint8_t *)dst))
+            return INVALID_PARAM;
+
+        match_length = token & LZ_RUN_MASK;
+        if (match_length == LZ_RUN_MASK && lz_get_length(&ip, iend, &match_length) != SUCCESS)
+            return INVALID_PARAM;
+        match_length += LZ_MIN_MATCH;
+
+        if ((size_t)(oend - op) < match_length)
+            return INVALID_PARAM;
+
+        // Matches may overlap their own output (that's how runs are encoded),
+        // in which case they're copied forwards a byte at a time.
+        if (offset >= match_length)
+        {
+            memcpy(op, op - offset, match_length);
+        }
+        else
+        {
+            for (i = 0; i < match_length; i++)
+                op[i] = op[i - offset];
+        }
+        op += match_length;
+    }
+
+    *written = (size_t)(op - (uint8_t *)dst);
+    return SUCCESS;
+}
+
+/**
+ * Grows a buffer to at least the given size.
+ * @return SUCCESS or OUT_OF_MEM.
+ */
+static int
+libivc_compress_reserve(char **buffer, size_t *size, size_t needed)
+{
+    char *grown;
+
+    if (*size >= needed)
+        return SUCCESS;
+
+    grown = (char *) realloc(*buffer, needed);
+    libivc_checkp(grown, OUT_OF_MEM);
+
+    *buffer = grown;
+    *size = needed;
+    return SUCCESS;
+}
+
+/**
+ * Gets the largest frame the client's outgoing ring can ever hold.
+ */
+static size_t
+libivc_compress_max_frame(struct libivc_compressor *cz)
+{
+    struct ringbuffer_channel_t *channel;
+
+    channel = &cz->client->ringbuffer->channels[cz->client->server_side ? 1 : 0];
+    return (size_t)(channel->body_length - 1);
+}
+
+/**
+ * Creates a compressor on top of a connected client.
+ * @return SUCCESS or appropriate error number.
+ */
+int
+libivc_compress_create(struct libivc_compressor **cz, struct libivc_client *client, uint32_t threshold)
+{
+    struct libivc_compressor *icz = NULL;
+
+    libivc_checkp(cz, INVALID_PARAM);
+    libivc_checkp(client, INVALID_PARAM);
+    libivc_checkp(client->ringbuffer, INVALID_PARAM);
+
+    icz = (struct libivc_compressor *) malloc(sizeof(struct libivc_compressor));
+    libivc_checkp(icz, OUT_OF_MEM);
+    memset(icz, 0, sizeof(struct libivc_compressor));
+
+    icz->client = client;
+    icz->threshold = threshold;
+    pthread_mutex_init(&icz->tx_lock, NULL);
+    pthread_mutex_init(&icz->rx_lock, NULL);
+    pthread_mutex_init(&icz->stats_lock, NULL);
+
+    *cz = icz;
+    return SUCCESS;
+}
+
+/**
+ * Destroys a compressor.
+ */
+void
+libivc_compress_destroy(struct libivc_compressor *cz)
+{
+    libivc_checkp(cz);
+
+    pthread_mutex_destroy(&cz->tx_lock);
+    pthread_mutex_destroy(&cz->rx_lock);
+    pthread_mutex_destroy(&cz->stats_lock);
+
+    if (cz->tx_body)
+        free(cz->tx_body);
+    if (cz->rx_body)
+        free(cz->rx_body);
+
+    memset(cz, 0, sizeof(struct libivc_compressor));
+    free(cz);
+}
+
+/**
+ * Sends a message, compressed if that's worthwhile.
+ * @return SUCCESS, NO_SPACE if the ring doesn't have room for the frame right
+ *    now, or appropriate error number.
+ */
+int
+libivc_compress_send(struct libivc_compressor *cz, char *src, size_t srcSize)
+{
+    struct libivc_compress_header header;
+    char *body = src;
+    size_t compressed = 0, space = 0;
+    int rc;
+
+    libivc_checkp(cz, INVALID_PARAM);
+    libivc_checkp(src, INVALID_PARAM);
+    libivc_assert(srcSize > 0 && srcSize < LIBIVC_COMPRESS_FLAG, INVALID_PARAM);
+
+    header.length = (uint32_t)srcSize;
+    header.raw_length = (uint32_t)srcSize;
+
+    pthread_mutex_lock(&cz->tx_lock);
+
+    // Only keep the compressed form if it's actually smaller; the codec gives
+    // up as soon as it isn't.
+    if (srcSize >= cz->threshold &&
+        libivc_compress_reserve(&cz->tx_body, &cz->tx_body_size, srcSize) == SUCCESS &&
+        libivc_lz_compress(src, srcSize, cz->tx_body, srcSize - 1, &compressed) == SUCCESS)
+    {
+        body = cz->tx_body;
+        header.length = (uint32_t)compressed;
+        header.raw_length |= LIBIVC_COMPRESS_FLAG;
+    }
+
+    rc = INVALID_PARAM;
+    libivc_assert_goto(sizeof(header) + header.length <= libivc_compress_max_frame(cz), END);
+
+    rc = libivc_getAvailableSpace(cz->client, &space);
+    libivc_assert_goto(rc == SUCCESS, END);
+    if (space < sizeof(header) + header.length)
+    {
+        rc = NO_SPACE;
+        goto END;
+    }
+
+    // Cork around the header and body, so the remote sees a single event per frame.
+    libivc_cork(cz->client);
+    rc = libivc_send(cz->client, (char *)&header, sizeof(header));
+    if (rc == SUCCESS)
+        rc = libivc_send(cz->client, body, header.length);
+    libivc_uncork(cz->client);
+
+    if (rc == SUCCESS)
+    {
+        pthread_mutex_lock(&cz->stats_lock);
+        cz->stats.messages_sent++;
+        if (header.raw_length & LIBIVC_COMPRESS_FLAG)
+            cz->stats.messages_compressed++;
+        cz->stats.raw_bytes_sent += srcSize;
+        cz->stats.wire_bytes_sent += sizeof(header) + header.length;
+        pthread_mutex_unlock(&cz->stats_lock);
+    }
+
+END:
+    pthread_mutex_unlock(&cz->tx_lock);
+    return rc;
+}
+
+/**
+ * Skips what has arrived of a malformed frame's body.
+ * @return SUCCESS once the whole body is skipped, NO_DATA_AVAIL while more of
+ *    it is still to come, or appropriate error number.
+ */
+static int
+libivc_compress_discard(struct libivc_compressor *cz)
+{
+    size_t available = 0, n;
+    int rc;
+
+    rc = libivc_getAvailableData(cz->client, &available);
+    if (rc != SUCCESS && rc != NO_DATA_AVAIL)
+        return rc;
+
+    n = available < cz->rx_discard ? available : cz->rx_discard;
+    rc = libivc_consume(cz->client, n);
+    if (rc != SUCCESS)
+        return rc;
+
+    cz->rx_discard -= n;
+    return cz->rx_discard ? NO_DATA_AVAIL : SUCCESS;
+}
+
+/**
+ * Receives a message, decompressing it if needed. Malformed frames are
+ * dropped, and skipped as their bodies arrive.
+ * @return SUCCESS, NO_DATA_AVAIL if no message has arrived, NO_SPACE if dest is
+ *    too small, INVALID_PARAM if the frame was malformed or corrupt, or
+ *    appropriate error number.
+ */
+int
+libivc_compress_recv(struct libivc_compressor *cz, char *dest, size_t destSize, size_t *actualSize)
+{
+    size_t available = 0, raw_length, decompressed = 0;
+    uint8_t compressed;
+    int rc;
+
+    libivc_checkp(cz, INVALID_PARAM);
+    libivc_checkp(dest, INVALID_PARAM);
+    libivc_checkp(actualSize, INVALID_PARAM);
+
+    pthread_mutex_lock(&cz->rx_lock);
+
+    if (cz->rx_discard)
+    {
+        rc = libivc_compress_discard(cz);
+        if (rc != SUCCESS)
+            goto END;
+    }
+
+    // The header and body are published together, but the header is kept once
+    // read, in case dest turns out to be too small.
+    if (!cz->rx_have_header)
+    {
+        rc = libivc_recv(cz->client, (char *)&cz->rx_header, sizeof(cz->rx_header));
+        if (rc != SUCCESS)
+            goto END;
+        cz->rx_have_header = 1;
+    }
+
+    raw_length = cz->rx_header.raw_length & ~LIBIVC_COMPRESS_FLAG;
+    compressed = (cz->rx_header.raw_length & LIBIVC_COMPRESS_FLAG) != 0;
+
+    // The header comes from the remote. A frame that couldn't have been sent
+    // whole, or a raw one whose lengths disagree, would otherwise either never
+    // be received or be copied past what we checked dest against.
+    if (cz->rx_header.length > libivc_compress_max_frame(cz) - sizeof(cz->rx_header) ||
+        (!compressed && cz->rx_header.length != raw_length))
+    {
+        libivc_error_ratelimited("Dropping a malformed %uB message from dom%u:%u.\n",
+            cz->rx_header.length, cz->client->remote_domid, cz->client->port);
+        cz->rx_have_header = 0;
+        cz->rx_discard = cz->rx_header.length;
+        rc = libivc_compress_discard(cz);
+        if (rc == SUCCESS || rc == NO_DATA_AVAIL)
+            rc = INVALID_PARAM;
+        goto END;
+    }
+
+    *actualSize = raw_length;
+    if (destSize < raw_length)
+    {
+        rc = NO_SPACE;
+        goto END;
+    }
+
+    rc = libivc_getAvailableData(cz->client, &available);
+    if (rc != SUCCESS)
+        goto END;
+    if (available < cz->rx_header.length)
+    {
+        rc = NO_DATA_AVAIL;
+        goto END;
+    }
+
+    if (!compressed)
+    {
+        rc = libivc_recv(cz->client, dest, cz->rx_header.length);
+    }
+    else
+    {
+        rc = libivc_compress_reserve(&cz->rx_body, &cz->rx_body_size, cz->rx_header.length);
+        if (rc == SUCCESS)
+            rc = libivc_recv(cz->client, cz->rx_body, cz->rx_header.length);
+        if (rc == SUCCESS)
+            rc = libivc_lz_decompress(cz->rx_body, cz->rx_header.length, dest, raw_length, &decompressed);
+        if (rc == SUCCESS && decompressed != raw_length)
+            rc = INVALID_PARAM;
+        if (rc == INVALID_PARAM)
+            libivc_error_ratelimited("Dropping a corrupt compressed message from dom%u:%u.\n",
+                cz->client->remote_domid, cz->client->port);
+    }
+
+    if (rc == OUT_OF_MEM)
+        goto END;
+
+    // Whether or not it decompressed, the frame has been consumed.
+    cz->rx_have_header = 0;
+    if (rc == SUCCESS)
+    {
+        pthread_mutex_lock(&cz->stats_lock);
+        cz->stats.messages_received++;
+        cz->stats.raw_bytes_received += raw_length;
+        cz->stats.wire_bytes_received += sizeof(cz->rx_header) + cz->rx_header.length;
+        pthread_mutex_unlock(&cz->stats_lock);
+    }
+
+END:
+    pthread_mutex_unlock(&cz->rx_lock);
+    return rc;
+}
+
+/**
+ * Gets a snapshot of a compressor's counters.
+ * @return SUCCESS or appropriate error number.
+ */
+int
+libivc_compress_get_stats(struct libivc_compressor *cz, struct libivc_compress_stats *stats)
+{
+    libivc_checkp(cz, INVALID_PARAM);
+    libivc_checkp(stats, INVALID_PARAM);
+
+    pthread_mutex_lock(&cz->stats_lock);
+    *stats = cz->stats;
+    pthread_mutex_unlock(&cz->stats_lock);
+
+    return SUCCESS;
+}
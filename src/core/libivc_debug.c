@@ -6,12 +6,89 @@
 
 #include <libivc_debug.h>
 
+#ifdef __linux
+#ifdef KERNEL
+#include <linux/jiffies.h>
+#include <linux/atomic.h>
+#else
+#include <time.h>
+#endif
+#endif
+
 ////////////////////////////////////////////////////////////////////////////////
 // Global Variables                                                           //
 ////////////////////////////////////////////////////////////////////////////////
 
 bool debugging_enabled = false;
 
+// The binary log ring. Producers claim a slot by advancing logRingHead, and
+// publish it by setting its sequence number to one past their position; the
+// (single) consumer hands it back by advancing the sequence number a lap.
+static struct
+{
+    uint32_t sequence;
+    struct libivc_log_record record;
+} logRing[LIBIVC_LOG_RING_SIZE];
+
+static uint32_t logRingHead = 0;
+static uint32_t logRingTail = 0;
+static uint32_t logRingDropped = 0;
+static bool logRingInitialized = false;
+static bool logRingEnabled = false;
+
+////////////////////////////////////////////////////////////////////////////////
+// Helpers                                                                    //
+////////////////////////////////////////////////////////////////////////////////
+
+#ifdef __linux
+#ifdef KERNEL
+#define log_load_acquire(p) smp_load_acquire(p)
+#define log_store_release(p, v) smp_store_release(p, v)
+#define log_cas(p, o, n) (cmpxchg(p, o, n) == (o))
+#else
+#define log_load_acquire(p) __atomic_load_n(p, __ATOMIC_ACQUIRE)
+#define log_store_release(p, v) __atomic_store_n(p, v, __ATOMIC_RELEASE)
+#define log_cas(p, o, n) __extension__ ({ \
+        uint32_t __expected = (o); \
+        __atomic_compare_exchange_n(p, &__expected, n, false, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED); \
+    })
+#endif
+#else
+static uint32_t log_load_acquire(volatile uint32_t *p)
+{
+    uint32_t value = *p;
+    MemoryBarrier();
+    return value;
+}
+#define log_store_release(p, v) \
+    do { MemoryBarrier(); *(volatile uint32_t *)(p) = (v); } while (0)
+#define log_cas(p, o, n) \
+    (InterlockedCompareExchange((volatile LONG *)(p), (LONG)(n), (LONG)(o)) == (LONG)(o))
+#endif
+
+/**
+ * Returns a coarse monotonic timestamp, in milliseconds.
+ */
+static uint64_t libivc_debug_now_ms(void)
+{
+#ifdef __linux
+#ifdef KERNEL
+    return (uint64_t)jiffies_to_msecs(jiffies);
+#else
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &now);
+    return ((uint64_t)now.tv_sec * 1000) + ((uint64_t)now.tv_nsec / 1000000);
+#endif
+#else
+#ifdef KERNEL
+    return KeQueryInterruptTime() / 10000;
+#else
+    return GetTickCount64();
+#endif
+#endif
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 // Functions                                                                  //
 ////////////////////////////////////////////////////////////////////////////////
@@ -37,6 +114,7 @@ void libivc_debug_fini(void)
 #endif
 
     libivc_debug_set_enabled(false);
+    libivc_log_ring_set_enabled(false);
 }
 
 bool libivc_debug_is_enabled(void)
@@ -49,3 +127,130 @@ void libivc_debug_set_enabled(bool enabled)
     debugging_enabled = enabled;
 }
 
+bool libivc_ratelimit_check(struct libivc_ratelimit *state, uint32_t *suppressed)
+{
+    uint64_t now = libivc_debug_now_ms();
+
+    if (state->window_start == 0 || now - state->window_start >= LIBIVC_RATELIMIT_INTERVAL_MS)
+    {
+        // Report what the last window suppressed along with the first
+        // message of this one.
+        *suppressed = state->suppressed;
+        state->window_start = now ? now : 1;
+        state->printed = 0;
+        state->suppressed = 0;
+    }
+
+    if (state->printed >= LIBIVC_RATELIMIT_BURST)
+    {
+        state->suppressed++;
+        return false;
+    }
+
+    state->printed++;
+    return true;
+}
+
+void libivc_log_record(uint32_t level, const char *format, int64_t a0, int64_t a1,
+                       int64_t a2, int64_t a3)
+{
+    uint32_t position, sequence, dropped;
+    int32_t lag;
+
+    if (!logRingInitialized)
+        return;
+
+    position = log_load_acquire(&logRingHead);
+    for (;;)
+    {
+        sequence = log_load_acquire(&logRing[position & (LIBIVC_LOG_RING_SIZE - 1)].sequence);
+        lag = (int32_t)(sequence - position);
+
+        if (lag == 0)
+        {
+            // The slot is free; try to claim it.
+            if (log_cas(&logRingHead, position, position + 1))
+                break;
+            position = log_load_acquire(&logRingHead);
+        }
+        else if (lag < 0)
+        {
+            // The ring is full.
+            do
+            {
+                dropped = log_load_acquire(&logRingDropped);
+            } while (!log_cas(&logRingDropped, dropped, dropped + 1));
+            return;
+        }
+        else
+        {
+            // Another producer claimed it first.
+            position = log_load_acquire(&logRingHead);
+        }
+    }
+
+    logRing[position & (LIBIVC_LOG_RING_SIZE - 1)].record.timestamp = libivc_debug_now_ms();
+    logRing[position & (LIBIVC_LOG_RING_SIZE - 1)].record.format = format;
+    logRing[position & (LIBIVC_LOG_RING_SIZE - 1)].record.args[0] = a0;
+    logRing[position & (LIBIVC_LOG_RING_SIZE - 1)].record.args[1] = a1;
+    logRing[position & (LIBIVC_LOG_RING_SIZE - 1)].record.args[2] = a2;
+    logRing[position & (LIBIVC_LOG_RING_SIZE - 1)].record.args[3] = a3;
+    logRing[position & (LIBIVC_LOG_RING_SIZE - 1)].record.level = level;
+    log_store_release(&logRing[position & (LIBIVC_LOG_RING_SIZE - 1)].sequence, position + 1);
+}
+
+uint32_t libivc_log_drain(libivc_log_sink sink, void *opaque, uint32_t *dropped)
+{
+    struct libivc_log_record record;
+    uint32_t sequence, count = 0, lost;
+
+    if (sink == NULL)
+        return 0;
+
+    for (;;)
+    {
+        sequence = log_load_acquire(&logRing[logRingTail & (LIBIVC_LOG_RING_SIZE - 1)].sequence);
+        if (sequence != logRingTail + 1)
+            break;
+
+        record = logRing[logRingTail & (LIBIVC_LOG_RING_SIZE - 1)].record;
+        log_store_release(&logRing[logRingTail & (LIBIVC_LOG_RING_SIZE - 1)].sequence,
+                          logRingTail + LIBIVC_LOG_RING_SIZE);
+        logRingTail++;
+
+        sink(opaque, &record);
+        count++;
+    }
+
+    if (dropped)
+    {
+        do
+        {
+            lost = log_load_acquire(&logRingDropped);
+        } while (!log_cas(&logRingDropped, lost, 0));
+        *dropped = lost;
+    }
+
+    return count;
+}
+
+bool libivc_log_ring_is_enabled(void)
+{
+    return logRingEnabled;
+}
+
+void libivc_log_ring_set_enabled(bool enabled)
+{
+    uint32_t i;
+
+    // Slots start out free for the first lap. Nothing can be recording before
+    // the ring is first enabled.
+    if (enabled && !logRingInitialized)
+    {
+        for (i = 0; i < LIBIVC_LOG_RING_SIZE; i++)
+            logRing[i].sequence = i;
+        logRingInitialized = true;
+    }
+
+    logRingEnabled = enabled;
+}
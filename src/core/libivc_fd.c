@@ -0,0 +1,191 @@
+//
+// IVC Driver
+//
+// Copyright (C) 2016 Assured Information Security, Inc. All rights reserved.
+//
+
+#define _GNU_SOURCE // for preadv and pwritev
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/uio.h>
+
+#include <libivc.h>
+#include <libivc_types.h>
+#include <libivc_private.h>
+#include <libivc_fd.h>
+#include <libivc_debug.h>
+
+/**
+ * Trims the ring's segments to the next chunk of a transfer.
+ * @return the number of iovecs filled in.
+ */
+static int
+fd_chunk_iov(struct libivc_segment segments[2], size_t want, struct iovec iov[2])
+{
+    int count = 0, i;
+
+    for (i = 0; i < 2 && want > 0; i++)
+    {
+        if (segments[i].length == 0)
+            continue;
+
+        iov[count].iov_base = segments[i].base;
+        iov[count].iov_len = segments[i].length < want ? segments[i].length : want;
+        want -= iov[count].iov_len;
+        count++;
+    }
+
+    return count;
+}
+
+/**
+ * Streams data from a file descriptor to the remote.
+ * @return SUCCESS once length bytes have been sent, ERROR_AGAIN if the ring
+ *    filled or the descriptor would block, NO_DATA_AVAIL if the file ended
+ *    first, or appropriate error number.
+ */
+int
+libivc_send_from_fd(struct libivc_client *client, int fd, int64_t offset, size_t length,
+    size_t *transferred)
+{
+    struct libivc_segment segments[2];
+    struct iovec iov[2];
+    size_t available, want;
+    ssize_t n;
+    int rc, count;
+
+    libivc_checkp(client, INVALID_PARAM);
+    libivc_checkp(transferred, INVALID_PARAM);
+    libivc_assert(fd >= 0, INVALID_PARAM);
+    libivc_assert(*transferred <= length, INVALID_PARAM);
+
+    while (*transferred < length)
+    {
+        rc = libivc_reserve(client, segments, &available);
+        if (rc == NO_SPACE)
+            return ERROR_AGAIN;
+        if (rc != SUCCESS)
+            return rc;
+
+        want = length - *transferred;
+        if (want > available)
+            want = available;
+        if (want > LIBIVC_FD_CHUNK)
+            want = LIBIVC_FD_CHUNK;
+
+        count = fd_chunk_iov(segments, want, iov);
+        if (offset < 0)
+            n = readv(fd, iov, count);
+        else
+            n = preadv(fd, iov, count, (off_t)(offset + (int64_t)*transferred));
+
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                return ERROR_AGAIN;
+
+            rc = -errno;
+            libivc_error("Failed to read from fd %d for dom%u:%u after %zuB: %d\n", fd,
+                client->remote_domid, client->port, *transferred, rc);
+            return rc;
+        }
+
+        if (n == 0)
+            return NO_DATA_AVAIL;
+
+        rc = libivc_commit(client, (size_t)n);
+        if (rc != SUCCESS)
+            return rc;
+
+        *transferred += (size_t)n;
+    }
+
+    return SUCCESS;
+}
+
+/**
+ * Streams data from the remote to a file descriptor.
+ * @return SUCCESS once length bytes have been written, ERROR_AGAIN if the ring
+ *    emptied or the descriptor would block, or appropriate error number.
+ */
+int
+libivc_recv_to_fd(struct libivc_client *client, int fd, int64_t offset, size_t length,
+    size_t *transferred)
+{
+    struct libivc_segment segments[2];
+    struct iovec iov[2];
+    size_t available, want, consumed = 0;
+    uint8_t event_enabled = 0;
+    ssize_t n;
+    int rc = SUCCESS, count;
+
+    libivc_checkp(client, INVALID_PARAM);
+    libivc_checkp(transferred, INVALID_PARAM);
+    libivc_assert(fd >= 0, INVALID_PARAM);
+    libivc_assert(*transferred <= length, INVALID_PARAM);
+
+    while (*transferred < length)
+    {
+        rc = libivc_peek(client, segments, &available);
+        if (rc == NO_DATA_AVAIL)
+        {
+            rc = ERROR_AGAIN;
+            break;
+        }
+        if (rc != SUCCESS)
+            break;
+
+        want = length - *transferred;
+        if (want > available)
+            want = available;
+        if (want > LIBIVC_FD_CHUNK)
+            want = LIBIVC_FD_CHUNK;
+
+        count = fd_chunk_iov(segments, want, iov);
+        if (offset < 0)
+            n = writev(fd, iov, count);
+        else
+            n = pwritev(fd, iov, count, (off_t)(offset + (int64_t)*transferred));
+
+        if (n < 0 && errno == EINTR)
+            continue;
+
+        if (n <= 0)
+        {
+            if (n == 0 || errno == EAGAIN || errno == EWOULDBLOCK)
+            {
+                rc = ERROR_AGAIN;
+                break;
+            }
+
+            rc = -errno;
+            libivc_error("Failed to write to fd %d for dom%u:%u after %zuB: %d\n", fd,
+                client->remote_domid, client->port, *transferred, rc);
+            break;
+        }
+
+        rc = libivc_consume(client, (size_t)n);
+        if (rc != SUCCESS)
+            break;
+
+        *transferred += (size_t)n;
+        consumed += (size_t)n;
+    }
+
+    // Let a sender that is waiting on ring space know we've made some.
+    if (consumed)
+    {
+        libivc_remote_events_enabled(client, &event_enabled);
+        if (event_enabled)
+            libivc_notify_remote(client);
+    }
+
+    return rc;
+}
@@ -0,0 +1,594 @@
+//
+// IVC Driver
+//
+// Copyright (C) 2016 Assured Information Security, Inc. All rights reserved.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+#include <list.h>
+
+#include <libivc.h>
+#include <libivc_types.h>
+#include <libivc_private.h>
+#include <libivc_heap.h>
+#include <libivc_debug.h>
+
+#define LIBIVC_HEAP_MAGIC 0x50414548
+
+/**
+ * The bounds on the size of a slab. The actual size is the largest power of
+ * two that still cuts the heap into at least LIBIVC_HEAP_MIN_SLABS slabs, so
+ * a few size classes can be in use at once.
+ */
+#define LIBIVC_HEAP_MIN_SLAB_SIZE PAGE_SIZE
+#define LIBIVC_HEAP_MAX_SLAB_SIZE (1024 * 1024)
+#define LIBIVC_HEAP_MIN_SLABS 8
+
+/**
+ * The number of size classes, LIBIVC_HEAP_MIN_OBJECT up to the largest slab.
+ */
+#define LIBIVC_HEAP_MAX_CLASSES 15
+
+/**
+ * The header starts past the ring header libivc keeps at the start of the
+ * buffer, and the heap on the first page after it.
+ */
+#define LIBIVC_HEAP_HEADER_OFFSET LIBIVC_RING_HEADER_RESERVED
+#define LIBIVC_HEAP_HEADER_END (LIBIVC_HEAP_HEADER_OFFSET + sizeof(struct libivc_heap_header))
+#define LIBIVC_HEAP_ARENA_OFFSET \
+    ((LIBIVC_HEAP_HEADER_END + PAGE_SIZE - 1) & ~((size_t)PAGE_SIZE - 1))
+
+#pragma pack(push, 1)
+
+/**
+ * A single producer, single consumer queue of handles. Each index is only
+ * ever written by one side, and each lives in its own cache line.
+ */
+struct libivc_heap_queue {
+    volatile uint32_t head;           // handles ever pushed; written by the queue's producer.
+    uint8_t pad0[60];
+    volatile uint32_t tail;           // handles ever popped; written by the queue's consumer.
+    uint8_t pad1[60];
+    uint64_t slots[LIBIVC_HEAP_QUEUE_SLOTS];
+};
+
+/**
+ * The header at LIBIVC_HEAP_HEADER_OFFSET. Only the producer writes its
+ * geometry; the queues are shared as described above.
+ */
+struct libivc_heap_header {
+    volatile uint32_t magic;          // LIBIVC_HEAP_MAGIC, once the producer has set the header up.
+    uint32_t arena_offset;            // where the heap starts in the buffer.
+    uint32_t arena_size;              // the size of the heap.
+    uint32_t slab_size;               // the size of each slab.
+    uint8_t pad[16];                  // zero; puts the queues on a cache line of their own.
+    struct libivc_heap_queue submit;  // producer to consumer: filled in objects.
+    struct libivc_heap_queue release; // consumer to producer: objects to free.
+};
+
+#pragma pack(pop)
+
+/**
+ * The producer's private record of one slab.
+ */
+struct libivc_heap_slab {
+    list_head_t node;                 // in its class's partial list, or the empty list.
+    int32_t size_class;               // the class the slab is carved into, or -1 if empty.
+    uint32_t capacity;                // the number of objects the slab holds.
+    uint32_t used;                    // the number of those allocated.
+    uint64_t *bitmap;                 // one bit per object, set while allocated.
+};
+
+struct libivc_heap {
+    pthread_mutex_t lock;             // guards the allocator and our ends of the queues.
+    struct libivc_client *client;     // the connection whose buffer we live in.
+    struct libivc_heap_header *header; // the header, in the buffer.
+    char *buffer;                     // the local mapping of the buffer.
+    size_t buffer_size;               // the size of the buffer.
+    uint8_t producer;                 // non zero on the allocating side.
+    uint8_t ready;                    // non zero once the geometry below is known and checked.
+    uint32_t arena_offset;            // our copy of the header's geometry, which the
+    uint32_t arena_size;              // consumer reads once and checks, so the producer
+    uint32_t slab_size;               // can't later move the heap out from under it.
+
+    // The rest is producer only.
+    uint32_t num_slabs;
+    uint32_t num_classes;
+    uint32_t bitmap_words;            // the length of each slab's bitmap.
+    struct libivc_heap_slab *slabs;
+    uint64_t *bitmaps;                // every slab's bitmap, in one allocation.
+    list_head_t partial[LIBIVC_HEAP_MAX_CLASSES]; // slabs with free objects, by class.
+    list_head_t empty;                // slabs not carved into any class.
+};
+
+/**
+ * Pushes a handle onto one of the queues.
+ * @return SUCCESS, or NO_SPACE if the queue is full.
+ */
+static int
+heap_queue_push(struct libivc_heap_queue *queue, uint64_t handle)
+{
+    uint32_t head = queue->head;
+
+    if (head - queue->tail >= LIBIVC_HEAP_QUEUE_SLOTS)
+        return NO_SPACE;
+
+    queue->slots[head % LIBIVC_HEAP_QUEUE_SLOTS] = handle;
+
+    // The slot must be visible before the new head is.
+    __sync_synchronize();
+    queue->head = head + 1;
+
+    return SUCCESS;
+}
+
+/**
+ * Pops a handle off one of the queues.
+ * @return SUCCESS, NO_DATA_AVAIL if the queue is empty, or INTERNAL_ERROR if
+ *    the remote has corrupted its index.
+ */
+static int
+heap_queue_pop(struct libivc_heap_queue *queue, uint64_t *handle)
+{
+    uint32_t tail = queue->tail;
+    uint32_t head = queue->head;
+
+    if (head == tail)
+        return NO_DATA_AVAIL;
+
+    libivc_assert(head - tail <= LIBIVC_HEAP_QUEUE_SLOTS, INTERNAL_ERROR);
+
+    __sync_synchronize();
+    *handle = queue->slots[tail % LIBIVC_HEAP_QUEUE_SLOTS];
+
+    // Don't hand the slot back until we've read it.
+    __sync_synchronize();
+    queue->tail = tail + 1;
+
+    return SUCCESS;
+}
+
+/**
+ * Reads and checks the producer's geometry, if it has been written yet.
+ * Consumer only; the lock must be held.
+ * @return non zero once the heap is usable.
+ */
+static uint8_t
+heap_check_header(struct libivc_heap *heap)
+{
+    struct libivc_heap_header *header = heap->header;
+    uint32_t offset, size, slab;
+
+    if (heap->ready)
+        return 1;
+
+    if (header->magic != LIBIVC_HEAP_MAGIC)
+        return 0;
+
+    __sync_synchronize();
+    offset = header->arena_offset;
+    size = header->arena_size;
+    slab = header->slab_size;
+
+    if (offset < LIBIVC_HEAP_HEADER_END || offset > heap->buffer_size ||
+        size > heap->buffer_size - offset || slab == 0 || size < slab)
+    {
+        libivc_error_ratelimited("Heap on dom%u:%u has a bad header (%u bytes at %u).\n",
+            heap->client->remote_domid, heap->client->port, size, offset);
+        return 0;
+    }
+
+    heap->arena_offset = offset;
+    heap->arena_size = size;
+    heap->slab_size = slab;
+    heap->ready = 1;
+    return 1;
+}
+
+/**
+ * Checks that a handle lies entirely within the heap.
+ */
+static uint8_t
+heap_handle_valid(struct libivc_heap *heap, uint64_t handle)
+{
+    uint64_t offset = LIBIVC_HEAP_HANDLE_OFFSET(handle);
+    uint64_t length = LIBIVC_HEAP_HANDLE_LENGTH(handle);
+
+    return heap->ready && length > 0 && offset >= heap->arena_offset &&
+        offset + length <= (uint64_t)heap->arena_offset + heap->arena_size;
+}
+
+/**
+ * Frees an object. Producer only; the lock must be held.
+ * @return SUCCESS, or INVALID_PARAM if the handle isn't an allocated object.
+ */
+static int
+heap_free_locked(struct libivc_heap *heap, uint64_t handle)
+{
+    struct libivc_heap_slab *slab;
+    uint32_t offset, object_size, index;
+    uint64_t bit;
+
+    if (!heap_handle_valid(heap, handle))
+        return INVALID_PARAM;
+
+    offset = LIBIVC_HEAP_HANDLE_OFFSET(handle) - heap->arena_offset;
+    slab = &heap->slabs[offset / heap->slab_size];
+    if (slab->size_class < 0)
+        return INVALID_PARAM;
+
+    object_size = LIBIVC_HEAP_MIN_OBJECT << slab->size_class;
+    offset %= heap->slab_size;
+    index = offset / object_size;
+    bit = 1ULL << (index % 64);
+
+    // Only the exact start of an allocated object may be freed, and only once.
+    if (offset % object_size || LIBIVC_HEAP_HANDLE_LENGTH(handle) > object_size ||
+        !(slab->bitmap[index / 64] & bit))
+        return INVALID_PARAM;
+
+    slab->bitmap[index / 64] &= ~bit;
+    if (slab->used-- == slab->capacity)
+        list_add(&slab->node, &heap->partial[slab->size_class]);
+
+    // Hand wholly free slabs back, so another class can use them.
+    if (slab->used == 0)
+    {
+        list_del(&slab->node);
+        slab->size_class = -1;
+        list_add(&slab->node, &heap->empty);
+    }
+
+    return SUCCESS;
+}
+
+/**
+ * Frees everything on the release queue. Producer only; the lock must be held.
+ * @return the number of objects freed, or appropriate error number.
+ */
+static int
+heap_reclaim_locked(struct libivc_heap *heap)
+{
+    uint64_t handle;
+    int rc, freed = 0;
+
+    while ((rc = heap_queue_pop(&heap->header->release, &handle)) == SUCCESS)
+    {
+        if (heap_free_locked(heap, handle) == SUCCESS)
+            freed++;
+        else
+            libivc_error_ratelimited("dom%u:%u released a bad handle %llx.\n",
+                heap->client->remote_domid, heap->client->port, (unsigned long long)handle);
+    }
+
+    return rc == NO_DATA_AVAIL ? freed : rc;
+}
+
+/**
+ * Sets up the producer's allocator and publishes the header.
+ * @return SUCCESS or appropriate error number.
+ */
+static int
+heap_init_producer(struct libivc_heap *heap)
+{
+    struct libivc_heap_header *header = heap->header;
+    uint32_t i, slab_size = LIBIVC_HEAP_MAX_SLAB_SIZE;
+
+    heap->arena_offset = (uint32_t)LIBIVC_HEAP_ARENA_OFFSET;
+    heap->arena_size = (uint32_t)(heap->buffer_size - heap->arena_offset);
+
+    while (slab_size > LIBIVC_HEAP_MIN_SLAB_SIZE &&
+        heap->arena_size / slab_size < LIBIVC_HEAP_MIN_SLABS)
+        slab_size >>= 1;
+
+    heap->slab_size = slab_size;
+    heap->num_slabs = heap->arena_size / slab_size;
+    heap->arena_size = heap->num_slabs * slab_size;
+
+    for (heap->num_classes = 0; heap->num_classes < LIBIVC_HEAP_MAX_CLASSES &&
+        ((uint32_t)LIBIVC_HEAP_MIN_OBJECT << heap->num_classes) <= slab_size; heap->num_classes++)
+        INIT_LIST_HEAD(&heap->partial[heap->num_classes]);
+    INIT_LIST_HEAD(&heap->empty);
+
+    heap->bitmap_words = (slab_size / LIBIVC_HEAP_MIN_OBJECT + 63) / 64;
+    heap->slabs = (struct libivc_heap_slab *) calloc(heap->num_slabs, sizeof(struct libivc_heap_slab));
+    heap->bitmaps = (uint64_t *) calloc((size_t)heap->num_slabs * heap->bitmap_words, sizeof(uint64_t));
+    libivc_checkp(heap->slabs, OUT_OF_MEM);
+    libivc_checkp(heap->bitmaps, OUT_OF_MEM);
+
+    for (i = 0; i < heap->num_slabs; i++)
+    {
+        heap->slabs[i].size_class = -1;
+        heap->slabs[i].bitmap = heap->bitmaps + (size_t)i * heap->bitmap_words;
+        list_add_tail(&heap->slabs[i].node, &heap->empty);
+    }
+
+    // Start both queues from scratch, and only then tell the consumer the
+    // heap is there.
+    header->magic = 0;
+    __sync_synchronize();
+    memset(header->pad, 0, sizeof(header->pad));
+    memset(&header->submit, 0, sizeof(header->submit));
+    memset(&header->release, 0, sizeof(header->release));
+    header->arena_offset = heap->arena_offset;
+    header->arena_size = heap->arena_size;
+    header->slab_size = heap->slab_size;
+    __sync_synchronize();
+    header->magic = LIBIVC_HEAP_MAGIC;
+
+    heap->ready = 1;
+    return SUCCESS;
+}
+
+/**
+ * Creates a heap over a connected client's buffer.
+ * @return SUCCESS or appropriate error number.
+ */
+int
+libivc_heap_create(struct libivc_heap **heap, struct libivc_client *client, uint8_t producer)
+{
+    struct libivc_heap *iheap = NULL;
+    int rc;
+
+    libivc_checkp(heap, INVALID_PARAM);
+    libivc_checkp(client, INVALID_PARAM);
+    libivc_checkp(client->buffer, INVALID_PARAM);
+    libivc_assert((size_t)client->num_pages * PAGE_SIZE >=
+        LIBIVC_HEAP_ARENA_OFFSET + LIBIVC_HEAP_MIN_SLAB_SIZE, INVALID_PARAM);
+
+    iheap = (struct libivc_heap *) malloc(sizeof(struct libivc_heap));
+    libivc_checkp(iheap, OUT_OF_MEM);
+    memset(iheap, 0, sizeof(struct libivc_heap));
+
+    pthread_mutex_init(&iheap->lock, NULL);
+    iheap->client = client;
+    iheap->buffer = client->buffer;
+    iheap->header = (struct libivc_heap_header *) (client->buffer + LIBIVC_HEAP_HEADER_OFFSET);
+    iheap->buffer_size = (size_t)client->num_pages * PAGE_SIZE;
+    iheap->producer = producer ? 1 : 0;
+
+    // Keep libivc's event flags out of the header and the heap.
+    __libivc_take_over_buffer(client);
+
+    if (iheap->producer)
+    {
+        rc = heap_init_producer(iheap);
+        if (rc != SUCCESS)
+        {
+            libivc_heap_destroy(iheap);
+            return rc;
+        }
+    }
+
+    *heap = iheap;
+    return SUCCESS;
+}
+
+/**
+ * Destroys a heap. The client is left connected.
+ */
+void
+libivc_heap_destroy(struct libivc_heap *heap)
+{
+    libivc_checkp(heap);
+
+    pthread_mutex_destroy(&heap->lock);
+    free(heap->slabs);
+    free(heap->bitmaps);
+    memset(heap, 0, sizeof(struct libivc_heap));
+    free(heap);
+}
+
+/**
+ * Gets the largest object the heap can allocate.
+ * @return the size of the largest object, in bytes.
+ */
+size_t
+libivc_heap_max_object(struct libivc_heap *heap)
+{
+    libivc_checkp(heap, 0);
+    return heap->slab_size;
+}
+
+/**
+ * Allocates an object.
+ * @return SUCCESS, NO_SPACE if the heap is full, or appropriate error number.
+ */
+int
+libivc_heap_alloc(struct libivc_heap *heap, size_t size, uint64_t *handle)
+{
+    struct libivc_heap_slab *slab = NULL;
+    uint32_t size_class = 0, word, index, offset;
+
+    libivc_checkp(heap, INVALID_PARAM);
+    libivc_checkp(handle, INVALID_PARAM);
+    libivc_assert(heap->producer, INVALID_PARAM);
+    libivc_assert(size > 0 && size <= heap->slab_size, INVALID_PARAM);
+
+    while (((size_t)LIBIVC_HEAP_MIN_OBJECT << size_class) < size)
+        size_class++;
+
+    pthread_mutex_lock(&heap->lock);
+    heap_reclaim_locked(heap);
+
+    if (!list_empty(&heap->partial[size_class]))
+    {
+        slab = list_entry(heap->partial[size_class].next, struct libivc_heap_slab, node);
+    }
+    else if (!list_empty(&heap->empty))
+    {
+        slab = list_entry(heap->empty.next, struct libivc_heap_slab, node);
+        list_del(&slab->node);
+        slab->size_class = (int32_t)size_class;
+        slab->capacity = heap->slab_size / (LIBIVC_HEAP_MIN_OBJECT << size_class);
+        slab->used = 0;
+        memset(slab->bitmap, 0, heap->bitmap_words * sizeof(uint64_t));
+        list_add(&slab->node, &heap->partial[size_class]);
+    }
+    else
+    {
+        pthread_mutex_unlock(&heap->lock);
+        return NO_SPACE;
+    }
+
+    // Partial slabs always have a clear bit within their capacity.
+    for (word = 0; ~slab->bitmap[word] == 0; word++)
+        ;
+    index = word * 64 + (uint32_t)__builtin_ctzll(~slab->bitmap[word]);
+    slab->bitmap[word] |= 1ULL << (index % 64);
+
+    if (++slab->used == slab->capacity)
+        list_del_init(&slab->node);
+
+    offset = heap->arena_offset + (uint32_t)(slab - heap->slabs) * heap->slab_size +
+        index * (LIBIVC_HEAP_MIN_OBJECT << size_class);
+    pthread_mutex_unlock(&heap->lock);
+
+    *handle = ((uint64_t)offset << 32) | (uint64_t)size;
+    return SUCCESS;
+}
+
+/**
+ * Frees an object the consumer won't be handing back.
+ * @return SUCCESS, or INVALID_PARAM if the handle isn't an allocated object.
+ */
+int
+libivc_heap_free(struct libivc_heap *heap, uint64_t handle)
+{
+    int rc;
+
+    libivc_checkp(heap, INVALID_PARAM);
+    libivc_assert(heap->producer, INVALID_PARAM);
+
+    pthread_mutex_lock(&heap->lock);
+    rc = heap_free_locked(heap, handle);
+    pthread_mutex_unlock(&heap->lock);
+
+    return rc;
+}
+
+/**
+ * Gets the address of an object in the local mapping of the buffer.
+ * @return the object's address, or NULL if the handle lies outside the heap.
+ */
+void *
+libivc_heap_ptr(struct libivc_heap *heap, uint64_t handle)
+{
+    libivc_checkp(heap, NULL);
+
+    if (!heap->ready)
+    {
+        pthread_mutex_lock(&heap->lock);
+        heap_check_header(heap);
+        pthread_mutex_unlock(&heap->lock);
+    }
+
+    if (!heap_handle_valid(heap, handle))
+        return NULL;
+
+    return heap->buffer + LIBIVC_HEAP_HANDLE_OFFSET(handle);
+}
+
+/**
+ * Passes a filled in object to the consumer, and notifies it.
+ * @return SUCCESS, NO_SPACE if the consumer hasn't caught up yet, or
+ *    appropriate error number.
+ */
+int
+libivc_heap_submit(struct libivc_heap *heap, uint64_t handle)
+{
+    int rc;
+
+    libivc_checkp(heap, INVALID_PARAM);
+    libivc_assert(heap->producer, INVALID_PARAM);
+    libivc_assert(heap_handle_valid(heap, handle), INVALID_PARAM);
+
+    pthread_mutex_lock(&heap->lock);
+    rc = heap_queue_push(&heap->header->submit, handle);
+    pthread_mutex_unlock(&heap->lock);
+
+    if (rc == SUCCESS)
+        libivc_notify_remote(heap->client);
+
+    return rc;
+}
+
+/**
+ * Frees every object the consumer has returned so far.
+ * @return the number of objects freed, or appropriate error number.
+ */
+int
+libivc_heap_reclaim(struct libivc_heap *heap)
+{
+    int rc;
+
+    libivc_checkp(heap, INVALID_PARAM);
+    libivc_assert(heap->producer, INVALID_PARAM);
+
+    pthread_mutex_lock(&heap->lock);
+    rc = heap_reclaim_locked(heap);
+    pthread_mutex_unlock(&heap->lock);
+
+    return rc;
+}
+
+/**
+ * Takes the next object the producer has submitted.
+ * @return SUCCESS, NO_DATA_AVAIL if there are none, or appropriate error number.
+ */
+int
+libivc_heap_receive(struct libivc_heap *heap, uint64_t *handle)
+{
+    uint64_t next;
+    int rc;
+
+    libivc_checkp(heap, INVALID_PARAM);
+    libivc_checkp(handle, INVALID_PARAM);
+    libivc_assert(!heap->producer, INVALID_PARAM);
+
+    pthread_mutex_lock(&heap->lock);
+    if (!heap_check_header(heap))
+    {
+        pthread_mutex_unlock(&heap->lock);
+        return NO_DATA_AVAIL;
+    }
+
+    // Skip over anything that doesn't lie within the heap, rather than hand
+    // the caller a pointer outside of it; there's no use returning it either.
+    while ((rc = heap_queue_pop(&heap->header->submit, &next)) == SUCCESS &&
+        !heap_handle_valid(heap, next))
+        libivc_error_ratelimited("dom%u:%u submitted a bad handle %llx.\n",
+            heap->client->remote_domid, heap->client->port, (unsigned long long)next);
+    pthread_mutex_unlock(&heap->lock);
+
+    if (rc == SUCCESS)
+        *handle = next;
+
+    return rc;
+}
+
+/**
+ * Hands an object back to the producer.
+ * @return SUCCESS, NO_SPACE if the producer hasn't caught up yet, or
+ *    appropriate error number.
+ */
+int
+libivc_heap_release(struct libivc_heap *heap, uint64_t handle)
+{
+    int rc;
+
+    libivc_checkp(heap, INVALID_PARAM);
+    libivc_assert(!heap->producer, INVALID_PARAM);
+
+    // The producer drains this queue whenever it allocates, so there's no need
+    // to notify it.
+    pthread_mutex_lock(&heap->lock);
+    rc = heap_check_header(heap) ? heap_queue_push(&heap->header->release, handle) : INVALID_PARAM;
+    pthread_mutex_unlock(&heap->lock);
+
+    return rc;
+}
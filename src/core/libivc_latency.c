@@ -0,0 +1,672 @@
+//
+// IVC Driver
+//
+// Copyright (C) 2016 Assured Information Security, Inc. All rights reserved.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+#include <list.h>
+
+#include <libivc.h>
+#include <libivc_types.h>
+#include <libivc_private.h>
+#include <libivc_latency.h>
+#include <libivc_debug.h>
+
+// The kinds of frame on the wire.
+#define LATENCY_FRAME_DATA 0
+#define LATENCY_FRAME_CALIBRATE 1
+#define LATENCY_FRAME_CALIBRATE_REPLY 2
+
+#define LATENCY_SUB_BUCKETS (1u << LIBIVC_LATENCY_SUB_BUCKET_BITS)
+
+#pragma pack(push, 1)
+
+/**
+ * The header that precedes every frame on the wire. For data frames, origin_ns
+ * and publish_ns are on the sender's clock. Calibration frames have no body; a
+ * request carries its send time in origin_ns, and a reply echoes it and the
+ * request's sequence back along with the times the request was picked up
+ * (remote_ns) and answered (publish_ns).
+ */
+struct libivc_latency_header {
+    uint32_t length;                  // length of the body that follows the header.
+    uint16_t type;                    // LATENCY_FRAME_ type.
+    uint16_t sequence;                // on calibration frames, which request they are for.
+    uint64_t origin_ns;               // when the message originated.
+    uint64_t publish_ns;              // when the frame was published.
+    uint64_t remote_ns;               // on a reply, when the request was picked up.
+};
+
+#pragma pack(pop)
+
+struct libivc_latency {
+    struct libivc_client *client;     // the connection messages are sent over.
+
+    pthread_mutex_t tx_lock;          // serializes frames written to the ring.
+
+    pthread_mutex_t rx_lock;          // serializes frames read from the ring, and guards the fields below.
+    uint8_t rx_have_header;           // non zero once rx_header holds the current frame's header.
+    struct libivc_latency_header rx_header; // the header of the frame currently being received.
+    uint64_t rx_picked_up;            // when rx_header was read from the ring.
+    size_t rx_discard;                // bytes of a malformed frame still to be skipped.
+
+    uint16_t cal_sequence;            // the sequence of the last request sent.
+    uint32_t cal_rounds;              // rounds completed in this pass.
+    uint8_t cal_request_pending;      // non zero if the next request has yet to be sent.
+    uint8_t cal_awaiting_reply;       // non zero while a request is out.
+    int64_t cal_best_offset;          // the offset from this pass's shortest round so far.
+    uint64_t cal_best_rtt;            // that round's round trip.
+    uint8_t reply_pending;            // non zero if a remote's request has yet to be answered.
+    struct libivc_latency_header reply; // the answer, less its publish time.
+
+    pthread_mutex_t stats_lock;       // guards the fields below.
+    struct libivc_latency_stats stats; // counters for libivc_latency_get_stats.
+    struct libivc_latency_histogram histograms[2]; // indexed by LIBIVC_LATENCY_KIND_T.
+};
+
+/**
+ * Gets the histogram bucket a value is recorded in.
+ */
+static uint32_t
+latency_bucket_of(uint64_t value)
+{
+    uint32_t exponent = 0;
+
+    if (value < LATENCY_SUB_BUCKETS)
+        return (uint32_t)value;
+    if (value >> LIBIVC_LATENCY_MAX_BITS)
+        return LIBIVC_LATENCY_BUCKETS - 1;
+
+    while (value >> (exponent + 1))
+        exponent++;
+
+    // The top LIBIVC_LATENCY_SUB_BUCKET_BITS + 1 bits pick the bucket within
+    // the row for this power of two.
+    return ((exponent - LIBIVC_LATENCY_SUB_BUCKET_BITS + 1) << LIBIVC_LATENCY_SUB_BUCKET_BITS) +
+        (uint32_t)(value >> (exponent - LIBIVC_LATENCY_SUB_BUCKET_BITS)) - LATENCY_SUB_BUCKETS;
+}
+
+/**
+ * Records a value in a histogram. Called with stats_lock held.
+ */
+static void
+latency_record(struct libivc_latency_histogram *histogram, uint64_t value)
+{
+    if (histogram->count == 0 || value < histogram->min_ns)
+        histogram->min_ns = value;
+    if (value > histogram->max_ns)
+        histogram->max_ns = value;
+
+    histogram->count++;
+    histogram->total_ns += value;
+    histogram->buckets[latency_bucket_of(value)]++;
+}
+
+/**
+ * Gets the time from one of the remote's timestamps to one of ours, or zero if
+ * it appears negative. Called with stats_lock held.
+ */
+static uint64_t
+latency_since_remote(struct libivc_latency *lt, uint64_t remote_ns, uint64_t local_ns, uint8_t *clamped)
+{
+    int64_t elapsed = (int64_t)(local_ns - (remote_ns - (uint64_t)lt->stats.clock_offset_ns));
+
+    if (elapsed < 0)
+    {
+        *clamped = 1;
+        return 0;
+    }
+
+    return (uint64_t)elapsed;
+}
+
+/**
+ * Gets the largest frame the client's outgoing ring can ever hold.
+ */
+static size_t
+latency_max_frame(struct libivc_latency *lt)
+{
+    struct ringbuffer_channel_t *channel;
+
+    channel = &lt->client->ringbuffer->channels[lt->client->server_side ? 1 : 0];
+    return (size_t)(channel->body_length - 1);
+}
+
+/**
+ * Writes a frame to the ring, stamping its publish time. Called with tx_lock held.
+ * @return SUCCESS, NO_SPACE if the ring doesn't have room for it right now, or
+ *    appropriate error number.
+ */
+static int
+latency_write_frame(struct libivc_latency *lt, struct libivc_latency_header *header, char *body)
+{
+    size_t space = 0;
+    int rc;
+
+    libivc_assert(sizeof(*header) + header->length <= latency_max_frame(lt), INVALID_PARAM);
+
+    rc = libivc_getAvailableSpace(lt->client, &space);
+    if (rc != SUCCESS)
+        return rc;
+    if (space < sizeof(*header) + header->length)
+        return NO_SPACE;
+
+    // Cork around the header and body, so the remote sees a single event per frame.
+    libivc_cork(lt->client);
+    header->publish_ns = libivc_monotonic_ns();
+    rc = libivc_send(lt->client, (char *)header, sizeof(*header));
+    if (rc == SUCCESS && header->length)
+        rc = libivc_send(lt->client, body, header->length);
+    libivc_uncork(lt->client);
+
+    return rc;
+}
+
+/**
+ * Sends any calibration frames that didn't fit in the ring when they were
+ * due. Called with rx_lock held.
+ */
+static void
+latency_flush_calibration(struct libivc_latency *lt)
+{
+    struct libivc_latency_header header;
+
+    pthread_mutex_lock(&lt->tx_lock);
+
+    if (lt->reply_pending && latency_write_frame(lt, &lt->reply, NULL) == SUCCESS)
+        lt->reply_pending = 0;
+
+    if (lt->cal_request_pending)
+    {
+        memset(&header, 0, sizeof(header));
+        header.type = LATENCY_FRAME_CALIBRATE;
+        header.sequence = (uint16_t)(lt->cal_sequence + 1);
+        header.origin_ns = libivc_monotonic_ns();
+        if (latency_write_frame(lt, &header, NULL) == SUCCESS)
+        {
+            lt->cal_sequence = header.sequence;
+            lt->cal_request_pending = 0;
+            lt->cal_awaiting_reply = 1;
+        }
+    }
+
+    pthread_mutex_unlock(&lt->tx_lock);
+}
+
+/**
+ * Handles a calibration frame taken from the ring. Called with rx_lock held.
+ * @param header - the frame's header.
+ * @param now - when it was picked up.
+ */
+static void
+latency_handle_calibration(struct libivc_latency *lt, struct libivc_latency_header *header, uint64_t now)
+{
+    int64_t offset;
+    uint64_t rtt;
+
+    if (header->type == LATENCY_FRAME_CALIBRATE)
+    {
+        // Answer it as soon as there's room; the remote only needs the latest.
+        memset(&lt->reply, 0, sizeof(lt->reply));
+        lt->reply.type = LATENCY_FRAME_CALIBRATE_REPLY;
+        lt->reply.sequence = header->sequence;
+        lt->reply.origin_ns = header->origin_ns;
+        lt->reply.remote_ns = now;
+        lt->reply_pending = 1;
+        return;
+    }
+
+    if (header->type != LATENCY_FRAME_CALIBRATE_REPLY)
+    {
+        libivc_error_ratelimited("Dropping a frame of unknown type %u from dom%u:%u.\n",
+            header->type, lt->client->remote_domid, lt->client->port);
+        return;
+    }
+
+    // Replies to requests from an earlier pass are of no use.
+    if (!lt->cal_awaiting_reply || header->sequence != lt->cal_sequence)
+        return;
+    lt->cal_awaiting_reply = 0;
+
+    // The usual estimate: the round trip less the time the remote held the
+    // request, and the midpoint of the remote's hold against ours.
+    rtt = (now - header->origin_ns) - (header->publish_ns - header->remote_ns);
+    if ((int64_t)rtt < 0)
+        rtt = 0;
+    offset = ((int64_t)(header->remote_ns - header->origin_ns) +
+              (int64_t)(header->publish_ns - now)) / 2;
+
+    if (lt->cal_rounds == 0 || rtt < lt->cal_best_rtt)
+    {
+        lt->cal_best_rtt = rtt;
+        lt->cal_best_offset = offset;
+    }
+
+    if (++lt->cal_rounds < LIBIVC_LATENCY_CALIBRATION_ROUNDS)
+    {
+        lt->cal_request_pending = 1;
+        return;
+    }
+
+    pthread_mutex_lock(&lt->stats_lock);
+    lt->stats.calibrated = 1;
+    lt->stats.clock_offset_ns = lt->cal_best_offset;
+    lt->stats.calibration_rtt_ns = lt->cal_best_rtt;
+    pthread_mutex_unlock(&lt->stats_lock);
+
+    libivc_info("Calibrated dom%u:%u's clock at %lldns from ours, +/- %lluns.\n",
+        lt->client->remote_domid, lt->client->port, (long long)lt->cal_best_offset,
+        (unsigned long long)(lt->cal_best_rtt / 2));
+}
+
+/**
+ * Takes any calibration frames waiting at the head of the ring, leaving data
+ * frames for libivc_latency_recv, and sends whatever they call for. Called
+ * with rx_lock held.
+ */
+static void
+latency_service(struct libivc_latency *lt)
+{
+    struct libivc_segment segments[2];
+    struct libivc_latency_header header;
+    size_t available = 0, first;
+
+    latency_flush_calibration(lt);
+
+    while (!lt->rx_have_header)
+    {
+        if (libivc_getAvailableData(lt->client, &available) != SUCCESS || available < sizeof(header))
+            break;
+        if (libivc_peek(lt->client, segments, &available) != SUCCESS)
+            break;
+
+        // The header may wrap around the end of the ring.
+        first = segments[0].length < sizeof(header) ? segments[0].length : sizeof(header);
+        memcpy(&header, segments[0].base, first);
+        if (first < sizeof(header))
+            memcpy((char *)&header + first, segments[1].base, sizeof(header) - first);
+
+        if (header.type == LATENCY_FRAME_DATA)
+            break;
+
+        if (libivc_consume(lt->client, sizeof(header)) != SUCCESS)
+            break;
+
+        latency_handle_calibration(lt, &header, libivc_monotonic_ns());
+        latency_flush_calibration(lt);
+    }
+}
+
+/**
+ * Creates a tracer on top of a connected client.
+ * @return SUCCESS or appropriate error number.
+ */
+int
+libivc_latency_create(struct libivc_latency **lt, struct libivc_client *client)
+{
+    struct libivc_latency *ilt = NULL;
+
+    libivc_checkp(lt, INVALID_PARAM);
+    libivc_checkp(client, INVALID_PARAM);
+    libivc_checkp(client->ringbuffer, INVALID_PARAM);
+
+    ilt = (struct libivc_latency *) malloc(sizeof(struct libivc_latency));
+    libivc_checkp(ilt, OUT_OF_MEM);
+    memset(ilt, 0, sizeof(struct libivc_latency));
+
+    ilt->client = client;
+    pthread_mutex_init(&ilt->tx_lock, NULL);
+    pthread_mutex_init(&ilt->rx_lock, NULL);
+    pthread_mutex_init(&ilt->stats_lock, NULL);
+
+    // Start the first calibration pass; if the ring is full, it goes out with
+    // the next send or receive.
+    ilt->cal_request_pending = 1;
+    pthread_mutex_lock(&ilt->rx_lock);
+    latency_flush_calibration(ilt);
+    pthread_mutex_unlock(&ilt->rx_lock);
+
+    *lt = ilt;
+    return SUCCESS;
+}
+
+/**
+ * Destroys a tracer.
+ */
+void
+libivc_latency_destroy(struct libivc_latency *lt)
+{
+    libivc_checkp(lt);
+
+    pthread_mutex_destroy(&lt->tx_lock);
+    pthread_mutex_destroy(&lt->rx_lock);
+    pthread_mutex_destroy(&lt->stats_lock);
+
+    memset(lt, 0, sizeof(struct libivc_latency));
+    free(lt);
+}
+
+/**
+ * Gets the clock messages are timed with.
+ * @return the current time, in nanoseconds.
+ */
+uint64_t
+libivc_latency_now(void)
+{
+    return libivc_monotonic_ns();
+}
+
+/**
+ * Sends a message, originating now.
+ * @return SUCCESS, NO_SPACE if the ring doesn't have room for the frame right
+ *    now, or appropriate error number.
+ */
+int
+libivc_latency_send(struct libivc_latency *lt, char *src, size_t srcSize)
+{
+    return libivc_latency_send_at(lt, src, srcSize, libivc_monotonic_ns());
+}
+
+/**
+ * Sends a message that originated earlier.
+ * @return SUCCESS, NO_SPACE if the ring doesn't have room for the frame right
+ *    now, or appropriate error number.
+ */
+int
+libivc_latency_send_at(struct libivc_latency *lt, char *src, size_t srcSize, uint64_t origin_ns)
+{
+    struct libivc_latency_header header;
+    int rc;
+
+    libivc_checkp(lt, INVALID_PARAM);
+    libivc_checkp(src, INVALID_PARAM);
+    libivc_assert(srcSize > 0 && srcSize <= UINT32_MAX, INVALID_PARAM);
+
+    // A sender that never receives must still answer the remote's calibration.
+    pthread_mutex_lock(&lt->rx_lock);
+    latency_service(lt);
+    pthread_mutex_unlock(&lt->rx_lock);
+
+    memset(&header, 0, sizeof(header));
+    header.type = LATENCY_FRAME_DATA;
+    header.length = (uint32_t)srcSize;
+    header.origin_ns = origin_ns;
+
+    pthread_mutex_lock(&lt->tx_lock);
+    rc = latency_write_frame(lt, &header, src);
+    pthread_mutex_unlock(&lt->tx_lock);
+
+    if (rc == SUCCESS)
+    {
+        pthread_mutex_lock(&lt->stats_lock);
+        lt->stats.messages_sent++;
+        pthread_mutex_unlock(&lt->stats_lock);
+    }
+
+    return rc;
+}
+
+/**
+ * Skips what has arrived of a malformed frame's body. Called with rx_lock held.
+ * @return SUCCESS once the whole body is skipped, NO_DATA_AVAIL while more of
+ *    it is still to come, or appropriate error number.
+ */
+static int
+latency_discard(struct libivc_latency *lt)
+{
+    size_t available = 0, n;
+    int rc;
+
+    rc = libivc_getAvailableData(lt->client, &available);
+    if (rc != SUCCESS && rc != NO_DATA_AVAIL)
+        return rc;
+
+    n = available < lt->rx_discard ? available : lt->rx_discard;
+    rc = libivc_consume(lt->client, n);
+    if (rc != SUCCESS)
+        return rc;
+
+    lt->rx_discard -= n;
+    return lt->rx_discard ? NO_DATA_AVAIL : SUCCESS;
+}
+
+/**
+ * Receives a message, recording its latencies. Malformed frames are dropped,
+ * and skipped as their bodies arrive.
+ * @return SUCCESS, NO_DATA_AVAIL if no message has arrived, NO_SPACE if dest is
+ *    too small, INVALID_PARAM if the frame was malformed, or appropriate error
+ *    number.
+ */
+int
+libivc_latency_recv(struct libivc_latency *lt, char *dest, size_t destSize, size_t *actualSize)
+{
+    struct libivc_latency_header header;
+    size_t available = 0;
+    uint64_t delivered;
+    uint8_t clamped = 0;
+    int rc;
+
+    libivc_checkp(lt, INVALID_PARAM);
+    libivc_checkp(dest, INVALID_PARAM);
+    libivc_checkp(actualSize, INVALID_PARAM);
+
+    pthread_mutex_lock(&lt->rx_lock);
+    latency_flush_calibration(lt);
+
+    if (lt->rx_discard)
+    {
+        rc = latency_discard(lt);
+        if (rc != SUCCESS)
+            goto END;
+    }
+
+    // The header and body are published together, but the header is kept once
+    // read, in case dest turns out to be too small.
+    while (!lt->rx_have_header)
+    {
+        rc = libivc_recv(lt->client, (char *)&header, sizeof(header));
+        if (rc != SUCCESS)
+            goto END;
+
+        if (header.type != LATENCY_FRAME_DATA)
+        {
+            latency_handle_calibration(lt, &header, libivc_monotonic_ns());
+            latency_flush_calibration(lt);
+            continue;
+        }
+
+        // The length comes from the remote; a frame the ring couldn't hold
+        // whole would otherwise be waited on forever.
+        if (header.length > latency_max_frame(lt) - sizeof(header))
+        {
+            libivc_error_ratelimited("Dropping a malformed %uB message from dom%u:%u.\n",
+                header.length, lt->client->remote_domid, lt->client->port);
+            lt->rx_discard = header.length;
+            rc = latency_discard(lt);
+            if (rc == SUCCESS || rc == NO_DATA_AVAIL)
+                rc = INVALID_PARAM;
+            goto END;
+        }
+
+        lt->rx_header = header;
+        lt->rx_picked_up = libivc_monotonic_ns();
+        lt->rx_have_header = 1;
+    }
+
+    *actualSize = lt->rx_header.length;
+    if (destSize < lt->rx_header.length)
+    {
+        rc = NO_SPACE;
+        goto END;
+    }
+
+    rc = libivc_getAvailableData(lt->client, &available);
+    if (rc != SUCCESS)
+        goto END;
+    if (available < lt->rx_header.length)
+    {
+        rc = NO_DATA_AVAIL;
+        goto END;
+    }
+
+    rc = libivc_recv(lt->client, dest, lt->rx_header.length);
+    if (rc != SUCCESS)
+        goto END;
+
+    delivered = libivc_monotonic_ns();
+    lt->rx_have_header = 0;
+
+    pthread_mutex_lock(&lt->stats_lock);
+    lt->stats.messages_received++;
+    if (!lt->stats.calibrated)
+    {
+        lt->stats.messages_untimed++;
+    }
+    else
+    {
+        latency_record(&lt->histograms[LIBIVC_LATENCY_QUEUEING],
+            latency_since_remote(lt, lt->rx_header.publish_ns, lt->rx_picked_up, &clamped));
+        latency_record(&lt->histograms[LIBIVC_LATENCY_END_TO_END],
+            latency_since_remote(lt, lt->rx_header.origin_ns, delivered, &clamped));
+        if (clamped)
+            lt->stats.messages_clamped++;
+    }
+    pthread_mutex_unlock(&lt->stats_lock);
+
+END:
+    pthread_mutex_unlock(&lt->rx_lock);
+    return rc;
+}
+
+/**
+ * Starts calibrating the clock offset again.
+ * @return SUCCESS or appropriate error number.
+ */
+int
+libivc_latency_calibrate(struct libivc_latency *lt)
+{
+    libivc_checkp(lt, INVALID_PARAM);
+
+    pthread_mutex_lock(&lt->rx_lock);
+    lt->cal_rounds = 0;
+    lt->cal_awaiting_reply = 0;
+    lt->cal_request_pending = 1;
+    latency_flush_calibration(lt);
+    pthread_mutex_unlock(&lt->rx_lock);
+
+    return SUCCESS;
+}
+
+/**
+ * Gets a snapshot of a tracer's counters.
+ * @return SUCCESS or appropriate error number.
+ */
+int
+libivc_latency_get_stats(struct libivc_latency *lt, struct libivc_latency_stats *stats)
+{
+    libivc_checkp(lt, INVALID_PARAM);
+    libivc_checkp(stats, INVALID_PARAM);
+
+    pthread_mutex_lock(&lt->stats_lock);
+    *stats = lt->stats;
+    pthread_mutex_unlock(&lt->stats_lock);
+
+    return SUCCESS;
+}
+
+/**
+ * Gets a snapshot of one of a tracer's histograms.
+ * @return SUCCESS or appropriate error number.
+ */
+int
+libivc_latency_get_histogram(struct libivc_latency *lt, LIBIVC_LATENCY_KIND_T kind,
+    struct libivc_latency_histogram *histogram)
+{
+    libivc_checkp(lt, INVALID_PARAM);
+    libivc_checkp(histogram, INVALID_PARAM);
+    libivc_assert(kind == LIBIVC_LATENCY_QUEUEING || kind == LIBIVC_LATENCY_END_TO_END, INVALID_PARAM);
+
+    pthread_mutex_lock(&lt->stats_lock);
+    *histogram = lt->histograms[kind];
+    pthread_mutex_unlock(&lt->stats_lock);
+
+    return SUCCESS;
+}
+
+/**
+ * Empties a tracer's histograms.
+ * @return SUCCESS or appropriate error number.
+ */
+int
+libivc_latency_reset(struct libivc_latency *lt)
+{
+    libivc_checkp(lt, INVALID_PARAM);
+
+    pthread_mutex_lock(&lt->stats_lock);
+    memset(lt->histograms, 0, sizeof(lt->histograms));
+    pthread_mutex_unlock(&lt->stats_lock);
+
+    return SUCCESS;
+}
+
+/**
+ * Gets the smallest value recorded in a histogram bucket.
+ * @return the bucket's lower bound, in nanoseconds.
+ */
+uint64_t
+libivc_latency_bucket_floor(uint32_t bucket)
+{
+    uint32_t row;
+
+    if (bucket >= LIBIVC_LATENCY_BUCKETS)
+        bucket = LIBIVC_LATENCY_BUCKETS - 1;
+
+    row = bucket >> LIBIVC_LATENCY_SUB_BUCKET_BITS;
+    if (row == 0)
+        return bucket;
+
+    return ((uint64_t)LATENCY_SUB_BUCKETS + (bucket & (LATENCY_SUB_BUCKETS - 1))) << (row - 1);
+}
+
+/**
+ * Estimates a percentile of the values in a histogram.
+ * @return the largest value in the percentile's bucket, capped at the
+ *    histogram's maximum, or 0 if it's empty.
+ */
+uint64_t
+libivc_latency_percentile(const struct libivc_latency_histogram *histogram, double percentile)
+{
+    uint64_t target, seen = 0;
+    uint32_t i;
+
+    libivc_checkp(histogram, 0);
+    if (histogram->count == 0)
+        return 0;
+
+    if (percentile < 0.0)
+        percentile = 0.0;
+    if (percentile > 100.0)
+        percentile = 100.0;
+
+    // The rank of the value wanted, counting from one.
+    target = (uint64_t)((percentile / 100.0) * (double)histogram->count + 0.5);
+    if (target == 0)
+        target = 1;
+
+    for (i = 0; i < LIBIVC_LATENCY_BUCKETS - 1; i++)
+    {
+        seen += histogram->buckets[i];
+        if (seen >= target)
+            break;
+    }
+
+    if (i == LIBIVC_LATENCY_BUCKETS - 1 || libivc_latency_bucket_floor(i + 1) - 1 > histogram->max_ns)
+        return histogram->max_ns;
+
+    return libivc_latency_bucket_floor(i + 1) - 1;
+}
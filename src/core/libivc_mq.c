@@ -0,0 +1,421 @@
+//
+// IVC Driver
+//
+// Copyright (C) 2016 Assured Information Security, Inc. All rights reserved.
+//
+
+#define _GNU_SOURCE // for pthread_setaffinity_np
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <poll.h>
+#include <sched.h>
+#include <list.h>
+
+#include <libivc.h>
+#include <libivc_types.h>
+#include <libivc_private.h>
+#include <libivc_async.h>
+#include <libivc_mq.h>
+#include <libivc_debug.h>
+
+struct libivc_mq {
+    list_head_t node;                 // for tracking in a server's list of incomplete connections.
+    uint16_t remote_domid;            // the domain on the other end.
+    uint16_t port;                    // the port the queues are connected on.
+    uint64_t base_connection_id;      // the connection ID of queue 0.
+    uint32_t num_queues;              // the number of queues.
+    uint32_t num_connected;           // the number of queues that have arrived, server side.
+    uint64_t first_arrival;           // libivc_monotonic_ns() when the first of them arrived, server side.
+    uint32_t next_queue;              // the next queue for round-robin steering.
+    struct libivc_client *queues[LIBIVC_MQ_MAX_QUEUES]; // each queue's client.
+};
+
+struct libivc_mq_server {
+    pthread_mutex_t lock;             // guards incomplete.
+    list_head_t incomplete;           // connections still waiting for some of their queues.
+    uint32_t num_queues;              // the number of queues clients connect with.
+    libivc_mq_ready ready;            // called as each connection completes.
+    void *opaque;                     // passed to ready.
+};
+
+/**
+ * Pins each queue's event thread to a CPU, round-robin, so the queues'
+ * events are handled in parallel. Best effort.
+ */
+static void
+libivc_mq_pin(struct libivc_mq *mq)
+{
+#ifdef __linux
+    cpu_set_t cpus;
+    long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+    uint32_t i;
+
+    if (ncpus <= 1)
+        return;
+
+    for (i = 0; i < mq->num_queues; i++)
+    {
+        CPU_ZERO(&cpus);
+        CPU_SET(i % ncpus, &cpus);
+        if (pthread_setaffinity_np(mq->queues[i]->client_event_thread, sizeof(cpus), &cpus) != 0)
+            libivc_warn("Failed to pin queue %u of dom%u:%u to CPU %ld.\n", i,
+                mq->remote_domid, mq->port, i % ncpus);
+    }
+#endif
+}
+
+/**
+ * Opens a multi-queue connection to a remote server.
+ * @return SUCCESS or appropriate error number.
+ */
+int
+libivc_mq_connect(struct libivc_mq **mq, uint16_t remote_dom_id, uint16_t remote_port,
+    uint32_t numPages, uint32_t num_queues, uint64_t base_connection_id)
+{
+    struct libivc_mq *imq = NULL;
+    struct libivc_connect_op *ops[LIBIVC_MQ_MAX_QUEUES];
+    struct pollfd fds[LIBIVC_MQ_MAX_QUEUES];
+    uint32_t i, started = 0, pending = 0;
+    int rc = SUCCESS, qrc;
+
+    libivc_checkp(mq, INVALID_PARAM);
+    libivc_assert(num_queues > 0 && num_queues <= LIBIVC_MQ_MAX_QUEUES, INVALID_PARAM);
+    libivc_assert(base_connection_id % num_queues == 0, INVALID_PARAM);
+    libivc_assert(base_connection_id + num_queues - 1 < LIBIVC_ID_NONE, INVALID_PARAM);
+
+    imq = (struct libivc_mq *) malloc(sizeof(struct libivc_mq));
+    libivc_checkp(imq, OUT_OF_MEM);
+    memset(imq, 0, sizeof(struct libivc_mq));
+    INIT_LIST_HEAD(&imq->node);
+
+    imq->remote_domid = remote_dom_id;
+    imq->port = remote_port;
+    imq->base_connection_id = base_connection_id;
+    imq->num_queues = num_queues;
+
+    // Connect all of the queues at once, rather than a handshake at a time.
+    memset(ops, 0, sizeof(ops));
+    for (i = 0; i < num_queues; i++)
+    {
+        rc = libivc_connect_async(&ops[i], remote_dom_id, remote_port, numPages,
+            base_connection_id + i, NULL, NULL);
+        if (rc != SUCCESS)
+            break;
+        started++;
+    }
+
+    pending = started;
+    while (pending > 0)
+    {
+        for (i = 0; i < started; i++)
+        {
+            fds[i].fd = ops[i] ? libivc_connect_async_fd(ops[i]) : -1;
+            fds[i].events = POLLIN;
+            fds[i].revents = 0;
+        }
+
+        if (poll(fds, started, -1) < 0)
+        {
+            if (errno == EINTR)
+                continue;
+
+            libivc_error("Failed to wait for the queues of dom%u:%u to connect: %d\n",
+                remote_dom_id, remote_port, errno);
+            for (i = 0; i < started; i++)
+            {
+                if (ops[i])
+                    libivc_connect_async_cancel(ops[i]);
+            }
+            rc = INTERNAL_ERROR;
+            break;
+        }
+
+        for (i = 0; i < started; i++)
+        {
+            if (!ops[i] || !(fds[i].revents & POLLIN))
+                continue;
+
+            qrc = libivc_connect_async_finish(ops[i], &imq->queues[i]);
+            if (qrc == ERROR_AGAIN)
+                continue;
+
+            ops[i] = NULL;
+            pending--;
+            if (qrc != SUCCESS)
+            {
+                libivc_error("Failed to connect queue %u of %u to dom%u:%u: %d\n", i + 1,
+                    num_queues, remote_dom_id, remote_port, qrc);
+                imq->queues[i] = NULL;
+                if (rc == SUCCESS)
+                    rc = qrc;
+            }
+        }
+    }
+
+    if (rc != SUCCESS)
+    {
+        libivc_mq_destroy(imq);
+        return rc;
+    }
+
+    libivc_mq_pin(imq);
+
+    *mq = imq;
+    return SUCCESS;
+}
+
+/**
+ * Disconnects every queue of a multi-queue connection and destroys it.
+ */
+void
+libivc_mq_destroy(struct libivc_mq *mq)
+{
+    uint32_t i;
+
+    libivc_checkp(mq);
+
+    for (i = 0; i < mq->num_queues; i++)
+    {
+        if (mq->queues[i])
+            libivc_disconnect(mq->queues[i]);
+    }
+
+    memset(mq, 0, sizeof(struct libivc_mq));
+    free(mq);
+}
+
+/**
+ * Gets the number of queues in a multi-queue connection.
+ * @return the number of queues.
+ */
+uint32_t
+libivc_mq_num_queues(struct libivc_mq *mq)
+{
+    libivc_checkp(mq, 0);
+    return mq->num_queues;
+}
+
+/**
+ * Gets the client behind one queue.
+ * @return the queue's client, or NULL if there is no such queue.
+ */
+struct libivc_client *
+libivc_mq_queue(struct libivc_mq *mq, uint32_t queue)
+{
+    libivc_checkp(mq, NULL);
+    libivc_assert(queue < mq->num_queues, NULL);
+
+    return mq->queues[queue];
+}
+
+/**
+ * Picks the queue for a key.
+ * @return the queue's index.
+ */
+uint32_t
+libivc_mq_select(struct libivc_mq *mq, uint64_t key)
+{
+    libivc_checkp(mq, 0);
+
+    if (key == LIBIVC_MQ_ROUND_ROBIN)
+        return __sync_fetch_and_add(&mq->next_queue, 1) % mq->num_queues;
+
+    // Fibonacci hashing, so that keys that differ only in their low bits (such
+    // as sequential IDs) still spread evenly.
+    return (uint32_t)(((key * 0x9E3779B97F4A7C15ULL) >> 32) % mq->num_queues);
+}
+
+/**
+ * Sends a message on the queue picked by libivc_mq_select.
+ * @return SUCCESS or appropriate error number.
+ */
+int
+libivc_mq_send(struct libivc_mq *mq, uint64_t key, char *src, size_t srcSize)
+{
+    libivc_checkp(mq, INVALID_PARAM);
+    return libivc_send(mq->queues[libivc_mq_select(mq, key)], src, srcSize);
+}
+
+/**
+ * Creates the server side bookkeeping for multi-queue connections.
+ * @return SUCCESS or appropriate error number.
+ */
+int
+libivc_mq_server_create(struct libivc_mq_server **server, uint32_t num_queues,
+    libivc_mq_ready readyCallback, void *opaque)
+{
+    struct libivc_mq_server *iserver = NULL;
+
+    libivc_checkp(server, INVALID_PARAM);
+    libivc_checkp(readyCallback, INVALID_PARAM);
+    libivc_assert(num_queues > 0 && num_queues <= LIBIVC_MQ_MAX_QUEUES, INVALID_PARAM);
+
+    iserver = (struct libivc_mq_server *) malloc(sizeof(struct libivc_mq_server));
+    libivc_checkp(iserver, OUT_OF_MEM);
+    memset(iserver, 0, sizeof(struct libivc_mq_server));
+
+    pthread_mutex_init(&iserver->lock, NULL);
+    INIT_LIST_HEAD(&iserver->incomplete);
+    iserver->num_queues = num_queues;
+    iserver->ready = readyCallback;
+    iserver->opaque = opaque;
+
+    *server = iserver;
+    return SUCCESS;
+}
+
+/**
+ * Disconnects the queues of any incomplete connections, and destroys the object.
+ */
+void
+libivc_mq_server_destroy(struct libivc_mq_server *server)
+{
+    list_head_t *pos = NULL, *temp = NULL;
+    struct libivc_mq *mq = NULL;
+
+    libivc_checkp(server);
+
+    list_for_each_safe(pos, temp, &server->incomplete)
+    {
+        mq = list_entry(pos, struct libivc_mq, node);
+        list_del(pos);
+        libivc_mq_destroy(mq);
+    }
+
+    pthread_mutex_destroy(&server->lock);
+    memset(server, 0, sizeof(struct libivc_mq_server));
+    free(server);
+}
+
+/**
+ * Moves incomplete connections that have waited too long for the rest of their
+ * queues onto a list of connections to drop. The server's lock must be held.
+ */
+static void
+libivc_mq_server_expire_locked(struct libivc_mq_server *server, list_head_t *stale)
+{
+    list_head_t *pos = NULL, *temp = NULL;
+    struct libivc_mq *mq = NULL;
+    uint64_t now = libivc_monotonic_ns();
+
+    list_for_each_safe(pos, temp, &server->incomplete)
+    {
+        mq = list_entry(pos, struct libivc_mq, node);
+        if (now - mq->first_arrival >= (uint64_t)LIBIVC_MQ_INCOMPLETE_TIMEOUT_MS * 1000000)
+            list_move_tail(pos, stale);
+    }
+}
+
+/**
+ * Disconnects the queues that did arrive of incomplete connections being
+ * dropped. Must be called without the server's lock.
+ */
+static void
+libivc_mq_server_drop(list_head_t *stale)
+{
+    list_head_t *pos = NULL, *temp = NULL;
+    struct libivc_mq *mq = NULL;
+
+    list_for_each_safe(pos, temp, stale)
+    {
+        mq = list_entry(pos, struct libivc_mq, node);
+        libivc_warn("Dropping connection %llu from dom%u:%u, with only %u of its %u queues.\n",
+            (unsigned long long)mq->base_connection_id, mq->remote_domid, mq->port,
+            mq->num_connected, mq->num_queues);
+        list_del(pos);
+        libivc_mq_destroy(mq);
+    }
+}
+
+/**
+ * Hands a newly connected client to the server side bookkeeping.
+ * @return SUCCESS or appropriate error number.
+ */
+int
+libivc_mq_server_add(struct libivc_mq_server *server, struct libivc_client *client)
+{
+    list_head_t *pos = NULL;
+    list_head_t stale;
+    struct libivc_mq *mq = NULL, *candidate = NULL;
+    uint64_t connection_id, base;
+    uint32_t queue;
+    uint16_t domid = 0, port = 0;
+
+    libivc_checkp(server, INVALID_PARAM);
+    libivc_checkp(client, INVALID_PARAM);
+
+    connection_id = libivc_get_connection_id(client);
+    libivc_assert(connection_id != LIBIVC_ID_NONE, INVALID_PARAM);
+    libivc_getRemoteDomId(client, &domid);
+    libivc_getport(client, &port);
+
+    queue = (uint32_t)(connection_id % server->num_queues);
+    base = connection_id - queue;
+    INIT_LIST_HEAD(&stale);
+
+    pthread_mutex_lock(&server->lock);
+    libivc_mq_server_expire_locked(server, &stale);
+
+    list_for_each(pos, &server->incomplete)
+    {
+        candidate = list_entry(pos, struct libivc_mq, node);
+        if (candidate->remote_domid == domid && candidate->port == port &&
+            candidate->base_connection_id == base)
+        {
+            mq = candidate;
+            break;
+        }
+    }
+
+    // A remote only connects a queue it has already connected once it has given
+    // up on the connection and started over, so the queues that did arrive are
+    // dead ends.
+    if (mq && mq->queues[queue])
+    {
+        list_move_tail(&mq->node, &stale);
+        mq = NULL;
+    }
+
+    if (!mq)
+    {
+        mq = (struct libivc_mq *) malloc(sizeof(struct libivc_mq));
+        if (!mq)
+        {
+            pthread_mutex_unlock(&server->lock);
+            libivc_mq_server_drop(&stale);
+            return OUT_OF_MEM;
+        }
+
+        memset(mq, 0, sizeof(struct libivc_mq));
+        mq->remote_domid = domid;
+        mq->port = port;
+        mq->base_connection_id = base;
+        mq->num_queues = server->num_queues;
+        mq->first_arrival = libivc_monotonic_ns();
+        list_add_tail(&mq->node, &server->incomplete);
+    }
+
+    mq->queues[queue] = client;
+    mq->num_connected++;
+    if (mq->num_connected < mq->num_queues)
+        mq = NULL;
+    else
+        list_del_init(&mq->node);
+    pthread_mutex_unlock(&server->lock);
+
+    libivc_mq_server_drop(&stale);
+
+    if (mq)
+    {
+        libivc_mq_pin(mq);
+        server->ready(server->opaque, mq);
+    }
+
+    return SUCCESS;
+}
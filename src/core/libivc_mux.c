@@ -0,0 +1,905 @@
+//
+// IVC Driver
+//
+// Copyright (C) 2016 Assured Information Security, Inc. All rights reserved.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+#include <list.h>
+
+#include <libivc.h>
+#include <libivc_types.h>
+#include <libivc_private.h>
+#include <libivc_mux.h>
+#include <ringbuffer.h>
+#include <libivc_debug.h>
+
+#define LIBIVC_MUX_OPEN   0x1
+#define LIBIVC_MUX_DATA   0x2
+#define LIBIVC_MUX_CREDIT 0x3
+#define LIBIVC_MUX_CLOSE  0x4
+
+/**
+ * The most a single stream may send before the other streams get a turn.
+ */
+#define LIBIVC_MUX_QUANTUM 4096
+
+/**
+ * Consumed bytes are handed back to the sender as credit in batches of at
+ * least this size, rather than one credit frame per read.
+ */
+#define LIBIVC_MUX_CREDIT_THRESHOLD (LIBIVC_MUX_STREAM_WINDOW / 4)
+
+#pragma pack(push, 1)
+
+/**
+ * The header that precedes every frame on the wire.
+ */
+struct libivc_mux_header {
+    uint32_t stream_id;               // the stream the frame belongs to.
+    uint32_t length;                  // DATA: length of the body that follows. CREDIT: bytes of credit granted.
+    uint8_t type;                     // one of the LIBIVC_MUX_ frame types.
+    uint8_t reserved[3];
+};
+
+#pragma pack(pop)
+
+/**
+ * A fixed-size circular byte queue, LIBIVC_MUX_STREAM_WINDOW bytes long.
+ */
+struct libivc_mux_buffer {
+    char *data;
+    uint32_t head;                    // offset of the oldest byte.
+    uint32_t count;                   // number of bytes queued.
+};
+
+struct libivc_mux_stream {
+    list_head_t node;                 // for tracking in the multiplexer's stream list.
+    struct libivc_mux *mux;           // the multiplexer that carries this stream.
+    uint32_t id;                      // the stream's ID, shared by both ends.
+    libivc_mux_stream_event event_cb; // called when the stream becomes readable or writable.
+    libivc_mux_stream_closed closed_cb; // called when the remote closes the stream.
+    void *opaque;                     // passed to the callbacks.
+
+    struct libivc_mux_buffer tx;      // data written locally, waiting to be sent.
+    struct libivc_mux_buffer rx;      // data received, waiting to be read locally.
+    uint32_t tx_credit;               // bytes the remote currently has room to receive.
+    uint32_t rx_consumed;             // bytes read locally that haven't yet been returned as credit.
+
+    uint8_t open_pending;             // non zero until the OPEN frame has been sent.
+    uint8_t local_closed;             // non zero once closed locally; CLOSE follows the remaining data.
+    uint8_t close_sent;               // non zero once the CLOSE frame has been sent.
+    uint8_t remote_closed;            // non zero once the remote has closed the stream.
+    uint8_t tx_was_full;              // non zero if a write came up short; report writable once it drains.
+
+    uint8_t notify_opened;            // callbacks waiting to be delivered.
+    uint8_t notify_event;
+    uint8_t notify_closed;
+};
+
+struct libivc_mux {
+    struct libivc_client *client;     // the connection the streams are carried over.
+    libivc_mux_stream_opened opened_cb; // called when the remote opens a stream.
+    void *opaque;                     // passed to opened_cb.
+
+    pthread_mutex_t lock;             // recursive, so callbacks may call back into the mux.
+    list_head_t streams;              // open streams, in round-robin order.
+    uint32_t next_id;                 // the ID for the next locally-opened stream.
+    uint32_t max_payload;             // the largest DATA body that fits in the ring.
+
+    uint8_t rx_have_header;           // non zero once rx_header holds the current frame's header.
+    struct libivc_mux_header rx_header; // the header of the frame currently being received.
+    uint8_t delivering;               // non zero while callbacks are being run.
+    uint8_t broken;                   // non zero once the remote has sent a frame that makes no sense.
+};
+
+
+/**
+ * Copies up to length bytes into a buffer.
+ * @return the number of bytes copied.
+ */
+static uint32_t
+libivc_mux_buffer_put(struct libivc_mux_buffer *buffer, char *src, uint32_t length)
+{
+    uint32_t tail, first;
+
+    if (length > LIBIVC_MUX_STREAM_WINDOW - buffer->count)
+        length = LIBIVC_MUX_STREAM_WINDOW - buffer->count;
+
+    tail = (buffer->head + buffer->count) % LIBIVC_MUX_STREAM_WINDOW;
+    first = LIBIVC_MUX_STREAM_WINDOW - tail;
+    if (first > length)
+        first = length;
+
+    memcpy(buffer->data + tail, src, first);
+    memcpy(buffer->data, src + first, length - first);
+    buffer->count += length;
+
+    return length;
+}
+
+/**
+ * Copies up to length bytes out of a buffer.
+ * @return the number of bytes copied.
+ */
+static uint32_t
+libivc_mux_buffer_get(struct libivc_mux_buffer *buffer, char *dest, uint32_t length)
+{
+    uint32_t first;
+
+    if (length > buffer->count)
+        length = buffer->count;
+
+    first = LIBIVC_MUX_STREAM_WINDOW - buffer->head;
+    if (first > length)
+        first = length;
+
+    memcpy(dest, buffer->data + buffer->head, first);
+    memcpy(dest + first, buffer->data, length - first);
+    buffer->head = (buffer->head + length) % LIBIVC_MUX_STREAM_WINDOW;
+    buffer->count -= length;
+
+    return length;
+}
+
+/**
+ * Receives exactly length bytes from the ring straight into a buffer, which
+ * must have room for them.
+ */
+static int
+libivc_mux_buffer_recv(struct libivc_mux_buffer *buffer, struct libivc_client *client, uint32_t length)
+{
+    uint32_t tail, first;
+    int rc = SUCCESS;
+
+    tail = (buffer->head + buffer->count) % LIBIVC_MUX_STREAM_WINDOW;
+    first = LIBIVC_MUX_STREAM_WINDOW - tail;
+    if (first > length)
+        first = length;
+
+    if (first)
+        rc = libivc_recv(client, buffer->data + tail, first);
+    if (rc == SUCCESS && length > first)
+        rc = libivc_recv(client, buffer->data, length - first);
+
+    if (rc == SUCCESS)
+        buffer->count += length;
+
+    return rc;
+}
+
+/**
+ * Sends exactly length bytes from the front of a buffer to the ring, which
+ * must have room for them.
+ */
+static int
+libivc_mux_buffer_send(struct libivc_mux_buffer *buffer, struct libivc_client *client, uint32_t length)
+{
+    uint32_t first;
+    int rc = SUCCESS;
+
+    first = LIBIVC_MUX_STREAM_WINDOW - buffer->head;
+    if (first > length)
+        first = length;
+
+    if (first)
+        rc = libivc_send(client, buffer->data + buffer->head, first);
+    if (rc == SUCCESS && length > first)
+        rc = libivc_send(client, buffer->data, length - first);
+
+    if (rc == SUCCESS)
+    {
+        buffer->head = (buffer->head + length) % LIBIVC_MUX_STREAM_WINDOW;
+        buffer->count -= length;
+    }
+
+    return rc;
+}
+
+/**
+ * Finds a stream by ID. Assumes the mux lock is held.
+ */
+static struct libivc_mux_stream *
+libivc_mux_find_stream(struct libivc_mux *mux, uint32_t id)
+{
+    list_head_t *pos = NULL;
+
+    list_for_each(pos, &mux->streams)
+    {
+        if (list_entry(pos, struct libivc_mux_stream, node)->id == id)
+            return list_entry(pos, struct libivc_mux_stream, node);
+    }
+
+    return NULL;
+}
+
+/**
+ * Allocates a stream and adds it to the multiplexer. Assumes the mux lock is held.
+ */
+static struct libivc_mux_stream *
+libivc_mux_new_stream(struct libivc_mux *mux, uint32_t id)
+{
+    struct libivc_mux_stream *stream = NULL;
+
+    stream = (struct libivc_mux_stream *) malloc(sizeof(struct libivc_mux_stream));
+    libivc_checkp(stream, NULL);
+    memset(stream, 0, sizeof(struct libivc_mux_stream));
+
+    stream->tx.data = (char *) malloc(LIBIVC_MUX_STREAM_WINDOW);
+    stream->rx.data = (char *) malloc(LIBIVC_MUX_STREAM_WINDOW);
+    if (!stream->tx.data || !stream->rx.data)
+    {
+        free(stream->tx.data);
+        free(stream->rx.data);
+        free(stream);
+        return NULL;
+    }
+
+    stream->mux = mux;
+    stream->id = id;
+    stream->tx_credit = LIBIVC_MUX_STREAM_WINDOW;
+    list_add_tail(&stream->node, &mux->streams);
+
+    return stream;
+}
+
+/**
+ * Removes a stream from the multiplexer and frees it. Assumes the mux lock is held.
+ */
+static void
+libivc_mux_free_stream(struct libivc_mux_stream *stream)
+{
+    list_del(&stream->node);
+    free(stream->tx.data);
+    free(stream->rx.data);
+    memset(stream, 0, sizeof(struct libivc_mux_stream));
+    free(stream);
+}
+
+/**
+ * Writes a frame to the ring, if there is room for it. Assumes the mux lock is held.
+ */
+static int
+libivc_mux_send_frame(struct libivc_mux *mux, struct libivc_mux_stream *stream, uint8_t type,
+    uint32_t length)
+{
+    struct libivc_mux_header header;
+    size_t space = 0;
+    uint32_t body = (type == LIBIVC_MUX_DATA) ? length : 0;
+    int rc;
+
+    rc = libivc_getAvailableSpace(mux->client, &space);
+    libivc_assert(rc == SUCCESS, rc);
+    if (space < sizeof(header) + body)
+        return NO_SPACE;
+
+    memset(&header, 0, sizeof(header));
+    header.stream_id = stream->id;
+    header.length = length;
+    header.type = type;
+
+    rc = libivc_send(mux->client, (char *)&header, sizeof(header));
+    if (rc == SUCCESS && body)
+        rc = libivc_mux_buffer_send(&stream->tx, mux->client, body);
+
+    return rc;
+}
+
+/**
+ * Gives a single stream its turn: sends any pending control frames, and up to a
+ * quantum of data. Frees the stream once both ends have closed it.
+ * Assumes the mux lock is held.
+ * @return a positive number if anything was sent, 0 if there was nothing to send,
+ *    or NO_SPACE if the ring is full.
+ */
+static int
+libivc_mux_service_stream(struct libivc_mux *mux, struct libivc_mux_stream *stream)
+{
+    size_t space = 0;
+    uint32_t chunk;
+    int sent = 0, rc;
+
+    if (stream->open_pending)
+    {
+        rc = libivc_mux_send_frame(mux, stream, LIBIVC_MUX_OPEN, 0);
+        if (rc != SUCCESS)
+            return rc;
+        stream->open_pending = 0;
+        sent = 1;
+    }
+
+    if (!stream->remote_closed && !stream->local_closed &&
+        stream->rx_consumed >= LIBIVC_MUX_CREDIT_THRESHOLD)
+    {
+        rc = libivc_mux_send_frame(mux, stream, LIBIVC_MUX_CREDIT, stream->rx_consumed);
+        if (rc != SUCCESS)
+            return rc;
+        stream->rx_consumed = 0;
+        sent = 1;
+    }
+
+    if (!stream->remote_closed && stream->tx.count && stream->tx_credit)
+    {
+        chunk = stream->tx.count;
+        if (chunk > stream->tx_credit)
+            chunk = stream->tx_credit;
+        if (chunk > mux->max_payload)
+            chunk = mux->max_payload;
+
+        // Send what fits, rather than waiting for room for a whole quantum.
+        libivc_getAvailableSpace(mux->client, &space);
+        if (space <= sizeof(struct libivc_mux_header))
+            return NO_SPACE;
+        if (chunk > space - sizeof(struct libivc_mux_header))
+            chunk = (uint32_t)(space - sizeof(struct libivc_mux_header));
+
+        rc = libivc_mux_send_frame(mux, stream, LIBIVC_MUX_DATA, chunk);
+        if (rc != SUCCESS)
+            return rc;
+
+        stream->tx_credit -= chunk;
+        sent = 1;
+
+        if (stream->tx_was_full && !stream->local_closed)
+        {
+            stream->tx_was_full = 0;
+            stream->notify_event = 1;
+        }
+    }
+
+    if (stream->local_closed && !stream->close_sent &&
+        (stream->tx.count == 0 || stream->remote_closed))
+    {
+        rc = libivc_mux_send_frame(mux, stream, LIBIVC_MUX_CLOSE, 0);
+        if (rc != SUCCESS)
+            return rc;
+        stream->close_sent = 1;
+        sent = 1;
+    }
+
+    if (stream->local_closed && stream->close_sent && stream->remote_closed)
+        libivc_mux_free_stream(stream);
+
+    return sent;
+}
+
+/**
+ * Sends as much pending data as the ring and the streams' credits allow, giving
+ * each stream one turn per round. Each call picks up the rotation where the last
+ * left off. Assumes the mux lock is held.
+ */
+static void
+libivc_mux_pump(struct libivc_mux *mux)
+{
+    struct libivc_mux_stream *stream = NULL;
+    list_head_t *pos = NULL;
+    uint32_t remaining, progress;
+    int rc = SUCCESS;
+
+    // Publish the whole pump under a single remote notification.
+    libivc_cork(mux->client);
+
+    do
+    {
+        progress = 0;
+
+        remaining = 0;
+        list_for_each(pos, &mux->streams)
+            remaining++;
+
+        while (remaining-- && !list_empty(&mux->streams))
+        {
+            stream = list_entry(mux->streams.next, struct libivc_mux_stream, node);
+            list_move_tail(&stream->node, &mux->streams);
+
+            rc = libivc_mux_service_stream(mux, stream);
+            if (rc < 0)
+                break;
+            progress += (uint32_t)rc;
+        }
+    } while (progress && rc >= 0);
+
+    libivc_uncork(mux->client);
+}
+
+/**
+ * Discards a frame body that has nowhere to go.
+ */
+static int
+libivc_mux_discard(struct libivc_mux *mux, uint32_t length)
+{
+    char scratch[256];
+    uint32_t chunk;
+    int rc = SUCCESS;
+
+    while (length && rc == SUCCESS)
+    {
+        chunk = length < sizeof(scratch) ? length : (uint32_t)sizeof(scratch);
+        rc = libivc_recv(mux->client, scratch, chunk);
+        length -= chunk;
+    }
+
+    return rc;
+}
+
+/**
+ * Handles a single frame whose header (and, for DATA, body) has arrived.
+ * Assumes the mux lock is held.
+ */
+static int
+libivc_mux_handle_frame(struct libivc_mux *mux, struct libivc_mux_header *header)
+{
+    struct libivc_mux_stream *stream = libivc_mux_find_stream(mux, header->stream_id);
+
+    switch (header->type)
+    {
+    case LIBIVC_MUX_OPEN:
+        if (stream)
+        {
+            libivc_error("Remote opened mux stream %u, which is already open.\n", header->stream_id);
+            return SUCCESS;
+        }
+
+        stream = libivc_mux_new_stream(mux, header->stream_id);
+        libivc_checkp(stream, OUT_OF_MEM);
+
+        // With no one to hand the stream to, refuse it.
+        if (mux->opened_cb)
+            stream->notify_opened = 1;
+        else
+            stream->local_closed = 1;
+        return SUCCESS;
+
+    case LIBIVC_MUX_DATA:
+        if (!stream || stream->local_closed)
+            return libivc_mux_discard(mux, header->length);
+
+        if (header->length > LIBIVC_MUX_STREAM_WINDOW - stream->rx.count)
+        {
+            libivc_error("Remote overran the window on mux stream %u; dropping %u bytes.\n",
+                header->stream_id, header->length);
+            return libivc_mux_discard(mux, header->length);
+        }
+
+        stream->notify_event = 1;
+        return libivc_mux_buffer_recv(&stream->rx, mux->client, header->length);
+
+    case LIBIVC_MUX_CREDIT:
+        if (stream)
+            stream->tx_credit += header->length;
+        return SUCCESS;
+
+    case LIBIVC_MUX_CLOSE:
+        if (!stream || stream->remote_closed)
+            return SUCCESS;
+
+        // The remote won't read anything else we send.
+        stream->remote_closed = 1;
+        stream->tx.count = 0;
+        if (!stream->local_closed)
+            stream->notify_closed = 1;
+        return SUCCESS;
+
+    default:
+        libivc_error("Received unknown mux frame type %u.\n", header->type);
+        return INTERNAL_ERROR;
+    }
+}
+
+/**
+ * Runs any callbacks that have been queued up. Streams may be closed from within
+ * the callbacks, so we rescan from the start after each one. Callbacks queued by
+ * calls made from within a callback are picked up by the same rescan, rather
+ * than being run recursively. Assumes the mux lock is held.
+ */
+static void
+libivc_mux_deliver(struct libivc_mux *mux)
+{
+    struct libivc_mux_stream *stream = NULL, *found;
+    list_head_t *pos = NULL;
+
+    if (mux->delivering)
+        return;
+
+    mux->delivering = 1;
+    do
+    {
+        found = NULL;
+        list_for_each(pos, &mux->streams)
+        {
+            stream = list_entry(pos, struct libivc_mux_stream, node);
+            if (!stream->local_closed &&
+                (stream->notify_opened || stream->notify_event || stream->notify_closed))
+            {
+                found = stream;
+                break;
+            }
+        }
+
+        if (!found)
+            break;
+
+        if (found->notify_opened)
+        {
+            found->notify_opened = 0;
+            mux->opened_cb(mux->opaque, mux, found);
+        }
+        else if (found->notify_event)
+        {
+            found->notify_event = 0;
+            if (found->event_cb)
+                found->event_cb(found->opaque, found);
+        }
+        else
+        {
+            found->notify_closed = 0;
+            if (found->closed_cb)
+                found->closed_cb(found->opaque, found);
+        }
+    } while (found);
+    mux->delivering = 0;
+}
+
+/**
+ * Client event callback: the remote has published frames, or freed ring space.
+ */
+static void
+libivc_mux_event(void *opaque, struct libivc_client *client)
+{
+    UNUSED(client);
+    libivc_mux_poll((struct libivc_mux *) opaque);
+}
+
+/**
+ * Marks every stream as closed by the remote, which won't read or send
+ * anything more. Assumes the mux lock is held.
+ */
+static void
+libivc_mux_close_all(struct libivc_mux *mux)
+{
+    struct libivc_mux_stream *stream = NULL;
+    list_head_t *pos = NULL;
+
+    list_for_each(pos, &mux->streams)
+    {
+        stream = list_entry(pos, struct libivc_mux_stream, node);
+        if (!stream->remote_closed)
+        {
+            stream->remote_closed = 1;
+            stream->tx.count = 0;
+            stream->notify_closed = 1;
+        }
+    }
+}
+
+/**
+ * Client disconnect callback: every stream is closed by the remote.
+ */
+static void
+libivc_mux_disconnect(void *opaque, struct libivc_client *client)
+{
+    struct libivc_mux *mux = (struct libivc_mux *) opaque;
+
+    UNUSED(client);
+
+    pthread_mutex_lock(&mux->lock);
+    libivc_mux_close_all(mux);
+    libivc_mux_deliver(mux);
+    pthread_mutex_unlock(&mux->lock);
+}
+
+
+/**
+ * Creates a multiplexer on top of a connected client.
+ * @return SUCCESS or appropriate error number.
+ */
+int
+libivc_mux_create(struct libivc_mux **mux, struct libivc_client *client,
+    libivc_mux_stream_opened openedCallback, void *opaque)
+{
+    struct libivc_mux *imux = NULL;
+    pthread_mutexattr_t attr;
+    int32_t body_length;
+    int rc;
+
+    libivc_checkp(mux, INVALID_PARAM);
+    libivc_checkp(client, INVALID_PARAM);
+    libivc_checkp(client->ringbuffer, INVALID_PARAM);
+
+    imux = (struct libivc_mux *) malloc(sizeof(struct libivc_mux));
+    libivc_checkp(imux, OUT_OF_MEM);
+    memset(imux, 0, sizeof(struct libivc_mux));
+
+    imux->client = client;
+    imux->opened_cb = openedCallback;
+    imux->opaque = opaque;
+    INIT_LIST_HEAD(&imux->streams);
+
+    // Each end allocates IDs from its own half of the space, so both can open
+    // streams at once without colliding.
+    imux->next_id = client->server_side ? 2 : 1;
+
+    body_length = client->ringbuffer->channels[client->server_side ? 1 : 0].body_length;
+    imux->max_payload = (uint32_t)(body_length - 1) - sizeof(struct libivc_mux_header);
+    if (imux->max_payload > LIBIVC_MUX_QUANTUM)
+        imux->max_payload = LIBIVC_MUX_QUANTUM;
+
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&imux->lock, &attr);
+    pthread_mutexattr_destroy(&attr);
+
+    rc = libivc_register_event_callbacks(client, libivc_mux_event, libivc_mux_disconnect, imux);
+    if (rc != SUCCESS)
+    {
+        pthread_mutex_destroy(&imux->lock);
+        free(imux);
+        return rc;
+    }
+
+    *mux = imux;
+
+    // Pick up anything the remote sent before we were listening.
+    return libivc_mux_poll(imux);
+}
+
+/**
+ * Destroys a multiplexer, and any streams that are still open.
+ */
+void
+libivc_mux_destroy(struct libivc_mux *mux)
+{
+    list_head_t *pos = NULL, *temp = NULL;
+
+    libivc_checkp(mux);
+
+    list_for_each_safe(pos, temp, &mux->streams)
+    {
+        libivc_mux_free_stream(list_entry(pos, struct libivc_mux_stream, node));
+    }
+
+    pthread_mutex_destroy(&mux->lock);
+    memset(mux, 0, sizeof(struct libivc_mux));
+    free(mux);
+}
+
+/**
+ * Opens a new stream to the remote.
+ * @return SUCCESS or appropriate error number.
+ */
+int
+libivc_mux_open(struct libivc_mux *mux, struct libivc_mux_stream **stream)
+{
+    struct libivc_mux_stream *istream = NULL;
+
+    libivc_checkp(mux, INVALID_PARAM);
+    libivc_checkp(stream, INVALID_PARAM);
+
+    pthread_mutex_lock(&mux->lock);
+    if (mux->broken)
+    {
+        pthread_mutex_unlock(&mux->lock);
+        return PROTOCOL_ERROR;
+    }
+
+    istream = libivc_mux_new_stream(mux, mux->next_id);
+    if (istream)
+    {
+        mux->next_id += 2;
+        istream->open_pending = 1;
+        libivc_mux_pump(mux);
+    }
+    pthread_mutex_unlock(&mux->lock);
+
+    libivc_checkp(istream, OUT_OF_MEM);
+    *stream = istream;
+    return SUCCESS;
+}
+
+/**
+ * Closes a stream. Data already written is still delivered to the remote.
+ * @return SUCCESS or appropriate error number.
+ */
+int
+libivc_mux_close(struct libivc_mux_stream *stream)
+{
+    struct libivc_mux *mux = NULL;
+
+    libivc_checkp(stream, INVALID_PARAM);
+    mux = stream->mux;
+
+    pthread_mutex_lock(&mux->lock);
+    stream->local_closed = 1;
+    stream->event_cb = NULL;
+    stream->closed_cb = NULL;
+    libivc_mux_pump(mux);
+    pthread_mutex_unlock(&mux->lock);
+
+    return SUCCESS;
+}
+
+/**
+ * Registers callbacks for a single stream.
+ * @return SUCCESS or appropriate error number.
+ */
+int
+libivc_mux_register_stream_callbacks(struct libivc_mux_stream *stream,
+    libivc_mux_stream_event eventCallback, libivc_mux_stream_closed closedCallback,
+    void *opaque)
+{
+    libivc_checkp(stream, INVALID_PARAM);
+
+    pthread_mutex_lock(&stream->mux->lock);
+    stream->event_cb = eventCallback;
+    stream->closed_cb = closedCallback;
+    stream->opaque = opaque;
+
+    // Don't lose anything that arrived before the callbacks were registered.
+    if (stream->rx.count)
+        stream->notify_event = 1;
+    if (stream->remote_closed)
+        stream->notify_closed = 1;
+    libivc_mux_deliver(stream->mux);
+    pthread_mutex_unlock(&stream->mux->lock);
+
+    return SUCCESS;
+}
+
+/**
+ * Gets the ID of a stream.
+ */
+uint32_t
+libivc_mux_stream_id(struct libivc_mux_stream *stream)
+{
+    libivc_checkp(stream, 0);
+    return stream->id;
+}
+
+/**
+ * Writes as many bytes as possible, up to srcSize, to a stream.
+ * @return SUCCESS or appropriate error number.
+ */
+int
+libivc_mux_write(struct libivc_mux_stream *stream, char *src, size_t srcSize, size_t *actualSize)
+{
+    struct libivc_mux *mux = NULL;
+    uint32_t length;
+    int rc = SUCCESS;
+
+    libivc_checkp(stream, INVALID_PARAM);
+    libivc_checkp(src, INVALID_PARAM);
+    libivc_checkp(actualSize, INVALID_PARAM);
+    mux = stream->mux;
+
+    length = srcSize > LIBIVC_MUX_STREAM_WINDOW ? LIBIVC_MUX_STREAM_WINDOW : (uint32_t)srcSize;
+    *actualSize = 0;
+
+    pthread_mutex_lock(&mux->lock);
+    if (stream->remote_closed)
+    {
+        rc = NOT_CONNECTED;
+    }
+    else
+    {
+        *actualSize = libivc_mux_buffer_put(&stream->tx, src, length);
+        if (*actualSize < srcSize)
+            stream->tx_was_full = 1;
+        libivc_mux_pump(mux);
+    }
+    pthread_mutex_unlock(&mux->lock);
+
+    return rc;
+}
+
+/**
+ * Reads as many bytes as possible, up to destSize, from a stream.
+ * @return SUCCESS or appropriate error number.
+ */
+int
+libivc_mux_read(struct libivc_mux_stream *stream, char *dest, size_t destSize, size_t *actualSize)
+{
+    struct libivc_mux *mux = NULL;
+    uint32_t length;
+    int rc = SUCCESS;
+
+    libivc_checkp(stream, INVALID_PARAM);
+    libivc_checkp(dest, INVALID_PARAM);
+    libivc_checkp(actualSize, INVALID_PARAM);
+    mux = stream->mux;
+
+    length = destSize > LIBIVC_MUX_STREAM_WINDOW ? LIBIVC_MUX_STREAM_WINDOW : (uint32_t)destSize;
+
+    pthread_mutex_lock(&mux->lock);
+    *actualSize = libivc_mux_buffer_get(&stream->rx, dest, length);
+    if (*actualSize)
+    {
+        // Hand the space back to the sender.
+        stream->rx_consumed += (uint32_t)*actualSize;
+        libivc_mux_pump(mux);
+    }
+    else if (stream->remote_closed)
+    {
+        rc = NOT_CONNECTED;
+    }
+    pthread_mutex_unlock(&mux->lock);
+
+    return rc;
+}
+
+/**
+ * Processes any frames waiting in the ring, and sends any pending data.
+ * @return SUCCESS or appropriate error number.
+ */
+int
+libivc_mux_poll(struct libivc_mux *mux)
+{
+    size_t available = 0, consumed = 0;
+    uint8_t event_enabled = 0;
+    int rc = SUCCESS;
+
+    libivc_checkp(mux, INVALID_PARAM);
+
+    pthread_mutex_lock(&mux->lock);
+    while (!mux->broken && libivc_getAvailableData(mux->client, &available) == SUCCESS)
+    {
+        // The header and body are published separately, so we may see one
+        // without the other; hold on to the header until its body arrives.
+        if (!mux->rx_have_header)
+        {
+            if (available < sizeof(struct libivc_mux_header))
+                break;
+
+            rc = libivc_recv(mux->client, (char *)&mux->rx_header, sizeof(struct libivc_mux_header));
+            if (rc != SUCCESS)
+                break;
+
+            mux->rx_have_header = 1;
+            consumed += sizeof(struct libivc_mux_header);
+            continue;
+        }
+
+        // A body the ring could never hold would otherwise be waited for
+        // forever. Nothing after it can be trusted, so give up on the mux.
+        if (mux->rx_header.type == LIBIVC_MUX_DATA && mux->rx_header.length > mux->max_payload)
+        {
+            libivc_error("Remote sent %u bytes on mux stream %u, more than a frame can carry; giving up on the mux.\n",
+                mux->rx_header.length, mux->rx_header.stream_id);
+            mux->broken = 1;
+            libivc_mux_close_all(mux);
+            break;
+        }
+
+        if (mux->rx_header.type == LIBIVC_MUX_DATA && available < mux->rx_header.length)
+            break;
+
+        rc = libivc_mux_handle_frame(mux, &mux->rx_header);
+        mux->rx_have_header = 0;
+        if (rc != SUCCESS)
+            break;
+
+        if (mux->rx_header.type == LIBIVC_MUX_DATA)
+            consumed += mux->rx_header.length;
+    }
+
+    if (mux->broken)
+        rc = PROTOCOL_ERROR;
+
+    // Credits may have arrived, or the remote may have freed ring space.
+    libivc_mux_pump(mux);
+    libivc_mux_deliver(mux);
+    pthread_mutex_unlock(&mux->lock);
+
+    // Let a remote that is waiting on ring space know we've made some.
+    if (consumed)
+    {
+        libivc_remote_events_enabled(mux->client, &event_enabled);
+        if (event_enabled)
+            libivc_notify_remote(mux->client);
+    }
+
+    return rc;
+}
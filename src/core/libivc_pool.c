@@ -0,0 +1,195 @@
+//
+// IVC Driver
+//
+// Copyright (C) 2016 Assured Information Security, Inc. All rights reserved.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+
+#include <libivc.h>
+#include <libivc_types.h>
+#include <libivc_private.h>
+#include <libivc_pool.h>
+#include <libivc_debug.h>
+
+/**
+ * The port idle clients are recorded against until they're first connected.
+ */
+#define LIBIVC_POOL_IDLE_PORT 0xFFFF
+
+struct libivc_pool {
+    pthread_mutex_t lock;             // guards the fields below.
+    uint16_t remote_domid;            // the domain every client in the pool is granted to.
+    uint32_t num_pages;               // the size of every client's buffer.
+    uint64_t next_connection_id;      // the connection ID for the next client created.
+    struct libivc_client **idle;      // a stack of parked clients; the most recently used on top.
+    uint32_t num_idle;                // the number of clients in idle.
+    uint32_t capacity;                // the most clients idle may hold.
+};
+
+/**
+ * Creates a pool, and warms it with idle clients.
+ * @return SUCCESS or appropriate error number.
+ */
+int
+libivc_pool_create(struct libivc_pool **pool, uint16_t remote_dom_id, uint32_t numPages,
+    uint32_t count, uint64_t base_connection_id)
+{
+    struct libivc_pool *ipool = NULL;
+    struct libivc_client *client = NULL;
+    int rc;
+
+    libivc_checkp(pool, INVALID_PARAM);
+    libivc_assert(numPages > 0, INVALID_PARAM);
+    libivc_assert(count > 0, INVALID_PARAM);
+
+    ipool = (struct libivc_pool *) malloc(sizeof(struct libivc_pool));
+    libivc_checkp(ipool, OUT_OF_MEM);
+    memset(ipool, 0, sizeof(struct libivc_pool));
+
+    ipool->idle = (struct libivc_client **) malloc(count * sizeof(struct libivc_client *));
+    if (!ipool->idle)
+    {
+        free(ipool);
+        return OUT_OF_MEM;
+    }
+
+    ipool->remote_domid = remote_dom_id;
+    ipool->num_pages = numPages;
+    ipool->next_connection_id = base_connection_id;
+    ipool->capacity = count;
+    pthread_mutex_init(&ipool->lock, NULL);
+
+    while (ipool->num_idle < count)
+    {
+        rc = libivc_connect_parked(&client, remote_dom_id, LIBIVC_POOL_IDLE_PORT, numPages,
+            ipool->next_connection_id);
+        if (rc != SUCCESS)
+        {
+            libivc_error("Failed to warm client %u of %u in pool for dom%u: %d\n",
+                ipool->num_idle + 1, count, remote_dom_id, rc);
+            libivc_pool_destroy(ipool);
+            return rc;
+        }
+
+        ipool->next_connection_id++;
+        ipool->idle[ipool->num_idle++] = client;
+    }
+
+    *pool = ipool;
+    return SUCCESS;
+}
+
+/**
+ * Disconnects the pool's idle clients and destroys it.
+ */
+void
+libivc_pool_destroy(struct libivc_pool *pool)
+{
+    libivc_checkp(pool);
+
+    while (pool->num_idle > 0)
+        libivc_disconnect(pool->idle[--pool->num_idle]);
+
+    pthread_mutex_destroy(&pool->lock);
+    free(pool->idle);
+    memset(pool, 0, sizeof(struct libivc_pool));
+    free(pool);
+}
+
+/**
+ * Connects to a server in the pool's domain, preferring an idle client.
+ * @return SUCCESS or appropriate error number.
+ */
+int
+libivc_pool_connect(struct libivc_pool *pool, uint16_t remote_port, struct libivc_client **client)
+{
+    struct libivc_client *iclient = NULL;
+    uint64_t connection_id = 0;
+    int rc;
+
+    libivc_checkp(pool, INVALID_PARAM);
+    libivc_checkp(client, INVALID_PARAM);
+
+    pthread_mutex_lock(&pool->lock);
+    if (pool->num_idle > 0)
+        iclient = pool->idle[--pool->num_idle];
+    else
+        connection_id = pool->next_connection_id++;
+    pthread_mutex_unlock(&pool->lock);
+
+    // With nothing idle, fall back to a connection of our own; it joins the
+    // pool when it's released.
+    if (!iclient)
+        return libivc_connect_with_id(client, pool->remote_domid, remote_port, pool->num_pages,
+            connection_id);
+
+    rc = libivc_reconnect(iclient, pool->remote_domid, remote_port);
+    if (rc != SUCCESS)
+    {
+        // The client is still parked, and as good as it was.
+        libivc_pool_release(pool, iclient);
+        return rc;
+    }
+
+    *client = iclient;
+    return SUCCESS;
+}
+
+/**
+ * Returns a client to the pool.
+ * @return SUCCESS or appropriate error number.
+ */
+int
+libivc_pool_release(struct libivc_pool *pool, struct libivc_client *client)
+{
+    int rc;
+
+    libivc_checkp(pool, INVALID_PARAM);
+    libivc_checkp(client, INVALID_PARAM);
+    libivc_assert(client->remote_domid == pool->remote_domid, INVALID_PARAM);
+    libivc_assert(client->num_pages == pool->num_pages, INVALID_PARAM);
+
+    rc = libivc_park(client);
+    if (rc != SUCCESS)
+    {
+        libivc_disconnect(client);
+        return rc;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    if (pool->num_idle < pool->capacity)
+    {
+        pool->idle[pool->num_idle++] = client;
+        client = NULL;
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    // Already full; this one isn't needed.
+    if (client)
+        libivc_disconnect(client);
+
+    return SUCCESS;
+}
+
+/**
+ * Gets the number of idle clients in the pool.
+ * @return the number of idle clients.
+ */
+uint32_t
+libivc_pool_idle_count(struct libivc_pool *pool)
+{
+    uint32_t count;
+
+    libivc_checkp(pool, 0);
+
+    pthread_mutex_lock(&pool->lock);
+    count = pool->num_idle;
+    pthread_mutex_unlock(&pool->lock);
+
+    return count;
+}
@@ -0,0 +1,637 @@
+//
+// IVC Driver
+//
+// Copyright (C) 2016 Assured Information Security, Inc. All rights reserved.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <list.h>
+
+#include <libivc.h>
+#include <libivc_types.h>
+#include <libivc_private.h>
+#include <libivc_rpc.h>
+#include <ringbuffer.h>
+#include <libivc_debug.h>
+
+#define LIBIVC_RPC_REQUEST  0x1
+#define LIBIVC_RPC_RESPONSE 0x2
+
+#pragma pack(push, 1)
+
+/**
+ * The header that precedes every request and response on the wire.
+ */
+struct libivc_rpc_header {
+    uint64_t id;                      // correlation ID; responses carry the ID of their request.
+    uint32_t method;                  // application-defined method number. requests only.
+    uint32_t length;                  // length of the body that follows the header.
+    int32_t status;                   // application-defined status. responses only.
+    uint32_t flags;                   // LIBIVC_RPC_REQUEST or LIBIVC_RPC_RESPONSE.
+};
+
+#pragma pack(pop)
+
+/**
+ * A request that has been sent, and is waiting for its response.
+ */
+struct libivc_rpc_pending {
+    list_head_t node;
+    uint64_t id;
+    libivc_rpc_completion completion;
+    void *opaque;
+};
+
+struct libivc_rpc {
+    struct libivc_client *client;     // the connection the RPC layer runs over.
+    libivc_rpc_request_handler handler; // called for each incoming request.
+    void *opaque;                     // passed to the request handler.
+
+    pthread_mutex_t tx_lock;          // serializes frames written to the ring, and guards the fields below.
+    uint64_t next_id;                 // the correlation ID for the next request.
+    list_head_t pending;              // requests waiting for a response.
+    uint32_t num_pending;             // the number of entries in pending.
+    uint8_t batching;                 // non zero between libivc_rpc_begin_batch and libivc_rpc_end_batch.
+    uint8_t broken;                   // non zero once the remote has sent a frame that makes no sense.
+
+    pthread_mutex_t rx_lock;          // serializes frames read from the ring, and guards the fields below.
+    uint8_t rx_have_header;           // non zero once rx_header holds the current frame's header.
+    struct libivc_rpc_header rx_header; // the header of the frame currently being received.
+    char *rx_body;                    // buffer the current frame's body is received into.
+    uint32_t rx_body_size;            // allocated size of rx_body.
+};
+
+/**
+ * State shared between libivc_rpc_call and the completion that wakes it.
+ */
+struct libivc_rpc_waiter {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    uint8_t done;
+    int status;
+    char *response;
+    size_t responseSize;
+    size_t actualSize;
+};
+
+
+/**
+ * Gets the largest frame the client's outgoing ring can ever hold. Both
+ * directions are the same size, so this bounds incoming frames too.
+ */
+static uint32_t
+libivc_rpc_max_frame(struct libivc_rpc *rpc)
+{
+    struct ringbuffer_channel_t *channel;
+
+    channel = &rpc->client->ringbuffer->channels[rpc->client->server_side ? 1 : 0];
+    return (uint32_t)(channel->body_length - 1);
+}
+
+/**
+ * Writes a single frame to the ring, notifying the remote once the whole frame
+ * is published (or at the end of the batch, if one is in progress).
+ * Assumes the tx lock is held.
+ */
+static int
+libivc_rpc_write_frame(struct libivc_rpc *rpc, struct libivc_rpc_header *header, char *payload)
+{
+    size_t space = 0;
+    int rc;
+
+    libivc_assert(header->length <= libivc_rpc_max_frame(rpc) - sizeof(*header), INVALID_PARAM);
+
+    if (rpc->broken)
+        return PROTOCOL_ERROR;
+
+    rc = libivc_getAvailableSpace(rpc->client, &space);
+    libivc_assert(rc == SUCCESS, rc);
+    if (space < sizeof(*header) + header->length)
+        return NO_SPACE;
+
+    // Cork around the header and body, so the remote sees a single event per frame.
+    if (!rpc->batching)
+        libivc_cork(rpc->client);
+
+    rc = libivc_send(rpc->client, (char *)header, sizeof(*header));
+    if (rc == SUCCESS && header->length)
+        rc = libivc_send(rpc->client, payload, header->length);
+
+    if (!rpc->batching)
+        libivc_uncork(rpc->client);
+
+    return rc;
+}
+
+/**
+ * Removes a request from the outstanding table.
+ * @return the request, if it was still outstanding, or NULL otherwise.
+ */
+static struct libivc_rpc_pending *
+libivc_rpc_take_pending(struct libivc_rpc *rpc, uint64_t id)
+{
+    struct libivc_rpc_pending *request = NULL;
+    list_head_t *pos = NULL, *temp = NULL;
+
+    pthread_mutex_lock(&rpc->tx_lock);
+    list_for_each_safe(pos, temp, &rpc->pending)
+    {
+        if (container_of(pos, struct libivc_rpc_pending, node)->id == id)
+        {
+            request = container_of(pos, struct libivc_rpc_pending, node);
+            list_del(pos);
+            rpc->num_pending--;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&rpc->tx_lock);
+
+    return request;
+}
+
+/**
+ * Completes every outstanding request with NOT_CONNECTED.
+ */
+static void
+libivc_rpc_fail_pending(struct libivc_rpc *rpc)
+{
+    struct libivc_rpc_pending *request = NULL;
+    list_head_t failed;
+    list_head_t *pos = NULL, *temp = NULL;
+
+    INIT_LIST_HEAD(&failed);
+
+    pthread_mutex_lock(&rpc->tx_lock);
+    list_splice_init(&rpc->pending, &failed);
+    rpc->num_pending = 0;
+    pthread_mutex_unlock(&rpc->tx_lock);
+
+    list_for_each_safe(pos, temp, &failed)
+    {
+        request = container_of(pos, struct libivc_rpc_pending, node);
+        list_del(pos);
+        request->completion(request->opaque, rpc, NOT_CONNECTED, NULL, 0);
+        free(request);
+    }
+}
+
+/**
+ * Gives up on a connection whose remote has sent a malformed frame: nothing
+ * more is sent, and outstanding requests fail, as no response can be trusted
+ * to arrive. The bad frame is left in the ring, so receives keep failing.
+ */
+static void
+libivc_rpc_break(struct libivc_rpc *rpc, uint32_t length)
+{
+    uint8_t was_broken;
+
+    pthread_mutex_lock(&rpc->tx_lock);
+    was_broken = rpc->broken;
+    rpc->broken = 1;
+    pthread_mutex_unlock(&rpc->tx_lock);
+
+    if (was_broken)
+        return;
+
+    libivc_error("libivc_rpc: dom%d:%d sent a frame with a %uB body, larger than the ring; giving up on it.\n",
+        rpc->client->remote_domid, rpc->client->port, length);
+    libivc_rpc_fail_pending(rpc);
+}
+
+/**
+ * Sends a request, recording it in the outstanding table.
+ */
+static int
+libivc_rpc_send_request(struct libivc_rpc *rpc, uint32_t method, char *payload, uint32_t length,
+    libivc_rpc_completion completion, void *opaque, uint64_t *id)
+{
+    struct libivc_rpc_pending *request = NULL;
+    struct libivc_rpc_header header;
+    int rc;
+
+    request = (struct libivc_rpc_pending *) malloc(sizeof(struct libivc_rpc_pending));
+    libivc_checkp(request, OUT_OF_MEM);
+    memset(request, 0, sizeof(struct libivc_rpc_pending));
+    request->completion = completion;
+    request->opaque = opaque;
+
+    memset(&header, 0, sizeof(header));
+    header.method = method;
+    header.length = length;
+    header.flags = LIBIVC_RPC_REQUEST;
+
+    pthread_mutex_lock(&rpc->tx_lock);
+    header.id = request->id = rpc->next_id++;
+
+    // Record the request before it is sent, as the response may arrive
+    // before we'd otherwise get the chance.
+    list_add_tail(&request->node, &rpc->pending);
+    rpc->num_pending++;
+
+    rc = libivc_rpc_write_frame(rpc, &header, payload);
+    if (rc != SUCCESS)
+    {
+        list_del(&request->node);
+        rpc->num_pending--;
+        free(request);
+    }
+    pthread_mutex_unlock(&rpc->tx_lock);
+
+    if (rc == SUCCESS && id)
+        *id = header.id;
+
+    return rc;
+}
+
+/**
+ * Dispatches a fully received frame.
+ */
+static void
+libivc_rpc_dispatch(struct libivc_rpc *rpc, struct libivc_rpc_header *header, char *body)
+{
+    struct libivc_rpc_pending *request = NULL;
+
+    if (header->flags & LIBIVC_RPC_RESPONSE)
+    {
+        request = libivc_rpc_take_pending(rpc, header->id);
+        if (!request)
+        {
+            libivc_warn("Dropping RPC response for unknown request %llu.\n",
+                (unsigned long long) header->id);
+            return;
+        }
+
+        request->completion(request->opaque, rpc, header->status, body, header->length);
+        free(request);
+    }
+    else if (rpc->handler)
+    {
+        rpc->handler(rpc->opaque, rpc, header->id, header->method, body, header->length);
+    }
+    else
+    {
+        // No one is listening for requests; let the caller know rather than
+        // leaving it waiting forever.
+        libivc_rpc_reply(rpc, header->id, NOT_IMPLEMENTED, NULL, 0);
+    }
+}
+
+/**
+ * Client event callback: the remote has published new frames.
+ */
+static void
+libivc_rpc_event(void *opaque, struct libivc_client *client)
+{
+    UNUSED(client);
+    libivc_rpc_poll((struct libivc_rpc *) opaque);
+}
+
+/**
+ * Client disconnect callback: no responses will be coming.
+ */
+static void
+libivc_rpc_disconnect(void *opaque, struct libivc_client *client)
+{
+    UNUSED(client);
+    libivc_rpc_fail_pending((struct libivc_rpc *) opaque);
+}
+
+/**
+ * Completion used by libivc_rpc_call, which copies out the response and wakes the caller.
+ */
+static void
+libivc_rpc_wake(void *opaque, struct libivc_rpc *rpc, int status, char *payload, uint32_t length)
+{
+    struct libivc_rpc_waiter *waiter = (struct libivc_rpc_waiter *) opaque;
+
+    UNUSED(rpc);
+
+    pthread_mutex_lock(&waiter->lock);
+    waiter->status = status;
+    waiter->actualSize = length;
+    if (payload && length)
+        memcpy(waiter->response, payload, length < waiter->responseSize ? length : waiter->responseSize);
+    waiter->done = 1;
+    pthread_cond_signal(&waiter->cond);
+    pthread_mutex_unlock(&waiter->lock);
+}
+
+
+/**
+ * Creates an RPC endpoint on top of a connected client.
+ * @param rpc - pointer to receive the new RPC endpoint.
+ * @param client - a connected ivc client.
+ * @param handler - called for each request received from the remote, or NULL.
+ * @param opaque - A user-specified object that will be passed to the handler.
+ * @return SUCCESS or appropriate error number.
+ */
+int
+libivc_rpc_create(struct libivc_rpc **rpc, struct libivc_client *client,
+    libivc_rpc_request_handler handler, void *opaque)
+{
+    struct libivc_rpc *irpc = NULL;
+    int rc;
+
+    libivc_checkp(rpc, INVALID_PARAM);
+    libivc_checkp(client, INVALID_PARAM);
+    libivc_checkp(client->ringbuffer, INVALID_PARAM);
+
+    irpc = (struct libivc_rpc *) malloc(sizeof(struct libivc_rpc));
+    libivc_checkp(irpc, OUT_OF_MEM);
+    memset(irpc, 0, sizeof(struct libivc_rpc));
+
+    irpc->client = client;
+    irpc->handler = handler;
+    irpc->opaque = opaque;
+    irpc->next_id = 1;
+    INIT_LIST_HEAD(&irpc->pending);
+    pthread_mutex_init(&irpc->tx_lock, NULL);
+    pthread_mutex_init(&irpc->rx_lock, NULL);
+
+    rc = libivc_register_event_callbacks(client, libivc_rpc_event, libivc_rpc_disconnect, irpc);
+    if (rc != SUCCESS)
+    {
+        pthread_mutex_destroy(&irpc->tx_lock);
+        pthread_mutex_destroy(&irpc->rx_lock);
+        free(irpc);
+        return rc;
+    }
+
+    *rpc = irpc;
+
+    // Pick up anything the remote sent before we were listening.
+    return libivc_rpc_poll(irpc);
+}
+
+/**
+ * Destroys an RPC endpoint, completing any outstanding requests with NOT_CONNECTED.
+ * @param rpc - the RPC endpoint to destroy.
+ */
+void
+libivc_rpc_destroy(struct libivc_rpc *rpc)
+{
+    libivc_checkp(rpc);
+
+    libivc_rpc_fail_pending(rpc);
+
+    pthread_mutex_destroy(&rpc->tx_lock);
+    pthread_mutex_destroy(&rpc->rx_lock);
+    if (rpc->rx_body)
+        free(rpc->rx_body);
+
+    memset(rpc, 0, sizeof(struct libivc_rpc));
+    free(rpc);
+}
+
+/**
+ * Sends a request without waiting for its response.
+ * @return SUCCESS, NO_SPACE if the ring cannot currently hold the request, or
+ *    appropriate error number.
+ */
+int
+libivc_rpc_call_async(struct libivc_rpc *rpc, uint32_t method, char *payload, uint32_t length,
+    libivc_rpc_completion completion, void *opaque)
+{
+    libivc_checkp(rpc, INVALID_PARAM);
+    libivc_checkp(completion, INVALID_PARAM);
+    libivc_assert(payload != NULL || length == 0, INVALID_PARAM);
+
+    return libivc_rpc_send_request(rpc, method, payload, length, completion, opaque, NULL);
+}
+
+/**
+ * Sends a request and waits for its response.
+ * @return the status passed to libivc_rpc_reply by the remote, TIMED_OUT, or
+ *    appropriate error number.
+ */
+int
+libivc_rpc_call(struct libivc_rpc *rpc, uint32_t method, char *payload, uint32_t length,
+    char *response, size_t responseSize, size_t *actualSize, uint32_t timeout_ms)
+{
+    struct libivc_rpc_waiter waiter;
+    struct libivc_rpc_pending *request = NULL;
+    struct timespec deadline;
+    uint64_t id = 0;
+    int rc;
+
+    libivc_checkp(rpc, INVALID_PARAM);
+    libivc_assert(payload != NULL || length == 0, INVALID_PARAM);
+    libivc_assert(response != NULL || responseSize == 0, INVALID_PARAM);
+
+    memset(&waiter, 0, sizeof(waiter));
+    pthread_mutex_init(&waiter.lock, NULL);
+    pthread_cond_init(&waiter.cond, NULL);
+    waiter.response = response;
+    waiter.responseSize = responseSize;
+
+    rc = libivc_rpc_send_request(rpc, method, payload, length, libivc_rpc_wake, &waiter, &id);
+    if (rc != SUCCESS)
+        goto END;
+
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += timeout_ms / 1000;
+    deadline.tv_nsec += (long)(timeout_ms % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L)
+    {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+
+    pthread_mutex_lock(&waiter.lock);
+    while (!waiter.done)
+    {
+        if (!timeout_ms)
+        {
+            pthread_cond_wait(&waiter.cond, &waiter.lock);
+        }
+        else if (pthread_cond_timedwait(&waiter.cond, &waiter.lock, &deadline) != 0 && !waiter.done)
+        {
+            // Withdraw the request. If the response is already being dispatched,
+            // we can't, and it will be along shortly; wait for it instead.
+            request = libivc_rpc_take_pending(rpc, id);
+            if (request)
+            {
+                free(request);
+                waiter.status = TIMED_OUT;
+                waiter.done = 1;
+            }
+            else
+            {
+                timeout_ms = 0;
+            }
+        }
+    }
+    pthread_mutex_unlock(&waiter.lock);
+
+    rc = waiter.status;
+    if (actualSize)
+        *actualSize = waiter.actualSize;
+
+END:
+    pthread_cond_destroy(&waiter.cond);
+    pthread_mutex_destroy(&waiter.lock);
+    return rc;
+}
+
+/**
+ * Answers a request received by the request handler.
+ * @return SUCCESS, NO_SPACE if the ring cannot currently hold the response, or
+ *    appropriate error number.
+ */
+int
+libivc_rpc_reply(struct libivc_rpc *rpc, uint64_t request_id, int32_t status,
+    char *payload, uint32_t length)
+{
+    struct libivc_rpc_header header;
+    int rc;
+
+    libivc_checkp(rpc, INVALID_PARAM);
+    libivc_assert(payload != NULL || length == 0, INVALID_PARAM);
+
+    memset(&header, 0, sizeof(header));
+    header.id = request_id;
+    header.length = length;
+    header.status = status;
+    header.flags = LIBIVC_RPC_RESPONSE;
+
+    pthread_mutex_lock(&rpc->tx_lock);
+    rc = libivc_rpc_write_frame(rpc, &header, payload);
+    pthread_mutex_unlock(&rpc->tx_lock);
+
+    return rc;
+}
+
+/**
+ * Starts a batch, deferring the remote notification until the batch ends.
+ * @return SUCCESS or appropriate error number.
+ */
+int
+libivc_rpc_begin_batch(struct libivc_rpc *rpc)
+{
+    int rc;
+
+    libivc_checkp(rpc, INVALID_PARAM);
+
+    pthread_mutex_lock(&rpc->tx_lock);
+    rc = rpc->batching ? SUCCESS : libivc_cork(rpc->client);
+    if (rc == SUCCESS)
+        rpc->batching = 1;
+    pthread_mutex_unlock(&rpc->tx_lock);
+
+    return rc;
+}
+
+/**
+ * Ends a batch, notifying the remote of everything sent during it.
+ * @return SUCCESS or appropriate error number.
+ */
+int
+libivc_rpc_end_batch(struct libivc_rpc *rpc)
+{
+    int rc;
+
+    libivc_checkp(rpc, INVALID_PARAM);
+
+    pthread_mutex_lock(&rpc->tx_lock);
+    rc = rpc->batching ? libivc_uncork(rpc->client) : SUCCESS;
+    rpc->batching = 0;
+    pthread_mutex_unlock(&rpc->tx_lock);
+
+    return rc;
+}
+
+/**
+ * Processes any frames waiting in the ring.
+ * @return SUCCESS or appropriate error number.
+ */
+int
+libivc_rpc_poll(struct libivc_rpc *rpc)
+{
+    size_t available = 0;
+    char *body = NULL;
+    uint32_t length = 0;
+    int rc = SUCCESS;
+
+    libivc_checkp(rpc, INVALID_PARAM);
+
+    pthread_mutex_lock(&rpc->rx_lock);
+    while (libivc_getAvailableData(rpc->client, &available) == SUCCESS)
+    {
+        // The header and body are published separately, so we may see one
+        // without the other; hold on to the header until its body arrives.
+        if (!rpc->rx_have_header)
+        {
+            if (available < sizeof(struct libivc_rpc_header))
+                break;
+
+            rc = libivc_recv(rpc->client, (char *)&rpc->rx_header, sizeof(struct libivc_rpc_header));
+            if (rc != SUCCESS)
+                break;
+
+            rpc->rx_have_header = 1;
+            continue;
+        }
+
+        // A body the ring could never hold would otherwise be waited for forever.
+        if (rpc->rx_header.length > libivc_rpc_max_frame(rpc) - sizeof(struct libivc_rpc_header))
+        {
+            length = rpc->rx_header.length;
+            rc = PROTOCOL_ERROR;
+            break;
+        }
+
+        if (available < rpc->rx_header.length)
+            break;
+
+        if (rpc->rx_header.length > rpc->rx_body_size)
+        {
+            body = (char *) realloc(rpc->rx_body, rpc->rx_header.length);
+            if (!body)
+            {
+                rc = OUT_OF_MEM;
+                break;
+            }
+            rpc->rx_body = body;
+            rpc->rx_body_size = rpc->rx_header.length;
+        }
+
+        if (rpc->rx_header.length)
+        {
+            rc = libivc_recv(rpc->client, rpc->rx_body, rpc->rx_header.length);
+            if (rc != SUCCESS)
+                break;
+        }
+
+        rpc->rx_have_header = 0;
+        libivc_rpc_dispatch(rpc, &rpc->rx_header, rpc->rx_body);
+    }
+    pthread_mutex_unlock(&rpc->rx_lock);
+
+    if (rc == PROTOCOL_ERROR)
+        libivc_rpc_break(rpc, length);
+
+    return rc;
+}
+
+/**
+ * Gets the number of requests that are still waiting for a response.
+ * @return the number of outstanding requests.
+ */
+uint32_t
+libivc_rpc_outstanding(struct libivc_rpc *rpc)
+{
+    uint32_t outstanding;
+
+    libivc_checkp(rpc, 0);
+
+    pthread_mutex_lock(&rpc->tx_lock);
+    outstanding = rpc->num_pending;
+    pthread_mutex_unlock(&rpc->tx_lock);
+
+    return outstanding;
+}
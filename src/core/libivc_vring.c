@@ -0,0 +1,604 @@
+//
+// IVC Driver
+//
+// Copyright (C) 2016 Assured Information Security, Inc. All rights reserved.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+
+#include <libivc.h>
+#include <libivc_types.h>
+#include <libivc_private.h>
+#include <libivc_vring.h>
+#include <libivc_debug.h>
+
+#define LIBIVC_VRING_MAGIC 0x474E5256
+
+/**
+ * The header starts past the ring header libivc keeps at the start of the
+ * buffer, and the bulk area on the first page after it.
+ */
+#define LIBIVC_VRING_HEADER_OFFSET LIBIVC_RING_HEADER_RESERVED
+#define LIBIVC_VRING_HEADER_END (LIBIVC_VRING_HEADER_OFFSET + sizeof(struct libivc_vring_header))
+#define LIBIVC_VRING_BULK_OFFSET \
+    ((LIBIVC_VRING_HEADER_END + PAGE_SIZE - 1) & ~((size_t)PAGE_SIZE - 1))
+
+#define LIBIVC_VRING_PAGES(size) (((size) + PAGE_SIZE - 1) / PAGE_SIZE)
+
+#pragma pack(push, 1)
+
+/**
+ * A completion: which buffer, and how much the consumer wrote into it.
+ */
+struct libivc_vring_used {
+    uint32_t id;
+    uint32_t length;
+};
+
+/**
+ * The header at LIBIVC_VRING_HEADER_OFFSET. As with virtio, each ring has a single
+ * index, written only by the side that fills it. Only LIBIVC_VRING_SIZE buffers
+ * can be in flight at once, so neither ring can overrun its reader.
+ */
+struct libivc_vring_header {
+    volatile uint32_t magic;          // LIBIVC_VRING_MAGIC, once the producer has set the header up.
+    uint32_t bulk_offset;             // where the bulk area starts in the buffer.
+    uint32_t bulk_size;               // the size of the bulk area.
+    uint8_t pad0[20];
+    volatile uint32_t avail_idx;      // descriptors ever posted; written by the producer.
+    uint8_t pad1[60];
+    volatile uint32_t used_idx;       // buffers ever completed; written by the consumer.
+    uint8_t pad2[60];
+    struct libivc_vring_desc avail[LIBIVC_VRING_SIZE];
+    struct libivc_vring_used used[LIBIVC_VRING_SIZE];
+};
+
+#pragma pack(pop)
+
+/**
+ * The producer's private record of one buffer ID.
+ */
+struct libivc_vring_buffer {
+    uint32_t offset;                  // the buffer's first page, as an offset in the shared buffer.
+    uint32_t pages;                   // the number of pages it spans.
+    uint32_t flags;                   // as posted.
+    uint32_t length;                  // as posted.
+    uint8_t in_use;                   // non zero while the buffer is taken from the bulk area.
+    uint8_t posted;                   // non zero while the consumer owns it.
+};
+
+struct libivc_vring {
+    pthread_mutex_t lock;             // guards everything below.
+    struct libivc_client *client;     // the connection whose buffer we live in.
+    struct libivc_vring_header *header; // the header, in the buffer.
+    char *buffer;                     // the local mapping of the buffer.
+    size_t buffer_size;               // the size of the buffer.
+    uint8_t producer;                 // non zero on the side that owns the data buffers.
+    uint8_t ready;                    // non zero once the bulk area below is known and checked.
+    uint8_t kick_pending;             // non zero if we've published anything since the last kick.
+    uint32_t bulk_offset;             // our copy of the header's geometry.
+    uint32_t bulk_size;
+    uint32_t last_seen;               // the next entry to read from the remote's ring.
+
+    // The rest is producer only.
+    struct libivc_vring_buffer buffers[LIBIVC_VRING_SIZE]; // by ID.
+    uint32_t free_ids[LIBIVC_VRING_SIZE]; // a stack of the IDs not in use.
+    uint32_t num_free_ids;
+    uint32_t num_pages;               // the number of pages in the bulk area.
+    uint64_t *page_map;               // one bit per page of the bulk area, set while taken.
+    uint32_t next_page;               // where the next search for free pages starts.
+};
+
+/**
+ * Reads and checks the producer's geometry, if it has been written yet.
+ * Consumer only; the lock must be held.
+ * @return non zero once the ring is usable.
+ */
+static uint8_t
+vring_check_header(struct libivc_vring *vring)
+{
+    struct libivc_vring_header *header = vring->header;
+    uint32_t offset, size;
+
+    if (vring->ready)
+        return 1;
+
+    if (header->magic != LIBIVC_VRING_MAGIC)
+        return 0;
+
+    __sync_synchronize();
+    offset = header->bulk_offset;
+    size = header->bulk_size;
+
+    if (offset < LIBIVC_VRING_HEADER_END || offset > vring->buffer_size ||
+        size > vring->buffer_size - offset)
+    {
+        libivc_error_ratelimited("Descriptor ring on dom%u:%u has a bad header (%u bytes at %u).\n",
+            vring->client->remote_domid, vring->client->port, size, offset);
+        return 0;
+    }
+
+    vring->bulk_offset = offset;
+    vring->bulk_size = size;
+    vring->last_seen = 0;
+    vring->ready = 1;
+    return 1;
+}
+
+/**
+ * Checks that a descriptor lies entirely within the bulk area.
+ */
+static uint8_t
+vring_desc_valid(struct libivc_vring *vring, struct libivc_vring_desc *desc)
+{
+    return vring->ready && desc->id < LIBIVC_VRING_SIZE && desc->offset >= vring->bulk_offset &&
+        (uint64_t)desc->offset + desc->length <= (uint64_t)vring->bulk_offset + vring->bulk_size;
+}
+
+static uint8_t
+vring_page_taken(struct libivc_vring *vring, uint32_t page)
+{
+    return (vring->page_map[page / 64] >> (page % 64)) & 1;
+}
+
+static void
+vring_mark_pages(struct libivc_vring *vring, uint32_t first, uint32_t count, uint8_t taken)
+{
+    uint32_t page;
+
+    for (page = first; page < first + count; page++)
+    {
+        if (taken)
+            vring->page_map[page / 64] |= 1ULL << (page % 64);
+        else
+            vring->page_map[page / 64] &= ~(1ULL << (page % 64));
+    }
+}
+
+/**
+ * Finds a run of free pages, first fit from where the last search left off, so
+ * buffers are handed out in a rolling fashion rather than crowding the start.
+ * Producer only; the lock must be held.
+ * @return the first page of the run, or num_pages if there's none.
+ */
+static uint32_t
+vring_find_pages(struct libivc_vring *vring, uint32_t count)
+{
+    uint32_t start = vring->next_page, scanned = 0, run = 0, page;
+
+    if (start + count > vring->num_pages)
+        start = 0;
+
+    // A run that straddles where the search starts is only found on coming
+    // back round to it, so scan that far past the start.
+    page = start;
+    while (scanned < vring->num_pages + count - 1)
+    {
+        // Runs can't wrap around the end of the bulk area.
+        if (page == vring->num_pages)
+        {
+            page = 0;
+            run = 0;
+        }
+
+        run = vring_page_taken(vring, page) ? 0 : run + 1;
+        page++;
+        scanned++;
+
+        if (run == count)
+            return page - count;
+    }
+
+    return vring->num_pages;
+}
+
+/**
+ * Sets up the producer's side and publishes the header.
+ * @return SUCCESS or appropriate error number.
+ */
+static int
+vring_init_producer(struct libivc_vring *vring)
+{
+    struct libivc_vring_header *header = vring->header;
+    uint32_t i;
+
+    vring->bulk_offset = (uint32_t)LIBIVC_VRING_BULK_OFFSET;
+    vring->num_pages = (uint32_t)((vring->buffer_size - vring->bulk_offset) / PAGE_SIZE);
+    vring->bulk_size = vring->num_pages * PAGE_SIZE;
+
+    vring->page_map = (uint64_t *) calloc((vring->num_pages + 63) / 64, sizeof(uint64_t));
+    libivc_checkp(vring->page_map, OUT_OF_MEM);
+
+    for (i = 0; i < LIBIVC_VRING_SIZE; i++)
+        vring->free_ids[i] = LIBIVC_VRING_SIZE - 1 - i;
+    vring->num_free_ids = LIBIVC_VRING_SIZE;
+
+    header->magic = 0;
+    __sync_synchronize();
+    header->avail_idx = 0;
+    header->used_idx = 0;
+    header->bulk_offset = vring->bulk_offset;
+    header->bulk_size = vring->bulk_size;
+    __sync_synchronize();
+    header->magic = LIBIVC_VRING_MAGIC;
+
+    vring->ready = 1;
+    return SUCCESS;
+}
+
+/**
+ * Creates a descriptor ring over a connected client's buffer.
+ * @return SUCCESS or appropriate error number.
+ */
+int
+libivc_vring_create(struct libivc_vring **vring, struct libivc_client *client, uint8_t producer)
+{
+    struct libivc_vring *ivring = NULL;
+    int rc;
+
+    libivc_checkp(vring, INVALID_PARAM);
+    libivc_checkp(client, INVALID_PARAM);
+    libivc_checkp(client->buffer, INVALID_PARAM);
+    libivc_assert((size_t)client->num_pages * PAGE_SIZE >= LIBIVC_VRING_BULK_OFFSET + PAGE_SIZE,
+        INVALID_PARAM);
+
+    ivring = (struct libivc_vring *) malloc(sizeof(struct libivc_vring));
+    libivc_checkp(ivring, OUT_OF_MEM);
+    memset(ivring, 0, sizeof(struct libivc_vring));
+
+    pthread_mutex_init(&ivring->lock, NULL);
+    ivring->client = client;
+    ivring->buffer = client->buffer;
+    ivring->header = (struct libivc_vring_header *) (client->buffer + LIBIVC_VRING_HEADER_OFFSET);
+    ivring->buffer_size = (size_t)client->num_pages * PAGE_SIZE;
+    ivring->producer = producer ? 1 : 0;
+
+    // Keep libivc's event flags out of the header and the bulk area.
+    __libivc_take_over_buffer(client);
+
+    if (ivring->producer)
+    {
+        rc = vring_init_producer(ivring);
+        if (rc != SUCCESS)
+        {
+            libivc_vring_destroy(ivring);
+            return rc;
+        }
+    }
+
+    *vring = ivring;
+    return SUCCESS;
+}
+
+/**
+ * Destroys a descriptor ring. The client is left connected.
+ */
+void
+libivc_vring_destroy(struct libivc_vring *vring)
+{
+    libivc_checkp(vring);
+
+    pthread_mutex_destroy(&vring->lock);
+    free(vring->page_map);
+    memset(vring, 0, sizeof(struct libivc_vring));
+    free(vring);
+}
+
+/**
+ * Gets the size of the bulk area.
+ * @return the size of the bulk area, in bytes.
+ */
+size_t
+libivc_vring_bulk_size(struct libivc_vring *vring)
+{
+    libivc_checkp(vring, 0);
+    return vring->bulk_size;
+}
+
+/**
+ * Takes a data buffer from the bulk area.
+ * @return SUCCESS, NO_SPACE if there's no room, or appropriate error number.
+ */
+int
+libivc_vring_get_buffer(struct libivc_vring *vring, size_t size, uint32_t flags,
+    struct libivc_vring_desc *desc)
+{
+    struct libivc_vring_buffer *buffer;
+    uint32_t pages, first, id;
+
+    libivc_checkp(vring, INVALID_PARAM);
+    libivc_checkp(desc, INVALID_PARAM);
+    libivc_assert(vring->producer, INVALID_PARAM);
+    libivc_assert(size > 0 && size <= vring->bulk_size, INVALID_PARAM);
+
+    pages = (uint32_t)LIBIVC_VRING_PAGES(size);
+
+    pthread_mutex_lock(&vring->lock);
+    if (vring->num_free_ids == 0 || (first = vring_find_pages(vring, pages)) == vring->num_pages)
+    {
+        pthread_mutex_unlock(&vring->lock);
+        return NO_SPACE;
+    }
+
+    id = vring->free_ids[--vring->num_free_ids];
+    vring_mark_pages(vring, first, pages, 1);
+    vring->next_page = first + pages;
+
+    buffer = &vring->buffers[id];
+    buffer->offset = vring->bulk_offset + first * PAGE_SIZE;
+    buffer->pages = pages;
+    buffer->flags = flags;
+    buffer->length = (uint32_t)size;
+    buffer->in_use = 1;
+    buffer->posted = 0;
+    pthread_mutex_unlock(&vring->lock);
+
+    desc->offset = buffer->offset;
+    desc->length = (uint32_t)size;
+    desc->flags = flags;
+    desc->id = id;
+    return SUCCESS;
+}
+
+/**
+ * Returns a data buffer to the bulk area.
+ * @return SUCCESS, or INVALID_PARAM if the buffer isn't ours to return.
+ */
+int
+libivc_vring_put_buffer(struct libivc_vring *vring, struct libivc_vring_desc *desc)
+{
+    struct libivc_vring_buffer *buffer;
+
+    libivc_checkp(vring, INVALID_PARAM);
+    libivc_checkp(desc, INVALID_PARAM);
+    libivc_assert(vring->producer, INVALID_PARAM);
+    libivc_assert(desc->id < LIBIVC_VRING_SIZE, INVALID_PARAM);
+
+    pthread_mutex_lock(&vring->lock);
+    buffer = &vring->buffers[desc->id];
+    if (!buffer->in_use || buffer->posted || buffer->offset != desc->offset)
+    {
+        pthread_mutex_unlock(&vring->lock);
+        return INVALID_PARAM;
+    }
+
+    vring_mark_pages(vring, (buffer->offset - vring->bulk_offset) / PAGE_SIZE, buffer->pages, 0);
+    buffer->in_use = 0;
+    vring->free_ids[vring->num_free_ids++] = desc->id;
+    pthread_mutex_unlock(&vring->lock);
+
+    return SUCCESS;
+}
+
+/**
+ * Gets the address of a data buffer in the local mapping of the buffer.
+ * @return the data's address, or NULL if the descriptor lies outside the bulk area.
+ */
+void *
+libivc_vring_ptr(struct libivc_vring *vring, struct libivc_vring_desc *desc)
+{
+    libivc_checkp(vring, NULL);
+    libivc_checkp(desc, NULL);
+
+    if (!vring_desc_valid(vring, desc))
+        return NULL;
+
+    return vring->buffer + desc->offset;
+}
+
+/**
+ * Passes ownership of a data buffer to the consumer.
+ * @return SUCCESS, NO_SPACE if the ring is full, or appropriate error number.
+ */
+int
+libivc_vring_post(struct libivc_vring *vring, struct libivc_vring_desc *desc)
+{
+    struct libivc_vring_header *header;
+    struct libivc_vring_buffer *buffer;
+    uint32_t idx;
+
+    libivc_checkp(vring, INVALID_PARAM);
+    libivc_checkp(desc, INVALID_PARAM);
+    libivc_assert(vring->producer, INVALID_PARAM);
+    libivc_assert(desc->id < LIBIVC_VRING_SIZE, INVALID_PARAM);
+
+    header = vring->header;
+
+    pthread_mutex_lock(&vring->lock);
+    buffer = &vring->buffers[desc->id];
+    if (!buffer->in_use || buffer->posted || buffer->offset != desc->offset ||
+        desc->length > buffer->pages * PAGE_SIZE)
+    {
+        pthread_mutex_unlock(&vring->lock);
+        return INVALID_PARAM;
+    }
+
+    buffer->posted = 1;
+    buffer->flags = desc->flags;
+    buffer->length = desc->length;
+
+    idx = header->avail_idx;
+    header->avail[idx % LIBIVC_VRING_SIZE] = *desc;
+
+    // The descriptor must be visible before the index that covers it.
+    __sync_synchronize();
+    header->avail_idx = idx + 1;
+    vring->kick_pending = 1;
+    pthread_mutex_unlock(&vring->lock);
+
+    return SUCCESS;
+}
+
+/**
+ * Takes back the next data buffer the consumer has completed.
+ * @return SUCCESS, NO_DATA_AVAIL if there are none, or appropriate error number.
+ */
+int
+libivc_vring_reap(struct libivc_vring *vring, struct libivc_vring_desc *desc)
+{
+    struct libivc_vring_header *header;
+    struct libivc_vring_buffer *buffer;
+    struct libivc_vring_used used;
+    uint32_t used_idx;
+
+    libivc_checkp(vring, INVALID_PARAM);
+    libivc_checkp(desc, INVALID_PARAM);
+    libivc_assert(vring->producer, INVALID_PARAM);
+
+    header = vring->header;
+
+    pthread_mutex_lock(&vring->lock);
+    while ((used_idx = header->used_idx) != vring->last_seen)
+    {
+        if (used_idx - vring->last_seen > LIBIVC_VRING_SIZE)
+        {
+            pthread_mutex_unlock(&vring->lock);
+            libivc_error_ratelimited("dom%u:%u corrupted its completion index.\n",
+                vring->client->remote_domid, vring->client->port);
+            return INTERNAL_ERROR;
+        }
+
+        __sync_synchronize();
+        used = header->used[vring->last_seen % LIBIVC_VRING_SIZE];
+        vring->last_seen++;
+
+        // Completions for buffers the consumer doesn't own are dropped.
+        if (used.id >= LIBIVC_VRING_SIZE || !vring->buffers[used.id].posted)
+        {
+            libivc_error_ratelimited("dom%u:%u completed a buffer it doesn't own (%u).\n",
+                vring->client->remote_domid, vring->client->port, used.id);
+            continue;
+        }
+
+        buffer = &vring->buffers[used.id];
+        buffer->posted = 0;
+
+        desc->offset = buffer->offset;
+        desc->flags = buffer->flags;
+        desc->id = used.id;
+        if (buffer->flags & LIBIVC_VRING_F_WRITE)
+            desc->length = used.length < buffer->length ? used.length : buffer->length;
+        else
+            desc->length = buffer->length;
+
+        pthread_mutex_unlock(&vring->lock);
+        return SUCCESS;
+    }
+    pthread_mutex_unlock(&vring->lock);
+
+    return NO_DATA_AVAIL;
+}
+
+/**
+ * Takes the next data buffer the producer has posted.
+ * @return SUCCESS, NO_DATA_AVAIL if there are none, or appropriate error number.
+ */
+int
+libivc_vring_pop(struct libivc_vring *vring, struct libivc_vring_desc *desc)
+{
+    struct libivc_vring_header *header;
+    struct libivc_vring_desc next;
+    uint32_t avail_idx;
+
+    libivc_checkp(vring, INVALID_PARAM);
+    libivc_checkp(desc, INVALID_PARAM);
+    libivc_assert(!vring->producer, INVALID_PARAM);
+
+    header = vring->header;
+
+    pthread_mutex_lock(&vring->lock);
+    if (!vring_check_header(vring))
+    {
+        pthread_mutex_unlock(&vring->lock);
+        return NO_DATA_AVAIL;
+    }
+
+    while ((avail_idx = header->avail_idx) != vring->last_seen)
+    {
+        if (avail_idx - vring->last_seen > LIBIVC_VRING_SIZE)
+        {
+            pthread_mutex_unlock(&vring->lock);
+            libivc_error_ratelimited("dom%u:%u corrupted its descriptor index.\n",
+                vring->client->remote_domid, vring->client->port);
+            return INTERNAL_ERROR;
+        }
+
+        __sync_synchronize();
+        next = header->avail[vring->last_seen % LIBIVC_VRING_SIZE];
+        vring->last_seen++;
+
+        // Never hand the caller a buffer outside of the bulk area.
+        if (!vring_desc_valid(vring, &next))
+        {
+            libivc_error_ratelimited("dom%u:%u posted a bad descriptor (%u bytes at %u).\n",
+                vring->client->remote_domid, vring->client->port, next.length, next.offset);
+            continue;
+        }
+
+        pthread_mutex_unlock(&vring->lock);
+        *desc = next;
+        return SUCCESS;
+    }
+    pthread_mutex_unlock(&vring->lock);
+
+    return NO_DATA_AVAIL;
+}
+
+/**
+ * Hands a data buffer back to the producer.
+ * @return SUCCESS or appropriate error number.
+ */
+int
+libivc_vring_complete(struct libivc_vring *vring, struct libivc_vring_desc *desc,
+    uint32_t written)
+{
+    struct libivc_vring_header *header;
+    uint32_t idx;
+
+    libivc_checkp(vring, INVALID_PARAM);
+    libivc_checkp(desc, INVALID_PARAM);
+    libivc_assert(!vring->producer, INVALID_PARAM);
+    libivc_assert(vring->ready, INVALID_PARAM);
+    libivc_assert(desc->id < LIBIVC_VRING_SIZE, INVALID_PARAM);
+
+    header = vring->header;
+
+    pthread_mutex_lock(&vring->lock);
+    idx = header->used_idx;
+    header->used[idx % LIBIVC_VRING_SIZE].id = desc->id;
+    header->used[idx % LIBIVC_VRING_SIZE].length =
+        (desc->flags & LIBIVC_VRING_F_WRITE) ? written : 0;
+
+    __sync_synchronize();
+    header->used_idx = idx + 1;
+    vring->kick_pending = 1;
+    pthread_mutex_unlock(&vring->lock);
+
+    return SUCCESS;
+}
+
+/**
+ * Notifies the remote of whatever has been published since the last kick.
+ * @return SUCCESS or appropriate error number.
+ */
+int
+libivc_vring_kick(struct libivc_vring *vring)
+{
+    uint8_t pending;
+
+    libivc_checkp(vring, INVALID_PARAM);
+
+    pthread_mutex_lock(&vring->lock);
+    pending = vring->kick_pending;
+    vring->kick_pending = 0;
+    pthread_mutex_unlock(&vring->lock);
+
+    if (!pending)
+        return SUCCESS;
+
+    return libivc_notify_remote(vring->client);
+}
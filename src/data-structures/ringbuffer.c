@@ -237,6 +237,92 @@ int32_t ringbuffer_write(struct ringbuffer_channel_t *channel, char *buffer, int
     return bytes_to_write;
 }
 
+/*
+ * Splits the length bytes starting at loc into the part before the end of the
+ * body and the part that wraps around to its start.
+ */
+static void ringbuffer_split(struct ringbuffer_channel_t *channel, int32_t loc, int32_t length,
+                             char **seg1, int32_t *len1, char **seg2, int32_t *len2)
+{
+    *seg1 = channel->body + loc;
+    *seg2 = channel->body;
+
+    if(loc + length <= channel->body_length)
+    {
+        *len1 = length;
+        *len2 = 0;
+    }
+    else
+    {
+        *len1 = channel->body_length - loc;
+        *len2 = length - *len1;
+    }
+}
+
+int32_t ringbuffer_read_segments(struct ringbuffer_channel_t *channel, char **seg1, int32_t *len1,
+                                 char **seg2, int32_t *len2)
+{
+    int32_t bytes_available;
+
+    if(channel == 0) return -EINVAL;
+    if(seg1 == 0 || len1 == 0 || seg2 == 0 || len2 == 0) return -EINVAL;
+    if(channel->header == 0) return -ENODEV;
+    if(channel->body == 0) return -ENODEV;
+
+    bytes_available = ringbuffer_bytes_available_read(channel);
+    ring_mb(); // Read the data only after the index that covers it.
+
+    ringbuffer_split(channel, channel->header->lloc, bytes_available, seg1, len1, seg2, len2);
+    return bytes_available;
+}
+
+int32_t ringbuffer_consume(struct ringbuffer_channel_t *channel, int32_t length)
+{
+    int32_t lloc;
+
+    if(channel == 0) return -EINVAL;
+    if(channel->header == 0) return -ENODEV;
+    if(channel->body == 0) return -ENODEV;
+    if(length < 0 || length > ringbuffer_bytes_available_read(channel)) return -EFBIG;
+
+    lloc = channel->header->lloc;
+    ring_mb(); // Consume, then update index.
+    channel->header->lloc = (lloc + length) % channel->body_length;
+    ring_mb(); // Update index before it gets read.
+    return length;
+}
+
+int32_t ringbuffer_write_segments(struct ringbuffer_channel_t *channel, char **seg1, int32_t *len1,
+                                  char **seg2, int32_t *len2)
+{
+    int32_t bytes_available;
+
+    if(channel == 0) return -EINVAL;
+    if(seg1 == 0 || len1 == 0 || seg2 == 0 || len2 == 0) return -EINVAL;
+    if(channel->header == 0) return -ENODEV;
+    if(channel->body == 0) return -ENODEV;
+
+    bytes_available = ringbuffer_bytes_available_write(channel);
+    ringbuffer_split(channel, channel->header->rloc, bytes_available, seg1, len1, seg2, len2);
+    return bytes_available;
+}
+
+int32_t ringbuffer_commit(struct ringbuffer_channel_t *channel, int32_t length)
+{
+    int32_t rloc;
+
+    if(channel == 0) return -EINVAL;
+    if(channel->header == 0) return -ENODEV;
+    if(channel->body == 0) return -ENODEV;
+    if(length < 0 || length > ringbuffer_bytes_available_write(channel)) return -EFBIG;
+
+    rloc = channel->header->rloc;
+    ring_mb(); // Produce, then update index.
+    channel->header->rloc = (rloc + length) % channel->body_length;
+    ring_mb(); // Update index before it gets read.
+    return length;
+}
+
 void ringbuffer_clear_buffer(struct ringbuffer_channel_t *channel)
 {
     if (channel == 0) return;
@@ -301,3 +387,65 @@ int32_t ringbuffer_get_flags(struct ringbuffer_channel_t *channel)
 
     return flags;
 }
+
+int ringbuffer_channel_detach(struct ringbuffer_channel_t *channel, struct ringbuffer_header_t *header)
+{
+    if(channel == 0) return -EINVAL;
+    if(header == 0) return -EINVAL;
+    if(channel->header == 0) return -ENODEV;
+
+    header->lloc = 0;
+    header->rloc = 0;
+    header->reserved1 = channel->header->reserved1;
+    ring_mb(); // Read the flags before letting go of the ring.
+
+    // A one byte body leaves no room to write, and nothing to read.
+    channel->header = header;
+    channel->body = (char *)header;
+    channel->body_length = 1;
+
+    return 0;
+}
+
+/*
+ * Finds a control word in the first channel's header.
+ */
+static volatile int32_t *ringbuffer_control(struct ringbuffer_t *handle, int32_t index)
+{
+    struct ringbuffer_header_t *header;
+
+    if(handle == 0 || handle->buffer == 0) return 0;
+
+    header = (struct ringbuffer_header_t *)handle->buffer;
+    switch(index)
+    {
+        case 0: return &header->reserved2;
+        case 1: return &header->reserved3;
+        case 2: return &header->reserved4;
+        default: return 0;
+    }
+}
+
+void ringbuffer_set_control(struct ringbuffer_t *handle, int32_t index, int32_t value)
+{
+    volatile int32_t *word = ringbuffer_control(handle, index);
+
+    if(word == 0) return;
+
+    ring_mb(); // Everything before the word is visible before it.
+    *word = value;
+    ring_mb(); // Update the word before anything else.
+}
+
+int32_t ringbuffer_get_control(struct ringbuffer_t *handle, int32_t index)
+{
+    volatile int32_t *word = ringbuffer_control(handle, index);
+    int32_t value;
+
+    if(word == 0) return 0;
+
+    value = *word;
+    ring_mb(); // Read the word once, before anything it covers.
+
+    return value;
+}
@@ -355,6 +355,74 @@ int32_t ringbuffer_read(struct ringbuffer_channel_t *channel, char *buffer, int3
  */
 int32_t ringbuffer_write(struct ringbuffer_channel_t *channel, char *buffer, int32_t length);
 
+/**
+ * Get the Readable Segments of the Ringbuffer
+ *
+ * Rather than copying data out, this exposes the data waiting in the channel
+ * in place. Data that wraps around the end of the channel is split into two
+ * segments; otherwise the second is empty. Nothing is consumed until
+ * ringbuffer_consume is called.
+ *
+ * @param channel a pointer to the channel
+ * @param seg1 receives the start of the first segment
+ * @param len1 receives the length of the first segment
+ * @param seg2 receives the start of the second segment
+ * @param len2 receives the length of the second segment
+ * @return -EINVAL if NULL is provided for the channel or any output
+ *         -ENODEV if the channel proivded is not properly created
+ *         BYTES available on success
+ */
+int32_t ringbuffer_read_segments(struct ringbuffer_channel_t *channel, char **seg1, int32_t *len1,
+                                 char **seg2, int32_t *len2);
+
+/**
+ * Consume data from the Ringbuffer
+ *
+ * Marks data exposed by ringbuffer_read_segments as read.
+ *
+ * @param channel a pointer to the channel
+ * @param length the number of bytes to consume
+ * @return -EINVAL if NULL is provided for the channel
+ *         -ENODEV if the channel proivded is not properly created
+ *         -EFBIG if the length provided is more than is available
+ *         BYTES consumed on success
+ */
+int32_t ringbuffer_consume(struct ringbuffer_channel_t *channel, int32_t length);
+
+/**
+ * Get the Writable Segments of the Ringbuffer
+ *
+ * Rather than copying data in, this exposes the free space in the channel so
+ * it can be filled in place. Space that wraps around the end of the channel
+ * is split into two segments; otherwise the second is empty. Nothing is
+ * published until ringbuffer_commit is called.
+ *
+ * @param channel a pointer to the channel
+ * @param seg1 receives the start of the first segment
+ * @param len1 receives the length of the first segment
+ * @param seg2 receives the start of the second segment
+ * @param len2 receives the length of the second segment
+ * @return -EINVAL if NULL is provided for the channel or any output
+ *         -ENODEV if the channel proivded is not properly created
+ *         BYTES available on success
+ */
+int32_t ringbuffer_write_segments(struct ringbuffer_channel_t *channel, char **seg1, int32_t *len1,
+                                  char **seg2, int32_t *len2);
+
+/**
+ * Commit data to the Ringbuffer
+ *
+ * Publishes data written into space exposed by ringbuffer_write_segments.
+ *
+ * @param channel a pointer to the channel
+ * @param length the number of bytes to publish
+ * @return -EINVAL if NULL is provided for the channel
+ *         -ENODEV if the channel proivded is not properly created
+ *         -EFBIG if the length provided is more than the free space
+ *         BYTES published on success
+ */
+int32_t ringbuffer_commit(struct ringbuffer_channel_t *channel, int32_t length);
+
 /**
  * Bytes Available to Read from the Ringbuffer
  *
@@ -391,5 +459,42 @@ void ringbuffer_set_flags(struct ringbuffer_channel_t *channel, uint32_t flags);
 int32_t ringbuffer_get_flags(struct ringbuffer_channel_t *channel);
 
 void ringbuffer_clear_buffer(struct ringbuffer_channel_t *channel);
+
+/**
+ * Detach a Channel from the Ringbuffer
+ *
+ * Points the channel at a private header, so that it appears both empty and
+ * full, and no longer touches the ring, until ringbuffer_use lays it out
+ * again. The channel's flags are carried over to the private header.
+ *
+ * @param channel a pointer to the channel
+ * @param header the private header to use
+ * @return -EINVAL if NULL is provided for the channel or header
+ *         -ENODEV if the channel proivded is not properly created
+ *         0 on success
+ */
+int ringbuffer_channel_detach(struct ringbuffer_channel_t *channel, struct ringbuffer_header_t *header);
+
+/**
+ * Set a control word of the Ringbuffer
+ *
+ * The first channel's header holds three words that aren't used by the ring
+ * itself. As the header is always at the start of the buffer, however the
+ * channels are laid out, they're free for the two ends to coordinate with.
+ *
+ * @param handle a pointer to the ringbuffer
+ * @param index the word to set, from 0 to 2
+ * @param value the value to set it to
+ */
+void ringbuffer_set_control(struct ringbuffer_t *handle, int32_t index, int32_t value);
+
+/**
+ * Get a control word of the Ringbuffer
+ *
+ * @param handle a pointer to the ringbuffer
+ * @param index the word to get, from 0 to 2
+ * @return the word's value, or 0 if the ringbuffer or index is invalid
+ */
+int32_t ringbuffer_get_control(struct ringbuffer_t *handle, int32_t index);
 #pragma pack(pop)
 #endif
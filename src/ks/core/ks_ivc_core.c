@@ -17,6 +17,159 @@
 #include <ks_ivc_core.h>
 
 static struct libivc_client *ivcXenClient = NULL;
+
+/**
+ * A CONNECT request waiting for its ACK. ACKs echo the request's port and
+ * connection ID, and come from the domain the request went to, which is
+ * enough to match them up; so any number of requests may be waiting at once.
+ */
+typedef struct ks_ivc_pending_ack {
+    list_head_t node;                 // for tracking in ivcPendingAcks.
+    uint16_t domid;                   // the domain the request was sent to.
+    uint16_t port;                    // the port the request was sent to.
+    uint64_t connection_id;           // the connection ID of the request.
+    uint8_t done;                     // non zero once the ACK has arrived.
+    int16_t status;                   // the status the ACK carried.
+#ifdef __linux
+    wait_queue_head_t wait;           // woken when the ACK arrives.
+#else
+    KEVENT event;                     // set when the ACK arrives.
+#endif
+} ks_ivc_pending_ack_t;
+
+// CONNECT requests waiting for their ACKs, and the lock that guards them.
+static list_head_t ivcPendingAcks;
+static mutex_t ivcPendingAckLock;
+
+// Serializes handling of the messages in the backend channel, which both the
+// backend's event work and connecting threads pick up; they must be handled
+// one at a time, and in order.
+static mutex_t ivcBackendLock;
+
+/**
+ * Records that a CONNECT request is about to be sent, so that its ACK can be
+ * matched up with it.
+ * @param ack Storage for the pending request, valid until it's unregistered.
+ * @param client The client whose connection is being requested.
+ * @return SUCCESS, or ADDRESS_IN_USE if an identical request is already waiting.
+ */
+static int
+ks_ivc_core_register_ack(ks_ivc_pending_ack_t *ack, struct libivc_client *client)
+{
+    list_head_t *pos = NULL;
+    ks_ivc_pending_ack_t *other = NULL;
+    int rc = SUCCESS;
+
+    memset(ack, 0, sizeof(ks_ivc_pending_ack_t));
+    ack->domid = client->remote_domid;
+    ack->port = client->port;
+    ack->connection_id = client->connection_id;
+#ifdef __linux
+    init_waitqueue_head(&ack->wait);
+#else
+    KeInitializeEvent(&ack->event, NotificationEvent, FALSE);
+#endif
+
+    mutex_lock(&ivcPendingAckLock);
+    list_for_each(pos, &ivcPendingAcks)
+    {
+        other = container_of(pos, ks_ivc_pending_ack_t, node);
+        if (other->domid == ack->domid && other->port == ack->port &&
+            other->connection_id == ack->connection_id)
+        {
+            rc = ADDRESS_IN_USE;
+            break;
+        }
+    }
+
+    if (rc == SUCCESS)
+        list_add_tail(&ack->node, &ivcPendingAcks);
+    mutex_unlock(&ivcPendingAckLock);
+
+    return rc;
+}
+
+/**
+ * Stops waiting for an ACK. Once this returns, the ACK will no longer be
+ * delivered to the pending request, and its storage may be released.
+ * @param ack The pending request.
+ */
+static void
+ks_ivc_core_unregister_ack(ks_ivc_pending_ack_t *ack)
+{
+    mutex_lock(&ivcPendingAckLock);
+    list_del(&ack->node);
+    mutex_unlock(&ivcPendingAckLock);
+}
+
+/**
+ * Waits for the ACK to a CONNECT request.
+ * @param ack The pending request.
+ * @param block Zero to only check whether the ACK has arrived, without waiting.
+ * @return SUCCESS once the ACK has arrived, or TIMED_OUT.
+ */
+static int
+ks_ivc_core_wait_for_ack(ks_ivc_pending_ack_t *ack, uint8_t block)
+{
+#ifdef __linux
+    if (!wait_event_timeout(ack->wait, ack->done, block ? msecs_to_jiffies(6000) : 0))
+        return TIMED_OUT;
+#else
+    LARGE_INTEGER timeout;
+
+    timeout.QuadPart = block ? -3LL * 10000000 : 0; // relative, in 100ns units.
+    if (KeWaitForSingleObject(&ack->event, Executive, KernelMode, FALSE, &timeout) == STATUS_TIMEOUT)
+        return TIMED_OUT;
+#endif
+
+    return SUCCESS;
+}
+
+/**
+ * Delivers an ACK to the CONNECT request waiting for it.
+ * @param msg The ACK.
+ * @return SUCCESS, or NOT_CONNECTED if nothing was waiting for it.
+ */
+static int
+ks_ivc_core_handle_ack_msg(libivc_message_t *msg)
+{
+    list_head_t *pos = NULL;
+    ks_ivc_pending_ack_t *ack = NULL;
+
+    libivc_checkp(msg, INVALID_PARAM);
+
+    mutex_lock(&ivcPendingAckLock);
+    list_for_each(pos, &ivcPendingAcks)
+    {
+        ack = container_of(pos, ks_ivc_pending_ack_t, node);
+        if (!ack->done && ack->domid == msg->from_dom && ack->port == msg->port &&
+            ack->connection_id == msg->connection_id)
+            break;
+
+        ack = NULL;
+    }
+
+    if (ack)
+    {
+        ack->status = msg->status;
+        ack->done = 1;
+#ifdef __linux
+        wake_up(&ack->wait);
+#else
+        KeSetEvent(&ack->event, 0, FALSE);
+#endif
+    }
+    mutex_unlock(&ivcPendingAckLock);
+
+    // Most likely the answer to a request that has already timed out.
+    if (!ack)
+    {
+        libivc_warn_ratelimited("Dropping unexpected ACK from dom%u:%u.\n", msg->from_dom, msg->port);
+        return NOT_CONNECTED;
+    }
+
+    return SUCCESS;
+}
 int domId = -1;
 
 int
@@ -27,8 +180,10 @@ libivc_platform_init(platform_functions_t *pf)
     libivc_checkp(pf, INVALID_PARAM);
 
     pf->connect = ks_ivc_core_connect;
+    pf->connectMany = ks_ivc_core_connect_many;
     pf->disconnect = ks_ivc_core_disconnect;
     pf->reconnect = ks_ivc_core_reconnect;
+    pf->park = ks_ivc_core_park;
     pf->notifyRemote = ks_ivc_core_notify_remote;
     pf->registerServerListener = ks_ivc_core_reg_svr_lsnr;
     pf->unregisterServerListener = ks_ivc_core_unreg_svr_lsnr;
@@ -36,16 +191,15 @@ libivc_platform_init(platform_functions_t *pf)
 }
 
 /**
- * Notification when backend fires a ring event.
- * @param irq - not used.
+ * Handles every message waiting in the backend channel.
+ * Assumes the backend lock is held.
  */
 static void
-ks_ivc_core_backend_event(int irq)
+ks_ivc_core_handle_backend_messages(void)
 {
     libivc_message_t inMessage;
     size_t messageSize = 0;
     int rc = INVALID_PARAM;
-    UNUSED(irq);
 
     memset(&inMessage, 0, sizeof (inMessage));
 
@@ -86,6 +240,9 @@ ks_ivc_core_backend_event(int irq)
                     // Flush and bail??
                 }
                 break;
+            case ACK:
+                ks_ivc_core_handle_ack_msg(&inMessage);
+                break;
             case DOMAIN_DEAD:
                 rc = ks_ivc_core_handle_domain_death_notification(&inMessage);
                 if (rc) {
@@ -103,6 +260,40 @@ END:
     libivc_enable_events(ivcXenClient);
 }
 
+/**
+ * Notification when backend fires a ring event.
+ * @param irq - not used.
+ */
+static void
+ks_ivc_core_backend_event(int irq)
+{
+    UNUSED(irq);
+
+    mutex_lock(&ivcBackendLock);
+    ks_ivc_core_handle_backend_messages();
+    mutex_unlock(&ivcBackendLock);
+}
+
+/**
+ * Handles anything left in the backend channel, unless someone else already
+ * is, in which case they'll get to it. Never waits for the backend lock, so
+ * it's safe from callbacks run while the lock is held.
+ */
+static void
+ks_ivc_core_drain_backend(void)
+{
+#ifdef __linux
+    if (!mutex_trylock(&ivcBackendLock))
+        return;
+#else
+    if (!ExTryToAcquireFastMutex(&ivcBackendLock))
+        return;
+#endif
+
+    ks_ivc_core_handle_backend_messages();
+    mutex_unlock(&ivcBackendLock);
+}
+
 int
 ks_ivc_core_init(void)
 {
@@ -122,10 +313,13 @@ ks_ivc_core_init(void)
     memset(ivcXenClient, 0, sizeof (struct libivc_client));
 
     mutex_init(&ivcXenClient->mutex);
+    INIT_LIST_HEAD(&ivcPendingAcks);
+    mutex_init(&ivcPendingAckLock);
+    mutex_init(&ivcBackendLock);
     ivcXenClient->num_pages = 1;
     ivcXenClient->connection_id = LIBIVC_ID_NONE;
 
-    libivc_assert_goto((rc = ks_platform_alloc_shared_mem(1, IVC_DOM_ID,
+    libivc_assert_goto((rc = ks_platform_alloc_shared_mem(1, IVC_DOM_ID, 0,
                              &ivcXenClient->buffer,
                              &ivcXenClient->mapped_grants)) == SUCCESS, ERROR);
 
@@ -363,7 +557,7 @@ ks_ivc_core_open_grant_channel(struct libivc_client *client, libivc_message_t *
     // share memory to remote domain to store our local buffer grant refs.
     // (our read/write, their read only)
     libivc_assert((rc = ks_platform_alloc_shared_mem(NUM_GRANT_REFS,
-                        client->remote_domid, 
+                        client->remote_domid, 0,
                         (char **) &channel, &channel_grants)) == SUCCESS,
                         NULL);
     memset(channel, 0, NUM_GRANT_REFS * PAGE_SIZE);
@@ -401,27 +595,74 @@ ks_ivc_core_close_grant_channel(grant_ref_t * channel)
 }
 
 
+/**
+ * A CONNECT request that has been sent, and what needs tidying up once its ACK
+ * is in.
+ */
+typedef struct ks_ivc_pending_connect {
+    ks_ivc_pending_ack_t ack;         // matches the ACK up with the request.
+    grant_ref_t *channel;             // the grant channel sent with the request.
+    uint8_t registered;               // non zero while ack is registered.
+    uint8_t sent;                     // non zero if there's an ACK to wait for.
+} ks_ivc_pending_connect_t;
+
+/**
+ * Stops waiting for a CONNECT request's ACK and releases its grant channel.
+ * @param pending The request.
+ */
+static void
+ks_ivc_core_end_connect(ks_ivc_pending_connect_t *pending)
+{
+    if (pending->registered)
+        ks_ivc_core_unregister_ack(&pending->ack);
+
+    if (pending->channel)
+        ks_ivc_core_close_grant_channel(pending->channel);
+
+    pending->registered = 0;
+    pending->channel = NULL;
+    pending->sent = 0;
+}
+
 static int
-ks_ivc_send_connect_message(struct libivc_client *client)
+ks_ivc_send_disconnect_message(struct libivc_client *client);
+
+/**
+ * Gets the connect_flags describing a client's buffer, for its CONNECT request.
+ */
+static uint16_t
+ks_ivc_core_connect_flags(struct libivc_client *client)
 {
-#ifdef __linux
-    unsigned long timeout;
-#else
-	LARGE_INTEGER TimeOut;
-	ULONG ticks;
-	LARGE_INTEGER CurTime;
-#endif
+    uint16_t flags = client->read_only ? CONNECT_FLAG_READ_ONLY : 0;
+
+    // A single lane is the classic layout, which every peer understands; leave
+    // the lane bits clear so we can still talk to peers that predate lanes.
+    if (client->num_lanes > 1)
+        flags |= (client->num_lanes << CONNECT_FLAG_LANES_SHIFT) & CONNECT_FLAG_LANES_MASK;
+    return flags;
+}
 
-    grant_ref_t *channel = NULL;
+/**
+ * Sends a client's CONNECT request, without waiting for the ACK. A connection
+ * within this domain is made on the spot, and has no ACK to wait for.
+ * @param client The client to connect.
+ * @param pending Receives the state of the request, for ks_ivc_core_finish_connect.
+ * @return SUCCESS, NO_SPACE if the backend channel is full, or appropriate error number.
+ */
+static int
+ks_ivc_core_begin_connect(struct libivc_client *client, ks_ivc_pending_connect_t *pending)
+{
     libivc_message_t message;
     int rc = INVALID_PARAM;
     struct libivc_client *targetComm = NULL;
 
     // make sure the client isn't NULL.
     libivc_checkp(client, INVALID_PARAM);
+    libivc_checkp(pending, INVALID_PARAM);
 
     // make sure no garbage is being sent across in the message.
     memset(&message, 0, sizeof (libivc_message_t));
+    memset(pending, 0, sizeof (ks_ivc_pending_connect_t));
 
     message.from_dom = (uint16_t) domId;
     message.to_dom = client->remote_domid;
@@ -432,6 +673,7 @@ ks_ivc_send_connect_message(struct libivc_client *client)
     message.type = CONNECT;
     message.event_channel = client->event_channel;
     message.num_grants = client->num_pages;
+    message.connect_flags = ks_ivc_core_connect_flags(client);
 
     // If we're trying to connect to another client in the same domain,
     // we can send over the connect message directly.
@@ -449,22 +691,22 @@ ks_ivc_send_connect_message(struct libivc_client *client)
 
     libivc_checkp(targetComm, INTERNAL_ERROR);
     libivc_checkp(targetComm->ringbuffer, INTERNAL_ERROR);
+    libivc_checkp(client->mapped_grants, INVALID_PARAM);
 
-    //'clear' the ringbuffer
-	//Prior to establishing a connection, we should clear the buffer of
-	//any leftover messages. This is primarily to support the Windows case
-	//where a hotplug event occurs while the VM is asleep. The xenevtchn
-	//doesn't properly propogate the disconnect event on wakeup. As a result
-	//when we try to establish another connection, instead of reading back an ACK or NACK
-	//we read the leftover disconnect, which causes issues.
-    libivc_clear_ringbuffer(targetComm);
+    // Handle anything left over in the backend channel before we start.
+    // This is primarily to support the Windows case where a hotplug event
+    // occurs while the VM is asleep: the xenevtchn doesn't properly propogate
+    // the event on wakeup, leaving messages behind in the channel.
+    ks_ivc_core_drain_backend();
+
+    // Be ready for the ACK before there's any chance of it arriving. It's
+    // delivered by the backend event handler, like any other message.
+    libivc_assert_goto((rc = ks_ivc_core_register_ack(&pending->ack, client)) == SUCCESS, ERROR);
+    pending->registered = 1;
 
     // Otherwise, we should have grants that we want to communicate to a
     // remote domain. Open a chnanel for us to communicate them.
-    libivc_checkp(client->mapped_grants, INVALID_PARAM);
-    channel = ks_ivc_core_open_grant_channel(client, &message);
-
-    libivc_disable_events(targetComm);
+    pending->channel = ks_ivc_core_open_grant_channel(client, &message);
 
     rc = libivc_send(targetComm, (void*)&message, sizeof (message));
     switch (rc) {
@@ -475,83 +717,91 @@ ks_ivc_send_connect_message(struct libivc_client *client)
         case NO_SPACE:
             libivc_error("CONNECT message could not be send to dom%u:%u, "
                     "channel is full.\n", message.to_dom, message.port);
-            goto END;
+            goto ERROR;
         default:
             libivc_error("Failed to send CONNECT packet (%d).\n", rc);
-            goto END;
+            goto ERROR;
     }
 
-    memset(&message, 0, sizeof (message));
+    pending->sent = 1;
+    return SUCCESS;
 
-    // Events are disabled so prepare to poll until timeout.
-#ifdef __linux
-    timeout = jiffies + msecs_to_jiffies(6000);
-#else
-    KeQueryTickCount(&TimeOut);
-    TimeOut.QuadPart += (3 * 10000000) / KeQueryTimeIncrement();
-#endif
+ERROR:
+    ks_ivc_core_end_connect(pending);
+    return rc;
+}
 
-    rc = libivc_recv(targetComm, (void*)&message, sizeof (message));
-    while (rc != SUCCESS) {
-        switch (rc) {
-            case NO_DATA_AVAIL:
-                msleep(100);
-                break;
-            default:
-                libivc_error("Failed to receive from dom%u:%u channel while "
-                        "waiting for ACK packet, abandon (%d).\n",
-                        client->remote_domid, client->port, rc);
-                goto END;
-        }
+/**
+ * Collects the ACK to a CONNECT request sent by ks_ivc_core_begin_connect.
+ * @param client The client being connected.
+ * @param pending The state of the request; released before returning.
+ * @param block Zero to fail with TIMED_OUT at once if the ACK isn't already in.
+ * @return SUCCESS once the connection is established, or appropriate error number.
+ */
+static int
+ks_ivc_core_finish_connect(struct libivc_client *client, ks_ivc_pending_connect_t *pending,
+                           uint8_t block)
+{
+    int rc = SUCCESS;
+    int requested, applied;
 
-#ifdef __linux
-        if (time_after(jiffies, timeout))
-#else
-        KeQueryTickCount(&CurTime);
-        if(TimeOut.QuadPart < CurTime.QuadPart)
-#endif
-        {
-            libivc_warn("Connection to dom%u:%u timed out.\n",
-                    client->remote_domid, client->port);
-            rc = TIMED_OUT;
-            goto END;
-        }
+    if (!pending->sent)
+        return SUCCESS;
 
-        rc = libivc_recv(targetComm, (void*)&message, sizeof (message));
+    rc = ks_ivc_core_wait_for_ack(&pending->ack, block);
+    if (rc != SUCCESS) {
+        libivc_warn("Connection to dom%u:%u timed out.\n",
+                client->remote_domid, client->port);
+        goto END;
     }
 
-    // We have different cases to handle on the message back.
-    // 1. On a channeled message, we expect an ACK message back and status SUCCESS
-    //    if we initiated the connection.
-    // 2. On a chance the remote domain isn't up, we expect an ACK back from the backend driver
-    //    and a status of CONNECTION_REFUSED
-    // 3. On the chance that the remote dom fails or isn't listening, we expect an ACK
-    //    and an appropriate status set in the status field. IE: CONNECTION_REFUSED
+    // We have different cases to handle on the ACK.
+    // 1. If we initiated the connection and it was accepted, status SUCCESS.
+    // 2. On a chance the remote domain isn't up, the backend driver ACKs with
+    //    a status of CONNECTION_REFUSED
+    // 3. On the chance that the remote dom fails or isn't listening, the ACK
+    //    carries an appropriate status. IE: CONNECTION_REFUSED
     // 2 and 3 will be treated as the same.
-    if (message.type != ACK) {
-        libivc_warn("Unexpected message (%d) received after connection request"
-                ", abort.\n", message.type);
-        rc = INTERNAL_ERROR;
+    requested = ks_ivc_core_connect_flags(client);
+    applied = ack_status_applied_flags(pending->ack.status);
+    if (pending->ack.status != SUCCESS && applied < 0) {
+        libivc_error("Connection failed (%d).\n", pending->ack.status);
+        rc = pending->ack.status;
         goto END;
     }
-    if (message.status != SUCCESS) {
-        libivc_error("Connection failed (%d).\n", message.status);
-        rc = message.status;
+
+    // A peer that doesn't know about lanes or read only buffers lays out a
+    // single pair of channels over the pages, and would corrupt ours; undo
+    // the connection rather than use it.
+    if (requested && applied != requested) {
+        libivc_error("dom%u:%u can't share a buffer the way we asked (%#x, got %#x); disconnecting.\n",
+                client->remote_domid, client->port, requested, applied);
+        ks_ivc_send_disconnect_message(client);
+        rc = NOT_IMPLEMENTED;
         goto END;
     }
     // Instruct the backend to handle notification upon death.
-    ks_ivc_request_remote_notification_on_death(client, targetComm);
+    ks_ivc_request_remote_notification_on_death(client, ivcXenClient);
 
     libivc_debug("Connection to dom%u:%u established.\n", client->remote_domid,
             client->port);
 
 END:
-    if (channel)
-        ks_ivc_core_close_grant_channel(channel);
+    ks_ivc_core_end_connect(pending);
+    return rc;
+}
+
+static int
+ks_ivc_send_connect_message(struct libivc_client *client)
+{
+    ks_ivc_pending_connect_t pending;
+    int rc;
 
-    libivc_enable_events(targetComm);
+    rc = ks_ivc_core_begin_connect(client, &pending);
+    if (rc != SUCCESS)
+        return rc;
 
-    return rc;
+    return ks_ivc_core_finish_connect(client, &pending, 1);
 }
 
 static int
@@ -600,6 +850,7 @@ ks_ivc_core_notify_event_received(struct libivc_client *client)
     list_head_t *cpos = NULL, *ctmp = NULL; // client list iterators
     callback_node_t *callback = NULL;
     uint8_t calledback = 0;
+    uint64_t pickedUp = 0;
 
     libivc_checkp(client, -EINVAL);
 
@@ -611,6 +862,11 @@ ks_ivc_core_notify_event_received(struct libivc_client *client)
     } 
     else 
     {
+        pickedUp = libivc_monotonic_ns();
+
+        // pick up, or take part in, any resize the remote has started.
+        __libivc_service_resize(client);
+
         if (!list_empty(&client->callback_list)) 
         {
             list_for_each_safe(cpos, ctmp, &client->callback_list) 
@@ -623,6 +879,9 @@ ks_ivc_core_notify_event_received(struct libivc_client *client)
                 }
             }
         }
+
+        // Userspace clients keep their own counters.
+        __libivc_record_events(client, 1, pickedUp, calledback);
     }
 
     return SUCCESS;
@@ -643,6 +902,45 @@ ks_ivc_client_remote_event_fired(int irq)
     libivc_put_client(client);
 }
 
+/**
+ * Determines whether a server-side client is still waiting for a user space
+ * process to accept it.
+ */
+static bool
+ks_ivc_core_awaiting_accept(struct libivc_client *client)
+{
+    if (client->context != NULL)
+        return false;
+
+    if (client->remote_domid == IVC_DOM_ID && client->port == IVC_PORT)
+    {
+        libivc_error("Bootstrap connection is associated with a server!\n");
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * Counts the clients waiting for a user space server to accept them.
+ * Assumes the server's client mutex is held.
+ */
+static uint32_t
+ks_ivc_core_pending_accepts(struct libivc_server *server)
+{
+    list_head_t *pos = NULL;
+    struct libivc_client *client = NULL;
+    uint32_t pending = 0;
+
+    list_for_each(pos, &server->client_list)
+    {
+        client = container_of(pos, struct libivc_client, node);
+        if (client->context == NULL)
+            pending++;
+    }
+
+    return pending;
+}
 
 /**
  * called when an inbound message to connect is received by handling an event
@@ -659,6 +957,7 @@ ks_ivc_core_handle_connect_msg(libivc_message_t *msg)
     struct libivc_client *responseClient = NULL;
     struct libivc_server *server = NULL;
     libivc_message_t respMessage;
+    uint16_t lanes;
 
     libivc_info("Received inbound connection request.\n");
     memset(&respMessage, 0, sizeof (libivc_message_t));
@@ -701,6 +1000,28 @@ ks_ivc_core_handle_connect_msg(libivc_message_t *msg)
 
     mutex_lock(&server->client_mutex);
 
+    // If a user space server has fallen this far behind, as when every guest
+    // reconnects at once, refuse rather than queue yet more mappings it may
+    // never accept; the remote's connect fails, and retrying is up to it.
+    if (server->context != NULL && server->accept_backlog &&
+        ks_ivc_core_pending_accepts(server) >= server->accept_backlog)
+    {
+        libivc_warn_ratelimited("Accept backlog of %u full on port %u; refusing dom%u.\n",
+            server->accept_backlog, server->port, msg->from_dom);
+        rc = CONNECTION_REFUSED;
+        goto ERROR;
+    }
+
+    // The lane count comes from the remote, and sizes the client's lane tables.
+    lanes = (msg->connect_flags & CONNECT_FLAG_LANES_MASK) >> CONNECT_FLAG_LANES_SHIFT;
+    if (lanes > LIBIVC_MAX_LANES)
+    {
+        libivc_warn_ratelimited("Refusing dom%u:%u, which asked for %u lanes.\n",
+            msg->from_dom, msg->port, lanes);
+        rc = INVALID_PARAM;
+        goto ERROR;
+    }
+
     newClient = (struct libivc_client *) ks_platform_alloc(sizeof (struct libivc_client));
     rc = OUT_OF_MEM;
     libivc_checkp_goto(newClient, ERROR);
@@ -711,6 +1032,8 @@ ks_ivc_core_handle_connect_msg(libivc_message_t *msg)
     newClient->server_side = 1;
     newClient->num_pages = msg->num_grants;
     newClient->connection_id = msg->connection_id;
+    newClient->read_only = (msg->connect_flags & CONNECT_FLAG_READ_ONLY) ? 1 : 0;
+    newClient->num_lanes = lanes ? (uint8_t) lanes : 1;
 
     // Track a reference to this new client.
     libivc_get_client(newClient);
@@ -726,6 +1049,7 @@ ks_ivc_core_handle_connect_msg(libivc_message_t *msg)
 #endif
 
     mutex_init(&newClient->mutex);
+    libivc_event_wait_init(&newClient->event_wait);
     newClient->buffer = NULL;
 
     // If this request came from another domain, map in the remote memory, and
@@ -738,7 +1062,12 @@ ks_ivc_core_handle_connect_msg(libivc_message_t *msg)
         libivc_assert_goto((rc = ks_platform_bind_interdomain_evt(msg->from_dom, msg->event_channel,
                                  &newClient->irq_port,
                                  ks_ivc_client_remote_event_fired)) == SUCCESS, ERROR);
+
+        // Confirm any flags we've laid out the buffer by, so the remote knows
+        // we understood them; a plain request gets the plain SUCCESS it expects.
         respMessage.status = SUCCESS;
+        if (msg->connect_flags & CONNECT_FLAGS_MASK)
+            respMessage.status = (int16_t) (ACK_STATUS_FLAGS_APPLIED | (msg->connect_flags & CONNECT_FLAGS_MASK));
     } 
 
     rc = INTERNAL_ERROR;
@@ -923,12 +1252,43 @@ ks_ivc_core_handle_domain_death_notification(libivc_message_t *msg)
 }
 
 /**
- * Driver level connect function called when libivc_connect is ready to hand off to platform.
+ * Releases what ks_ivc_core_prepare_connect set up for a client, if anything.
+ * @param client The client that failed to connect.
+ */
+static void
+ks_ivc_core_release_connect(struct libivc_client *client)
+{
+    if (client->buffer && client->shares_buffer) 
+    {
+        ks_platform_unshare_mem(client->buffer, client->mapped_grants);
+        client->buffer = NULL;
+    }
+    else if (client->buffer) 
+    {
+        ks_platform_free_shared_mem(client->buffer);
+        client->buffer = NULL;
+    }
+
+    if (client->irq_port > 0) 
+    {
+        ks_platform_unbind_event_callback(client->irq_port);
+        client->event_channel = 0;
+        client->irq_port = 0;
+    }
+    else if (client->event_channel)
+    {
+        ks_platform_closeEvtChn(client->event_channel);
+        client->event_channel = 0;
+    }
+}
+
+/**
+ * Sets up the event channel and shared memory for a client-style connection.
  * @param client The ivc client trying to make the connection.
- * @return SUCCESS or appropriate error number.
+ * @return SUCCESS or appropriate error number; on failure nothing is left set up.
  */
-int
-ks_ivc_core_connect(struct libivc_client *client)
+static int
+ks_ivc_core_prepare_connect(struct libivc_client *client)
 {
     int rc = SUCCESS;
 
@@ -972,35 +1332,144 @@ ks_ivc_core_connect(struct libivc_client *client)
     // - Granted memory, if this is an inter-VM client; or
     // - A big block of kernel virtual memory, if this is a IVC client being used
     //   on the same VM.
-    libivc_assert_goto((rc = ks_platform_alloc_shared_mem(client->num_pages,
-                             client->remote_domid, &client->buffer, &client->mapped_grants)) == SUCCESS, ERROR);
+    // If we've been asked to share another client's buffer, share its pages instead.
+    if(client->buffer_source)
+    {
+        libivc_checkp_goto(client->buffer_source->buffer, ERROR);
+        libivc_assert_goto((rc = ks_platform_share_mem(client->buffer_source->buffer,
+                                 client->remote_domid, client->read_only, &client->mapped_grants)) == SUCCESS, ERROR);
+        client->buffer = client->buffer_source->buffer;
+    }
+    else
+    {
+        libivc_assert_goto((rc = ks_platform_alloc_shared_mem(client->num_pages,
+                                 client->remote_domid, client->read_only, &client->buffer, &client->mapped_grants)) == SUCCESS, ERROR);
+    }
 
-    // Send a connection request to the local or remote domain. 
-    libivc_assert_goto((rc = ks_ivc_send_connect_message(client)) == SUCCESS, ERROR);
+    return SUCCESS;
 
-    rc = SUCCESS;
-    goto END;
+ERROR:
+    ks_ivc_core_release_connect(client);
+    return rc;
+}
+
+/**
+ * Driver level connect function called when libivc_connect is ready to hand off to platform.
+ * @param client The ivc client trying to make the connection.
+ * @return SUCCESS or appropriate error number.
+ */
+int
+ks_ivc_core_connect(struct libivc_client *client)
+{
+    int rc = SUCCESS;
+
+    libivc_assert((rc = ks_ivc_core_prepare_connect(client)) == SUCCESS, rc);
+
+    // Send a connection request to the local or remote domain, unless we've
+    // been asked to hold on to the buffer until a later reconnect.
+    if(!client->parked)
+    {
+        libivc_assert_goto((rc = ks_ivc_send_connect_message(client)) == SUCCESS, ERROR);
+    }
+
+    return SUCCESS;
 
 ERROR:
-    if (client->buffer) 
+    ks_ivc_core_release_connect(client);
+    return rc;
+}
+
+/**
+ * Collects the ACKs to every CONNECT request in flight. Once one request has
+ * timed out, the rest have had as long, and are only checked.
+ * @param clients The clients being connected.
+ * @param pending Their requests.
+ * @param statuses Their statuses, updated for each request in flight.
+ * @param first The first client that may have a request in flight.
+ * @param last One past the last such client.
+ * @param block Cleared once a request times out.
+ */
+static void
+ks_ivc_core_finish_connects(struct libivc_client **clients, ks_ivc_pending_connect_t *pending,
+                            int *statuses, uint32_t first, uint32_t last, uint8_t *block)
+{
+    uint32_t i;
+
+    for (i = first; i < last; i++)
     {
-        ks_platform_free_shared_mem(client->buffer);
+        if (!pending[i].sent)
+            continue;
+
+        statuses[i] = ks_ivc_core_finish_connect(clients[i], &pending[i], *block);
+        if (statuses[i] == TIMED_OUT)
+            *block = 0;
     }
+}
 
-    if (client->irq_port > 0) 
+/**
+ * Driver level connect for many clients at once. Every buffer is allocated and
+ * granted first, then the CONNECT requests are sent back to back, and only
+ * then are the ACKs collected, so the remotes handle the requests in parallel.
+ * @param clients The ivc clients trying to make connections.
+ * @param statuses Receives SUCCESS or an error number for each client.
+ * @param count The number of clients.
+ * @return SUCCESS if every client's status has been filled in, or appropriate
+ *    error number.
+ */
+int
+ks_ivc_core_connect_many(struct libivc_client **clients, int *statuses, uint32_t count)
+{
+    ks_ivc_pending_connect_t *pending = NULL;
+    uint32_t i = 0, first = 0, in_flight = 0;
+    uint8_t block = 1;
+
+    libivc_checkp(clients, INVALID_PARAM);
+    libivc_checkp(statuses, INVALID_PARAM);
+    libivc_assert(count > 0, INVALID_PARAM);
+
+    pending = (ks_ivc_pending_connect_t *) malloc(count * sizeof(ks_ivc_pending_connect_t));
+    libivc_checkp(pending, OUT_OF_MEM);
+    memset(pending, 0, count * sizeof(ks_ivc_pending_connect_t));
+
+    for (i = 0; i < count; i++)
+        statuses[i] = ks_ivc_core_prepare_connect(clients[i]);
+
+    i = 0;
+    while (i < count)
     {
-        ks_platform_unbind_event_callback(client->irq_port);
-        client->event_channel = 0;
-        client->irq_port = 0;
+        if (statuses[i] != SUCCESS || clients[i]->parked)
+        {
+            i++;
+            continue;
+        }
+
+        statuses[i] = ks_ivc_core_begin_connect(clients[i], &pending[i]);
+
+        // If the backend channel has filled, the requests already in it are
+        // answered before this one is tried again.
+        if (statuses[i] == NO_SPACE && in_flight)
+        {
+            ks_ivc_core_finish_connects(clients, pending, statuses, first, i, &block);
+            first = i;
+            in_flight = 0;
+            continue;
+        }
+
+        if (pending[i].sent)
+            in_flight++;
+        i++;
     }
-    else if (client->event_channel)
+
+    ks_ivc_core_finish_connects(clients, pending, statuses, first, count, &block);
+
+    for (i = 0; i < count; i++)
     {
-        ks_platform_closeEvtChn(client->event_channel);
-        client->event_channel = 0;
+        if (statuses[i] != SUCCESS)
+            ks_ivc_core_release_connect(clients[i]);
     }
 
-END:
-    return rc;
+    free(pending);
+    return SUCCESS;
 }
 
 /**
@@ -1010,15 +1479,25 @@ int
 ks_ivc_core_reconnect(struct libivc_client *client, uint16_t new_domid, uint16_t new_port)
 {
     int rc = SUCCESS;
+    uint16_t old_domid, old_port;
 
     libivc_info("In %s\n", __FUNCTION__);
     libivc_checkp(client, INVALID_PARAM);
     libivc_assert(client->buffer, INVALID_PARAM);
 
     // Apply the new domain ID, and new port information.
+    old_domid = client->remote_domid;
+    old_port = client->port;
     client->remote_domid = new_domid;
     client->port = new_port;
 
+    // A parked buffer still holds whatever its last connection left in it;
+    // start the new connection with empty rings.
+    if(client->parked)
+    {
+        memset(client->buffer, 0, client->num_pages * PAGE_SIZE);
+    }
+
     // Tear down any existing event channels. We'll bring up new event channels, 
     // if necessary.
     if(client->event_channel) {
@@ -1049,6 +1528,10 @@ ks_ivc_core_reconnect(struct libivc_client *client, uint16_t new_domid, uint16_t
 
 ERROR:
 
+    // Leave the client as it was found, so it can still be looked up by its
+    // old domain and port.
+    client->remote_domid = old_domid;
+    client->port = old_port;
 
     if (client->irq_port > 0)
     {
@@ -1075,8 +1558,13 @@ ks_ivc_core_notify_remote(struct libivc_client *client)
     return ks_platform_fire_remote_event(client);
 }
 
-int
-ks_ivc_core_disconnect(struct libivc_client *client)
+/**
+ * Tells the remote that we're closing our end of a connection.
+ * @param client The ivc client that is disconnecting.
+ * @return SUCCESS or appropriate error number.
+ */
+static int
+ks_ivc_send_disconnect_message(struct libivc_client *client)
 {
     int rc = SUCCESS;
     struct libivc_client *msgTarget = NULL;
@@ -1118,7 +1606,53 @@ ks_ivc_core_disconnect(struct libivc_client *client)
         rc = ks_platform_notify_local_disconnect(client);
     }
 
+    return rc;
+}
+
+/**
+ * Releases the remote end of a client-side connection, but keeps the client's
+ * buffer and grants for a later reconnect.
+ * @param client The ivc client to park.
+ * @return SUCCESS or appropriate error number.
+ */
+int
+ks_ivc_core_park(struct libivc_client *client)
+{
+    int rc;
+
+    libivc_checkp(client, INVALID_PARAM);
+    libivc_assert(!client->server_side, INVALID_PARAM);
+    libivc_checkp(client->buffer, INVALID_PARAM);
+
+    rc = ks_ivc_send_disconnect_message(client);
+
+    if (client->irq_port) 
+    {
+        ks_platform_unbind_event_callback(client->irq_port);
+        client->irq_port = 0;
+        client->event_channel = 0;
+    }
+    else if (client->event_channel)
+    {
+        ks_platform_closeEvtChn(client->event_channel);
+        client->event_channel = 0;
+    }
+
+    return rc;
+}
+
+int
+ks_ivc_core_disconnect(struct libivc_client *client)
+{
+    int rc = SUCCESS;
+
+    libivc_checkp(client, INVALID_PARAM);
 
+    // A parked client has no remote to tell.
+    if(!client->parked)
+    {
+        rc = ks_ivc_send_disconnect_message(client);
+    }
 
     if (client->irq_port) 
     {
@@ -1132,7 +1666,11 @@ ks_ivc_core_disconnect(struct libivc_client *client)
     }
     
 
-    if (client->buffer && !client->server_side) 
+    if (client->buffer && !client->server_side && client->shares_buffer) 
+    {
+        ks_platform_unshare_mem(client->buffer, client->mapped_grants);
+    }
+    else if (client->buffer && !client->server_side) 
     {
         ks_platform_free_shared_mem(client->buffer);
     } 
@@ -1263,6 +1801,220 @@ ks_ivc_check_for_equiv_client(uint16_t domid, uint16_t port, uint64_t conn_id, u
     return ret;
 }
 
+/**
+ * Finds the user space server an accept ioctl is for, checking that the calling
+ * process owns it.
+ * @param listener - the server's port, domid and connection ID.
+ * @param context - non null pointer to user space file context.
+ * @return the server, with a reference held, or NULL if there is none.
+ */
+static struct libivc_server *
+ks_ivc_core_find_accepting_server(struct libivc_client_ioctl_info *listener, file_context_t *context)
+{
+    struct libivc_server_ioctl_info externalServer;
+    struct libivc_server *internalServer = NULL;
+
+    memset(&externalServer, 0, sizeof (struct libivc_server_ioctl_info));
+    externalServer.port = listener->port;
+    externalServer.limit_to_domid = listener->remote_domid;
+    externalServer.limit_to_connection_id = listener->connection_id;
+    internalServer = ks_ivc_core_find_internal_server(&externalServer, context);
+    libivc_checkp(internalServer, NULL); // nobody listening on this port.
+
+    // only the process that owns the server may accept from it.
+    if(internalServer->context != context) {
+        libivc_error("Trying to accept on another process' server!\n");
+        libivc_put_server(internalServer);
+        return NULL;
+    }
+
+    return internalServer;
+}
+
+/**
+ * Hands a waiting client to the user space process accepting it, mapping its
+ * buffer in and filling in the process' view of it.
+ * Assumes the server's client mutex is held.
+ * @param internalClient - a client for which ks_ivc_core_awaiting_accept holds.
+ * @param client - the user space representation to fill in; carries the event
+ *    handles the client should use.
+ * @param context - non null pointer to user space file context.
+ * @return SUCCESS or appropriate error number.
+ */
+static int
+ks_ivc_core_accept_client(struct libivc_client *internalClient, struct libivc_client_ioctl_info *client,
+                          file_context_t *context)
+{
+    int rc;
+
+    // Note: we don't need to up the reference count, here, as we
+    // hold the relevant server's client mutex, and thus have its
+    // reference on the internal client.
+
+    // if this isn't channeled, there may not be a local buffer to map.
+    if (internalClient->buffer != NULL) 
+    {
+        libivc_assert((rc = ks_platform_map_to_userspace(internalClient->buffer, 
+                            &client->buffer,
+                            internalClient->num_pages * PAGE_SIZE,
+                            context)) == SUCCESS, rc);
+        client->num_pages = internalClient->num_pages;
+    }
+
+    internalClient->context = context;
+    client->remote_domid = internalClient->remote_domid;
+    client->port = internalClient->port;
+    client->server_side = internalClient->server_side = 1;
+    client->opaque = internalClient->opaque;
+    client->connection_id = internalClient->connection_id;
+    client->read_only = internalClient->read_only;
+    client->num_lanes = internalClient->num_lanes;
+#ifdef __linux // linux specific fields for user space event notifications.  
+    internalClient->client_disconnect_event = client->client_disconnect_event;
+    internalClient->client_notify_event = client->client_notify_event;
+#endif
+    libivc_info("Successfully accepted client %u:%u -- id: %u\n", client->remote_domid, client->port, (unsigned int)client->connection_id);
+    return SUCCESS;
+}
+
+/**
+ * Accepts as many of a user space server's waiting clients as the caller has
+ * room for.
+ * @param batch - the server to accept from, and the number of clients to accept;
+ *    receives the number accepted.
+ * @param clients - batch->max_clients entries, each carrying the event handles
+ *    the client should use; the first batch->num_clients are filled in.
+ * @param context - non null pointer to user space file context.
+ * @return SUCCESS, even if no clients were waiting, or appropriate error number.
+ */
+int
+ks_ivc_core_accept_batch(struct libivc_accept_batch_ioctl_info *batch, struct libivc_client_ioctl_info *clients,
+                         file_context_t *context)
+{
+    int rc = SUCCESS;
+    list_head_t *pos = NULL, *temp = NULL;
+    struct libivc_client *internalClient = NULL;
+    struct libivc_server *internalServer = NULL;
+
+    libivc_checkp(batch, INVALID_PARAM);
+    libivc_checkp(clients, INVALID_PARAM);
+    libivc_checkp(context, INVALID_PARAM);
+    libivc_assert(batch->max_clients <= LIBIVC_ACCEPT_BATCH_MAX, INVALID_PARAM);
+
+    internalServer = ks_ivc_core_find_accepting_server(&batch->listener, context);
+    libivc_checkp(internalServer, INVALID_PARAM);
+
+    batch->num_clients = 0;
+
+    mutex_lock(&internalServer->client_mutex);
+    list_for_each_safe(pos, temp, &internalServer->client_list) 
+    {
+        if (batch->num_clients == batch->max_clients)
+            break;
+
+        internalClient = container_of(pos, struct libivc_client, node);
+        if (!ks_ivc_core_awaiting_accept(internalClient))
+            continue;
+
+        // Stop at the first failure, leaving the rest waiting, but keep
+        // whatever was accepted before it.
+        rc = ks_ivc_core_accept_client(internalClient, &clients[batch->num_clients], context);
+        if (rc != SUCCESS)
+            break;
+
+        batch->num_clients++;
+    }
+    mutex_unlock(&internalServer->client_mutex);
+    libivc_put_server(internalServer);
+
+    return batch->num_clients ? SUCCESS : rc;
+}
+
+/**
+ * Connects many user space clients at once, as IVC_CONNECT would each of them.
+ * @param batch - the number of clients.
+ * @param clients - batch->num_clients entries, each carrying the connection's
+ *    parameters and the event handles the client should use; the connected
+ *    ones are filled in.
+ * @param statuses - receives SUCCESS or an error number for each client.
+ * @param context - non null pointer to user space file context.
+ * @return SUCCESS once every status has been filled in, or appropriate error number.
+ */
+int
+ks_ivc_core_connect_batch(struct libivc_connect_batch_ioctl_info *batch, struct libivc_client_ioctl_info *clients,
+                          int32_t *statuses, file_context_t *context)
+{
+    struct libivc_connect_req *reqs = NULL;
+    struct libivc_connect_result *results = NULL;
+    struct libivc_client *internalClient = NULL;
+    uint32_t i;
+    int rc = INVALID_PARAM;
+
+    libivc_checkp(batch, INVALID_PARAM);
+    libivc_checkp(clients, INVALID_PARAM);
+    libivc_checkp(statuses, INVALID_PARAM);
+    libivc_checkp(context, INVALID_PARAM);
+    libivc_assert(batch->num_clients > 0 && batch->num_clients <= LIBIVC_CONNECT_BATCH_MAX, INVALID_PARAM);
+
+    reqs = (struct libivc_connect_req *) malloc(batch->num_clients * sizeof(struct libivc_connect_req));
+    results = (struct libivc_connect_result *) malloc(batch->num_clients * sizeof(struct libivc_connect_result));
+    rc = OUT_OF_MEM;
+    libivc_checkp_goto(reqs, END);
+    libivc_checkp_goto(results, END);
+
+    rc = INVALID_PARAM;
+    for (i = 0; i < batch->num_clients; i++)
+    {
+        // Shared and parked connections still go through IVC_CONNECT.
+        libivc_assert_goto(!clients[i].read_only && !clients[i].parked, END);
+
+        memset(&reqs[i], 0, sizeof(struct libivc_connect_req));
+        reqs[i].remote_domid = clients[i].remote_domid;
+        reqs[i].port = clients[i].port;
+        reqs[i].num_pages = clients[i].num_pages;
+        reqs[i].connection_id = clients[i].connection_id;
+        reqs[i].num_lanes = clients[i].num_lanes ? clients[i].num_lanes : 1;
+    }
+
+    libivc_assert_goto((rc = libivc_connect_many(reqs, batch->num_clients, results)) == SUCCESS, END);
+
+    for (i = 0; i < batch->num_clients; i++)
+    {
+        statuses[i] = results[i].status;
+        internalClient = results[i].client;
+        if (statuses[i] != SUCCESS)
+            continue;
+
+        // need to map to userspace.
+        libivc_info("Mapping %p to user space.\n", internalClient->buffer);
+        clients[i].num_pages = internalClient->num_pages;
+        statuses[i] = ks_platform_map_to_userspace(internalClient->buffer, &clients[i].buffer,
+                                                   clients[i].num_pages * PAGE_SIZE, context);
+        if (statuses[i] != SUCCESS)
+        {
+            // close the connection, it's useless if the client can't get to it.
+            libivc_error("Failed to map addresses to user space, closing connection.\n");
+            libivc_disconnect(internalClient);
+            continue;
+        }
+
+        internalClient->context = context;
+
+#ifdef __linux // linux specific fields for user space event notifications.
+        internalClient->client_disconnect_event = clients[i].client_disconnect_event;
+        internalClient->client_notify_event = clients[i].client_notify_event;
+#endif
+    }
+
+END:
+    if (results)
+        free(results);
+    if (reqs)
+        free(reqs);
+
+    return rc;
+}
+
 /**
  * Services IOCTLs coming from user space for ivc client related operations.
  * @param ioctlNum The ioctl number.
@@ -1284,12 +2036,11 @@ ks_ivc_core_client_ioctl(uint8_t ioctlNum, struct libivc_client_ioctl_info *clie
     // representation of the connected client.
     struct libivc_client *internalClient = NULL;
     struct libivc_server *internalServer = NULL; // for the accept ioctl
-    struct libivc_server_ioctl_info externalServer; // just used to find the internal one.
 
     // sanity check the parameters
     libivc_checkp(client, rc);
     libivc_checkp(context, rc);
-    libivc_assert(ioctlNum <= IVC_RECONNECT_IOCTL, INVALID_PARAM);
+    libivc_assert(ioctlNum <= IVC_PARK_IOCTL, INVALID_PARAM);
 
     switch (ioctlNum) 
     {
@@ -1297,11 +2048,49 @@ ks_ivc_core_client_ioctl(uint8_t ioctlNum, struct libivc_client_ioctl_info *clie
         case IVC_RECONNECT_IOCTL:
         {
 
-            if(ioctlNum == IVC_CONNECT_IOCTL) {
-                // perform the driver level connection to the remote domain.
-                libivc_assert((rc = libivc_connect_with_id(&internalClient, client->remote_domid,
+            if(ioctlNum == IVC_CONNECT_IOCTL && client->read_only) {
+                struct libivc_client *sourceClient = NULL;
+
+                // If the buffer is to be shared with an existing connection, look it
+                // up; only the process that owns that connection may share its buffer.
+                if(client->has_source) {
+                    struct libivc_client_ioctl_info sourceInfo;
+
+                    memset(&sourceInfo, 0, sizeof (struct libivc_client_ioctl_info));
+                    sourceInfo.remote_domid = client->source_domid;
+                    sourceInfo.port = client->source_port;
+                    sourceInfo.connection_id = client->source_connection_id;
+                    sourceInfo.server_side = 0;
+
+                    sourceClient = ks_ivc_core_find_internal_client(&sourceInfo);
+                    libivc_checkp(sourceClient, INVALID_PARAM);
+
+                    if(sourceClient->context != context) {
+                        libivc_error("Trying to share another process' buffer!\n");
+                        libivc_put_client(sourceClient);
+                        return ACCESS_DENIED;
+                    }
+                }
+
+                rc = libivc_connect_shared(&internalClient, client->remote_domid, client->port,
+                                           client->num_pages, client->connection_id, sourceClient);
+                if(sourceClient)
+                    libivc_put_client(sourceClient);
+
+                libivc_assert(rc == SUCCESS, rc);
+                libivc_checkp(internalClient, INTERNAL_ERROR);
+                client->num_pages = internalClient->num_pages;
+            } else if(ioctlNum == IVC_CONNECT_IOCTL && client->parked) {
+                // allocate and grant the buffer, but leave connecting for a reconnect.
+                libivc_assert((rc = libivc_connect_parked(&internalClient, client->remote_domid,
                                                    client->port, client->num_pages, client->connection_id)) == SUCCESS, rc);
                 libivc_checkp(internalClient, INTERNAL_ERROR);
+            } else if(ioctlNum == IVC_CONNECT_IOCTL) {
+                // perform the driver level connection to the remote domain.
+                libivc_assert((rc = libivc_connect_lanes(&internalClient, client->remote_domid,
+                                                   client->port, client->num_pages, client->connection_id,
+                                                   client->num_lanes ? client->num_lanes : 1)) == SUCCESS, rc);
+                libivc_checkp(internalClient, INTERNAL_ERROR);
             } else {
                 internalClient = ks_ivc_core_find_internal_client(client);
                 libivc_checkp(internalClient, INTERNAL_ERROR);
@@ -1345,18 +2134,22 @@ ks_ivc_core_client_ioctl(uint8_t ioctlNum, struct libivc_client_ioctl_info *clie
                 }
             }
 #endif
-            // need to map to userspace.
+            // need to map to userspace. A reconnected client keeps its pages, so
+            // it can keep the mapping it already has.
             libivc_checkp(internalClient->buffer, INTERNAL_ERROR);
-            libivc_info("Mapping %p to user space.\n", internalClient->buffer);
-            rc = ks_platform_map_to_userspace(internalClient->buffer, &client->buffer,
-                                              client->num_pages * PAGE_SIZE, context);
-
-            if (rc != SUCCESS) 
+            if (ioctlNum != IVC_RECONNECT_IOCTL || client->buffer == NULL)
             {
-                // close the connection, it's useless if the client can't get to it.
-                libivc_error("Failed to map addresses to user space, closing connection.\n");
-                libivc_disconnect(internalClient);
-                return rc;
+                libivc_info("Mapping %p to user space.\n", internalClient->buffer);
+                rc = ks_platform_map_to_userspace(internalClient->buffer, &client->buffer,
+                                                  client->num_pages * PAGE_SIZE, context);
+
+                if (rc != SUCCESS) 
+                {
+                    // close the connection, it's useless if the client can't get to it.
+                    libivc_error("Failed to map addresses to user space, closing connection.\n");
+                    libivc_disconnect(internalClient);
+                    return rc;
+                }
             }
 
             internalClient->context = context;
@@ -1390,6 +2183,17 @@ ks_ivc_core_client_ioctl(uint8_t ioctlNum, struct libivc_client_ioctl_info *clie
 
             break;
         }
+        case IVC_PARK_IOCTL:
+        {
+            internalClient = ks_ivc_core_find_internal_client(client);
+            libivc_checkp(internalClient, INVALID_PARAM);
+            rc = libivc_park(internalClient);
+            libivc_put_client(internalClient);
+            libivc_assert(rc == SUCCESS, rc);
+
+            client->parked = 1;
+            break;
+        }
         case IVC_NOTIFY_REMOTE_IOCTL: 
         {
             internalClient = ks_ivc_core_find_internal_client(client);
@@ -1400,63 +2204,22 @@ ks_ivc_core_client_ioctl(uint8_t ioctlNum, struct libivc_client_ioctl_info *clie
         }
         case IVC_SERVER_ACCEPT_IOCTL:
         {
-            memset(&externalServer, 0, sizeof (struct libivc_server_ioctl_info));
-            externalServer.port = client->port;
-            externalServer.limit_to_domid = client->remote_domid;
-            externalServer.limit_to_connection_id = client->connection_id;
-            internalServer = ks_ivc_core_find_internal_server(&externalServer, context);
-            libivc_checkp(internalServer, INVALID_PARAM); // nobody listening on this port.
-
-            // only the process that owns the server may accept from it.
-            if(internalServer->context != context) {
-                libivc_error("Trying to accept on another process' server!\n");
-                goto accept_done;
-            }
+            internalServer = ks_ivc_core_find_accepting_server(client, context);
+            libivc_checkp(internalServer, INVALID_PARAM);
 
+            // Accept just the first waiting client; IVC_SERVER_ACCEPT_BATCH
+            // takes more at once.
             mutex_lock(&internalServer->client_mutex);
             list_for_each_safe(pos, temp, &internalServer->client_list) 
             {
                 internalClient = container_of(pos, struct libivc_client, node);
-                if (internalClient->remote_domid == IVC_DOM_ID && internalClient->port == IVC_PORT) 
-                {
-                    libivc_error("Bootstrap connection is associated with a server!\n");
-                    continue;
-                }
-
-                // Note: we don't need to up the reference count, here, as we
-                // hold the relevant server's client mutex, and thus have its
-                // reference on the internal client.
-
-                if (internalClient->context == NULL) 
+                if (ks_ivc_core_awaiting_accept(internalClient))
                 {
-                    internalClient->context = context;
-
-                    // if this isn't channeled, there may not be a local buffer to map.
-                    if (internalClient->buffer != NULL) 
-                    {
-                        libivc_assert_goto((rc = ks_platform_map_to_userspace(internalClient->buffer, 
-                                            &client->buffer,
-                                            internalClient->num_pages * PAGE_SIZE,
-                                            context)) == SUCCESS, lock_done);
-                        client->num_pages = internalClient->num_pages;
-                    }
-
-                    client->remote_domid = internalClient->remote_domid;
-                    client->port = internalClient->port;
-                    client->server_side = internalClient->server_side = 1;
-                    client->opaque = internalClient->opaque;
-                    client->connection_id = internalClient->connection_id;
-#ifdef __linux // linux specific fields for user space event notifications.  
-                    internalClient->client_disconnect_event = client->client_disconnect_event;
-                    internalClient->client_notify_event = client->client_notify_event;
-#endif
-                    libivc_info("Successfully accepted client %u:%u -- id: %u\n", client->remote_domid, client->port, (unsigned int)client->connection_id);
-                    rc = SUCCESS;
+                    rc = ks_ivc_core_accept_client(internalClient, client, context);
+                    break;
                 }
             }
-        lock_done:
             mutex_unlock(&internalServer->client_mutex);
-        accept_done:
             libivc_put_server(internalServer);
             break;
         }
@@ -1544,8 +2307,9 @@ ks_ivc_core_server_ioctl(uint8_t ioctlNum, struct libivc_server_ioctl_info *serv
     switch (ioctlNum) {
         case IVC_REG_SVR_LSNR_IOCTL: 
         {
-            rc = libivc_start_listening_server(&internalServer, server->port,
+            rc = libivc_start_listening_server_backlog(&internalServer, server->port,
                 server->limit_to_domid, server->limit_to_connection_id,
+                server->accept_backlog,
                 ks_ivc_core_us_connectCallback, server->opaque);
 
             libivc_assert(rc == SUCCESS, rc);
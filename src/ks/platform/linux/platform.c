@@ -215,18 +215,19 @@ ks_platform_free(void *mem)
 }
 
 static int
-ks_platform_grant_out_memory(shareable_mem_alloc_t * memAlloc)
+ks_platform_grant_out_pages(struct page **pages, uint32_t numPages, uint16_t remoteDomId,
+                            uint8_t readOnly, grant_ref_t **grantHandles)
 {
     int grant_ref;
     int pageIndex = 0;
 
     // allocate storage for the grant refs.
-    memAlloc->grantHandles = vzalloc(memAlloc->numPages * sizeof(grant_ref_t));
-    libivc_checkp(memAlloc->grantHandles, OUT_OF_MEM);
+    *grantHandles = vzalloc(numPages * sizeof(grant_ref_t));
+    libivc_checkp(*grantHandles, OUT_OF_MEM);
 
-    for(pageIndex = 0; pageIndex < memAlloc->numPages; pageIndex++)
+    for(pageIndex = 0; pageIndex < numPages; pageIndex++)
     {
-        grant_ref = gnttab_grant_foreign_access(memAlloc->remoteDomId, pfn_to_mfn(page_to_pfn(memAlloc->pages[pageIndex])), 0 /*readOnly*/);
+        grant_ref = gnttab_grant_foreign_access(remoteDomId, pfn_to_mfn(page_to_pfn(pages[pageIndex])), readOnly);
 
         // the grant call returns negative numbers for errors.
         if(grant_ref < 0)
@@ -236,17 +237,82 @@ ks_platform_grant_out_memory(shareable_mem_alloc_t * memAlloc)
         }
         else
         {
-            if(pageIndex == 0 || pageIndex == memAlloc->numPages - 1)    
+            if(pageIndex == 0 || pageIndex == numPages - 1)    
                 libivc_info("ALLOC_GRANT_REF, rc = %d\n", grant_ref);
             
             // the grant handle is required to end the foreign mapping.
-            memAlloc->grantHandles[pageIndex] = grant_ref;
+            (*grantHandles)[pageIndex] = grant_ref;
         }
     }
 
     return SUCCESS;
 }
 
+static int
+ks_platform_grant_out_memory(shareable_mem_alloc_t * memAlloc)
+{
+    return ks_platform_grant_out_pages(memAlloc->pages, memAlloc->numPages, memAlloc->remoteDomId,
+                                       memAlloc->readOnly, &memAlloc->grantHandles);
+}
+
+/**
+ * Ends one set of accesses to a shared allocation: either the allocation itself,
+ * or one of its shares. The allocation is torn down once the last of these is
+ * released.
+ * @param allocMem The allocation being released.
+ * @param grantHandles The grants to end, or NULL if the access was local.
+ * @param readOnly Non zero if the grants were read only.
+ */
+static void
+__ks_platform_release_shared_mem(shareable_mem_alloc_t *allocMem, grant_ref_t *grantHandles,
+                                 uint8_t readOnly)
+{
+    int pageIndex = 0;
+    bool last = (--allocMem->refCount == 0);
+
+    // If nobody else is using the allocation, undo the vmap before the pages go away.
+    if(last)
+    {
+        list_del(&allocMem->listHead);
+
+        if(allocMem->numPages > 1)
+        {
+            vunmap(allocMem->kAddress);
+        }
+
+        allocMem->kAddress = NULL;
+    }
+
+    for(pageIndex = 0; pageIndex < allocMem->numPages; pageIndex++)
+    {
+
+        // If we had granted out memory in association with this access,
+        // terminate the grants.
+        if(grantHandles) {
+            // end the access and free the allocated page when the remote domain releases the memory.
+            // note that the memory needs to be cleanly unmapped from user space on both sides
+            // and not have any references to it in use.
+            gnttab_end_foreign_access(grantHandles[pageIndex], readOnly, (unsigned long) page_address(allocMem->pages[pageIndex]));
+            grantHandles[pageIndex] = 0;
+
+        } 
+        // Otherwise, this was a local mapping; release our reference on the pages.
+        else {
+            // If we're the last person using this page, free it.
+            if(put_page_testzero(allocMem->pages[pageIndex])) {
+                __free_page(allocMem->pages[pageIndex]);
+            }
+        }
+    }
+
+    if(!last)
+        return;
+
+    vfree(allocMem->pages);
+    allocMem->pages = NULL;
+    vfree(allocMem);
+}
+
 
 /**
  * Allocates memory for sharing to a remote domain and grants it.
@@ -259,7 +325,7 @@ ks_platform_grant_out_memory(shareable_mem_alloc_t * memAlloc)
  * @return SUCCESS or appropriate error message.
  */
 int
-ks_platform_alloc_shared_mem(uint32_t numPages, uint16_t remoteDomId,
+ks_platform_alloc_shared_mem(uint32_t numPages, uint16_t remoteDomId, uint8_t readOnly,
                              char **mem, grant_ref_t **grantRefs)
 {
     int pageIndex = 0;
@@ -275,7 +341,10 @@ ks_platform_alloc_shared_mem(uint32_t numPages, uint16_t remoteDomId,
     libivc_checkp(memAlloc, OUT_OF_MEM);
 
     memAlloc->remoteDomId = remoteDomId;
+    memAlloc->readOnly = readOnly;
     memAlloc->numPages = numPages;
+    memAlloc->refCount = 1;
+    INIT_LIST_HEAD(&memAlloc->shares);
 
     // Allocate memory to store the page array.
     memAlloc->pages = vzalloc(numPages * sizeof(memAlloc->pages[0]));
@@ -341,7 +410,7 @@ ERROR:
             {
                 if(memAlloc->grantHandles[pageIndex] > 0)
                 {
-                    gnttab_end_foreign_access(memAlloc->grantHandles[pageIndex], 1, 0);
+                    gnttab_end_foreign_access(memAlloc->grantHandles[pageIndex], readOnly, 0);
                     memAlloc->grantHandles[pageIndex] = 0;
                 }
             }
@@ -370,6 +439,8 @@ END:
 
 /**
  * Free the shared memory previously created by ks_platform_alloc_shared_mem.
+ * If the memory has been shared on with ks_platform_share_mem, the pages are
+ * only released once each of those shares has been undone as well.
  * @param mem - Non NULL pointer returned in ks_platform_alloc_shared_mem
  * @return SUCCESS or appropriate error number.
  */
@@ -377,71 +448,144 @@ int
 ks_platform_free_shared_mem(char *mem)
 {
     int rc = INVALID_PARAM;
-    list_head_t *pos = NULL, *temp = NULL;
     shareable_mem_alloc_t *allocMem = NULL;
+    grant_ref_t *grantHandles = NULL;
+
+    libivc_checkp(mem, rc);
+
+    allocMem = find_shareable_mem_by_kaddr(mem);
+
+    // if it wasn't found, or was already freed, return the INVALID_PARAM error
+    libivc_checkp(allocMem, rc);
+    libivc_assert(!allocMem->freed, rc);
+
+    allocMem->freed = 1;
+    grantHandles = allocMem->grantHandles;
+    allocMem->grantHandles = NULL;
+
+    // We're now finished using the relevant colection of pages, ad we're ready to release them.
+    __ks_platform_release_shared_mem(allocMem, grantHandles, allocMem->readOnly);
+
+    if(grantHandles)
+        vfree(grantHandles);
+
+    return SUCCESS;
+}
+
+/**
+ * Shares memory previously allocated by ks_platform_alloc_shared_mem to an
+ * additional domain, without copying it. Every domain it is shared to sees the
+ * same pages.
+ * @param mem - Non NULL pointer returned in ks_platform_alloc_shared_mem
+ * @param remoteDomId The remote domain id being shared to.
+ * @param readOnly Non zero for read only memory to the remote dom.
+ * @param grantRefs pointer to receive list of grant refs into.  Should not be
+ * modified outside of platform itself.
+ * @return SUCCESS or appropriate error number.
+ */
+int
+ks_platform_share_mem(char *mem, uint16_t remoteDomId, uint8_t readOnly,
+                      grant_ref_t **grantRefs)
+{
+    int rc = INVALID_PARAM;
     int pageIndex = 0;
+    shareable_mem_alloc_t *allocMem = NULL;
+    shared_mem_grant_t *share = NULL;
 
     libivc_checkp(mem, rc);
+    libivc_checkp(grantRefs, rc);
+
+    allocMem = find_shareable_mem_by_kaddr(mem);
+    libivc_checkp(allocMem, rc);
+    libivc_assert(!allocMem->freed, rc);
+
+    share = (shared_mem_grant_t *) vzalloc(sizeof(shared_mem_grant_t));
+    libivc_checkp(share, OUT_OF_MEM);
+
+    share->remoteDomId = remoteDomId;
+    share->readOnly = readOnly;
 
-    list_for_each_safe(pos, temp, &sharedMemoryList)
+    // Each share holds its own reference on the pages, which is dropped when
+    // its access ends; so the pages outlive whichever access ends first.
+    for(pageIndex = 0; pageIndex < allocMem->numPages; pageIndex++)
     {
-        allocMem = container_of(pos, shareable_mem_alloc_t, listHead);
-        if(allocMem->kAddress == mem)
-        {
-            // found it , remove from list and jump out of loop.
-            list_del(pos);
-            break;
-        }
-        else
-        {
-            allocMem = NULL;
-        }
+        get_page(allocMem->pages[pageIndex]);
     }
-    // if it wasn't found, return the INVALID_PARAM error
-    libivc_checkp(allocMem, rc);
 
-    // undo the vmap.
-    if(allocMem->numPages > 1)
+    if(remoteDomId != domId)
     {
-        vunmap(allocMem->kAddress);
+        rc = ks_platform_grant_out_pages(allocMem->pages, allocMem->numPages, remoteDomId,
+                                         readOnly, &share->grantHandles);
+        if(rc)
+            goto ERROR;
     }
 
-    mem = allocMem->kAddress = NULL;
+    allocMem->refCount++;
+    INIT_LIST_HEAD(&share->listHead);
+    list_add(&share->listHead, &allocMem->shares);
 
+    *grantRefs = share->grantHandles;
+    return SUCCESS;
 
-    // We're now finished using the relevant colection of pages, ad we're ready to release them.
+ERROR:
     for(pageIndex = 0; pageIndex < allocMem->numPages; pageIndex++)
     {
+        if(share->grantHandles && share->grantHandles[pageIndex] > 0)
+        {
+            gnttab_end_foreign_access(share->grantHandles[pageIndex], readOnly, 0);
+        }
 
-        // If we had granted out memory in association with this buffer,
-        // terminate the grants.
-        if(allocMem->grantHandles) {
-            // end the access and free the allocated page when the remote domain releases the memory.
-            // note that the memory needs to be cleanly unmapped from user space on both sides
-            // and not have any references to it in use.
-            gnttab_end_foreign_access(allocMem->grantHandles[pageIndex], 0, (unsigned long) page_address(allocMem->pages[pageIndex]));
-            allocMem->grantHandles[pageIndex] = 0;
+        put_page(allocMem->pages[pageIndex]);
+    }
 
-        } 
-        // Otherwise, this was a local mapping; release our reference on the pages.
-        else {
-            // If we're the last person using this page, free it.
-            if(put_page_testzero(allocMem->pages[pageIndex])) {
-                __free_page(allocMem->pages[pageIndex]);
-            }
-        }
+    if(share->grantHandles)
+        vfree(share->grantHandles);
+
+    vfree(share);
+    return rc;
+}
+
+/**
+ * Undoes a share created by ks_platform_share_mem.
+ * @param mem - Non NULL pointer passed to ks_platform_share_mem
+ * @param grantRefs - the grant refs returned by ks_platform_share_mem.
+ * @return SUCCESS or appropriate error number.
+ */
+int
+ks_platform_unshare_mem(char *mem, grant_ref_t *grantRefs)
+{
+    int rc = INVALID_PARAM;
+    list_head_t *pos = NULL, *temp = NULL;
+    shareable_mem_alloc_t *allocMem = NULL;
+    shared_mem_grant_t *share = NULL;
+
+    libivc_checkp(mem, rc);
+
+    allocMem = find_shareable_mem_by_kaddr(mem);
+    libivc_checkp(allocMem, rc);
 
-        allocMem->pages[pageIndex] = NULL;
+    // Local shares have no grants; as they're interchangeable, any of them will do.
+    list_for_each_safe(pos, temp, &allocMem->shares)
+    {
+        share = container_of(pos, shared_mem_grant_t, listHead);
+        if(share->grantHandles == grantRefs)
+        {
+            list_del(pos);
+            break;
+        }
+        else
+        {
+            share = NULL;
+        }
     }
+    libivc_checkp(share, rc);
 
-    if(allocMem->grantHandles)
-        vfree(allocMem->grantHandles);
+    __ks_platform_release_shared_mem(allocMem, share->grantHandles, share->readOnly);
 
-    allocMem->grantHandles = NULL;
-    vfree(allocMem->pages);
-    allocMem->pages = NULL;
-    vfree(allocMem);
-    allocMem = NULL;
+    if(share->grantHandles)
+        vfree(share->grantHandles);
+
+    vfree(share);
     return SUCCESS;
 }
 
@@ -1295,7 +1439,7 @@ ks_platform_ioctl(struct file *f, unsigned int cmd, unsigned long payload)
     libivc_checkp(context, -EINVAL);
     context->private = f;
     libivc_assert(_IOC_TYPE(cmd) == IVC_DRIVER_IOC_MAGIC, -EINVAL);
-    libivc_assert(_IOC_NR(cmd) <= IVC_RECONNECT_IOCTL, -EINVAL);
+    libivc_assert(_IOC_NR(cmd) <= IVC_PARK_IOCTL, -EINVAL);
 
     if(_IOC_DIR(cmd) & _IOC_READ)
     {
@@ -1320,6 +1464,7 @@ ks_platform_ioctl(struct file *f, unsigned int cmd, unsigned long payload)
     {
         case IVC_CONNECT_IOCTL:
         case IVC_RECONNECT_IOCTL:
+        case IVC_PARK_IOCTL:
         case IVC_DISCONNECT_IOCTL:
         case IVC_NOTIFY_REMOTE_IOCTL:
         case IVC_SERVER_ACCEPT_IOCTL:
@@ -1353,6 +1498,89 @@ ks_platform_ioctl(struct file *f, unsigned int cmd, unsigned long payload)
             }
         }
         break;
+        case IVC_CONNECT_BATCH_IOCTL:
+        {
+            struct libivc_connect_batch_ioctl_info batch;
+            struct libivc_client_ioctl_info *clients = NULL;
+            int32_t *statuses = NULL;
+            uint32_t i;
+
+            // safely copy the batch, and then the entries it points to, into kernel space.
+            libivc_assert((copy_from_user((void *) &batch, (void *) payload,
+                                          sizeof(struct libivc_connect_batch_ioctl_info))) == SUCCESS, -EINVAL);
+            libivc_assert(batch.num_clients > 0 && batch.num_clients <= LIBIVC_CONNECT_BATCH_MAX, -EINVAL);
+
+            clients = kmalloc_array(batch.num_clients, sizeof(struct libivc_client_ioctl_info), GFP_KERNEL);
+            statuses = kmalloc_array(batch.num_clients, sizeof(int32_t), GFP_KERNEL);
+            if(!clients || !statuses)
+            {
+                err = -ENOMEM;
+            }
+            else if(copy_from_user((void *) clients, (void __user *) batch.clients,
+                                   batch.num_clients * sizeof(struct libivc_client_ioctl_info)))
+            {
+                err = -EINVAL;
+            }
+            else
+            {
+                err = ks_ivc_core_connect_batch(&batch, clients, statuses, context);
+                if(err == SUCCESS &&
+                   (copy_to_user((void __user *) batch.clients, clients,
+                                 batch.num_clients * sizeof(struct libivc_client_ioctl_info)) ||
+                    copy_to_user((void __user *) batch.statuses, statuses,
+                                 batch.num_clients * sizeof(int32_t))))
+                {
+                    // User space can't learn of the connections it now has, so
+                    // can't ever close them; close them here instead.
+                    for(i = 0; i < batch.num_clients; i++)
+                    {
+                        if(statuses[i] != SUCCESS)
+                            continue;
+                        vm_munmap((uintptr_t) clients[i].buffer, clients[i].num_pages * PAGE_SIZE);
+                        ks_ivc_core_client_ioctl(IVC_DISCONNECT_IOCTL, &clients[i], context);
+                    }
+                    err = -EACCES;
+                }
+            }
+
+            kfree(statuses);
+            kfree(clients);
+        }
+        break;
+        case IVC_SERVER_ACCEPT_BATCH_IOCTL:
+        {
+            struct libivc_accept_batch_ioctl_info batch;
+            struct libivc_client_ioctl_info *clients = NULL;
+            struct libivc_client_ioctl_info __user *usClients = NULL;
+
+            // safely copy the batch, and then the entries it points to, into kernel space.
+            libivc_assert((copy_from_user((void *) &batch, (void *) payload,
+                                          sizeof(struct libivc_accept_batch_ioctl_info))) == SUCCESS, -EINVAL);
+            libivc_assert(batch.max_clients > 0 && batch.max_clients <= LIBIVC_ACCEPT_BATCH_MAX, -EINVAL);
+
+            usClients = (struct libivc_client_ioctl_info __user *) batch.clients;
+            clients = kmalloc_array(batch.max_clients, sizeof(struct libivc_client_ioctl_info), GFP_KERNEL);
+            libivc_checkp(clients, -ENOMEM);
+
+            if(copy_from_user((void *) clients, usClients, batch.max_clients * sizeof(struct libivc_client_ioctl_info)))
+            {
+                kfree(clients);
+                return -EINVAL;
+            }
+
+            err = ks_ivc_core_accept_batch(&batch, clients, context);
+            if(err == SUCCESS)
+            {
+                // Only the accepted entries are copied back; the rest keep their event handles.
+                if(copy_to_user(usClients, clients, batch.num_clients * sizeof(struct libivc_client_ioctl_info)) ||
+                   copy_to_user((struct libivc_accept_batch_ioctl_info *) payload, &batch,
+                                sizeof(struct libivc_accept_batch_ioctl_info)))
+                    err = -EACCES;
+            }
+
+            kfree(clients);
+        }
+        break;
         case IVC_REG_SVR_LSNR_IOCTL:
         case IVC_UNREG_SVR_LSNR_IOCTL:
         {
@@ -707,7 +707,7 @@ ks_platform_free(void *mem)
 }
 
 static int
-ks_platform_permit_grant_ref(PFN_NUMBER pfn, USHORT domain, PXENBUS_GNTTAB_CACHE cache, mapped_grant_ref_t *gref)
+ks_platform_permit_grant_ref(PFN_NUMBER pfn, USHORT domain, PXENBUS_GNTTAB_CACHE cache, uint8_t readOnly, mapped_grant_ref_t *gref)
 {
     NTSTATUS status;
 
@@ -725,7 +725,7 @@ ks_platform_permit_grant_ref(PFN_NUMBER pfn, USHORT domain, PXENBUS_GNTTAB_CACHE
         TRUE,
         domain,
         pfn,
-        FALSE,
+        readOnly ? TRUE : FALSE,
         &gref->entry);
 
     if (!NT_SUCCESS(status))
@@ -882,7 +882,7 @@ gnttab_cache_release(PXENBUS_GNTTAB_CACHE cache)
 __pragma(warning(push))
 __pragma(warning(disable:4127))
 int
-ks_platform_alloc_shared_mem(uint32_t numPages, uint16_t remoteDomId,
+ks_platform_alloc_shared_mem(uint32_t numPages, uint16_t remoteDomId, uint8_t readOnly,
 							 char **mem, mapped_grant_ref_t ** mappedGrants)
 {
 	int rc = INVALID_PARAM;
@@ -934,7 +934,7 @@ ks_platform_alloc_shared_mem(uint32_t numPages, uint16_t remoteDomId,
 	rc = ACCESS_DENIED; // in case we error.
 	for (pageNo = 0; pageNo < numPages; pageNo++)
 	{
-        rc = ks_platform_permit_grant_ref(mdlPfn[pageNo], remoteDomId, allocMem->grantCache, &allocMem->grantHandles[pageNo]);
+        rc = ks_platform_permit_grant_ref(mdlPfn[pageNo], remoteDomId, allocMem->grantCache, readOnly, &allocMem->grantHandles[pageNo]);
         libivc_assert_goto(rc == SUCCESS, ERROR);
 	}
 	rc = SUCCESS;
@@ -1045,6 +1045,44 @@ ks_platform_free_shared_mem(char *mem)
 	return SUCCESS;
 }
 
+/**
+* Shares memory previously allocated by ks_platform_alloc_shared_mem to an
+* additional domain. Not yet supported on this platform.
+* @param mem - Non NULL pointer returned in ks_platform_alloc_shared_mem
+* @param remoteDomId The remote domain id being shared to.
+* @param readOnly Non zero for read only memory to the remote dom.
+* @param grantRefs pointer to receive list of grant refs into.
+* @return NOT_IMPLEMENTED
+*/
+int
+ks_platform_share_mem(char *mem, uint16_t remoteDomId, uint8_t readOnly,
+                      mapped_grant_ref_t **grantRefs)
+{
+    UNUSED(mem);
+    UNUSED(remoteDomId);
+    UNUSED(readOnly);
+    UNUSED(grantRefs);
+
+    libivc_error("ks_platform_share_mem not implemented on this platform.\n");
+    return NOT_IMPLEMENTED;
+}
+
+/**
+* Undoes a share created by ks_platform_share_mem. Not yet supported on this
+* platform.
+* @param mem - Non NULL pointer passed to ks_platform_share_mem
+* @param grantRefs - the grant refs returned by ks_platform_share_mem.
+* @return NOT_IMPLEMENTED
+*/
+int
+ks_platform_unshare_mem(char *mem, mapped_grant_ref_t *grantRefs)
+{
+    UNUSED(mem);
+    UNUSED(grantRefs);
+
+    return NOT_IMPLEMENTED;
+}
+
 static VOID
 _Function_class_(EVT_WDF_WORKITEM)
 _IRQL_requires_same_
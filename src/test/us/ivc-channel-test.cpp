@@ -0,0 +1,97 @@
+/**
+ * IVC Test Code: C++ Interface
+ *
+ * Copyright (C) 2016 Assured Information Security, Inc.
+ *
+ * Makes sure libivc.hpp compiles, in full, for a typical message type: every
+ * member of ivc::channel is instantiated, which a program using only some of
+ * them wouldn't do. The checks that run don't need a remote domain, or the
+ * driver.
+ *
+ * Exits non zero if any check fails.
+ */
+
+#include <cstdint>
+#include <cstdio>
+#include <type_traits>
+#include <libivc.hpp>
+
+namespace
+{
+
+struct sample_message
+{
+    std::uint32_t sequence;
+    std::uint16_t kind;
+    std::uint16_t flags;
+    std::uint64_t value;
+};
+
+static_assert(std::is_trivially_copyable_v<sample_message>);
+
+static_assert(!std::is_copy_constructible_v<ivc::connection>);
+static_assert(std::is_nothrow_move_constructible_v<ivc::connection>);
+static_assert(!std::is_copy_constructible_v<ivc::channel<sample_message>>);
+static_assert(std::is_nothrow_move_constructible_v<ivc::channel<sample_message>>);
+static_assert(std::is_same_v<ivc::channel<sample_message>::value_type, sample_message>);
+
+// Spans convert from arrays, and from spans of non const to const.
+static_assert(std::is_constructible_v<ivc::span<const sample_message>, ivc::span<sample_message>>);
+static_assert(!std::is_constructible_v<ivc::span<sample_message>, ivc::span<const sample_message>>);
+
+int failures = 0;
+
+#define check(cond) \
+    do { \
+        if (!(cond)) { \
+            std::printf("FAILED: %s:%d: %s\n", __FILE__, __LINE__, #cond); \
+            failures++; \
+        } \
+    } while (0)
+
+void
+test_span()
+{
+    sample_message messages[4] = {};
+    ivc::span<sample_message> all(messages);
+    ivc::span<const sample_message> view = all;
+
+    check(all.size() == 4);
+    check(view.data() == messages);
+    check(all.subspan(1).size() == 3);
+    check(all.subspan(1, 2).data() == &messages[1]);
+}
+
+void
+test_unconnected()
+{
+    ivc::channel<sample_message> channel;
+
+    check(!channel.conn());
+
+    ivc::channel<sample_message> moved = std::move(channel);
+    check(!moved.conn());
+}
+
+} // namespace
+
+// Compile every member of the templates, used or not.
+template class ivc::span<char>;
+template class ivc::span<const char>;
+template class ivc::channel<sample_message>;
+
+int
+main()
+{
+    test_span();
+    test_unconnected();
+
+    if (failures)
+    {
+        std::printf("%d checks failed.\n", failures);
+        return 1;
+    }
+
+    std::printf("All checks passed.\n");
+    return 0;
+}
@@ -0,0 +1,358 @@
+/**
+ * IVC Example Code: Compression Benchmark
+ *
+ * Copyright (C) 2016 Assured Information Security, Inc.
+ *
+ * Measures what payload compression buys a connection. Run it as a server in
+ * one domain, which receives and discards messages, and as a client in another:
+ *
+ *   ivc-compress-bench server
+ *   ivc-compress-bench client <dom-id> [<pages> [<message-bytes> [<messages> [<threshold>]]]]
+ *
+ * The client sends the same telemetry-like messages twice, raw and then
+ * compressed, and reports the effective throughput of each, in total and per
+ * granted page. The codec alone can be measured without a remote with:
+ *
+ *   ivc-compress-bench codec [<message-bytes> [<messages>]]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+#include <libivc.h>
+#include <libivc_private.h>
+#include <libivc_compress.h>
+
+/**
+ * The port to use for IVC communications.
+ */
+static const int ivc_port = 12;
+
+static struct libivc_server *server = 0;
+static struct libivc_client *client = 0;
+
+static uint64_t now_ns(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return ((uint64_t)now.tv_sec * 1000000000ULL) + (uint64_t)now.tv_nsec;
+}
+
+void usage()
+{
+    printf("Usage: ivc-compress-bench server\n");
+    printf("       ivc-compress-bench client <dom-id> [<pages> [<message-bytes> [<messages> [<threshold>]]]]\n");
+    printf("       ivc-compress-bench codec [<message-bytes> [<messages>]]\n\n");
+}
+
+/**
+ * Fills a buffer with something like a telemetry record: text fields, slowly
+ * changing counters and runs of padding.
+ */
+void fill_message(char *message, size_t size, int sequence)
+{
+    size_t offset = 0;
+    int field = 0, written;
+
+    while(offset < size)
+    {
+        written = snprintf(message + offset, size - offset,
+            "sensor=%02d seq=%08d temp=%d.%d state=nominal padding=________________;",
+            field, sequence, 40 + (sequence + field) % 7, (sequence * 3 + field) % 10);
+        if(written <= 0)
+            break;
+
+        offset += (size_t)written;
+        field++;
+    }
+}
+
+/**
+ * Server side: drain whatever arrives on a connection, raw or compressed.
+ */
+struct bench_connection {
+    struct libivc_compressor *cz;
+    char *message;
+    size_t size;
+};
+
+void handle_event(void *opaque, struct libivc_client *eventClient)
+{
+    struct bench_connection *connection = (struct bench_connection *)opaque;
+    size_t actual;
+    int rc;
+
+    UNUSED(eventClient);
+
+    while((rc = libivc_compress_recv(connection->cz, connection->message, connection->size, &actual)) != NO_DATA_AVAIL)
+    {
+        if(rc == NO_SPACE)
+        {
+            connection->message = (char *)realloc(connection->message, actual);
+            connection->size = actual;
+        }
+        else if(rc != SUCCESS)
+        {
+            fprintf(stderr, "Failed to receive: %d\n", rc);
+            return;
+        }
+    }
+}
+
+void handle_disconnect(void *opaque, struct libivc_client *eventClient)
+{
+    struct bench_connection *connection = (struct bench_connection *)opaque;
+    struct libivc_compress_stats stats;
+
+    libivc_compress_get_stats(connection->cz, &stats);
+    fprintf(stderr, "Client disconnected after %llu messages, %llu bytes (%llu on the wire).\n",
+        (unsigned long long)stats.messages_received, (unsigned long long)stats.raw_bytes_received,
+        (unsigned long long)stats.wire_bytes_received);
+
+    libivc_disconnect(eventClient);
+    libivc_compress_destroy(connection->cz);
+    free(connection->message);
+    free(connection);
+}
+
+void handle_client_connected(void *opaque, struct libivc_client *newClient)
+{
+    struct bench_connection *connection;
+    int rc;
+
+    UNUSED(opaque);
+
+    connection = (struct bench_connection *)calloc(1, sizeof(*connection));
+    rc = libivc_compress_create(&connection->cz, newClient, LIBIVC_COMPRESS_DEFAULT_THRESHOLD);
+    if(rc != SUCCESS)
+    {
+        fprintf(stderr, "Failed to create a compressor: %d\n", rc);
+        libivc_disconnect(newClient);
+        free(connection);
+        return;
+    }
+
+    libivc_register_event_callbacks(newClient, handle_event, handle_disconnect, connection);
+    libivc_enable_events(newClient);
+    fprintf(stderr, "Client connected; draining messages.\n");
+}
+
+void handle_interrupt_signal(int raised_signal)
+{
+    if(client)
+        libivc_disconnect(client);
+    if(server)
+        libivc_shutdownIvcServer(server);
+
+    signal(raised_signal, SIG_DFL);
+    raise(raised_signal);
+}
+
+int run_server()
+{
+    int rc;
+
+    rc = libivc_startIvcServer(&server, ivc_port, handle_client_connected, NULL);
+    if(rc != SUCCESS)
+    {
+        fprintf(stderr, "Failed to start the server: %d\n", rc);
+        return rc;
+    }
+
+    fprintf(stderr, "Listening on port %d.\n", ivc_port);
+
+    while(1)
+    {
+        pause();
+    }
+
+    return 0;
+}
+
+/**
+ * Client side: send the messages through a compressor with the given threshold,
+ * and report the effective throughput.
+ */
+int send_messages(struct libivc_compressor *cz, const char *label, char *message, size_t size,
+    int messages, int pages)
+{
+    struct libivc_compress_stats before, after;
+    uint64_t start, elapsed;
+    double seconds, mbps;
+    int rc, i;
+
+    libivc_compress_get_stats(cz, &before);
+    start = now_ns();
+    for(i = 0; i < messages; i++)
+    {
+        fill_message(message, size, i);
+
+        //If the ring is momentarily full, wait for the server to drain it.
+        while((rc = libivc_compress_send(cz, message, size)) == NO_SPACE)
+        {
+            sched_yield();
+        }
+
+        if(rc != SUCCESS)
+        {
+            fprintf(stderr, "Failed to send message %d: %d\n", i, rc);
+            return rc;
+        }
+    }
+    elapsed = now_ns() - start;
+    libivc_compress_get_stats(cz, &after);
+
+    seconds = elapsed / 1e9;
+    mbps = (after.raw_bytes_sent - before.raw_bytes_sent) / seconds / (1024 * 1024);
+    printf("%s: %d messages of %zu bytes; %.1f MB/s, %.2f MB/s per page; ratio %.2f (%llu of %llu compressed)\n",
+        label, messages, size, mbps, mbps / pages,
+        (double)(after.raw_bytes_sent - before.raw_bytes_sent) / (double)(after.wire_bytes_sent - before.wire_bytes_sent),
+        (unsigned long long)(after.messages_compressed - before.messages_compressed),
+        (unsigned long long)(after.messages_sent - before.messages_sent));
+
+    return SUCCESS;
+}
+
+int run_client(int remote_domid, int pages, size_t size, int messages, uint32_t threshold)
+{
+    struct libivc_compressor *raw = NULL, *compressed = NULL;
+    char *message;
+    int rc;
+
+    message = (char *)malloc(size);
+
+    rc = libivc_connect(&client, remote_domid, ivc_port, pages);
+    if(rc != SUCCESS)
+    {
+        fprintf(stderr, "Failed to connect to the remote server: %d\n", rc);
+        return rc;
+    }
+
+    //Both compressors speak the same framing, so the server needn't know which is in use.
+    rc = libivc_compress_create(&raw, client, 0xFFFFFFFF);
+    if(rc == SUCCESS)
+        rc = libivc_compress_create(&compressed, client, threshold);
+    if(rc != SUCCESS)
+    {
+        fprintf(stderr, "Failed to create a compressor: %d\n", rc);
+        return rc;
+    }
+
+    rc = send_messages(raw, "raw", message, size, messages, pages);
+    if(rc == SUCCESS)
+        rc = send_messages(compressed, "compressed", message, size, messages, pages);
+
+    libivc_disconnect(client);
+    libivc_compress_destroy(raw);
+    libivc_compress_destroy(compressed);
+    free(message);
+    return rc;
+}
+
+/**
+ * Measures the codec alone.
+ */
+int run_codec(size_t size, int messages)
+{
+    char *message, *compressed, *restored;
+    size_t bound = libivc_lz_bound(size), written = 0, restored_size = 0;
+    uint64_t compress_ns = 0, decompress_ns = 0, wire = 0, start;
+    int i, rc;
+
+    message = (char *)malloc(size);
+    compressed = (char *)malloc(bound);
+    restored = (char *)malloc(size);
+
+    for(i = 0; i < messages; i++)
+    {
+        fill_message(message, size, i);
+
+        start = now_ns();
+        rc = libivc_lz_compress(message, size, compressed, bound, &written);
+        compress_ns += now_ns() - start;
+        if(rc != SUCCESS)
+        {
+            fprintf(stderr, "Failed to compress message %d: %d\n", i, rc);
+            return rc;
+        }
+
+        start = now_ns();
+        rc = libivc_lz_decompress(compressed, written, restored, size, &restored_size);
+        decompress_ns += now_ns() - start;
+        if(rc != SUCCESS || restored_size != size || memcmp(message, restored, size))
+        {
+            fprintf(stderr, "Message %d did not survive a round trip: %d\n", i, rc);
+            return INTERNAL_ERROR;
+        }
+
+        wire += written;
+    }
+
+    printf("codec: %d messages of %zu bytes; ratio %.2f; compress %.1f MB/s, decompress %.1f MB/s\n",
+        messages, size, ((double)size * messages) / wire,
+        ((double)size * messages) / (compress_ns / 1e9) / (1024 * 1024),
+        ((double)size * messages) / (decompress_ns / 1e9) / (1024 * 1024));
+
+    free(message);
+    free(compressed);
+    free(restored);
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    int remote_domid, pages = 4, messages = 100000;
+    unsigned int size = 1024, threshold = LIBIVC_COMPRESS_DEFAULT_THRESHOLD;
+
+    signal(SIGINT, handle_interrupt_signal);
+    signal(SIGTERM, handle_interrupt_signal);
+
+    if(argc >= 2 && !strcmp(argv[1], "server"))
+    {
+        return run_server();
+    }
+
+    if(argc >= 2 && !strcmp(argv[1], "codec"))
+    {
+        if(argc > 2)
+            size = (unsigned int)atoi(argv[2]);
+        if(argc > 3)
+            messages = atoi(argv[3]);
+
+        if(size == 0 || messages <= 0)
+        {
+            usage();
+            return EINVAL;
+        }
+
+        return run_codec(size, messages);
+    }
+
+    if(argc < 3 || strcmp(argv[1], "client") || sscanf(argv[2], "%d", &remote_domid) != 1)
+    {
+        usage();
+        return EINVAL;
+    }
+
+    if(argc > 3)
+        pages = atoi(argv[3]);
+    if(argc > 4)
+        size = (unsigned int)atoi(argv[4]);
+    if(argc > 5)
+        messages = atoi(argv[5]);
+    if(argc > 6)
+        threshold = (unsigned int)atoi(argv[6]);
+
+    if(pages <= 0 || size == 0 || messages <= 0)
+    {
+        usage();
+        return EINVAL;
+    }
+
+    return run_client(remote_domid, pages, size, messages, threshold);
+}
@@ -0,0 +1,173 @@
+/**
+ * IVC Test Code: C++ Coroutine Interface
+ *
+ * Copyright (C) 2016 Assured Information Security, Inc.
+ *
+ * Makes sure libivc_coro.hpp compiles, in full: coroutines awaiting every
+ * kind of operation are instantiated, though without a remote they can only
+ * be run far enough to see unconnected handles refuse them. The event loop,
+ * and coroutines resumed on it, are checked on their own.
+ *
+ * Exits non zero if any check fails.
+ */
+
+#include <cstdint>
+#include <cstdio>
+#include <utility>
+#include <libivc_coro.hpp>
+
+namespace
+{
+
+struct sample_message
+{
+    std::uint32_t sequence;
+    std::uint32_t length;
+    std::uint64_t value;
+};
+
+template <typename A>
+concept awaiter = requires(A a, std::coroutine_handle<> handle) {
+    { a.await_ready() } -> std::convertible_to<bool>;
+    a.await_suspend(handle);
+    a.await_resume();
+};
+
+static_assert(ivc::executor<ivc::event_loop>);
+static_assert(awaiter<decltype(std::declval<ivc::async_connection &>().recv(std::declval<ivc::span<char>>()))>);
+static_assert(awaiter<decltype(std::declval<ivc::async_connection &>().send(std::declval<ivc::span<const char>>()))>);
+static_assert(awaiter<decltype(std::declval<ivc::async_connection &>().recv(std::declval<sample_message &>()))>);
+static_assert(awaiter<decltype(std::declval<ivc::async_connection &>().send(std::declval<const sample_message &>()))>);
+static_assert(awaiter<decltype(std::declval<ivc::async_server &>().accept())>);
+static_assert(!std::is_copy_constructible_v<ivc::async_connection>);
+static_assert(std::is_nothrow_move_constructible_v<ivc::async_connection>);
+static_assert(!std::is_copy_constructible_v<ivc::async_server>);
+
+int failures = 0;
+
+#define check(cond) \
+    do { \
+        if (!(cond)) { \
+            std::printf("FAILED: %s:%d: %s\n", __FILE__, __LINE__, #cond); \
+            failures++; \
+        } \
+    } while (0)
+
+/**
+ * Echoes messages back until the connection closes.
+ */
+ivc::detached
+echo(ivc::async_connection conn, int &outcome)
+{
+    sample_message message;
+    char payload[64];
+
+    try
+    {
+        for (;;)
+        {
+            co_await conn.recv(message);
+            co_await conn.recv(ivc::span<char>(payload, message.length));
+            co_await conn.send(message);
+            co_await conn.send(ivc::span<const char>(payload, message.length));
+        }
+    }
+    catch (const ivc::error &e)
+    {
+        outcome = e.code();
+    }
+}
+
+/**
+ * Accepts connections, and echoes on each, until the server shuts down.
+ */
+ivc::detached
+serve(ivc::async_server &server, int &outcome, int &echo_outcome)
+{
+    try
+    {
+        for (;;)
+            echo(co_await server.accept(), echo_outcome);
+    }
+    catch (const ivc::error &e)
+    {
+        outcome = e.code();
+    }
+}
+
+/**
+ * Resumes the awaiting coroutine on an event loop.
+ */
+struct resume_on
+{
+    ivc::event_loop &loop;
+
+    bool await_ready() const noexcept { return false; }
+    void await_suspend(std::coroutine_handle<> handle) { loop.post([handle] { handle.resume(); }); }
+    void await_resume() const noexcept {}
+};
+
+ivc::detached
+count_on(ivc::event_loop &loop, int &steps)
+{
+    for (int i = 0; i < 3; i++)
+    {
+        co_await resume_on{loop};
+        steps++;
+    }
+
+    loop.stop();
+}
+
+void
+test_unconnected()
+{
+    ivc::async_server server;
+    int outcome = SUCCESS, echo_outcome = SUCCESS;
+
+    // Nothing is ever connected, so both give up straight away.
+    echo(ivc::async_connection(), echo_outcome);
+    check(echo_outcome == NOT_CONNECTED);
+
+    echo_outcome = SUCCESS;
+    serve(server, outcome, echo_outcome);
+    check(outcome == NOT_CONNECTED);
+    check(echo_outcome == SUCCESS);
+}
+
+void
+test_event_loop()
+{
+    ivc::event_loop loop;
+    int steps = 0, ran = 0;
+
+    loop.post([&ran] { ran++; });
+    loop.post([&ran] { ran++; });
+    check(loop.poll() == 2);
+    check(ran == 2);
+    check(loop.poll() == 0);
+
+    // The coroutine runs to its first suspension here, and the rest on the loop.
+    count_on(loop, steps);
+    check(steps == 0);
+    loop.run();
+    check(steps == 3);
+}
+
+} // namespace
+
+int
+main()
+{
+    test_unconnected();
+    test_event_loop();
+
+    if (failures)
+    {
+        std::printf("%d checks failed.\n", failures);
+        return 1;
+    }
+
+    std::printf("All checks passed.\n");
+    return 0;
+}
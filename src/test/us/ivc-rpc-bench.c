@@ -0,0 +1,270 @@
+/**
+ * IVC Example Code: RPC Benchmark
+ *
+ * Copyright (C) 2016 Assured Information Security, Inc.
+ *
+ * Measures the latency and throughput of the libivc RPC layer. Run it as a server
+ * in one domain, which echoes every request back, and as a client in another:
+ *
+ *   ivc-rpc-bench server
+ *   ivc-rpc-bench client <dom-id> [<pages> [<payload-bytes> [<calls> [<depth> [<batch>]]]]]
+ *
+ * The client first issues calls one at a time to measure round-trip latency, then
+ * keeps <depth> calls outstanding (sent in batches of <batch> per notification) to
+ * measure throughput.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+#include <libivc.h>
+#include <libivc_private.h>
+#include <libivc_rpc.h>
+
+/**
+ * The port to use for IVC communications.
+ */
+static const int ivc_port = 11;
+
+static struct libivc_server *server = 0;
+static struct libivc_client *client = 0;
+static struct libivc_rpc *rpc = 0;
+
+/**
+ * The number of pipelined calls that have been completed, and that are still in flight.
+ */
+static volatile int completed = 0;
+static volatile int in_flight = 0;
+
+static uint64_t now_ns(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return ((uint64_t)now.tv_sec * 1000000000ULL) + (uint64_t)now.tv_nsec;
+}
+
+void usage()
+{
+    printf("Usage: ivc-rpc-bench server\n");
+    printf("       ivc-rpc-bench client <dom-id> [<pages> [<payload-bytes> [<calls> [<depth> [<batch>]]]]]\n\n");
+}
+
+/**
+ * Server side: echo every request back to the caller.
+ */
+void handle_request(void *opaque, struct libivc_rpc *rpc, uint64_t request_id,
+    uint32_t method, char *payload, uint32_t length)
+{
+    UNUSED(opaque);
+    UNUSED(method);
+
+    //If the ring is momentarily full, wait for the caller to drain it.
+    while(libivc_rpc_reply(rpc, request_id, SUCCESS, payload, length) == NO_SPACE)
+    {
+        sched_yield();
+    }
+}
+
+/**
+ * Server side: set up an RPC endpoint on each new connection.
+ */
+void handle_client_connected(void *opaque, struct libivc_client *newClient)
+{
+    int rc;
+
+    UNUSED(opaque);
+
+    rc = libivc_rpc_create(&rpc, newClient, handle_request, NULL);
+    if(rc != SUCCESS)
+    {
+        fprintf(stderr, "Failed to create an RPC endpoint: %d\n", rc);
+        libivc_disconnect(newClient);
+        return;
+    }
+
+    fprintf(stderr, "Client connected; echoing requests.\n");
+}
+
+/**
+ * Client side: account for a completed pipelined call.
+ */
+void handle_completion(void *opaque, struct libivc_rpc *rpc, int status, char *payload, uint32_t length)
+{
+    UNUSED(opaque);
+    UNUSED(rpc);
+    UNUSED(payload);
+    UNUSED(length);
+
+    if(status != SUCCESS)
+    {
+        fprintf(stderr, "Call failed: %d\n", status);
+    }
+
+    __sync_fetch_and_add(&completed, 1);
+    __sync_fetch_and_sub(&in_flight, 1);
+}
+
+void handle_interrupt_signal(int raised_signal)
+{
+    if(client)
+        libivc_disconnect(client);
+    if(server)
+        libivc_shutdownIvcServer(server);
+
+    signal(raised_signal, SIG_DFL);
+    raise(raised_signal);
+}
+
+int run_server()
+{
+    int rc;
+
+    rc = libivc_startIvcServer(&server, ivc_port, handle_client_connected, NULL);
+    if(rc != SUCCESS)
+    {
+        fprintf(stderr, "Failed to start the server: %d\n", rc);
+        return rc;
+    }
+
+    fprintf(stderr, "Listening on port %d.\n", ivc_port);
+
+    while(1)
+    {
+        pause();
+    }
+
+    return 0;
+}
+
+int run_client(int remote_domid, int pages, uint32_t payload_size, int calls, int depth, int batch)
+{
+    char *payload, *response;
+    uint64_t start, elapsed, min = (uint64_t)-1, max = 0, total = 0;
+    size_t actual;
+    int rc, i, sent;
+
+    payload = (char *)malloc(payload_size ? payload_size : 1);
+    response = (char *)malloc(payload_size ? payload_size : 1);
+    memset(payload, 0xA5, payload_size);
+
+    rc = libivc_connect(&client, remote_domid, ivc_port, pages);
+    if(rc != SUCCESS)
+    {
+        fprintf(stderr, "Failed to connect to the remote server: %d\n", rc);
+        return rc;
+    }
+
+    rc = libivc_rpc_create(&rpc, client, NULL, NULL);
+    if(rc != SUCCESS)
+    {
+        fprintf(stderr, "Failed to create an RPC endpoint: %d\n", rc);
+        return rc;
+    }
+
+    //Latency: one call at a time.
+    for(i = 0; i < calls; i++)
+    {
+        start = now_ns();
+        rc = libivc_rpc_call(rpc, 0, payload, payload_size, response, payload_size, &actual, 5000);
+        elapsed = now_ns() - start;
+
+        if(rc != SUCCESS)
+        {
+            fprintf(stderr, "Call %d failed: %d\n", i, rc);
+            return rc;
+        }
+
+        total += elapsed;
+        if(elapsed < min)
+            min = elapsed;
+        if(elapsed > max)
+            max = elapsed;
+    }
+
+    printf("latency: %d calls of %u bytes; min %.1fus avg %.1fus max %.1fus\n",
+        calls, payload_size, min / 1000.0, (total / (double)calls) / 1000.0, max / 1000.0);
+
+    //Throughput: keep up to depth calls outstanding, batching their notifications.
+    sent = 0;
+    start = now_ns();
+    while(completed < calls)
+    {
+        rc = SUCCESS;
+        libivc_rpc_begin_batch(rpc);
+        for(i = 0; i < batch && sent < calls && in_flight < depth; i++)
+        {
+            __sync_fetch_and_add(&in_flight, 1);
+            rc = libivc_rpc_call_async(rpc, 0, payload, payload_size, handle_completion, NULL);
+            if(rc != SUCCESS)
+            {
+                __sync_fetch_and_sub(&in_flight, 1);
+                break;
+            }
+            sent++;
+        }
+        libivc_rpc_end_batch(rpc);
+
+        if(rc != SUCCESS && rc != NO_SPACE)
+        {
+            fprintf(stderr, "Pipelined call failed: %d\n", rc);
+            return rc;
+        }
+
+        sched_yield();
+    }
+    elapsed = now_ns() - start;
+
+    printf("throughput: %d calls of %u bytes, depth %d, batch %d; %.0f calls/s, %.1f MB/s\n",
+        calls, payload_size, depth, batch, calls / (elapsed / 1e9),
+        ((double)calls * payload_size * 2) / (elapsed / 1e9) / (1024 * 1024));
+
+    libivc_disconnect(client);
+    libivc_rpc_destroy(rpc);
+    free(payload);
+    free(response);
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    int remote_domid, pages = 4, calls = 100000, depth = 64, batch = 16;
+    unsigned int payload_size = 64;
+
+    signal(SIGINT, handle_interrupt_signal);
+    signal(SIGTERM, handle_interrupt_signal);
+
+    if(argc >= 2 && !strcmp(argv[1], "server"))
+    {
+        return run_server();
+    }
+
+    if(argc < 3 || strcmp(argv[1], "client") || sscanf(argv[2], "%d", &remote_domid) != 1)
+    {
+        usage();
+        return EINVAL;
+    }
+
+    if(argc > 3)
+        pages = atoi(argv[3]);
+    if(argc > 4)
+        payload_size = (unsigned int)atoi(argv[4]);
+    if(argc > 5)
+        calls = atoi(argv[5]);
+    if(argc > 6)
+        depth = atoi(argv[6]);
+    if(argc > 7)
+        batch = atoi(argv[7]);
+
+    if(pages <= 0 || calls <= 0 || depth <= 0 || batch <= 0)
+    {
+        usage();
+        return EINVAL;
+    }
+
+    return run_client(remote_domid, pages, payload_size, calls, depth, batch);
+}
@@ -0,0 +1,340 @@
+/**
+ * IVC Test Code: Self Test
+ *
+ * Copyright (C) 2016 Assured Information Security, Inc.
+ *
+ * Checks the parts of libivc that don't need a remote domain, or the driver:
+ *
+ *   - the payload codec round trips, and rejects corrupt input without
+ *     writing past the end of its output;
+ *   - latency histogram buckets and percentiles;
+ *   - reserving, committing, peeking and consuming ring space across the
+ *     point where the ring wraps, using a ring in local memory.
+ *
+ * Exits non zero if any check fails.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <libivc.h>
+#include <libivc_private.h>
+#include <libivc_compress.h>
+#include <libivc_latency.h>
+
+static int failures = 0;
+
+#define check(cond) \
+    do { \
+        if (!(cond)) { \
+            printf("FAILED: %s:%d: %s\n", __FILE__, __LINE__, #cond); \
+            failures++; \
+        } \
+    } while (0)
+
+/**
+ * Fills a buffer with data that compresses about as well as real messages:
+ * repeated fields, with a counter changing now and then.
+ */
+static void fill_compressible(char *buffer, size_t size)
+{
+    size_t i;
+
+    for (i = 0; i < size; i++)
+        buffer[i] = "sensor=42;state=ok;"[i % 19] + (char)((i / 512) & 3);
+}
+
+static void fill_random(char *buffer, size_t size)
+{
+    size_t i;
+
+    for (i = 0; i < size; i++)
+        buffer[i] = (char)rand();
+}
+
+/**
+ * Compresses and decompresses a buffer, and checks it comes back the same.
+ */
+static void check_round_trip(const char *src, size_t size)
+{
+    size_t bound = libivc_lz_bound(size), written = 0, restored = 0;
+    char *compressed = (char *) malloc(bound);
+    char *output = (char *) malloc(size + 1);
+
+    check(compressed != NULL && output != NULL);
+    if (compressed && output)
+    {
+        check(libivc_lz_compress(src, size, compressed, bound, &written) == SUCCESS);
+        check(written <= bound);
+        check(libivc_lz_decompress(compressed, written, output, size, &restored) == SUCCESS);
+        check(restored == size);
+        check(memcmp(src, output, size) == 0);
+
+        // Output that doesn't fit is refused rather than truncated.
+        if (size > 1)
+            check(libivc_lz_decompress(compressed, written, output, size - 1, &restored) != SUCCESS);
+    }
+
+    free(output);
+    free(compressed);
+}
+
+static void test_codec(void)
+{
+    static const size_t sizes[] = { 1, 4, 15, 64, 1000, 4096, 65536 };
+    char *src = (char *) malloc(65536);
+    char *compressed = (char *) malloc(libivc_lz_bound(65536));
+    char output[4096 + 16];
+    size_t i, written = 0, restored = 0;
+    int round;
+
+    check(src != NULL && compressed != NULL);
+    if (!src || !compressed)
+        goto END;
+
+    for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+    {
+        fill_compressible(src, sizes[i]);
+        check_round_trip(src, sizes[i]);
+        fill_random(src, sizes[i]);
+        check_round_trip(src, sizes[i]);
+    }
+
+    // Data that compresses well should.
+    fill_compressible(src, 4096);
+    check(libivc_lz_compress(src, 4096, compressed, libivc_lz_bound(4096), &written) == SUCCESS);
+    check(written < 4096 / 2);
+
+    // Compression stops, rather than overrun, when the output doesn't fit.
+    fill_random(src, 4096);
+    check(libivc_lz_compress(src, 4096, compressed, 100, &written) == NO_SPACE);
+
+    // Corrupt input is either rejected or decodes to something that fits;
+    // the guard bytes past the end of the output are never touched.
+    fill_compressible(src, 4096);
+    check(libivc_lz_compress(src, 4096, compressed, libivc_lz_bound(4096), &written) == SUCCESS);
+    for (round = 0; round < 20000; round++)
+    {
+        size_t length = written, capacity = (size_t)rand() % 4097;
+        char *corrupt = (char *) malloc(written);
+
+        check(corrupt != NULL);
+        if (!corrupt)
+            break;
+
+        memcpy(corrupt, compressed, written);
+        if (round % 3 == 0)
+            length = (size_t)rand() % written;
+        else
+            corrupt[rand() % written] ^= (char)(1 + rand() % 255);
+
+        memset(output, 0x5A, sizeof(output));
+        if (libivc_lz_decompress(corrupt, length, output, capacity, &restored) == SUCCESS)
+            check(restored <= capacity);
+        for (i = capacity; i < sizeof(output); i++)
+        {
+            if (output[i] != 0x5A)
+            {
+                check(output[i] == 0x5A);
+                break;
+            }
+        }
+
+        free(corrupt);
+    }
+
+    // Arbitrary bytes aren't a stream the codec produced.
+    for (round = 0; round < 20000; round++)
+    {
+        size_t length = (size_t)rand() % 64;
+
+        fill_random(src, length);
+        memset(output, 0x5A, sizeof(output));
+        if (libivc_lz_decompress(src, length, output, 4096, &restored) == SUCCESS)
+            check(restored <= 4096);
+        check(output[4096] == 0x5A);
+    }
+
+END:
+    free(compressed);
+    free(src);
+}
+
+/**
+ * Finds the bucket a value is recorded in, from the buckets' floors.
+ */
+static uint32_t bucket_of(uint64_t value)
+{
+    uint32_t bucket = 0;
+
+    while (bucket + 1 < LIBIVC_LATENCY_BUCKETS && libivc_latency_bucket_floor(bucket + 1) <= value)
+        bucket++;
+
+    return bucket;
+}
+
+static void record(struct libivc_latency_histogram *histogram, uint64_t value, uint64_t count)
+{
+    if (histogram->count == 0 || value < histogram->min_ns)
+        histogram->min_ns = value;
+    if (value > histogram->max_ns)
+        histogram->max_ns = value;
+
+    histogram->count += count;
+    histogram->total_ns += value * count;
+    histogram->buckets[bucket_of(value)] += count;
+}
+
+static void test_histogram(void)
+{
+    struct libivc_latency_histogram histogram;
+    uint64_t floor, next, p95;
+    uint32_t i;
+
+    // Small values each get a bucket of their own.
+    for (i = 0; i < (1u << LIBIVC_LATENCY_SUB_BUCKET_BITS); i++)
+        check(libivc_latency_bucket_floor(i) == i);
+
+    // Buckets always grow, and never by more than 1 / 2^SUB_BUCKET_BITS.
+    for (i = 0; i + 1 < LIBIVC_LATENCY_BUCKETS; i++)
+    {
+        floor = libivc_latency_bucket_floor(i);
+        next = libivc_latency_bucket_floor(i + 1);
+        check(next > floor);
+        if (floor >= (1u << LIBIVC_LATENCY_SUB_BUCKET_BITS))
+            check((next - floor) << LIBIVC_LATENCY_SUB_BUCKET_BITS <= floor);
+    }
+
+    // Buckets past the last are the last.
+    floor = libivc_latency_bucket_floor(LIBIVC_LATENCY_BUCKETS - 1);
+    check(libivc_latency_bucket_floor(LIBIVC_LATENCY_BUCKETS) == floor);
+    check(libivc_latency_bucket_floor(0xFFFFFFFF) == floor);
+
+    memset(&histogram, 0, sizeof(histogram));
+    check(libivc_latency_percentile(&histogram, 50.0) == 0);
+
+    record(&histogram, 10, 90);
+    record(&histogram, 1000, 9);
+    record(&histogram, 1000000, 1);
+
+    check(libivc_latency_percentile(&histogram, 0.0) == 10);
+    check(libivc_latency_percentile(&histogram, 50.0) == 10);
+    check(libivc_latency_percentile(&histogram, 90.0) == 10);
+
+    // Larger values are only known to within their bucket.
+    p95 = libivc_latency_percentile(&histogram, 95.0);
+    check(p95 >= 1000 && p95 < libivc_latency_bucket_floor(bucket_of(1000) + 1));
+
+    // The top percentile is capped at the largest value seen.
+    check(libivc_latency_percentile(&histogram, 100.0) == 1000000);
+    check(libivc_latency_percentile(&histogram, 250.0) == 1000000);
+}
+
+/**
+ * Writes a pattern into reserved ring space, which may be split in two.
+ */
+static void write_segments(struct libivc_segment segments[2], size_t length, uint8_t seed)
+{
+    size_t i;
+
+    for (i = 0; i < length; i++)
+    {
+        if (i < segments[0].length)
+            segments[0].base[i] = (char)(seed + i);
+        else
+            segments[1].base[i - segments[0].length] = (char)(seed + i);
+    }
+}
+
+static int matches_segments(struct libivc_segment segments[2], size_t length, uint8_t seed)
+{
+    size_t i;
+    char c;
+
+    for (i = 0; i < length; i++)
+    {
+        c = i < segments[0].length ? segments[0].base[i] : segments[1].base[i - segments[0].length];
+        if (c != (char)(seed + i))
+            return 0;
+    }
+
+    return 1;
+}
+
+static void test_ring_segments(void)
+{
+    static char buffer[PAGE_SIZE] __attribute__((aligned(PAGE_SIZE)));
+    static struct libivc_client client, server;
+    struct libivc_segment space[2], data[2];
+    size_t available = 0, capacity, length;
+    uint8_t seed;
+    int wrapped = 0, round;
+
+    // Both ends of a connection, sharing one page of local memory.
+    client.buffer = server.buffer = buffer;
+    client.num_pages = server.num_pages = 1;
+    server.server_side = 1;
+    pthread_mutex_init(&client.mutex, NULL);
+    pthread_mutex_init(&server.mutex, NULL);
+    INIT_LIST_HEAD(&client.callback_list);
+    INIT_LIST_HEAD(&server.callback_list);
+    check(__libivc_create_ringbuffer(&client) == SUCCESS);
+    check(__libivc_create_ringbuffer(&server) == SUCCESS);
+
+    check(libivc_reserve(&client, space, &capacity) == SUCCESS);
+    check(space[1].length == 0);
+    check(libivc_peek(&server, data, &available) == NO_DATA_AVAIL);
+
+    // Odd sized messages walk the ring's indexes around it several times.
+    for (round = 0; round < 64; round++)
+    {
+        length = capacity / 3 + (size_t)round;
+        seed = (uint8_t)round;
+
+        check(libivc_reserve(&client, space, &available) == SUCCESS);
+        check(available == capacity);
+        check(space[0].length + space[1].length == available);
+        if (space[1].length)
+            wrapped++;
+
+        write_segments(space, length, seed);
+        check(libivc_commit(&client, length) == SUCCESS);
+
+        check(libivc_peek(&server, data, &available) == SUCCESS);
+        check(available == length);
+        check(data[0].length + data[1].length == length);
+        check(matches_segments(data, length, seed));
+
+        // Consume in two parts, so the read index lands mid message.
+        check(libivc_consume(&server, length / 2) == SUCCESS);
+        check(libivc_peek(&server, data, &available) == SUCCESS);
+        check(available == length - length / 2);
+        check(libivc_consume(&server, available) == SUCCESS);
+        check(libivc_peek(&server, data, &available) == NO_DATA_AVAIL);
+    }
+
+    check(wrapped > 0);
+
+    // Neither side can claim more than the ring holds.
+    check(libivc_commit(&client, capacity + 1) != SUCCESS);
+    check(libivc_consume(&server, 1) != SUCCESS);
+}
+
+int main(void)
+{
+    srand(1);
+
+    test_codec();
+    test_histogram();
+    test_ring_segments();
+
+    if (failures)
+    {
+        printf("%d checks failed.\n", failures);
+        return 1;
+    }
+
+    printf("All checks passed.\n");
+    return 0;
+}
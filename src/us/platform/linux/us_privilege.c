@@ -4,6 +4,8 @@
 // Copyright (C) 2016 Assured Information Security, Inc. All rights reserved.
 //
 
+#define _GNU_SOURCE // for ppoll
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
@@ -11,6 +13,7 @@
 #include <libivc.h>
 #include <platform_defs.h>
 #include <libivc_debug.h> // for libivc_<debug> prints
+#include <libivc_probes.h>
 #include <sys/ioctl.h> // for ioctls
 #include <sys/mman.h>
 #include <fcntl.h>
@@ -37,9 +40,15 @@ us_notify_remote(struct libivc_client * ivc);
 int
 us_ivc_connect(struct libivc_client *ivc);
 
+int
+us_ivc_connect_many(struct libivc_client **clients, int *statuses, uint32_t count);
+
 int
 us_ivc_reconnect(struct libivc_client *ivc, uint16_t new_domid, uint16_t new_port);
 
+int
+us_ivc_park(struct libivc_client *ivc);
+
 int
 us_ivc_disconnect(struct libivc_client * ivc);
 
@@ -75,6 +84,17 @@ populate_cli(struct libivc_client_ioctl_info *cli_info, struct libivc_client *cl
     cli_info->callback_list = client->callback_list;
     cli_info->opaque = client->opaque;
     cli_info->connection_id = client->connection_id;
+    cli_info->read_only = client->read_only;
+    cli_info->has_source = (client->buffer_source != NULL);
+    cli_info->parked = client->parked;
+    cli_info->num_lanes = client->num_lanes;
+
+    if (client->buffer_source)
+    {
+        cli_info->source_domid = client->buffer_source->remote_domid;
+        cli_info->source_port = client->buffer_source->port;
+        cli_info->source_connection_id = client->buffer_source->connection_id;
+    }
 }
 
 void
@@ -91,6 +111,8 @@ update_client(struct libivc_client_ioctl_info *cli_info, struct libivc_client *c
     client->callback_list = cli_info->callback_list;
     client->opaque = cli_info->opaque;
     client->connection_id = cli_info->connection_id;
+    client->read_only = cli_info->read_only;
+    client->num_lanes = cli_info->num_lanes;
 }
 
 void populate_serv(struct libivc_server_ioctl_info *serv_info, struct libivc_server *server)
@@ -100,6 +122,7 @@ void populate_serv(struct libivc_server_ioctl_info *serv_info, struct libivc_ser
     serv_info->limit_to_connection_id = server->limit_to_connection_id;
     serv_info->client_connect_event = server->client_connect_event;
     serv_info->opaque = server->opaque;
+    serv_info->accept_backlog = server->accept_backlog;
 }
 
 //************************* Function implementations. **************************
@@ -118,8 +141,10 @@ libivc_platform_init(platform_functions_t * pf)
     libivc_checkp(pf, INVALID_PARAM);
 
     pf->connect = us_ivc_connect;
+    pf->connectMany = us_ivc_connect_many;
     pf->disconnect = us_ivc_disconnect;
     pf->reconnect = us_ivc_reconnect;
+    pf->park = us_ivc_park;
     pf->notifyRemote = us_notify_remote;
     pf->registerServerListener = us_register_server_listener;
     pf->unregisterServerListener = us_unregister_server_listener;
@@ -159,7 +184,14 @@ us_client_listen(void *arg)
     list_head_t *pos = NULL, *temp = NULL;
     callback_node_t * callbacks = NULL;
     uint8_t fireEvent = 0, fireDisconnect = 0;
+    uint8_t dispatched = 0;
     uint64_t junk;
+    uint64_t events = 0;
+    uint64_t pickedUp = 0;
+    uint32_t pollInterval = 0;
+    uint8_t polledData = 0;
+    size_t available = 0, lastAvailable = 0;
+    struct timespec pollTimeout;
 
     libivc_checkp(arg, NULL);
     client = (struct libivc_client *) arg;
@@ -172,13 +204,48 @@ us_client_listen(void *arg)
         fds[1].fd = client->client_disconnect_event;
 
         fds[0].events = fds[1].events = POLLIN;
-        poll(fds, 2, 5); //we time out so we can shut down when required.
+
+        // while moderating, events are off, so wake up to poll the ring instead.
+        pollInterval = __libivc_moderate(client, polledData);
+        if (pollInterval)
+        {
+            pollTimeout.tv_sec = pollInterval / 1000000;
+            pollTimeout.tv_nsec = (long)(pollInterval % 1000000) * 1000;
+            ppoll(fds, 2, &pollTimeout, NULL);
+        }
+        else
+        {
+            poll(fds, 2, 5); //we time out so we can shut down when required.
+        }
+
+        // honor the cork delay threshold even if the application has stopped sending.
+        __libivc_flush_if_due(client);
+
+        // pick up, or take part in, any resize the remote has started.
+        __libivc_service_resize(client);
 
         fireEvent = fds[0].revents & POLLIN;
-        // if it was set, need to read it to set back to zero.
+        // if it was set, need to read it to set back to zero. The value read
+        // is the number of events fired since it was last read.
         if (fireEvent)
         {
-            read(client->client_notify_event, &junk, sizeof (uint64_t));
+            pickedUp = libivc_monotonic_ns();
+            events = 0;
+            if (read(client->client_notify_event, &events, sizeof (uint64_t)) != sizeof (uint64_t))
+                events = 1;
+        }
+
+        // treat new data found by polling as though an event had been fired.
+        // Data that was already there after the last callbacks doesn't count.
+        polledData = 0;
+        if (pollInterval && !fireEvent &&
+            libivc_getAvailableData(client, &available) == SUCCESS &&
+            available > lastAvailable)
+        {
+            pickedUp = libivc_monotonic_ns();
+            events = 0;
+            fireEvent = 1;
+            polledData = 1;
         }
 
         fireDisconnect = fds[1].revents & POLLIN;
@@ -192,25 +259,197 @@ us_client_listen(void *arg)
         // if either was set, notify any callbacks
         if (fireEvent || fireDisconnect)
         {
+            dispatched = 0;
+            if (fireEvent)
+                libivc_probe3(event_dispatch, client->remote_domid, client->port, events);
             list_for_each_safe(pos, temp, &client->callback_list)
             {
                 callbacks = container_of(pos, callback_node_t, node);
                 if (fireEvent && callbacks->eventCallback)
                 {
                     callbacks->eventCallback(client->opaque, client);
+                    dispatched = 1;
                 }
                 if (fireDisconnect && callbacks->disconnectCallback)
                 {
                     callbacks->disconnectCallback(client->opaque, client);
                 }
             }
+
+            if (fireEvent)
+            {
+                libivc_probe3(event_return, client->remote_domid, client->port, events);
+                __libivc_record_events(client, events, pickedUp, dispatched);
+            }
         }
+
+        if (pollInterval && libivc_getAvailableData(client, &available) == SUCCESS)
+            lastAvailable = available;
+        else
+            lastAvailable = 0;
+    }
+}
+
+/**
+ * Releases a client that was set up for accepting, but never handed to the user.
+ * @param client The client to release, or NULL.
+ */
+static void
+us_discard_accept(struct libivc_client *client)
+{
+    if (!client)
+        return;
+
+    if (client->client_disconnect_event > 0)
+        close(client->client_disconnect_event);
+    if (client->client_notify_event > 0)
+        close(client->client_notify_event);
+
+    free(client);
+}
+
+/**
+ * Sets up a client to receive a connection from the driver, with the event fds
+ * the driver will signal it through.
+ * @param server The server the client is being accepted on.
+ * @param cli_info Receives the ioctl form of the client.
+ * @return the new client, or NULL on failure.
+ */
+static struct libivc_client *
+us_prepare_accept(struct libivc_server *server, struct libivc_client_ioctl_info *cli_info)
+{
+    struct libivc_client *client = NULL;
+
+    // allocate the client which will receive data from the IVC driver.
+    client = (struct libivc_client *) malloc(sizeof (struct libivc_client));
+    libivc_checkp(client, NULL);
+    memset(client, 0, sizeof (struct libivc_client));
+    memset(cli_info, 0, sizeof (struct libivc_client_ioctl_info));
+    client->port = server->port;
+    client->remote_domid = server->limit_to_domid;
+    client->connection_id = server->limit_to_connection_id;
+    client->client_disconnect_event = eventfd(0, 0);
+    client->client_notify_event = eventfd(0, 0);
+    if (client->client_disconnect_event <= 0 || client->client_notify_event <= 0)
+    {
+        libivc_error("Failed to create event fds for an accept.\n");
+        us_discard_accept(client);
+        return NULL;
     }
+
+    mutex_init(&client->mutex);
+    libivc_event_wait_init(&client->event_wait);
+    INIT_LIST_HEAD(&client->callback_list);
+    INIT_LIST_HEAD(&client->node);
+
+    populate_cli(cli_info, client);
+    return client;
+}
+
+/**
+ * Finishes setting up a client the driver has accepted, and hands it to the user.
+ * @param server The server the client was accepted on.
+ * @param client The client, as set up by us_prepare_accept.
+ * @param cli_info The ioctl form of the client, as filled in by the driver.
+ * @return SUCCESS, or appropriate error number; on failure the client is released.
+ */
+static int
+us_finish_accept(struct libivc_server *server, struct libivc_client *client,
+                 struct libivc_client_ioctl_info *cli_info)
+{
+    pthread_attr_t attribs;
+    int rc;
+
+    update_client(cli_info, client);
+
+    map_finish_cb(client); // once for local
+
+    // Set up the ringbuffer, with as many lanes as the remote asked for.
+    libivc_assert_goto((rc = __libivc_create_ringbuffer(client)) == SUCCESS, CLIENT_ERROR);
+
+    pthread_attr_init(&attribs);
+    libivc_assert_goto((rc = pthread_create(&client->client_event_thread, &attribs, us_client_listen, client)) == SUCCESS, CLIENT_ERROR);
+
+    list_add(&client->node, &server->client_list);
+    libivc_info("Added %u:%u to server list.\n",client->remote_domid, client->port);
+    server->connect_cb(server->opaque, client);
+    libivc_probe3(accept_return, client->remote_domid, client->port, SUCCESS);
+    return SUCCESS;
+
+CLIENT_ERROR:
+    libivc_probe3(accept_return, client->remote_domid, client->port, rc);
+    us_discard_accept(client);
+    return rc;
+}
+
+/**
+ * Accepts every connection waiting on a server, up to LIBIVC_ACCEPT_BATCH_MAX
+ * per ioctl, until the driver has none left.
+ * @param server The server to accept on.
+ * @param hint How many connections the driver has signalled since the last pass.
+ */
+static void
+us_accept_pending(struct libivc_server *server, uint64_t hint)
+{
+    struct libivc_accept_batch_ioctl_info batch;
+    struct libivc_client_ioctl_info *cli_infos = NULL;
+    struct libivc_client *clients[LIBIVC_ACCEPT_BATCH_MAX];
+    uint32_t want, prepared, i;
+    int rc;
+
+    cli_infos = (struct libivc_client_ioctl_info *) malloc(LIBIVC_ACCEPT_BATCH_MAX * sizeof (struct libivc_client_ioctl_info));
+    libivc_checkp(cli_infos);
+
+    do
+    {
+        // Each client needs its event fds up front, so only ask for about as
+        // many as the driver has told us about.
+        want = (hint > LIBIVC_ACCEPT_BATCH_MAX) ? LIBIVC_ACCEPT_BATCH_MAX : (hint ? (uint32_t)hint : 1);
+
+        for (prepared = 0; prepared < want; prepared++)
+        {
+            clients[prepared] = us_prepare_accept(server, &cli_infos[prepared]);
+            if (!clients[prepared])
+                break;
+        }
+
+        if (prepared == 0)
+            break;
+
+        libivc_probe2(accept_entry, server->port, prepared);
+        memset(&batch, 0, sizeof (batch));
+        batch.listener.port = server->port;
+        batch.listener.remote_domid = server->limit_to_domid;
+        batch.listener.connection_id = server->limit_to_connection_id;
+        batch.max_clients = prepared;
+        batch.clients = cli_infos;
+
+        rc = ioctl(driverFd, IVC_SERVER_ACCEPT_BATCH, &batch);
+        if (rc != SUCCESS)
+        {
+            libivc_error("Failed to accept on port %u: %d\n", server->port, rc);
+            batch.num_clients = 0;
+        }
+
+        for (i = 0; i < batch.num_clients; i++)
+            us_finish_accept(server, clients[i], &cli_infos[i]);
+
+        for (i = batch.num_clients; i < prepared; i++)
+            us_discard_accept(clients[i]);
+
+        hint = (hint > batch.num_clients) ? hint - batch.num_clients : 0;
+
+        // A full batch may have left more behind it.
+    } while (batch.num_clients == prepared);
+
+    free(cli_infos);
 }
 
 /**
- * Monitors the event handle for the server and handles getting the connection
- * and calling the connection callback for the user.
+ * Monitors the event handle for the server and handles getting the connections
+ * and calling the connection callback for the user. Connections are accepted
+ * in batches, so a storm of them costs an ioctl per batch rather than per
+ * connection.
  * @param arg The server to be monitored
  * @return NULL
  */
@@ -220,12 +459,6 @@ us_server_listen(void * arg)
     struct libivc_server *server = (struct libivc_server*) arg;
     struct pollfd fds[1];
     uint64_t eventData = 0;
-    ssize_t dataSize;
-    struct libivc_client *client = NULL;
-    struct libivc_client_ioctl_info *cli_info = NULL;
-    pthread_t clientThread;
-    pthread_attr_t attribs;
-    int rc;
 
     // make sure we were not passed a null arg.
     libivc_checkp(server, NULL);
@@ -238,89 +471,20 @@ us_server_listen(void * arg)
         fds[0].fd = server->client_connect_event;
         fds[0].events = POLLIN;
 
-        //
-        // This method below is a very ugly holdover from the original IVC, 
-        // and features some horrid hacks (e.g. using a client IOCTL information
-        // structure to conver server detail!).
-        //
-        // This should be one of the first things on the chopping block during
-        // the cleanup effort, but it doesn't make sense to spend time cleaning
-        // it up now. =(
-        //
         poll(fds, 1, 5); //we time out so we can shut down when required.
         if (fds[0].revents & POLLIN)
         {
             libivc_info("Got a connection event.\n");
-            // read resets the eventfd counter to zero
-            dataSize = read(fds[0].fd, &eventData, sizeof (uint64_t));
-            // allocate the client which will receive data from the IVC driver.
-            client = (struct libivc_client *) malloc(sizeof (struct libivc_client));
-            cli_info = (struct libivc_client_ioctl_info *) malloc(sizeof (struct libivc_client_ioctl_info));
-            // this would be rare to fail, but always check.
-            libivc_checkp_goto(client, CLIENT_ERROR);
-            libivc_checkp_goto(cli_info, CLIENT_ERROR);
-            memset(client, 0, sizeof (struct libivc_client));
-            memset(cli_info, 0, sizeof (struct libivc_client_ioctl_info));
-            client->port = server->port;
-            client->remote_domid = server->limit_to_domid;
-            client->connection_id = server->limit_to_connection_id;
-            rc = ACCESS_DENIED;
-            client->client_disconnect_event = eventfd(0, 0);
-            libivc_assert_goto(client->client_disconnect_event > 0, CLIENT_ERROR);
-            client->client_notify_event = eventfd(0, 0);
-            libivc_assert_goto(client->client_notify_event > 0, CLIENT_ERROR);
-
-            mutex_init(&client->mutex);
-            INIT_LIST_HEAD(&client->callback_list);
-            INIT_LIST_HEAD(&client->node);
-
-            populate_cli(cli_info, client);
-            rc = ioctl(driverFd, IVC_SERVER_ACCEPT, cli_info);
-            libivc_assert_goto(rc == SUCCESS, CLIENT_ERROR);
-            update_client(cli_info, client);
-
-            map_finish_cb(client); // once for local
-
-            // Set up the ringbuffer.
-            client->ringbuffer = malloc(sizeof(client->ringbuffer[0]));
-            client->ringbuffer->buffer = client->buffer;
-            client->ringbuffer->length = client->num_pages*PAGE_SIZE;
-            client->ringbuffer->num_channels = 2;
-            client->ringbuffer->channels = malloc(2*sizeof(client->ringbuffer->channels[0]));
-            ringbuffer_channel_create(&client->ringbuffer->channels[0], (client->num_pages * PAGE_SIZE)/2);
-            ringbuffer_channel_create(&client->ringbuffer->channels[1], (client->num_pages * PAGE_SIZE)/2);
-            ringbuffer_use(client->ringbuffer);
-
-            pthread_attr_init(&attribs);
-            libivc_assert_goto((rc = pthread_create(&client->client_event_thread, &attribs, us_client_listen, client)) == SUCCESS, CLIENT_ERROR);
-
-            list_add(&client->node, &server->client_list);
-            libivc_info("Added %u:%u to server list.\n",client->remote_domid, client->port);
-            server->connect_cb(server->opaque, client);
-            goto END;
-        CLIENT_ERROR:
-            if (client)
-            {
-            if (client->client_disconnect_event > 0)
-            {
-                close(client->client_disconnect_event);
-                client->client_disconnect_event = 0;
-            }
-            if (client->client_notify_event > 0)
-            {
-                close(client->client_notify_event);
-                client->client_notify_event = 0;
-            }
+            // read resets the eventfd counter to zero, and tells us how many
+            // connections arrived since the last read.
+            if (read(fds[0].fd, &eventData, sizeof (uint64_t)) != sizeof (uint64_t))
+                eventData = 1;
 
-            free(client);
-            client = NULL;
-            }
-        END:
-            free(cli_info);
-            continue;
+            us_accept_pending(server, eventData);
         }
-
     }
+
+    return NULL;
 }
 
 /**
@@ -500,6 +664,137 @@ END:
     return rc;
 }
 
+/**
+ * Closes a client's event fds, if it has them.
+ * @param client The client whose connection failed.
+ */
+static void
+us_close_client_events(struct libivc_client *client)
+{
+    if (client->client_disconnect_event > 0)
+        close(client->client_disconnect_event);
+    if (client->client_notify_event > 0)
+        close(client->client_notify_event);
+
+    client->client_disconnect_event = 0;
+    client->client_notify_event = 0;
+}
+
+/**
+ * Undoes a connection the driver made, for a client that can't be used.
+ * @param client The client, with its buffer mapped but no event thread.
+ */
+static void
+us_abandon_connect(struct libivc_client *client)
+{
+    struct libivc_client_ioctl_info cli_info;
+
+    memset(&cli_info, 0, sizeof (cli_info));
+    populate_cli(&cli_info, client);
+    ioctl(driverFd, IVC_MUNMAP, &cli_info);
+    client->buffer = NULL;
+
+    us_close_client_events(client);
+
+    populate_cli(&cli_info, client);
+    ioctl(driverFd, IVC_DISCONNECT, &cli_info);
+}
+
+/**
+ * Connects many clients to their remote domains with a single ioctl, which
+ * has all their CONNECT requests in flight at once.
+ * @param clients Non null pointers to clients describing connection parameters.
+ * @param statuses Receives SUCCESS or an error number for each client.
+ * @param count The number of clients, at most LIBIVC_CONNECT_BATCH_MAX.
+ * @return SUCCESS if every status has been filled in, NOT_IMPLEMENTED if the
+ *    driver can't connect in batches, or appropriate error number, in which
+ *    case the clients are left as they were.
+ */
+int
+us_ivc_connect_many(struct libivc_client **clients, int *statuses, uint32_t count)
+{
+    int rc = INVALID_PARAM;
+    pthread_attr_t attribs;
+    struct libivc_connect_batch_ioctl_info batch;
+    struct libivc_client_ioctl_info *cli_infos = NULL;
+    int32_t *results = NULL;
+    uint32_t i;
+
+    libivc_checkp(clients, rc);
+    libivc_checkp(statuses, rc);
+    libivc_assert(count > 0 && count <= LIBIVC_CONNECT_BATCH_MAX, rc);
+
+    // Shared and parked connections have to be made one at a time.
+    for (i = 0; i < count; i++)
+    {
+        libivc_checkp(clients[i], rc);
+        libivc_assert(!clients[i]->read_only && !clients[i]->parked, rc);
+        libivc_assert(clients[i]->client_disconnect_event == 0 && clients[i]->client_notify_event == 0, rc);
+    }
+
+    rc = OUT_OF_MEM;
+    cli_infos = (struct libivc_client_ioctl_info *) malloc(count * sizeof(struct libivc_client_ioctl_info));
+    results = (int32_t *) malloc(count * sizeof(int32_t));
+    libivc_checkp_goto(cli_infos, ERROR);
+    libivc_checkp_goto(results, ERROR);
+    memset(cli_infos, 0, count * sizeof(struct libivc_client_ioctl_info));
+
+    rc = ACCESS_DENIED;
+    for (i = 0; i < count; i++)
+    {
+        clients[i]->client_disconnect_event = eventfd(0, 0);
+        clients[i]->client_notify_event = eventfd(0, 0);
+        libivc_assert_goto(clients[i]->client_disconnect_event > 0 && clients[i]->client_notify_event > 0, ERROR);
+
+        populate_cli(&cli_infos[i], clients[i]);
+    }
+
+    libivc_info("Sending %u connections to driver.\n", count);
+    batch.num_clients = count;
+    batch.clients = cli_infos;
+    batch.statuses = results;
+    if (ioctl(driverFd, IVC_CONNECT_BATCH, &batch) != SUCCESS)
+    {
+        // Only an older driver, which doesn't know the ioctl, is worth
+        // retrying one connection at a time.
+        rc = (errno == ENOTTY || errno == EINVAL) ? NOT_IMPLEMENTED : -errno;
+        libivc_info("Batch connect failed (%d).\n", rc);
+        goto ERROR;
+    }
+
+    pthread_attr_init(&attribs);
+    for (i = 0; i < count; i++)
+    {
+        statuses[i] = results[i];
+        if (statuses[i] != SUCCESS)
+        {
+            us_close_client_events(clients[i]);
+            continue;
+        }
+
+        update_client(&cli_infos[i], clients[i]);
+        libivc_info("Launching client event thread for %u:%u.\n", clients[i]->remote_domid, clients[i]->port);
+        statuses[i] = pthread_create(&clients[i]->client_event_thread, &attribs, us_client_listen, clients[i]);
+        if (statuses[i] != SUCCESS)
+            us_abandon_connect(clients[i]);
+    }
+
+    rc = SUCCESS;
+    goto END;
+
+ERROR:
+    libivc_info("In error handler of %s\n", __FUNCTION__);
+    for (i = 0; i < count; i++)
+        us_close_client_events(clients[i]);
+
+END:
+    if (results != NULL)
+        free(results);
+    if (cli_infos != NULL)
+        free(cli_infos);
+    return rc;
+}
+
 /**
  * Reconnects the client to the remote domain.
  * @param client Non null pointer to client to be reconnected.
@@ -543,6 +838,30 @@ END:
     return rc;
 }
 
+/**
+ * Releases the client's remote, keeping its buffer for a later reconnect.
+ * @param client Non null pointer to client to be parked.
+ * @return SUCCESS or appropriate error number.
+ */
+int
+us_ivc_park(struct libivc_client *client)
+{
+    int rc = INVALID_PARAM;
+    struct libivc_client_ioctl_info *cli_info = NULL;
+
+    libivc_checkp(client, rc);
+
+    cli_info = (struct libivc_client_ioctl_info *) malloc(sizeof(struct libivc_client_ioctl_info));
+    libivc_checkp(cli_info, OUT_OF_MEM);
+    memset(cli_info, 0, sizeof (struct libivc_client_ioctl_info));
+
+    populate_cli(cli_info, client);
+    rc = ioctl(driverFd, IVC_PARK, cli_info);
+
+    free(cli_info);
+    return rc;
+}
+
 
 /**
  * Disconnects the client and closes event descriptors
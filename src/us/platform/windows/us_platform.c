@@ -56,6 +56,7 @@ populate_cli(struct libivc_client_ioctl_info *cli_info, struct libivc_client *cl
     cli_info->remote_domid = client->remote_domid;
     cli_info->callback_list = client->callback_list;
     cli_info->server_side = client->server_side;
+    cli_info->num_lanes = client->num_lanes;
 }
 
 
@@ -72,6 +73,7 @@ update_client(struct libivc_client_ioctl_info *cli_info, struct libivc_client *c
     client->remote_domid = cli_info->remote_domid;
     client->callback_list = cli_info->callback_list;
     client->server_side = cli_info->server_side;
+    client->num_lanes = cli_info->num_lanes;
 }
 /**
 * Initializes the function callbacks to the LINUX userspace APIs and opens the
@@ -110,28 +112,61 @@ static DWORD WINAPI us_client_listen(struct libivc_client * client)
 	libivc_checkp(client->client_notify_event, INVALID_PARAM);
 	list_head_t * pos = NULL, *temp = NULL;
 	callback_node_t * callbacks = NULL;
+	uint64_t pickedUp = 0;
+	uint8_t dispatched = 0;
+	uint32_t pollInterval = 0;
+	uint8_t polledData = 0;
+	size_t available = 0, lastAvailable = 0;
 
 	waits[0] = client->client_notify_event;
 	waits[1] = client->client_disconnect_event;
 
 	while (libivc_isOpen(client))
 	{
-		waitRet = WaitForMultipleObjects(2, waits, FALSE, 10);
+		// While moderating, events are off, so wake up to poll the ring instead.
+		pollInterval = __libivc_moderate(client, polledData);
+		polledData = 0;
+		waitRet = WaitForMultipleObjects(2, waits, FALSE, pollInterval ? (pollInterval + 999) / 1000 : 10);
+
+		// Pick up, or take part in, any resize the remote has started.
+		__libivc_service_resize(client);
+
 		if (waitRet == WAIT_TIMEOUT)
 		{
-			continue;
+			// Treat new data found by polling as though an event had been fired.
+			if (pollInterval && libivc_getAvailableData(client, &available) == SUCCESS &&
+				available > lastAvailable)
+			{
+				pickedUp = libivc_monotonic_ns();
+				dispatched = 0;
+				list_for_each_safe(pos, temp, &client->callback_list)
+				{
+					callbacks = container_of(pos, callback_node_t, node);
+					if (callbacks->eventCallback)
+					{
+						callbacks->eventCallback(client->opaque, client);
+						dispatched = 1;
+					}
+				}
+				__libivc_record_events(client, 0, pickedUp, dispatched);
+				polledData = 1;
+			}
 		}
 		else if (waitRet == WAIT_OBJECT_0 + 0)
 		{
 			libivc_info("Got an event.\n");
+			pickedUp = libivc_monotonic_ns();
+			dispatched = 0;
 			list_for_each_safe(pos, temp, &client->callback_list)
 			{
 				callbacks = container_of(pos, callback_node_t, node);
 				if (callbacks->eventCallback)
 				{
 					callbacks->eventCallback(client->opaque, client);
+					dispatched = 1;
 				}
 			}
+			__libivc_record_events(client, 1, pickedUp, dispatched);
 		}
 		else if (waitRet == WAIT_OBJECT_0 + 1)
 		{
@@ -147,6 +182,12 @@ static DWORD WINAPI us_client_listen(struct libivc_client * client)
 				}
 			}
 		}
+
+		// Data that's still there after the callbacks doesn't count as new.
+		if (pollInterval && libivc_getAvailableData(client, &available) == SUCCESS)
+			lastAvailable = available;
+		else
+			lastAvailable = 0;
 	}
 END_THREAD:
 	return SUCCESS;
@@ -189,6 +230,7 @@ static DWORD WINAPI us_server_listener(struct libivc_server * server)
 			}
 			else
 			{
+				libivc_event_wait_init(&client->event_wait);
 				list_add(&client->node, &server->client_list);
 				server->connect_cb(client, client->opaque);
 			}
@@ -228,6 +270,7 @@ us_register_server_listener(struct libivc_server * server)
 	serv_info->port = server->port;
 	serv_info->limit_to_connection_id = server->limit_to_connection_id;
 	serv_info->limit_to_domid = server->limit_to_domid;
+	serv_info->accept_backlog = server->accept_backlog;
 	if (!DeviceIoControl(driverHandle, IVC_DRIVER_REG_SVR_LSNR, serv_info, sizeof(struct libivc_server_ioctl_info), serv_info,
 		sizeof(struct libivc_server_ioctl_info),&retSize, NULL))
 	{
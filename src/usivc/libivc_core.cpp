@@ -130,6 +130,14 @@ libivc_core::handleConnectMessage(const libivc_message_t *msg)
     uint32_t anykey = dom_port_key(LIBIVC_DOMID_ANY, msg->port);
     int rc;
 
+    // We only lay out the classic single pair of channels, over a writable
+    // buffer. Refuse anything else rather than corrupt the remote's rings.
+    if (msg->connect_flags) {
+        LOG(mLog, INFO) << "Refusing dom" << msg->from_dom << ":" << msg->port
+                        << ", which asked for unsupported connect flags " << msg->connect_flags;
+        return sendResponse(msg, ACK, -ENOSYS);
+    }
+
     // Have to provide a connected client here...
     if (mCallbackMap.contains(key)) {
         struct libivc_client *client = createClient(msg->from_dom,